@@ -0,0 +1,350 @@
+#pragma once
+//
+//  asset_pack.h
+//  3D Object Drawing
+//
+//  Cooked asset archive: vertex and index buffers, shader sources and scene entity
+//  tables in one binary file, each blob aligned so the runtime can memory-map the file
+//  and hand its pointers straight to glBufferData and glShaderSource.
+//
+//  Layout: AssetPackHeader at offset 0, blobs at ASSET_PACK_ALIGNMENT boundaries, then the
+//  table of contents (one AssetPackEntry per blob). All values are little endian.
+//
+
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const uint32_t ASSET_PACK_MAGIC = 0x4B503344;   // "D3PK" read as bytes: 'D' '3' 'P' 'K'
+const uint32_t ASSET_PACK_VERSION = 2;
+const uint64_t ASSET_PACK_ALIGNMENT = 64;      // cache line; also more than any GL upload needs
+
+enum AssetKind {
+    ASSET_VERTICES,    // interleaved vertex data, 'stride' bytes per vertex
+    ASSET_INDICES,     // GL_UNSIGNED_INT indices
+    ASSET_SHADER,      // GLSL source without a terminating zero
+    ASSET_ENTITIES,    // array of CookedEntity
+    ASSET_CLUSTERS,    // array of CookedCluster
+    ASSET_ROOMS,       // array of WorldChunkRoom (world_streaming.h)
+    ASSET_PROPS        // array of RoomProp
+};
+
+struct AssetPackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+    uint64_t tocOffset;
+    uint64_t fileBytes;
+};
+
+struct AssetPackEntry
+{
+    char name[48];     // zero padded; shaders are named by their source path
+    uint32_t kind;
+    uint32_t stride;   // bytes per element
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+// one draw of the cooked reference room (the HLOD build's input), with the data DrawItem needs besides its VAO
+struct CookedEntity
+{
+    glm::mat4 model;
+    glm::vec4 color;
+    glm::vec3 boundsMin;
+    uint32_t flags;
+    glm::vec3 boundsMax;
+    uint32_t indexCount;
+    glm::vec3 spinPivot;
+    float spinSpeed;
+    glm::vec3 spinAxis;
+    float spinPhase;
+    uint32_t material;
+    uint32_t reserved[3];
+};
+
+// [first, end) of a cluster in the entity table
+struct CookedCluster
+{
+    uint32_t first;
+    uint32_t end;
+};
+
+static_assert(sizeof(AssetPackHeader) == 32, "AssetPackHeader is part of the file format");
+static_assert(sizeof(AssetPackEntry) == 72, "AssetPackEntry is part of the file format");
+static_assert(sizeof(CookedEntity) == 160, "CookedEntity is part of the file format");
+
+class AssetPack;
+
+// pack that Shader reads its sources from when it has them; closing the pack clears it
+inline const AssetPack*& shaderAssetPack()
+{
+    static const AssetPack* pack = nullptr;
+    return pack;
+}
+
+// Collects blobs and writes them as one pack. Used by the cook step only.
+class AssetPackWriter
+{
+public:
+    void add(const char* name, AssetKind kind, const void* data, size_t bytes, uint32_t stride = 1)
+    {
+        Blob blob;
+        std::memset(&blob.entry, 0, sizeof(blob.entry));
+        std::memcpy(blob.entry.name, name, std::min(std::strlen(name), sizeof(blob.entry.name) - 1));
+        blob.entry.kind = kind;
+        blob.entry.stride = stride;
+        blob.entry.bytes = bytes;
+        blob.data.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + bytes);
+        blobs.push_back(blob);
+    }
+
+    // adds a text file, e.g. a shader; false if it cannot be read
+    bool addFile(const char* path, AssetKind kind)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        std::vector<char> text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        add(path, kind, text.data(), text.size());
+        return true;
+    }
+
+    bool write(const std::string& path)
+    {
+        AssetPackHeader header = {};
+        header.magic = ASSET_PACK_MAGIC;
+        header.version = ASSET_PACK_VERSION;
+        header.entryCount = static_cast<uint32_t>(blobs.size());
+        uint64_t offset = align(sizeof(AssetPackHeader));
+        for (Blob& blob : blobs)
+        {
+            blob.entry.offset = offset;
+            offset = align(offset + blob.entry.bytes);
+        }
+        header.tocOffset = offset;
+        header.fileBytes = offset + blobs.size() * sizeof(AssetPackEntry);
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        static const char padding[ASSET_PACK_ALIGNMENT] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t position = sizeof(header);
+        for (const Blob& blob : blobs)
+        {
+            file.write(padding, blob.entry.offset - position);
+            file.write(reinterpret_cast<const char*>(blob.data.data()), blob.data.size());
+            position = blob.entry.offset + blob.entry.bytes;
+        }
+        file.write(padding, header.tocOffset - position);
+        for (const Blob& blob : blobs)
+            file.write(reinterpret_cast<const char*>(&blob.entry), sizeof(blob.entry));
+        return static_cast<bool>(file);
+    }
+
+private:
+    struct Blob
+    {
+        AssetPackEntry entry;
+        std::vector<uint8_t> data;
+    };
+    std::vector<Blob> blobs;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + ASSET_PACK_ALIGNMENT - 1) & ~(ASSET_PACK_ALIGNMENT - 1);
+    }
+};
+
+// Read-only view of a mapped pack. Nothing is parsed or copied: lookups walk the table of
+// contents in place and return pointers into the mapping, valid until close().
+class AssetPack
+{
+public:
+    AssetPack() {}
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    ~AssetPack()
+    {
+        close();
+    }
+
+    bool open(const char* path)
+    {
+        close();
+        if (!map(path))
+        {
+            std::cout << "asset pack: cannot map " << path << std::endl;
+            return false;
+        }
+        const char* problem = validate();
+        if (problem)
+        {
+            std::cout << "asset pack: " << path << ": " << problem << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (shaderAssetPack() == this)
+            shaderAssetPack() = nullptr;
+        if (!base)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        mapping = file = NULL;
+#else
+        munmap(const_cast<uint8_t*>(base), bytes);
+#endif
+        base = nullptr;
+        bytes = 0;
+    }
+
+    bool isOpen() const { return base != nullptr; }
+    size_t size() const { return bytes; }
+
+    const AssetPackEntry* find(const char* name, AssetKind kind) const
+    {
+        if (!base)
+            return nullptr;
+        for (uint32_t i = 0; i < header()->entryCount; i++)
+        {
+            const AssetPackEntry& entry = toc()[i];
+            if (entry.kind == static_cast<uint32_t>(kind) && std::strncmp(entry.name, name, sizeof(entry.name)) == 0)
+                return &entry;
+        }
+        return nullptr;
+    }
+
+    const void* data(const AssetPackEntry& entry) const
+    {
+        return base + entry.offset;
+    }
+
+    template <typename T>
+    const T* array(const AssetPackEntry& entry) const
+    {
+        return reinterpret_cast<const T*>(base + entry.offset);
+    }
+
+    template <typename T>
+    size_t count(const AssetPackEntry& entry) const
+    {
+        return static_cast<size_t>(entry.bytes / sizeof(T));
+    }
+
+private:
+    const uint8_t* base = nullptr;
+    size_t bytes = 0;
+#ifdef _WIN32
+    HANDLE file = NULL;
+    HANDLE mapping = NULL;
+#endif
+
+    const AssetPackHeader* header() const { return reinterpret_cast<const AssetPackHeader*>(base); }
+    const AssetPackEntry* toc() const { return reinterpret_cast<const AssetPackEntry*>(base + header()->tocOffset); }
+
+    bool map(const char* path)
+    {
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            file = NULL;
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 ||
+            !(mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)))
+        {
+            CloseHandle(file);
+            file = NULL;
+            return false;
+        }
+        base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!base)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            mapping = file = NULL;
+            return false;
+        }
+        bytes = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);   // the mapping keeps the file open
+        if (mapped == MAP_FAILED)
+            return false;
+        base = static_cast<const uint8_t*>(mapped);
+        bytes = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    // checks everything a lookup relies on, so find() and data() need no checks of their own
+    const char* validate() const
+    {
+        if (bytes < sizeof(AssetPackHeader) || header()->magic != ASSET_PACK_MAGIC)
+            return "not an asset pack";
+        if (header()->version != ASSET_PACK_VERSION)
+            return "cooked by a different version, re-run --cook";
+        uint64_t tocOffset = header()->tocOffset;
+        if (header()->fileBytes != bytes || tocOffset % ASSET_PACK_ALIGNMENT != 0 ||
+            tocOffset > bytes || (bytes - tocOffset) / sizeof(AssetPackEntry) < header()->entryCount)
+            return "truncated table of contents";
+        for (uint32_t i = 0; i < header()->entryCount; i++)
+        {
+            const AssetPackEntry& entry = toc()[i];
+            if (entry.offset % ASSET_PACK_ALIGNMENT != 0 || entry.offset > tocOffset || entry.bytes > tocOffset - entry.offset)
+                return "entry outside the file";
+            if (entry.name[sizeof(entry.name) - 1] != '\0')
+                return "unterminated entry name";
+        }
+        return nullptr;
+    }
+};
+
+#endif
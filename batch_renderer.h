@@ -0,0 +1,431 @@
+#pragma once
+//
+//  batch_renderer.h
+//  3D Object Drawing
+//
+//  Renders a list of camera poses to images on several threads at once. Every worker
+//  owns a hidden window's GL context (so on llvmpipe each one rasterizes on its own
+//  core) with its own copy of the scene, and takes the next pose from a shared counter.
+//  The workers share glad's entry points, loaded once from the main context. The CPU
+//  backend renders the same scene with SoftwareRasterizer instead, one pose at a time with
+//  every thread on its tiles, and needs no context at all.
+//
+//  Pose file, one pose per line, '#' starts a comment:
+//      camera  posX posY posZ  yaw pitch roll  zoom              (Camera, angles in degrees)
+//      basic   eyeX eyeY eyeZ  lookAtX lookAtY lookAtZ  upX upY upZ  [zoom]   (BasicCamera)
+//
+
+#ifndef BATCH_RENDERER_H
+#define BATCH_RENDERER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "basic_camera.h"
+#include "camera.h"
+#include "clustered_lighting.h"
+#include "frame_arena.h"
+#include "frame_capture.h"
+#include "gl_resources.h"
+#include "render_queue.h"
+#include "room_scene.h"
+#include "shader.h"
+#include "software_rasterizer.h"
+#include "texture_streaming.h"
+#include "trace_events.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct CameraPose
+{
+    glm::mat4 view;
+    float zoom;    // vertical field of view in degrees, as Camera::Zoom
+};
+
+// parses the pose file described above; malformed lines are reported and skipped
+inline bool loadCameraPoses(const char* path, std::vector<CameraPose>& poses, std::ostream& errors)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        errors << "batch: cannot open " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+        std::istringstream fields(line);
+        std::string kind;
+        if (!(fields >> kind))
+            continue;
+
+        CameraPose pose;
+        pose.zoom = ZOOM;
+        bool ok = false;
+        if (kind == "camera")
+        {
+            glm::vec3 position;
+            float yaw, pitch, roll;
+            if (fields >> position.x >> position.y >> position.z >> yaw >> pitch >> roll >> pose.zoom)
+            {
+                Camera camera(position, glm::vec3(0.0f, 1.0f, 0.0f), yaw, pitch, roll);
+                pose.view = camera.GetViewMatrix();
+                ok = true;
+            }
+        }
+        else if (kind == "basic")
+        {
+            glm::vec3 eye, lookAt, up;
+            if (fields >> eye.x >> eye.y >> eye.z >> lookAt.x >> lookAt.y >> lookAt.z >> up.x >> up.y >> up.z)
+            {
+                float zoom;
+                if (fields >> zoom)
+                    pose.zoom = zoom;
+                BasicCamera camera(eye.x, eye.y, eye.z, lookAt.x, lookAt.y, lookAt.z, up);
+                pose.view = camera.createViewMatrix();
+                ok = true;
+            }
+        }
+        if (ok)
+            poses.push_back(pose);
+        else
+            errors << "batch: " << path << ":" << lineNumber << ": expected 'camera' or 'basic' pose" << std::endl;
+    }
+    return true;
+}
+
+// the vertex and index data every worker uploads into its own context
+struct CubeMesh
+{
+    const float* vertices;        // position + color, 6 floats per vertex
+    size_t vertexBytes;
+    const unsigned int* indices;
+    size_t indexBytes;
+};
+
+enum BatchBackend {
+    BATCH_GL,       // a GL context per worker
+    BATCH_CPU,      // SoftwareRasterizer
+    BATCH_BOTH      // GL, then the CPU backend compared with the GL images
+};
+
+struct BatchOptions
+{
+    int width = 800;
+    int height = 600;
+    unsigned int threads = 0;           // 0: one per hardware thread
+    std::string outputPrefix = "pose";  // images are <prefix>_00000.ppm, ...
+    int apartmentColumns = 1;
+    int apartmentRows = 1;
+    int scatterPerRoom = 0;
+    unsigned int scatterSeed = 0;
+    BatchBackend backend = BATCH_GL;
+};
+
+struct BatchWorkerStats
+{
+    unsigned int images = 0;
+    double renderMs = 0.0;     // scene build, culling, drawing and readback, summed
+    double writeMs = 0.0;
+};
+
+// The scene is static here (the clock hands at time 0), so it is built once per worker.
+struct BatchScene
+{
+    Apartment apartment;
+    std::vector<DrawItem> items;
+    std::vector<size_t> cellFirst;   // the items of cell c are [cellFirst[c], cellFirst[c + 1])
+
+    void build(const BatchOptions& options, GLuint vao, FrameArena& arena)
+    {
+        buildApartment(apartment, options.apartmentColumns, options.apartmentRows);
+        scatterProps(apartment, options.scatterPerRoom, options.scatterSeed);
+        FrameVector<DrawItem> list{ FrameAllocator<DrawItem>(arena) };
+        cellFirst.clear();
+        for (int cell = 0; cell < apartment.cells.cellCount(); cell++)
+        {
+            cellFirst.push_back(list.size());
+            appendRoom(list, vao, apartment.rooms[cell].placement, apartment.rooms[cell].openings, RoomState());
+            appendRoomProps(list, vao, apartment.rooms[cell]);
+        }
+        cellFirst.push_back(list.size());
+        items.assign(list.begin(), list.end());
+    }
+
+    // the same portal culling as the interactive view
+    void collect(const glm::vec3& eye, const glm::mat4& viewProjection, FrameVector<DrawItem>& drawList)
+    {
+        apartment.cells.computeVisibility(eye, viewProjection);
+        drawList.reserve(items.size());
+        for (int cell = 0; cell < apartment.cells.cellCount(); cell++)
+        {
+            if (!apartment.cells.isCellVisible(cell))
+                continue;
+            for (size_t i = cellFirst[cell]; i < cellFirst[cell + 1]; i++)
+                if (apartment.cells.isVisible(cell, items[i].bounds))
+                    drawList.push_back(items[i]);
+        }
+    }
+};
+
+// Renders every pose and prints a throughput report. Must be called on the main thread
+// (GLFW creates windows only there) after glfwInit and gladLoadGL.
+inline void runBatchRender(const std::vector<CameraPose>& poses, const BatchOptions& options, const CubeMesh& mesh,
+                           std::ostream& out)
+{
+    unsigned int threadCount = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min<unsigned int>(threadCount, static_cast<unsigned int>(std::max<size_t>(poses.size(), 1)));
+
+    // one hidden window per worker, only for its context: images go to an FBO
+    GLFWwindow* previous = glfwGetCurrentContext();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    std::vector<GLFWwindow*> contexts;
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        GLFWwindow* context = glfwCreateWindow(16, 16, "batch worker", NULL, NULL);
+        if (!context)
+            break;
+        contexts.push_back(context);
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (contexts.empty())
+    {
+        out << "batch: could not create a worker context" << std::endl;
+        return;
+    }
+
+    std::atomic<size_t> nextPose(0);
+    std::vector<BatchWorkerStats> workerStats(contexts.size());
+    auto worker = [&](unsigned int index) {
+        glfwMakeContextCurrent(contexts[index]);
+        glContextTag() = index + 1;
+        tracer().nameThread("batch worker " + std::to_string(index));
+        BatchWorkerStats& stats = workerStats[index];
+        {
+            glEnable(GL_DEPTH_TEST);
+            Shader shader("vertexShader.vs", "fragmentShader.fs");
+            GlVertexArray vao("batch cube VAO");
+            GlBuffer vbo(GPU_VERTEX_BUFFER, "batch cube vertices");
+            GlBuffer ebo(GPU_INDEX_BUFFER, "batch cube indices");
+            vao.bind();
+            vbo.data(GL_ARRAY_BUFFER, mesh.vertexBytes, mesh.vertices, GL_STATIC_DRAW);
+            ebo.data(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBytes, mesh.indices, GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)12);
+            glEnableVertexAttribArray(1);
+
+            GlFramebuffer framebuffer;
+            GlRenderbuffer color, depth;
+            framebuffer.create("batch FBO");
+            color.create("batch color");
+            depth.create("batch depth/stencil");
+            color.storage(GL_RGBA8, options.width, options.height);
+            depth.storage(GL_DEPTH24_STENCIL8, options.width, options.height);
+            framebuffer.bind();
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color.id());
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth.id());
+            glViewport(0, 0, options.width, options.height);
+
+            FrameArena arena(1 << 20);
+            BatchScene scene;
+            scene.build(options, vao.id(), arena);
+
+            RenderQueue queue;
+            shader.use();
+            setPointLightUnits(shader);
+            shader.setFloat("time", 0.0f);
+            std::vector<uint8_t> pixels((size_t)options.width * options.height * 4);
+            std::vector<uint8_t> scratch;
+            float aspect = (float)options.width / (float)options.height;
+
+            for (size_t p = nextPose.fetch_add(1); p < poses.size(); p = nextPose.fetch_add(1))
+            {
+                TRACE_ZONE_NAMED(renderZone, "batch render");
+                auto begin = std::chrono::steady_clock::now();
+                arena.reset();
+                const CameraPose& pose = poses[p];
+                glm::mat4 projection = glm::perspective(glm::radians(pose.zoom), aspect, 0.1f, 100.0f);
+                glm::vec3 eye(glm::inverse(pose.view)[3]);
+                shader.setMat4("projection", projection);
+                shader.setMat4("view", pose.view);
+
+                FrameVector<DrawItem> drawList{ FrameAllocator<DrawItem>(arena) };
+                scene.collect(eye, projection * pose.view, drawList);
+
+                glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                queue.execute(drawList, shader, eye, arena, vao.id());
+                glPixelStorei(GL_PACK_ALIGNMENT, 4);
+                glReadPixels(0, 0, options.width, options.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+                auto rendered = std::chrono::steady_clock::now();
+                TRACE_ZONE_END(renderZone);
+                TRACE_ZONE("batch write");
+
+                char name[32];
+                std::snprintf(name, sizeof(name), "_%05u.ppm", static_cast<unsigned int>(p));
+                if (!writePpm(options.outputPrefix + name, pixels.data(), options.width, options.height, scratch))
+                    std::cout << "batch: cannot write " << options.outputPrefix + name << std::endl;
+                auto written = std::chrono::steady_clock::now();
+
+                stats.images++;
+                stats.renderMs += std::chrono::duration<double, std::milli>(rendered - begin).count();
+                stats.writeMs += std::chrono::duration<double, std::milli>(written - rendered).count();
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+        // GL objects are gone; let the main thread destroy the window
+        glfwMakeContextCurrent(NULL);
+    };
+
+    glfwMakeContextCurrent(NULL);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < contexts.size(); i++)
+        threads.emplace_back(worker, i);
+    for (std::thread& thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (GLFWwindow* context : contexts)
+        glfwDestroyWindow(context);
+    glfwMakeContextCurrent(previous);
+
+    out << "batch: " << poses.size() << " poses at " << options.width << "x" << options.height << " on "
+        << contexts.size() << " contexts in " << std::fixed << std::setprecision(2) << seconds << " s, "
+        << (seconds > 0.0 ? poses.size() / seconds : 0.0) << " images/s" << std::endl;
+    for (size_t i = 0; i < workerStats.size(); i++)
+    {
+        const BatchWorkerStats& s = workerStats[i];
+        double images = s.images ? s.images : 1;
+        out << "  worker " << i << ": " << s.images << " images, render " << s.renderMs / images
+            << " ms, write " << s.writeMs / images << " ms per image" << std::endl;
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
+
+// Renders every pose with SoftwareRasterizer and prints the same report. With BATCH_BOTH the
+// GL images must already have been written: the CPU images go to <prefix>_cpu_00000.ppm, ...
+// and each is compared with its GL image, a pixel counting as different when any channel is
+// more than COMPARE_TOLERANCE apart (edge pixels where the two rasterizers round differently).
+inline void runSoftwareBatchRender(const std::vector<CameraPose>& poses, const BatchOptions& options, std::ostream& out)
+{
+    const int COMPARE_TOLERANCE = 2;
+    unsigned int threadCount = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    JobSystem jobs(threadCount - 1);
+
+    FrameArena arena(1 << 20);
+    BatchScene scene;
+    scene.build(options, 0, arena);
+    SoftwareRasterizer raster(options.width, options.height);
+    std::vector<uint8_t> pixels((size_t)options.width * options.height * 4);
+    std::vector<uint8_t> scratch, reference;
+    float aspect = (float)options.width / (float)options.height;
+    std::string prefix = options.outputPrefix + (options.backend == BATCH_BOTH ? "_cpu" : "");
+
+    BatchWorkerStats stats;
+    double geometryMs = 0.0, rasterMs = 0.0;
+    unsigned long long triangles = 0, pixelsWritten = 0;
+    unsigned long long compared = 0, different = 0;
+    double worstShare = 0.0;
+    size_t worstPose = 0;
+    int maxDifference = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < poses.size(); p++)
+    {
+        TRACE_ZONE_NAMED(renderZone, "batch render");
+        auto begin = std::chrono::steady_clock::now();
+        arena.reset();
+        const CameraPose& pose = poses[p];
+        glm::mat4 projection = glm::perspective(glm::radians(pose.zoom), aspect, 0.1f, 100.0f);
+        glm::vec3 eye(glm::inverse(pose.view)[3]);
+        FrameVector<DrawItem> drawList{ FrameAllocator<DrawItem>(arena) };
+        scene.collect(eye, projection * pose.view, drawList);
+        raster.render(drawList, pose.view, projection, 0.0f, eye, jobs, arena);
+        raster.readPixels(pixels.data());
+        auto rendered = std::chrono::steady_clock::now();
+        TRACE_ZONE_END(renderZone);
+        geometryMs += raster.stats.geometryMs;
+        rasterMs += raster.stats.rasterMs;
+        triangles += raster.stats.triangles;
+        pixelsWritten += raster.stats.pixelsWritten;
+        TRACE_ZONE("batch write");
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "_%05u.ppm", static_cast<unsigned int>(p));
+        if (!writePpm(prefix + name, pixels.data(), options.width, options.height, scratch))
+            std::cout << "batch: cannot write " << prefix + name << std::endl;
+        auto written = std::chrono::steady_clock::now();
+        stats.images++;
+        stats.renderMs += std::chrono::duration<double, std::milli>(rendered - begin).count();
+        stats.writeMs += std::chrono::duration<double, std::milli>(written - rendered).count();
+
+        if (options.backend != BATCH_BOTH)
+            continue;
+        int width = 0, height = 0;
+        if (!readPpm(options.outputPrefix + name, width, height, reference) || width != options.width || height != options.height)
+        {
+            out << "batch: no GL image " << options.outputPrefix + name << " to compare with" << std::endl;
+            continue;
+        }
+        // the PPM is top row first
+        unsigned long long differentHere = 0;
+        for (int y = 0; y < height; y++)
+        {
+            const uint8_t* cpu = &pixels[(size_t)(height - 1 - y) * width * 4];
+            const uint8_t* gl = &reference[(size_t)y * width * 4];
+            for (int x = 0; x < width * 4; x += 4)
+            {
+                int difference = 0;
+                for (int channel = 0; channel < 3; channel++)
+                    difference = std::max(difference, std::abs(cpu[x + channel] - gl[x + channel]));
+                maxDifference = std::max(maxDifference, difference);
+                differentHere += difference > COMPARE_TOLERANCE;
+            }
+        }
+        double share = (double)differentHere / ((double)width * height);
+        if (share > worstShare)
+        {
+            worstShare = share;
+            worstPose = p;
+        }
+        compared += (unsigned long long)width * height;
+        different += differentHere;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double images = stats.images ? stats.images : 1;
+    out << "batch (CPU): " << poses.size() << " poses at " << options.width << "x" << options.height << " on "
+        << jobs.threadCount() << " threads in " << std::fixed << std::setprecision(2) << seconds << " s, "
+        << (seconds > 0.0 ? poses.size() / seconds : 0.0) << " images/s" << std::endl;
+    out << "  render " << stats.renderMs / images << " ms (geometry " << geometryMs / images << " ms, raster "
+        << rasterMs / images << " ms), write " << stats.writeMs / images << " ms per image; "
+        << triangles / (unsigned long long)images << " triangles and " << pixelsWritten / (unsigned long long)images
+        << " pixel writes per image" << std::endl;
+    if (compared)
+        out << "  CPU vs GL: " << std::setprecision(3) << 100.0 * different / compared << "% of pixels differ by more than "
+            << COMPARE_TOLERANCE << "/255 (worst pose " << worstPose << ": " << 100.0 * worstShare
+            << "%), largest difference " << maxDifference << "/255" << std::endl;
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
+
+#endif
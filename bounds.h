@@ -0,0 +1,198 @@
+#pragma once
+//
+//  bounds.h
+//  3D Object Drawing
+//
+//  Axis-aligned bounding boxes for the room's objects and the convex volumes they are
+//  culled against.
+//
+
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+struct AABB
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB() : min(FLT_MAX), max(-FLT_MAX) {}
+    AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+    bool valid() const
+    {
+        return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+    }
+
+    glm::vec3 center() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extent() const
+    {
+        return max - min;
+    }
+
+    void expand(const glm::vec3& p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void expand(const AABB& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    float surfaceArea() const
+    {
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    bool overlaps(const AABB& other) const
+    {
+        return min.x <= other.max.x && max.x >= other.min.x &&
+               min.y <= other.max.y && max.y >= other.min.y &&
+               min.z <= other.max.z && max.z >= other.min.z;
+    }
+
+    bool contains(const glm::vec3& p) const
+    {
+        return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y && p.z >= min.z && p.z <= max.z;
+    }
+};
+
+// world-space bounds of 'local' after transforming it by 'model' (Arvo's method)
+inline AABB transformAABB(const glm::mat4& model, const AABB& local)
+{
+    AABB result;
+    glm::vec3 translation(model[3]);
+    result.min = translation;
+    result.max = translation;
+    for (int col = 0; col < 3; col++)
+    {
+        for (int row = 0; row < 3; row++)
+        {
+            float a = model[col][row] * local.min[col];
+            float b = model[col][row] * local.max[col];
+            result.min[row] += std::min(a, b);
+            result.max[row] += std::max(a, b);
+        }
+    }
+    return result;
+}
+
+// every object in the room is the 0..0.5 cube from main.cpp under some model matrix
+inline AABB cubeBounds(const glm::mat4& model)
+{
+    return transformAABB(model, AABB(glm::vec3(0.0f), glm::vec3(0.5f)));
+}
+
+// Ray origin + t * direction against the 0..0.5 cube under 'model'; on a hit, 't' is the
+// entry parameter in [0, maxT]. Flattened cubes (walls, panels) cannot be inverted and
+// are tested as their world bounds, which for them is exact when axis-aligned.
+inline bool intersectRayCube(const glm::mat4& model, const glm::vec3& origin, const glm::vec3& direction, float maxT, float& t)
+{
+    glm::vec3 o = origin, d = direction;
+    AABB box(glm::vec3(0.0f), glm::vec3(0.5f));
+    if (std::fabs(glm::determinant(glm::mat3(model))) > 1e-9f)
+    {
+        glm::mat4 inverse = glm::inverse(model);
+        o = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+        d = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+    }
+    else
+    {
+        box = cubeBounds(model);
+    }
+
+    float enter = 0.0f, exit = maxT;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (std::fabs(d[axis]) < 1e-12f)
+        {
+            if (o[axis] < box.min[axis] || o[axis] > box.max[axis])
+                return false;
+            continue;
+        }
+        float t0 = (box.min[axis] - o[axis]) / d[axis];
+        float t1 = (box.max[axis] - o[axis]) / d[axis];
+        enter = std::max(enter, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+    if (enter > exit)
+        return false;
+    t = enter;
+    return true;
+}
+
+// Convex volume bounded by planes (a, b, c, d); a point p is inside a plane when
+// a*p.x + b*p.y + c*p.z + d >= 0. Used for the view frustum and for the narrower
+// volumes seen through portals.
+struct Frustum
+{
+    static const int MAX_PLANES = 24;
+
+    glm::vec4 planes[MAX_PLANES];
+    int count = 0;
+
+    // the six planes of a projection * view matrix (Gribb/Hartmann)
+    static Frustum fromMatrix(const glm::mat4& m)
+    {
+        Frustum frustum;
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        frustum.addPlane(row3 + row0);
+        frustum.addPlane(row3 - row0);
+        frustum.addPlane(row3 + row1);
+        frustum.addPlane(row3 - row1);
+        frustum.addPlane(row3 + row2);
+        frustum.addPlane(row3 - row2);
+        return frustum;
+    }
+
+    // normalizes the plane so distance() returns world units; returns false when full
+    bool addPlane(const glm::vec4& plane)
+    {
+        if (count == MAX_PLANES)
+            return false;
+        float length = glm::length(glm::vec3(plane));
+        if (length <= 0.0f)
+            return true;   // degenerate plane culls nothing
+        planes[count++] = plane / length;
+        return true;
+    }
+
+    static float distance(const glm::vec4& plane, const glm::vec3& p)
+    {
+        return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+    }
+
+    // conservative: may keep a box that lies outside near a corner of the volume
+    bool intersects(const AABB& box) const
+    {
+        for (int i = 0; i < count; i++)
+        {
+            // the box corner furthest along the plane normal
+            const glm::vec4& p = planes[i];
+            glm::vec3 corner(p.x >= 0.0f ? box.max.x : box.min.x,
+                             p.y >= 0.0f ? box.max.y : box.min.y,
+                             p.z >= 0.0f ? box.max.z : box.min.z);
+            if (distance(p, corner) < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,478 @@
+#pragma once
+//
+//  bvh.h
+//  3D Object Drawing
+//
+//  Bounding volume hierarchy over object AABBs, built with the surface area heuristic.
+//  Answers ray casts (mouse picking) and swept-sphere casts (camera collision), and is
+//  refit in place when only some boxes move.
+//
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+struct BvhNode
+{
+    AABB bounds;
+    uint32_t first;   // leaf: first entry of 'order'; inner: index of the left child (right = left + 1)
+    uint32_t count;   // objects in a leaf, 0 for inner nodes
+};
+
+// nearest hit of a cast
+struct BvhHit
+{
+    int object = -1;
+    float t = FLT_MAX;          // fraction of the cast segment, or ray distance for raycast()
+    glm::vec3 normal = glm::vec3(0.0f);
+};
+
+class Bvh
+{
+public:
+    // rebuilds the tree over 'count' boxes; object i keeps index i in query results
+    void build(const AABB* boxes, size_t count)
+    {
+        objectBounds.assign(boxes, boxes + count);
+        centroids.resize(count);
+        order.resize(count);
+        leafOf.assign(count, 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            centroids[i] = boxes[i].center();
+            order[i] = static_cast<uint32_t>(i);
+        }
+        nodes.clear();
+        parents.clear();
+        nodes.reserve(count * 2 + 1);
+        parents.reserve(count * 2 + 1);
+        if (count == 0)
+            return;
+        nodes.push_back(BvhNode());
+        parents.push_back(UINT32_MAX);
+        nodes[0].first = 0;
+        nodes[0].count = static_cast<uint32_t>(count);
+        subdivide(0, 0);
+    }
+
+    // Takes this frame's boxes (same objects, same order as build) and refits only the
+    // paths above boxes that changed; returns how many objects moved.
+    size_t refit(const AABB* boxes)
+    {
+        size_t moved = 0;
+        for (size_t i = 0; i < objectBounds.size(); i++)
+        {
+            if (std::memcmp(&objectBounds[i], &boxes[i], sizeof(AABB)) == 0)
+                continue;
+            objectBounds[i] = boxes[i];
+            moved++;
+            for (uint32_t node = leafOf[i]; node != UINT32_MAX; node = parents[node])
+            {
+                AABB updated = nodeBounds(node);
+                if (std::memcmp(&updated, &nodes[node].bounds, sizeof(AABB)) == 0)
+                    break;   // ancestors already enclose it
+                nodes[node].bounds = updated;
+            }
+        }
+        return moved;
+    }
+
+    size_t objectCount() const { return objectBounds.size(); }
+    size_t nodeCount() const { return nodes.size(); }
+
+    // Nearest object along origin + t * direction with t in [0, maxT]. 'exact' confirms a
+    // box hit: bool exact(object, origin, direction, float& t) receives the box's entry t
+    // and may reject the hit or move t, e.g. by testing the real shape.
+    template <typename ExactTest>
+    BvhHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxT, ExactTest exact) const
+    {
+        BvhHit hit;
+        hit.t = maxT;
+        if (nodes.empty())
+            return hit;
+        glm::vec3 inverse = safeInverse(direction);
+
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BvhNode& node = nodes[stack[--top]];
+            float enter;
+            if (!slab(node.bounds, origin, inverse, hit.t, enter))
+                continue;
+            if (node.count != 0)
+            {
+                for (uint32_t i = 0; i < node.count; i++)
+                {
+                    uint32_t object = order[node.first + i];
+                    float boxT;
+                    if (!slab(objectBounds[object], origin, inverse, hit.t, boxT))
+                        continue;
+                    float t = boxT;
+                    if (exact(static_cast<int>(object), origin, direction, t) && t < hit.t)
+                    {
+                        hit.t = t;
+                        hit.object = static_cast<int>(object);
+                    }
+                }
+                continue;
+            }
+            pushNearFirst(node, origin, inverse, hit.t, glm::vec3(0.0f), stack, top);
+        }
+        return hit;
+    }
+
+    // First contact of a sphere moving from 'from' to 'to'. Each box is grown by the radius
+    // (corners are treated as square, which only errs towards stopping early). Boxes the
+    // sphere already overlaps at 'from' are ignored so it can always move out of them.
+    BvhHit sweepSphere(const glm::vec3& from, const glm::vec3& to, float radius) const
+    {
+        BvhHit hit;
+        hit.t = 1.0f;
+        if (nodes.empty())
+            return hit;
+        glm::vec3 delta = to - from;
+        glm::vec3 inverse = safeInverse(delta);
+        glm::vec3 grow(radius);
+
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            // children were tested when pushed, but hit.t may have shrunk since
+            const BvhNode& node = nodes[stack[--top]];
+            float enter;
+            AABB grown(node.bounds.min - grow, node.bounds.max + grow);
+            if (!slab(grown, from, inverse, hit.t, enter))
+                continue;
+            if (node.count != 0)
+            {
+                for (uint32_t i = 0; i < node.count; i++)
+                {
+                    uint32_t object = order[node.first + i];
+                    AABB box(objectBounds[object].min - grow, objectBounds[object].max + grow);
+                    if (box.contains(from))
+                        continue;
+                    glm::vec3 normal;
+                    float t;
+                    if (slabWithNormal(box, from, inverse, delta, hit.t, t, normal))
+                    {
+                        hit.t = t;
+                        hit.object = static_cast<int>(object);
+                        hit.normal = normal;
+                    }
+                }
+                continue;
+            }
+            pushNearFirst(node, from, inverse, hit.t, grow, stack, top);
+        }
+        return hit;
+    }
+
+private:
+    static const int BINS = 16;
+    static const int STACK_SIZE = 128;
+    static const uint32_t MAX_LEAF = 2;
+    // Traversal keeps at most one entry per level plus one, so the tree must stay under
+    // STACK_SIZE - 1 levels. From this depth on nodes are split at the median, which adds
+    // at most 32 more levels for any uint32_t count.
+    static const int MEDIAN_DEPTH = STACK_SIZE - 2 - 32;
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> order;      // object indices, leaves own contiguous ranges
+    std::vector<uint32_t> leafOf;     // leaf node of each object
+    std::vector<AABB> objectBounds;
+    std::vector<glm::vec3> centroids;
+
+    AABB nodeBounds(uint32_t index) const
+    {
+        const BvhNode& node = nodes[index];
+        AABB bounds;
+        if (node.count != 0)
+        {
+            for (uint32_t i = 0; i < node.count; i++)
+                bounds.expand(objectBounds[order[node.first + i]]);
+        }
+        else
+        {
+            bounds.expand(nodes[node.first].bounds);
+            bounds.expand(nodes[node.first + 1].bounds);
+        }
+        return bounds;
+    }
+
+    void makeLeaf(uint32_t index)
+    {
+        BvhNode& node = nodes[index];
+        for (uint32_t i = 0; i < node.count; i++)
+            leafOf[order[node.first + i]] = index;
+    }
+
+    // binned SAH split of node 'index' ('depth' levels below the root), recursing into both halves
+    void subdivide(uint32_t index, int depth)
+    {
+        nodes[index].bounds = nodeBounds(index);
+        uint32_t first = nodes[index].first;
+        uint32_t count = nodes[index].count;
+        if (count <= MAX_LEAF)
+        {
+            makeLeaf(index);
+            return;
+        }
+
+        AABB centroidBounds;
+        for (uint32_t i = 0; i < count; i++)
+            centroidBounds.expand(centroids[order[first + i]]);
+        glm::vec3 extent = centroidBounds.extent();
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        if (extent[axis] <= 0.0f)
+        {
+            makeLeaf(index);   // all centroids coincide; nothing to split
+            return;
+        }
+
+        uint32_t* begin = &order[first];
+        if (depth >= MEDIAN_DEPTH)
+        {
+            addChildren(index, first, count, medianSplit(begin, count, axis), depth);
+            return;
+        }
+
+        struct Bin { AABB bounds; uint32_t count = 0; } bins[BINS];
+        float scale = BINS / extent[axis];
+        auto binOf = [&](uint32_t object) {
+            int b = static_cast<int>((centroids[object][axis] - centroidBounds.min[axis]) * scale);
+            return std::min(b, BINS - 1);
+        };
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t object = order[first + i];
+            Bin& bin = bins[binOf(object)];
+            bin.bounds.expand(objectBounds[object]);
+            bin.count++;
+        }
+
+        // cost of splitting after each bin: area * count on both sides
+        float leftCost[BINS - 1];
+        AABB sweep;
+        uint32_t sweepCount = 0;
+        for (int b = 0; b < BINS - 1; b++)
+        {
+            sweep.expand(bins[b].bounds);
+            sweepCount += bins[b].count;
+            leftCost[b] = sweepCount ? sweep.surfaceArea() * sweepCount : 0.0f;
+        }
+        float bestCost = FLT_MAX;
+        int bestSplit = -1;
+        sweep = AABB();
+        sweepCount = 0;
+        for (int b = BINS - 1; b > 0; b--)
+        {
+            sweep.expand(bins[b].bounds);
+            sweepCount += bins[b].count;
+            float cost = leftCost[b - 1] + (sweepCount ? sweep.surfaceArea() * sweepCount : 0.0f);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+        float leafCost = nodes[index].bounds.surfaceArea() * count;
+        if (bestSplit < 0 || (bestCost >= leafCost && count <= 8))
+        {
+            makeLeaf(index);
+            return;
+        }
+
+        uint32_t* middle = std::partition(begin, begin + count, [&](uint32_t object) { return binOf(object) < bestSplit; });
+        uint32_t leftCount = static_cast<uint32_t>(middle - begin);
+        if (leftCount == 0 || leftCount == count)
+            leftCount = medianSplit(begin, count, axis);   // degenerate binning
+        addChildren(index, first, count, leftCount, depth);
+    }
+
+    // orders the range so its first half has the smaller centroids along 'axis'; returns that half's size
+    uint32_t medianSplit(uint32_t* begin, uint32_t count, int axis)
+    {
+        uint32_t leftCount = count / 2;
+        std::nth_element(begin, begin + leftCount, begin + count,
+                         [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        return leftCount;
+    }
+
+    void addChildren(uint32_t index, uint32_t first, uint32_t count, uint32_t leftCount, int depth)
+    {
+        uint32_t left = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(BvhNode());
+        nodes.push_back(BvhNode());
+        parents.push_back(index);
+        parents.push_back(index);
+        nodes[left].first = first;
+        nodes[left].count = leftCount;
+        nodes[left + 1].first = first + leftCount;
+        nodes[left + 1].count = count - leftCount;
+        nodes[index].first = left;
+        nodes[index].count = 0;
+        subdivide(left, depth + 1);
+        subdivide(left + 1, depth + 1);
+    }
+
+    static glm::vec3 safeInverse(const glm::vec3& d)
+    {
+        const float big = 1e30f;
+        return glm::vec3(d.x != 0.0f ? 1.0f / d.x : big, d.y != 0.0f ? 1.0f / d.y : big, d.z != 0.0f ? 1.0f / d.z : big);
+    }
+
+    // entry parameter of the segment into the box if it is within [0, maxT]
+    static bool slab(const AABB& box, const glm::vec3& origin, const glm::vec3& inverse, float maxT, float& enter)
+    {
+        glm::vec3 t0 = (box.min - origin) * inverse;
+        glm::vec3 t1 = (box.max - origin) * inverse;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxT));
+        return enter <= exit;
+    }
+
+    static bool slabWithNormal(const AABB& box, const glm::vec3& origin, const glm::vec3& inverse, const glm::vec3& delta,
+                               float maxT, float& enter, glm::vec3& normal)
+    {
+        glm::vec3 t0 = (box.min - origin) * inverse;
+        glm::vec3 t1 = (box.max - origin) * inverse;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        int axis = tNear.x > tNear.y ? (tNear.x > tNear.z ? 0 : 2) : (tNear.y > tNear.z ? 1 : 2);
+        enter = tNear[axis];
+        float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+        if (enter < 0.0f || enter > exit || enter >= maxT)
+            return false;
+        normal = glm::vec3(0.0f);
+        normal[axis] = delta[axis] > 0.0f ? -1.0f : 1.0f;
+        return true;
+    }
+
+    // 'grow' inflates the child boxes (the sphere radius for sweeps)
+    void pushNearFirst(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverse, float maxT,
+                       const glm::vec3& grow, uint32_t* stack, int& top) const
+    {
+        uint32_t left = node.first, right = node.first + 1;
+        float leftT, rightT;
+        AABB leftBox(nodes[left].bounds.min - grow, nodes[left].bounds.max + grow);
+        AABB rightBox(nodes[right].bounds.min - grow, nodes[right].bounds.max + grow);
+        bool hitLeft = slab(leftBox, origin, inverse, maxT, leftT);
+        bool hitRight = slab(rightBox, origin, inverse, maxT, rightT);
+        // the nearer child is pushed last so it is visited first
+        if (hitLeft && hitRight && leftT < rightT)
+        {
+            stack[top++] = right;
+            stack[top++] = left;
+        }
+        else
+        {
+            if (hitLeft)
+                stack[top++] = left;
+            if (hitRight)
+                stack[top++] = right;
+        }
+    }
+};
+
+// Moves a sphere from 'from' towards 'to', stopping at the first contact and sliding the
+// rest of the motion along the surface it hit (up to three contacts per call).
+inline glm::vec3 slideSphere(const Bvh& bvh, const glm::vec3& from, const glm::vec3& to, float radius)
+{
+    const float SKIN = 1e-3f;   // distance kept from surfaces so the next cast does not start inside
+    glm::vec3 position = from;
+    glm::vec3 motion = to - from;
+    for (int contact = 0; contact < 3; contact++)
+    {
+        float length = glm::length(motion);
+        if (length < 1e-6f)
+            break;
+        BvhHit hit = bvh.sweepSphere(position, position + motion, radius);
+        if (hit.object < 0)
+        {
+            position += motion;
+            break;
+        }
+        float travel = std::max(0.0f, hit.t * length - SKIN);
+        position += motion * (travel / length);
+        glm::vec3 remaining = motion * (1.0f - hit.t);
+        motion = remaining - hit.normal * glm::dot(remaining, hit.normal);
+    }
+    return position;
+}
+
+// Build, refit and query times for 'count' random boxes.
+inline void runBvhBenchmark(std::ostream& out, size_t count)
+{
+    typedef std::chrono::steady_clock Clock;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> size(0.1f, 2.0f);
+    std::vector<AABB> boxes(count);
+    for (AABB& box : boxes)
+    {
+        glm::vec3 p(position(random), position(random) * 0.05f, position(random));
+        box = AABB(p, p + glm::vec3(size(random), size(random), size(random)));
+    }
+
+    Bvh bvh;
+    auto start = Clock::now();
+    bvh.build(boxes.data(), count);
+    double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    // one object in a hundred moves, like the fan blades and clock hands among static furniture
+    for (size_t i = 0; i < count; i += 100)
+    {
+        boxes[i].min.y += 0.25f;
+        boxes[i].max.y += 0.25f;
+    }
+    start = Clock::now();
+    size_t moved = bvh.refit(boxes.data());
+    double refitMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    const int QUERIES = 10000;
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    int rayHits = 0, sweepHits = 0;
+    auto exact = [](int, const glm::vec3&, const glm::vec3&, float&) { return true; };
+    start = Clock::now();
+    for (int i = 0; i < QUERIES; i++)
+    {
+        glm::vec3 origin(position(random), 0.0f, position(random));
+        glm::vec3 direction(unit(random), unit(random) * 0.1f, unit(random));
+        rayHits += bvh.raycast(origin, direction, 100.0f, exact).object >= 0;
+    }
+    double rayUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / QUERIES;
+    start = Clock::now();
+    for (int i = 0; i < QUERIES; i++)
+    {
+        glm::vec3 from(position(random), 0.0f, position(random));
+        glm::vec3 to = from + glm::vec3(unit(random), 0.0f, unit(random)) * 0.1f;
+        sweepHits += bvh.sweepSphere(from, to, 0.2f).object >= 0;
+    }
+    double sweepUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / QUERIES;
+
+    out << "BVH over " << count << " boxes: " << bvh.nodeCount() << " nodes, build " << buildMs << " ms, refit of "
+        << moved << " moved boxes " << refitMs << " ms" << std::endl;
+    out << "  ray cast " << rayUs << " us (" << rayHits << " of " << QUERIES << " hit), sphere sweep "
+        << sweepUs << " us (" << sweepHits << " of " << QUERIES << " hit)" << std::endl;
+}
+
+#endif
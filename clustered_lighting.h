@@ -0,0 +1,477 @@
+#pragma once
+//
+//  clustered_lighting.h
+//  3D Object Drawing
+//
+//  Clustered forward shading for many point lights. The view frustum is cut into
+//  16 x 9 screen tiles and 24 depth slices spaced exponentially; every frame the CPU lists
+//  the lights touching each cluster, one depth slice per job, and uploads the lists as
+//  texture buffers. fragmentShader.fs finds its cluster from its view position and loops
+//  over that cluster's lights only.
+//
+
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_resources.h"
+#include "job_system.h"
+#include "room_scene.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <vector>
+
+// as CLUSTERS in fragmentShader.fs
+const int LIGHT_CLUSTERS_X = 16;
+const int LIGHT_CLUSTERS_Y = 9;
+const int LIGHT_CLUSTERS_Z = 24;
+const int LIGHT_CLUSTER_COUNT = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+
+// the 'pointLighting' uniform of fragmentShader.fs
+enum PointLightingMode {
+    POINT_LIGHTS_OFF,
+    POINT_LIGHTS_CLUSTERED,   // the lights listed for the fragment's cluster
+    POINT_LIGHTS_NAIVE        // every light for every fragment, to measure the clusters against
+};
+
+// two RGBA32F texels of the light buffer
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;        // no light reaches further
+    glm::vec3 color;     // irradiance / pi one unit away
+    float padding;
+};
+
+static_assert(sizeof(PointLight) == 32, "PointLight is uploaded as two RGBA32F texels");
+
+inline PointLight makePointLight(const glm::vec3& position, float radius, const glm::vec3& color)
+{
+    PointLight light;
+    light.position = position;
+    light.radius = radius;
+    light.color = color;
+    light.padding = 0.0f;
+    return light;
+}
+
+// The lights of one room: a lamp over each quarter of the ceiling (where the lightmap bake
+// puts its panels, so they are left out when the bake is shown), one over the table and
+// the glow of the TV while it shows a picture.
+inline void appendRoomLights(std::vector<PointLight>& lights, const RoomInstance& room, const RoomState& state,
+                             bool ceiling)
+{
+    auto place = [&](float x, float y, float z) { return glm::vec3(room.placement * glm::vec4(x, y, z, 1.0f)); };
+    if (ceiling)
+    {
+        const float xs[2] = { 1.0f, 4.6f };
+        const float zs[2] = { 0.5f, 3.5f };
+        for (float x : xs)
+            for (float z : zs)
+                lights.push_back(makePointLight(place(x, ROOM_CEILING_Y - 0.1f, z), 4.0f, glm::vec3(1.5f, 1.35f, 1.1f)));
+    }
+    lights.push_back(makePointLight(place(2.0f, 0.75f, 3.4f), 2.5f, glm::vec3(1.2f, 0.95f, 0.6f)));
+    glm::vec3 tv(state.tvColor);
+    if (tv != glm::vec3(0.0f))
+        lights.push_back(makePointLight(place(2.9f, 1.1f, -0.6f), 3.0f, tv * 0.8f));
+}
+
+// The room lights of the whole apartment, then coloured lights drifting up and down at random
+// places until there are 'count' (0: the room lights only, otherwise exactly 'count').
+inline void gatherSceneLights(std::vector<PointLight>& lights, const Apartment& apartment, const RoomState& state,
+                              bool ceiling, size_t count, float time)
+{
+    lights.clear();
+    for (const RoomInstance& room : apartment.rooms)
+        appendRoomLights(lights, room, state, ceiling);
+    if (count == 0 || apartment.rooms.empty())
+        return;
+    if (lights.size() > count)
+    {
+        lights.resize(count);
+        return;
+    }
+    std::mt19937 random(7411);
+    std::uniform_real_distribution<float> x(ROOM_MIN_X + 0.3f, ROOM_RIGHT_WALL_X - 0.3f), y(0.0f, 1.7f);
+    std::uniform_real_distribution<float> z(ROOM_MIN_Z + 0.3f, ROOM_MAX_Z - 0.3f), radius(1.5f, 3.0f);
+    std::uniform_real_distribution<float> channel(0.2f, 1.0f), phase(0.0f, 6.2831853f);
+    for (size_t i = 0; lights.size() < count; i++)
+    {
+        const RoomInstance& room = apartment.rooms[i % apartment.rooms.size()];
+        glm::vec3 p(x(random), y(random), z(random));
+        float r = radius(random);
+        glm::vec3 color(channel(random), channel(random), channel(random));
+        p.y += 0.2f * std::sin(time + phase(random));
+        lights.push_back(makePointLight(glm::vec3(room.placement * glm::vec4(p, 1.0f)), r, color));
+    }
+}
+
+// Every sampler starts on unit 0, and samplers of different types must not share a unit even
+// when unused, so each program built with fragmentShader.fs moves the buffer samplers away
+// once (the program must be in use).
+inline void setPointLightUnits(const Shader& shader)
+{
+    shader.setInt("pointLights", 3);
+    shader.setInt("lightClusters", 4);
+    shader.setInt("lightIndices", 5);
+}
+
+struct ClusterStats
+{
+    size_t lights = 0;
+    size_t visibleLights = 0;        // in the frustum
+    size_t indices = 0;              // light references over all clusters
+    unsigned int occupiedClusters = 0;
+    unsigned int maxPerCluster = 0;
+    size_t dropped = 0;              // over maxLightsPerCluster
+    double buildMs = 0.0;
+};
+
+class ClusteredLighting
+{
+public:
+    float nearPlane = 0.1f;          // as the projection
+    float farPlane = 100.0f;
+    unsigned int maxLightsPerCluster = 256;
+    ClusterStats stats;
+
+    // the three texture buffers; needs the context
+    void init()
+    {
+        lightBuffer.create(GPU_STORAGE_BUFFER, "point lights");
+        clusterBuffer.create(GPU_STORAGE_BUFFER, "light clusters");
+        indexBuffer.create(GPU_STORAGE_BUFFER, "cluster light indices");
+        lightTexture.create(GL_TEXTURE_BUFFER, GPU_OBJECT, "point light texels");
+        clusterTexture.create(GL_TEXTURE_BUFFER, GPU_OBJECT, "light cluster texels");
+        indexTexture.create(GL_TEXTURE_BUFFER, GPU_OBJECT, "cluster light index texels");
+        ready = true;
+    }
+
+    // Lists the lights of every cluster of the frustum of view and projection. Lights are
+    // placed by the view-space box around their sphere, one job per depth slice, so no two
+    // jobs write the same cluster.
+    void build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, JobSystem& jobs)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        this->lights = &lights;
+        this->projection = projection;
+        depthScale = LIGHT_CLUSTERS_Z / std::log(farPlane / nearPlane);
+        depthBias = -std::log(nearPlane) * depthScale;
+
+        // view-space spheres and their depth slices
+        spheres.resize(lights.size());
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            ViewSphere& sphere = spheres[i];
+            sphere.center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            sphere.radius = lights[i].radius;
+            float nearDepth = std::max(-sphere.center.z - sphere.radius, nearPlane);
+            float farDepth = std::min(-sphere.center.z + sphere.radius, farPlane);
+            sphere.visible = nearDepth <= farDepth;
+            sphere.firstSlice = slice(nearDepth);
+            sphere.lastSlice = slice(farDepth);
+            if (sphere.visible)
+            {
+                TileRange tiles;
+                sphere.visible = tileRange(sphere, nearDepth, farDepth, tiles);
+            }
+        }
+
+        clusters.resize(LIGHT_CLUSTER_COUNT * 2);
+        sliceIndices.resize(LIGHT_CLUSTERS_Z);
+        sliceDropped.assign(LIGHT_CLUSTERS_Z, 0);
+        auto job = [this](unsigned int k, unsigned int) { buildSlice(static_cast<int>(k)); };
+        jobs.parallelFor(LIGHT_CLUSTERS_Z, job);
+
+        // the slices' lists one after another
+        indices.clear();
+        stats = ClusterStats();
+        stats.lights = lights.size();
+        for (const ViewSphere& sphere : spheres)
+            stats.visibleLights += sphere.visible;
+        for (int k = 0; k < LIGHT_CLUSTERS_Z; k++)
+        {
+            uint32_t base = static_cast<uint32_t>(indices.size());
+            uint32_t* sliceClusters = &clusters[k * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * 2];
+            for (int c = 0; c < LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y; c++)
+            {
+                sliceClusters[c * 2] += base;
+                stats.occupiedClusters += sliceClusters[c * 2 + 1] != 0;
+                stats.maxPerCluster = std::max(stats.maxPerCluster, sliceClusters[c * 2 + 1]);
+            }
+            indices.insert(indices.end(), sliceIndices[k].begin(), sliceIndices[k].end());
+            stats.dropped += sliceDropped[k];
+        }
+        stats.indices = indices.size();
+        stats.buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // the lights, clusters and indices of the last build()
+    void upload()
+    {
+        if (!ready || !lights)
+            return;
+        // never empty: a texture buffer needs a store
+        static const uint32_t none[2] = { 0, 0 };
+        const void* lightData = lights->empty() ? static_cast<const void*>(none) : lights->data();
+        const void* indexData = indices.empty() ? static_cast<const void*>(none) : indices.data();
+        lightBuffer.data(GL_TEXTURE_BUFFER, std::max<size_t>(lights->size() * sizeof(PointLight), sizeof(none)), lightData,
+                         GL_STREAM_DRAW);
+        clusterBuffer.data(GL_TEXTURE_BUFFER, clusters.size() * sizeof(uint32_t), clusters.data(), GL_STREAM_DRAW);
+        indexBuffer.data(GL_TEXTURE_BUFFER, std::max<size_t>(indices.size() * sizeof(uint32_t), sizeof(none)), indexData,
+                         GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        attach(lightTexture, GL_RGBA32F, lightBuffer);
+        attach(clusterTexture, GL_RG32UI, clusterBuffer);
+        attach(indexTexture, GL_R32UI, indexBuffer);
+    }
+
+    // puts the buffers on the units of setPointLightUnits() and sets the uniforms; 'ambient' lights what no bake does
+    void bind(const Shader& shader, PointLightingMode mode, const glm::vec3& ambient, const glm::vec3& viewPos) const
+    {
+        glActiveTexture(GL_TEXTURE3);
+        lightTexture.bind();
+        glActiveTexture(GL_TEXTURE4);
+        clusterTexture.bind();
+        glActiveTexture(GL_TEXTURE5);
+        indexTexture.bind();
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("pointLighting", mode);
+        shader.setInt("pointLightCount", lights ? static_cast<int>(lights->size()) : 0);
+        shader.setVec2("clusterDepth", depthScale, depthBias);
+        shader.setVec3("ambientLight", ambient);
+        shader.setVec3("viewPos", viewPos);
+    }
+
+private:
+    struct ViewSphere
+    {
+        glm::vec3 center;
+        float radius;
+        int firstSlice, lastSlice;
+        bool visible;
+    };
+
+    struct TileRange
+    {
+        int x0, x1, y0, y1;
+    };
+
+    const std::vector<PointLight>* lights = nullptr;
+    glm::mat4 projection = glm::mat4(1.0f);
+    float depthScale = 1.0f;
+    float depthBias = 0.0f;
+    std::vector<ViewSphere> spheres;
+    std::vector<uint32_t> clusters;   // offset and count per cluster, x fastest, then y, then depth
+    std::vector<uint32_t> indices;
+    std::vector<std::vector<uint32_t>> sliceIndices;
+    std::vector<size_t> sliceDropped;
+    bool ready = false;
+    GlBuffer lightBuffer;
+    GlBuffer clusterBuffer;
+    GlBuffer indexBuffer;
+    GlTexture lightTexture;
+    GlTexture clusterTexture;
+    GlTexture indexTexture;
+
+    int slice(float depth) const
+    {
+        int k = static_cast<int>(std::floor(std::log(depth) * depthScale + depthBias));
+        return std::min(std::max(k, 0), LIGHT_CLUSTERS_Z - 1);
+    }
+
+    float sliceDepth(int k) const
+    {
+        return std::exp((k - depthBias) / depthScale);
+    }
+
+    // Screen tiles covered by the part of the sphere's box between two depths: the corners
+    // of that box projected, which bounds the whole box while it is in front of the eye.
+    bool tileRange(const ViewSphere& sphere, float nearDepth, float farDepth, TileRange& tiles) const
+    {
+        glm::vec2 low(FLT_MAX), high(-FLT_MAX);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 p((corner & 1) ? sphere.center.x + sphere.radius : sphere.center.x - sphere.radius,
+                        (corner & 2) ? sphere.center.y + sphere.radius : sphere.center.y - sphere.radius,
+                        (corner & 4) ? -farDepth : -nearDepth, 1.0f);
+            glm::vec4 clip = projection * p;
+            glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+            low = glm::min(low, ndc);
+            high = glm::max(high, ndc);
+        }
+        if (high.x < -1.0f || high.y < -1.0f || low.x > 1.0f || low.y > 1.0f)
+            return false;
+        auto tile = [](float ndc, int count) {
+            return std::min(std::max(static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * count)), 0), count - 1);
+        };
+        tiles.x0 = tile(low.x, LIGHT_CLUSTERS_X);
+        tiles.x1 = tile(high.x, LIGHT_CLUSTERS_X);
+        tiles.y0 = tile(low.y, LIGHT_CLUSTERS_Y);
+        tiles.y1 = tile(high.y, LIGHT_CLUSTERS_Y);
+        return true;
+    }
+
+    // counts, then fills, the lists of one depth slice; offsets are relative to the slice
+    void buildSlice(int k)
+    {
+        const int tilesPerSlice = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y;
+        uint32_t* sliceClusters = &clusters[k * tilesPerSlice * 2];
+        for (int c = 0; c < tilesPerSlice; c++)
+            sliceClusters[c * 2 + 1] = 0;
+        float sliceNear = sliceDepth(k), sliceFar = sliceDepth(k + 1);
+        auto covered = [&](const ViewSphere& sphere, TileRange& tiles) {
+            if (!sphere.visible || k < sphere.firstSlice || k > sphere.lastSlice)
+                return false;
+            float nearDepth = std::max(-sphere.center.z - sphere.radius, std::max(sliceNear, nearPlane));
+            float farDepth = std::min(-sphere.center.z + sphere.radius, std::min(sliceFar, farPlane));
+            return tileRange(sphere, nearDepth, std::max(nearDepth, farDepth), tiles);
+        };
+
+        TileRange tiles;
+        for (size_t i = 0; i < spheres.size(); i++)
+            if (covered(spheres[i], tiles))
+                for (int y = tiles.y0; y <= tiles.y1; y++)
+                    for (int x = tiles.x0; x <= tiles.x1; x++)
+                        sliceClusters[(y * LIGHT_CLUSTERS_X + x) * 2 + 1]++;
+        uint32_t total = 0;
+        size_t dropped = 0;
+        for (int c = 0; c < tilesPerSlice; c++)
+        {
+            uint32_t count = sliceClusters[c * 2 + 1];
+            if (count > maxLightsPerCluster)
+            {
+                dropped += count - maxLightsPerCluster;
+                count = maxLightsPerCluster;
+            }
+            sliceClusters[c * 2] = total;
+            sliceClusters[c * 2 + 1] = 0;   // filled again below
+            total += count;
+        }
+        std::vector<uint32_t>& list = sliceIndices[k];
+        list.resize(total);
+        for (size_t i = 0; i < spheres.size(); i++)
+            if (covered(spheres[i], tiles))
+                for (int y = tiles.y0; y <= tiles.y1; y++)
+                    for (int x = tiles.x0; x <= tiles.x1; x++)
+                    {
+                        uint32_t* cluster = &sliceClusters[(y * LIGHT_CLUSTERS_X + x) * 2];
+                        if (cluster[1] < maxLightsPerCluster)
+                            list[cluster[0] + cluster[1]++] = static_cast<uint32_t>(i);
+                    }
+        sliceDropped[k] = dropped;
+    }
+
+    static void attach(const GlTexture& texture, GLenum format, const GlBuffer& buffer)
+    {
+        texture.bind();
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer.id());
+    }
+};
+
+// one light count and shading mode of the sweep
+struct LightSweepRun
+{
+    size_t lights = 1;
+    PointLightingMode mode = POINT_LIGHTS_CLUSTERED;
+};
+
+struct LightSweepSample
+{
+    LightSweepRun run;
+    double frameMs = 0.0;            // averaged over the measured frames, GPU included
+    double buildMs = 0.0;
+    double lightsPerCluster = 0.0;   // over the occupied clusters
+    double maxPerCluster = 0.0;
+};
+
+// Frame time against light count: 1, 2, 4 .. 1024 lights, each clustered and naive.
+class LightSweep
+{
+public:
+    int warmupFrames = 10;
+    int measuredFrames = 30;
+
+    void plan()
+    {
+        runs.clear();
+        samples.clear();
+        for (size_t lights = 1; lights <= 1024; lights *= 2)
+        {
+            LightSweepRun run;
+            run.lights = lights;
+            run.mode = POINT_LIGHTS_CLUSTERED;
+            runs.push_back(run);
+            run.mode = POINT_LIGHTS_NAIVE;
+            runs.push_back(run);
+        }
+        current = 0;
+        frame = 0;
+    }
+
+    bool done() const { return current >= runs.size(); }
+    const LightSweepRun& run() const { return runs[current]; }
+
+    // Call once per finished frame. Returns true when the next frame belongs to a new run.
+    bool record(double frameMs, const ClusterStats& clusters)
+    {
+        const LightSweepRun& r = runs[current];
+        if (frame == 0)
+        {
+            LightSweepSample sample;
+            sample.run = r;
+            samples.push_back(sample);
+        }
+        LightSweepSample& sample = samples.back();
+        if (frame >= warmupFrames)
+        {
+            sample.frameMs += frameMs / measuredFrames;
+            sample.buildMs += clusters.buildMs / measuredFrames;
+            if (clusters.occupiedClusters)
+                sample.lightsPerCluster += static_cast<double>(clusters.indices) / clusters.occupiedClusters / measuredFrames;
+            sample.maxPerCluster = std::max(sample.maxPerCluster, static_cast<double>(clusters.maxPerCluster));
+        }
+        if (++frame < warmupFrames + measuredFrames)
+            return false;
+        frame = 0;
+        current++;
+        return true;
+    }
+
+    void report(std::ostream& out) const
+    {
+        out << "light sweep (" << LIGHT_CLUSTERS_X << "x" << LIGHT_CLUSTERS_Y << "x" << LIGHT_CLUSTERS_Z << " clusters)" << std::endl;
+        out << std::setw(7) << "lights" << std::setw(11) << "shading" << std::setw(11) << "frame ms"
+            << std::setw(11) << "build ms" << std::setw(16) << "per cluster" << std::setw(6) << "max" << std::endl;
+        for (const LightSweepSample& s : samples)
+        {
+            out << std::setw(7) << s.run.lights << std::setw(11) << (s.run.mode == POINT_LIGHTS_NAIVE ? "naive" : "clustered")
+                << std::setw(11) << std::fixed << std::setprecision(3) << s.frameMs << std::setw(11) << s.buildMs;
+            if (s.run.mode == POINT_LIGHTS_CLUSTERED)
+                out << std::setw(16) << std::setprecision(1) << s.lightsPerCluster << std::setw(6) << std::setprecision(0)
+                    << s.maxPerCluster;
+            out << std::endl;
+            out.unsetf(std::ios::fixed);
+            out << std::setprecision(6);
+        }
+    }
+
+private:
+    std::vector<LightSweepRun> runs;
+    std::vector<LightSweepSample> samples;
+    size_t current = 0;
+    int frame = 0;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+struct Object
+{
+    mat4 model;
+    vec4 color;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    vec4 spinPivot;   // xyz: pivot, w: radians per second
+    vec4 spinAxis;    // xyz: unit axis, w: phase
+};
+
+// matches the layout glMultiDrawElementsIndirect reads
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    uint baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Objects { Object objects[]; };
+layout (std430, binding = 1) writeonly buffer Commands { DrawCommand commands[]; };
+layout (binding = 0, offset = 0) uniform atomic_uint visibleCount;
+
+uniform vec4 frustumPlanes[6];
+uniform int objectCount;
+uniform int indexCount;
+// 1: append survivors (the draw count comes from visibleCount)
+// 0: one command per object, culled ones with no instances
+uniform int compact;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= uint(objectCount))
+        return;
+
+    vec3 bmin = objects[i].boundsMin.xyz;
+    vec3 bmax = objects[i].boundsMax.xyz;
+    bool visible = true;
+    for (int p = 0; p < 6; p++)
+    {
+        // box corner furthest along the plane normal
+        vec3 corner = mix(bmin, bmax, greaterThanEqual(frustumPlanes[p].xyz, vec3(0.0)));
+        if (dot(frustumPlanes[p].xyz, corner) + frustumPlanes[p].w < 0.0)
+            visible = false;
+    }
+
+    // baseInstance carries the object index to the vertex shader
+    if (compact != 0)
+    {
+        if (!visible)
+            return;
+        uint slot = atomicCounterIncrement(visibleCount);
+        commands[slot] = DrawCommand(uint(indexCount), 1u, 0u, 0u, i);
+    }
+    else
+    {
+        commands[i] = DrawCommand(uint(indexCount), visible ? 1u : 0u, 0u, 0u, i);
+        if (visible)
+            atomicCounterIncrement(visibleCount);
+    }
+}
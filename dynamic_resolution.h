@@ -0,0 +1,169 @@
+#pragma once
+//
+//  dynamic_resolution.h
+//  3D Object Drawing
+//
+//  Renders the scene into an offscreen target whose resolution follows a GPU time
+//  budget, then stretches it over the window.
+//
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include "gl_resources.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+struct DynamicResolutionOptions
+{
+    bool enabled = false;
+    float budgetMs = 16.0f;     // GPU time allowed for the scene pass
+    float minScale = 0.5f;      // of the framebuffer's width and height
+    float maxScale = 1.0f;
+};
+
+struct DynamicResolutionStats
+{
+    float scale = 1.0f;
+    int width = 0;              // resolution the scene was rendered at this frame
+    int height = 0;
+    double gpuMs = 0.0;         // most recent scene pass that has been measured
+    unsigned int reallocations = 0;
+};
+
+class DynamicResolution
+{
+public:
+    DynamicResolutionOptions options;
+    DynamicResolutionStats stats;
+
+    // Call before clearing: binds the target and sets the viewport for this frame's
+    // resolution. The targets follow the framebuffer size, reallocated only when it changes.
+    void begin(int framebufferWidth, int framebufferHeight)
+    {
+        windowWidth = std::max(framebufferWidth, 1);
+        windowHeight = std::max(framebufferHeight, 1);
+        measuring = false;
+        if (!options.enabled)
+        {
+            stats.scale = 1.0f;
+            stats.width = windowWidth;
+            stats.height = windowHeight;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, windowWidth, windowHeight);
+            return;
+        }
+
+        collectTimings();
+        if (windowWidth != targetWidth || windowHeight != targetHeight)
+            allocate(windowWidth, windowHeight);
+
+        stats.width = std::max(1, static_cast<int>(windowWidth * stats.scale + 0.5f));
+        stats.height = std::max(1, static_cast<int>(windowHeight * stats.scale + 0.5f));
+        framebuffer.bind();
+        glViewport(0, 0, stats.width, stats.height);
+
+        // a slot whose result has not come back yet is skipped rather than waited for
+        if (!pending[nextQuery])
+        {
+            glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery].id());
+            measuring = true;
+        }
+    }
+
+    // call after the scene is drawn: upscales the rendered region to the window
+    void end()
+    {
+        if (!options.enabled)
+            return;
+        if (measuring)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            pending[nextQuery] = true;
+            nextQuery = (nextQuery + 1) % QUERY_COUNT;
+        }
+
+        framebuffer.bind(GL_READ_FRAMEBUFFER);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, stats.width, stats.height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+    }
+
+private:
+    // results arrive a few frames late; three slots keep the GPU from ever being waited on
+    static const int QUERY_COUNT = 3;
+
+    GlFramebuffer framebuffer;
+    GlRenderbuffer color;
+    GlRenderbuffer depthStencil;   // the overdraw view counts in the stencil buffer
+    GlQuery queries[QUERY_COUNT];
+    bool pending[QUERY_COUNT] = {};
+    int nextQuery = 0;
+    bool measuring = false;
+    int targetWidth = 0;
+    int targetHeight = 0;
+    int windowWidth = 1;
+    int windowHeight = 1;
+
+    // full-size targets; a lower scale renders into their lower left corner
+    void allocate(int width, int height)
+    {
+        if (!framebuffer)
+        {
+            framebuffer.create("dynamic resolution FBO");
+            color.create("dynamic resolution color");
+            depthStencil.create("dynamic resolution depth/stencil");
+            for (int i = 0; i < QUERY_COUNT; i++)
+                queries[i].create("scene pass timer");
+        }
+        color.storage(GL_RGBA8, width, height);
+        depthStencil.storage(GL_DEPTH24_STENCIL8, width, height);
+        framebuffer.bind();
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color.id());
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil.id());
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "dynamic resolution: framebuffer incomplete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        targetWidth = width;
+        targetHeight = height;
+        stats.reallocations++;
+    }
+
+    // reads every finished timer and moves the scale toward the budget
+    void collectTimings()
+    {
+        for (int i = 0; i < QUERY_COUNT; i++)
+        {
+            int slot = (nextQuery + i) % QUERY_COUNT;
+            if (!pending[slot])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[slot].id(), GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;   // later slots were issued later
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[slot].id(), GL_QUERY_RESULT, &nanoseconds);
+            pending[slot] = false;
+            stats.gpuMs = nanoseconds / 1e6;
+            adjustScale();
+        }
+    }
+
+    void adjustScale()
+    {
+        // pixel work grows with the square of the scale
+        float step = std::sqrt(options.budgetMs / std::max(static_cast<float>(stats.gpuMs), 0.01f));
+        if (stats.gpuMs > options.budgetMs)
+            stats.scale *= std::max(step, 0.85f);          // over budget: shrink right away
+        else if (stats.gpuMs < options.budgetMs * 0.8f)
+            stats.scale *= std::min(step, 1.05f);          // clear headroom: grow back slowly
+        stats.scale = std::min(std::max(stats.scale, options.minScale), options.maxScale);
+    }
+};
+
+#endif
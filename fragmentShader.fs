@@ -1,9 +1,122 @@
 #version 330 core
 uniform vec4 color;
 
+// streamed albedo, tinted by 'color'; the room's boxes have no UVs, so each face is
+// mapped by its two world axes that are not the face normal
+in vec3 worldPos;
+uniform sampler2D albedo;
+uniform bool textured;
+uniform float textureRepeat;   // repeats per world unit
+
+// baked lighting (lightmap.h), in LightingMode order: none, the lightmap texels of this
+// cube's face, or an ambient cube blended from the light probes
+in vec3 localPos;
+uniform int lighting;
+uniform mat4 model;
+uniform vec3 viewPos;
+uniform sampler2D lightmap;        // irradiance / pi
+uniform sampler2D lightmapFaces;   // texel (face, slot): x, y, width, height of the face in lightmap texels
+uniform int lightmapSlot;
+uniform vec3 ambientCube[6];       // +x, -x, +y, -y, +z, -z
+
+// dynamic point lights (clustered_lighting.h), in PointLightingMode order: none, the lights
+// listed for this fragment's cluster, or every light
+uniform int pointLighting;
+uniform mat4 view;
+uniform mat4 projection;
+uniform samplerBuffer pointLights;      // two texels per light: position and radius, color
+uniform usamplerBuffer lightClusters;   // offset into lightIndices and count per cluster
+uniform usamplerBuffer lightIndices;
+uniform int pointLightCount;
+uniform vec2 clusterDepth;              // depth slice = log(depth) * x + y
+uniform vec3 ambientLight;              // in place of the baked lighting when it is off
+const ivec3 CLUSTERS = ivec3(16, 9, 24);   // as LIGHT_CLUSTERS_* in clustered_lighting.h
+
 out vec4 FragColor;
 
+// the face normal, turned towards the viewer
+vec3 faceNormal()
+{
+    vec3 n = normalize(cross(dFdx(worldPos), dFdy(worldPos)));
+    return dot(n, viewPos - worldPos) < 0.0 ? -n : n;
+}
+
+vec3 bakedLight()
+{
+    if (lighting == 2)
+    {
+        vec3 n = faceNormal();
+        vec3 w = n * n;
+        return w.x * ambientCube[n.x >= 0.0 ? 0 : 1] + w.y * ambientCube[n.y >= 0.0 ? 2 : 3] +
+               w.z * ambientCube[n.z >= 0.0 ? 4 : 5];
+    }
+    // the face is on the axis where localPos sits at 0 or 1
+    vec3 edge = min(localPos, 1.0 - localPos);
+    int axis = edge.x <= edge.y && edge.x <= edge.z ? 0 : (edge.y <= edge.z ? 1 : 2);
+    int u = (axis + 1) % 3;
+    int v = (axis + 2) % 3;
+    int side = localPos[axis] > 0.5 ? 1 : 0;
+    // both faces of a flat panel lie in one plane: take the one facing the viewer
+    if (dot(model[axis].xyz, model[axis].xyz) == 0.0)
+        side = dot(cross(model[u].xyz, model[v].xyz), viewPos - worldPos) > 0.0 ? 1 : 0;
+    vec4 rect = texelFetch(lightmapFaces, ivec2(axis * 2 + side, lightmapSlot), 0);
+    vec2 texel = rect.xy + 0.5 + vec2(localPos[u], localPos[v]) * (rect.zw - 1.0);
+    return texture(lightmap, texel / vec2(textureSize(lightmap, 0))).rgb;
+}
+
+vec3 pointLight(int index, vec3 n)
+{
+    vec4 positionRadius = texelFetch(pointLights, index * 2);
+    vec3 toLight = positionRadius.xyz - worldPos;
+    float d2 = dot(toLight, toLight);
+    float r2 = positionRadius.w * positionRadius.w;
+    // inverse square, faded to zero at the radius
+    float fade = clamp(1.0 - (d2 * d2) / (r2 * r2), 0.0, 1.0);
+    float cosine = max(dot(n, toLight * inversesqrt(max(d2, 1e-8))), 0.0);
+    return texelFetch(pointLights, index * 2 + 1).rgb * (cosine * fade * fade / (d2 + 1.0));
+}
+
+vec3 pointLightSum()
+{
+    vec3 n = faceNormal();
+    vec3 sum = vec3(0.0);
+    if (pointLighting == 2)
+    {
+        for (int i = 0; i < pointLightCount; i++)
+            sum += pointLight(i, n);
+        return sum;
+    }
+    vec4 eye = view * vec4(worldPos, 1.0);
+    vec4 clip = projection * eye;
+    ivec2 tile = clamp(ivec2((clip.xy / clip.w * 0.5 + 0.5) * vec2(CLUSTERS.xy)), ivec2(0), CLUSTERS.xy - 1);
+    int slice = clamp(int(floor(log(max(-eye.z, 1e-4)) * clusterDepth.x + clusterDepth.y)), 0, CLUSTERS.z - 1);
+    uvec2 range = texelFetch(lightClusters, (slice * CLUSTERS.y + tile.y) * CLUSTERS.x + tile.x).xy;
+    for (uint i = 0u; i < range.y; i++)
+        sum += pointLight(int(texelFetch(lightIndices, int(range.x + i)).r), n);
+    return sum;
+}
+
 void main()
 {
-    FragColor = color;
+    vec4 base = color;
+    if (textured)
+    {
+        vec3 n = abs(cross(dFdx(worldPos), dFdy(worldPos)));
+        vec2 uv;
+        if (n.y >= n.x && n.y >= n.z)
+            uv = worldPos.xz;
+        else if (n.x >= n.z)
+            uv = worldPos.zy;
+        else
+            uv = worldPos.xy;
+        base *= texture(albedo, uv * textureRepeat);
+    }
+    if (lighting != 0 || pointLighting != 0)
+    {
+        vec3 light = lighting != 0 ? bakedLight() : ambientLight;
+        if (pointLighting != 0)
+            light += pointLightSum();
+        base.rgb *= light;
+    }
+    FragColor = base;
 }
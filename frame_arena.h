@@ -0,0 +1,213 @@
+#pragma once
+//
+//  frame_arena.h
+//  3D Object Drawing
+//
+//  Frame-scoped linear allocator and STL allocator adapters.
+//
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// Number of heap allocations observed: every operator new when the program is built
+// with COUNT_FRAME_ALLOCATIONS (see main.cpp), plus the arena's own block allocations.
+inline std::atomic<unsigned long long>& heapAllocationCounter()
+{
+    static std::atomic<unsigned long long> counter(0);
+    return counter;
+}
+
+// Bump allocator for everything that only lives for one frame: draw lists, culling
+// lists, sort keys, temporary strings. Allocation is a pointer increment, deallocation
+// is a no-op and reset() releases everything at once at the top of the render loop.
+//
+// If a frame needs more than the current capacity the extra requests are served from
+// overflow blocks on the heap, and the next reset() grows the main block to the
+// high-water mark so the steady-state frame does not touch malloc at all.
+class FrameArena
+{
+public:
+    struct Stats
+    {
+        size_t capacity = 0;        // size of the main block
+        size_t used = 0;            // bytes handed out this frame (including overflow)
+        size_t highWater = 0;       // largest 'used' seen over all frames
+        size_t overflowBytes = 0;   // bytes served from overflow blocks this frame
+        unsigned int overflowFrames = 0;
+        unsigned int grows = 0;
+        unsigned long long frames = 0;
+    };
+
+    explicit FrameArena(size_t capacity = 1 << 20)
+    {
+        allocateBlock(capacity);
+    }
+
+    ~FrameArena()
+    {
+        releaseOverflow();
+        std::free(base);
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // returns 'size' bytes aligned to 'alignment' (power of two) that stay valid until the next reset()
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        uintptr_t current = reinterpret_cast<uintptr_t>(base) + offset;
+        uintptr_t aligned = (current + (alignment - 1)) & ~static_cast<uintptr_t>(alignment - 1);
+        size_t newOffset = static_cast<size_t>(aligned - reinterpret_cast<uintptr_t>(base)) + size;
+        if (newOffset <= stats.capacity)
+        {
+            stats.used += newOffset - offset;
+            offset = newOffset;
+            return reinterpret_cast<void*>(aligned);
+        }
+        return allocateOverflow(size, alignment);
+    }
+
+    template <typename T>
+    T* allocateArray(size_t count)
+    {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // copies a string into the arena; the returned pointer is valid until the next reset()
+    const char* copyString(const char* text, size_t length)
+    {
+        char* copy = allocateArray<char>(length + 1);
+        for (size_t i = 0; i < length; i++)
+            copy[i] = text[i];
+        copy[length] = '\0';
+        return copy;
+    }
+
+    // frees all allocations of the previous frame; call once at the start of each loop iteration
+    void reset()
+    {
+        if (stats.used > stats.highWater)
+            stats.highWater = stats.used;
+        if (!overflow.empty())
+        {
+            releaseOverflow();
+            stats.overflowFrames++;
+            // grow once to the high-water mark plus some headroom so the next frame fits
+            allocateBlock(stats.highWater + stats.highWater / 2);
+            stats.grows++;
+        }
+        offset = 0;
+        stats.used = 0;
+        stats.overflowBytes = 0;
+        stats.frames++;
+    }
+
+    const Stats& getStats() const
+    {
+        return stats;
+    }
+
+    void printStats(std::ostream& out) const
+    {
+        out << "frame arena: capacity " << stats.capacity / 1024 << " KB"
+            << ", high-water " << stats.highWater / 1024.0 << " KB"
+            << ", frames " << stats.frames
+            << ", overflow frames " << stats.overflowFrames
+            << ", grows " << stats.grows << std::endl;
+    }
+
+private:
+    char* base = nullptr;
+    size_t offset = 0;
+    std::vector<void*> overflow;
+    Stats stats;
+
+    // replaces the block; if malloc fails the old one is kept and bad_alloc is thrown
+    void allocateBlock(size_t capacity)
+    {
+        char* block = static_cast<char*>(std::malloc(capacity));
+        heapAllocationCounter().fetch_add(1, std::memory_order_relaxed);
+        if (block == nullptr)
+            throw std::bad_alloc();
+        std::free(base);
+        base = block;
+        stats.capacity = capacity;
+    }
+
+    void* allocateOverflow(size_t size, size_t alignment)
+    {
+        // over-allocate so the block can be aligned by hand
+        void* block = std::malloc(size + alignment);
+        heapAllocationCounter().fetch_add(1, std::memory_order_relaxed);
+        if (block == nullptr)
+            throw std::bad_alloc();
+        overflow.push_back(block);
+        stats.used += size + alignment;
+        stats.overflowBytes += size + alignment;
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(block) + (alignment - 1)) & ~static_cast<uintptr_t>(alignment - 1);
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    void releaseOverflow()
+    {
+        for (void* block : overflow)
+            std::free(block);
+        overflow.clear();
+    }
+};
+
+// STL allocator adapter so standard containers can live in a FrameArena. Containers
+// using it must not outlive the frame they were created in.
+template <typename T>
+class FrameAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit FrameAllocator(FrameArena& arena) : arena(&arena) {}
+
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t)
+    {
+        // memory is reclaimed in bulk by FrameArena::reset()
+    }
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>& other) const
+    {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>& other) const
+    {
+        return arena != other.arena;
+    }
+
+private:
+    template <typename U> friend class FrameAllocator;
+    FrameArena* arena;
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T> >;
+
+typedef std::basic_string<char, std::char_traits<char>, FrameAllocator<char> > FrameString;
+
+#endif
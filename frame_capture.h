@@ -0,0 +1,339 @@
+#pragma once
+//
+//  frame_capture.h
+//  3D Object Drawing
+//
+//  Records the window to disk without stalling the render loop: each frame is read
+//  into one of a ring of pixel buffer objects, mapped a few frames later when the copy
+//  has finished, and converted and written by a separate thread.
+//
+
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include "gl_resources.h"
+#include "trace_events.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum CaptureFormat {
+    CAPTURE_Y4M,   // one raw 4:4:4 video stream, e.g. for ffmpeg -i walk.y4m
+    CAPTURE_PPM    // one binary PPM per frame: <path>_00000.ppm, <path>_00001.ppm, ...
+};
+
+// Writes GL-ordered (bottom row first) RGBA pixels as a binary PPM; 'scratch' holds the
+// converted rows between calls. Returns the pixel bytes written, 0 on failure.
+inline size_t writePpm(const std::string& path, const uint8_t* rgba, int width, int height, std::vector<uint8_t>& scratch)
+{
+    scratch.resize((size_t)width * height * 3);
+    uint8_t* out = scratch.data();
+    for (int y = height - 1; y >= 0; y--)
+    {
+        const uint8_t* p = rgba + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++, p += 4, out += 3)
+        {
+            out[0] = p[0];
+            out[1] = p[1];
+            out[2] = p[2];
+        }
+    }
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return 0;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(scratch.data()), scratch.size());
+    return file ? scratch.size() : 0;
+}
+
+struct FrameCaptureStats
+{
+    unsigned long long frames = 0;     // handed to the writer
+    unsigned long long dropped = 0;    // writer behind or window resized mid-recording
+    unsigned long long written = 0;    // on disk
+    double overheadMs = 0.0;           // render thread time spent in capture(), summed
+    double worstOverheadMs = 0.0;
+    double frameMs = 0.0;              // frame times passed to capture(), summed
+    double writeMs = 0.0;              // writer thread time, summed
+    unsigned long long bytesWritten = 0;
+};
+
+class FrameCapture
+{
+public:
+    FrameCaptureStats stats;
+
+    FrameCapture() {}
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    ~FrameCapture()
+    {
+        stop();
+    }
+
+    bool active() const
+    {
+        return running;
+    }
+
+    // 'width' x 'height' is the framebuffer size; frames of any other size are dropped
+    bool start(const std::string& path, CaptureFormat format, int width, int height, int fps)
+    {
+        stop();
+        this->path = path;
+        this->format = format;
+        this->width = width;
+        this->height = height;
+        if (format == CAPTURE_Y4M)
+        {
+            stream.open(path, std::ios::binary);
+            if (!stream)
+            {
+                std::cout << "capture: cannot open " << path << std::endl;
+                return false;
+            }
+            stream << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C444\n";
+        }
+
+        size_t bytes = (size_t)width * height * 4;
+        for (int i = 0; i < RING_SIZE; i++)
+        {
+            ring[i].create(GPU_STAGING_BUFFER, "frame capture PBO");
+            ring[i].data(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+            inFlight[i] = false;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        freeFrames.clear();
+        for (int i = 0; i < POOL_SIZE; i++)
+            freeFrames.push_back(std::vector<uint8_t>(bytes));
+        nextSlot = 0;
+        stats = FrameCaptureStats();
+        quit = false;
+        running = true;
+        writer = std::thread(&FrameCapture::writerLoop, this);
+        return true;
+    }
+
+    // Call after the frame is complete in the default framebuffer, before the swap.
+    // 'frameMs' is the frame's time, used only for the overhead report.
+    void capture(double frameMs)
+    {
+        if (!running)
+            return;
+        auto begin = std::chrono::steady_clock::now();
+
+        // the slot about to be reused was read RING_SIZE - 1 frames ago and is done by now
+        if (inFlight[nextSlot])
+            collect(nextSlot);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        if (viewport[2] == width && viewport[3] == height)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            ring[nextSlot].bind(GL_PIXEL_PACK_BUFFER);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);   // into the PBO, returns at once
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            inFlight[nextSlot] = true;
+            nextSlot = (nextSlot + 1) % RING_SIZE;
+        }
+        else
+            stats.dropped++;
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        stats.overheadMs += ms;
+        stats.worstOverheadMs = ms > stats.worstOverheadMs ? ms : stats.worstOverheadMs;
+        stats.frameMs += frameMs;
+    }
+
+    // drains the ring and the writer, then closes the output
+    void stop()
+    {
+        if (!running)
+            return;
+        for (int i = 0; i < RING_SIZE; i++)
+        {
+            int slot = (nextSlot + i) % RING_SIZE;
+            if (inFlight[slot])
+                collect(slot);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        writer.join();
+        running = false;
+        if (stream.is_open())
+            stream.close();
+        for (int i = 0; i < RING_SIZE; i++)
+            ring[i].reset();
+        report(std::cout);
+    }
+
+    void report(std::ostream& out) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        unsigned long long captured = stats.frames + stats.dropped;
+        out << "capture: " << stats.written << " frames written to " << path << ", " << stats.dropped << " dropped";
+        if (captured > 0)
+        {
+            double average = stats.overheadMs / captured;
+            out << ", overhead " << average << " ms/frame (worst " << stats.worstOverheadMs << " ms, "
+                << (stats.frameMs > 0.0 ? 100.0 * stats.overheadMs / stats.frameMs : 0.0) << "% of frame time)";
+        }
+        if (stats.writeMs > 0.0)
+            out << ", writer " << stats.bytesWritten / (1024.0 * 1024.0) / (stats.writeMs / 1000.0) << " MB/s";
+        out << std::endl;
+    }
+
+private:
+    static const int RING_SIZE = 3;    // frames between a read and the map of its PBO
+    static const int POOL_SIZE = 8;    // frames the writer may fall behind before frames are dropped
+
+    GlBuffer ring[RING_SIZE];
+    bool inFlight[RING_SIZE] = {};
+    int nextSlot = 0;
+
+    std::string path;
+    CaptureFormat format = CAPTURE_Y4M;
+    int width = 0;
+    int height = 0;
+    std::ofstream stream;
+    bool running = false;
+
+    // frames travel render thread -> 'queued' -> writer -> 'freeFrames' -> render thread
+    std::thread writer;
+    mutable std::mutex mutex;   // guards the queues and the writer's stats
+    std::condition_variable wake;
+    std::deque<std::vector<uint8_t>> queued;
+    std::vector<std::vector<uint8_t>> freeFrames;
+    bool quit = false;
+
+    // maps a finished PBO and passes a copy of its pixels to the writer
+    void collect(int slot)
+    {
+        inFlight[slot] = false;
+        std::vector<uint8_t> frame;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (freeFrames.empty())
+            {
+                stats.dropped++;
+                return;
+            }
+            frame.swap(freeFrames.back());
+            freeFrames.pop_back();
+        }
+
+        ring[slot].bind(GL_PIXEL_PACK_BUFFER);
+        const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame.size(), GL_MAP_READ_BIT);
+        if (pixels)
+        {
+            std::memcpy(frame.data(), pixels, frame.size());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pixels)
+            {
+                queued.push_back(std::move(frame));
+                stats.frames++;
+            }
+            else
+            {
+                freeFrames.push_back(std::move(frame));
+                stats.dropped++;
+            }
+        }
+        wake.notify_one();
+    }
+
+    void writerLoop()
+    {
+        tracer().nameThread("capture writer");
+        std::vector<uint8_t> converted;
+        unsigned long long index = 0;
+        for (;;)
+        {
+            std::vector<uint8_t> frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !queued.empty(); });
+                if (queued.empty())
+                    return;
+                frame.swap(queued.front());
+                queued.pop_front();
+            }
+
+            TRACE_ZONE_NAMED(zone, "capture write");
+            auto begin = std::chrono::steady_clock::now();
+            size_t bytes = format == CAPTURE_Y4M ? writeY4mFrame(frame, converted) : writePpmFrame(frame, converted, index);
+            index++;
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            TRACE_ZONE_END(zone);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            freeFrames.push_back(std::move(frame));
+            stats.writeMs += ms;
+            stats.bytesWritten += bytes;
+            stats.written++;
+        }
+    }
+
+    // GL rows run bottom to top; both formats want them top to bottom
+    const uint8_t* row(const std::vector<uint8_t>& rgba, int y) const
+    {
+        return rgba.data() + (size_t)(height - 1 - y) * width * 4;
+    }
+
+    // BT.601 studio range, one full-resolution plane each for Y, Cb and Cr
+    size_t writeY4mFrame(const std::vector<uint8_t>& rgba, std::vector<uint8_t>& planes)
+    {
+        size_t plane = (size_t)width * height;
+        planes.resize(plane * 3);
+        uint8_t* yPlane = planes.data();
+        uint8_t* cbPlane = yPlane + plane;
+        uint8_t* crPlane = cbPlane + plane;
+        for (int y = 0; y < height; y++)
+        {
+            const uint8_t* p = row(rgba, y);
+            for (int x = 0; x < width; x++, p += 4)
+            {
+                int r = p[0], g = p[1], b = p[2];
+                size_t i = (size_t)y * width + x;
+                yPlane[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                cbPlane[i] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                crPlane[i] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            }
+        }
+        stream.write("FRAME\n", 6);
+        stream.write(reinterpret_cast<const char*>(planes.data()), planes.size());
+        return planes.size() + 6;
+    }
+
+    size_t writePpmFrame(const std::vector<uint8_t>& rgba, std::vector<uint8_t>& rgb, unsigned long long index)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "_%05llu.ppm", index);
+        return writePpm(path + name, rgba.data(), width, height, rgb);
+    }
+};
+
+#endif
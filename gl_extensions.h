@@ -0,0 +1,129 @@
+#pragma once
+//
+//  gl_extensions.h
+//  3D Object Drawing
+//
+//  Entry points and enums newer than the GL 3.3 core profile glad is generated for.
+//  They are looked up at runtime, so the program still starts on a 3.3 context and
+//  only the features that need them are switched off.
+//
+
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_ATOMIC_COUNTER_BUFFER
+#define GL_ATOMIC_COUNTER_BUFFER 0x92C0
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_PARAMETER_BUFFER
+#define GL_PARAMETER_BUFFER 0x80EE
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_ATOMIC_COUNTER_BARRIER_BIT
+#define GL_ATOMIC_COUNTER_BARRIER_BIT 0x00001000
+#endif
+
+#ifndef APIENTRYP
+#define APIENTRYP APIENTRY *
+#endif
+
+typedef void (APIENTRYP GlViewportIndexedfProc)(GLuint index, GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+typedef void (APIENTRYP GlDispatchComputeProc)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+typedef void (APIENTRYP GlMemoryBarrierProc)(GLbitfield barriers);
+typedef void (APIENTRYP GlMultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect,
+                                                         GLsizei drawCount, GLsizei stride);
+typedef void (APIENTRYP GlMultiDrawElementsIndirectCountProc)(GLenum mode, GLenum type, const void* indirect,
+                                                              GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+
+struct GlExtensions
+{
+    int major = 0;
+    int minor = 0;
+
+    // GL 4.1: several viewports, chosen per primitive with gl_ViewportIndex in a geometry
+    // shader; with ARB_shader_viewport_layer_array the vertex shader can choose too
+    bool viewportArray = false;
+    bool vertexViewportIndex = false;
+    GlViewportIndexedfProc viewportIndexedf = nullptr;
+
+    // GL 4.3: compute shaders, storage buffers, multi-draw indirect
+    bool compute = false;
+    GlDispatchComputeProc dispatchCompute = nullptr;
+    GlMemoryBarrierProc memoryBarrier = nullptr;
+    GlMultiDrawElementsIndirectProc multiDrawElementsIndirect = nullptr;
+
+    // GL 4.6 or ARB_indirect_parameters: draw count read from a buffer
+    bool indirectCount = false;
+    GlMultiDrawElementsIndirectCountProc multiDrawElementsIndirectCount = nullptr;
+
+    bool atLeast(int wantMajor, int wantMinor) const
+    {
+        return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+    }
+
+    static bool hasExtension(const char* extension)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && std::strcmp(name, extension) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // call once after the context is current and glad is loaded
+    void load(GLADloadproc getProcAddress)
+    {
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+        if (atLeast(4, 1))
+        {
+            viewportIndexedf = reinterpret_cast<GlViewportIndexedfProc>(getProcAddress("glViewportIndexedf"));
+            viewportArray = viewportIndexedf != nullptr;
+            vertexViewportIndex = viewportArray && hasExtension("GL_ARB_shader_viewport_layer_array");
+        }
+
+        if (atLeast(4, 3))
+        {
+            dispatchCompute = reinterpret_cast<GlDispatchComputeProc>(getProcAddress("glDispatchCompute"));
+            memoryBarrier = reinterpret_cast<GlMemoryBarrierProc>(getProcAddress("glMemoryBarrier"));
+            multiDrawElementsIndirect = reinterpret_cast<GlMultiDrawElementsIndirectProc>(getProcAddress("glMultiDrawElementsIndirect"));
+            compute = dispatchCompute && memoryBarrier && multiDrawElementsIndirect;
+        }
+
+        if (atLeast(4, 6))
+            multiDrawElementsIndirectCount = reinterpret_cast<GlMultiDrawElementsIndirectCountProc>(getProcAddress("glMultiDrawElementsIndirectCount"));
+        else if (compute && hasExtension("GL_ARB_indirect_parameters"))
+            multiDrawElementsIndirectCount = reinterpret_cast<GlMultiDrawElementsIndirectCountProc>(getProcAddress("glMultiDrawElementsIndirectCountARB"));
+        indirectCount = compute && multiDrawElementsIndirectCount;
+    }
+};
+
+inline GlExtensions& glExtensions()
+{
+    static GlExtensions extensions;
+    return extensions;
+}
+
+#endif
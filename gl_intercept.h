@@ -0,0 +1,617 @@
+#pragma once
+//
+//  gl_intercept.h
+//  3D Object Drawing
+//
+//  Counts GL calls by swapping glad's function pointers (and the GL 4.x ones in
+//  glExtensions()) for wrappers that count, check for redundancy and call on. A call is
+//  redundant when it sets state to what it already is: binding the bound VAO, enabling an
+//  enabled capability, or setting a uniform to its current value. Nothing is wrapped until
+//  install() and uninstall() restores the original pointers, so it costs nothing when off.
+//  Calls are counted for the render thread only; batch rendering does not install it.
+//
+
+#ifndef GL_INTERCEPT_H
+#define GL_INTERCEPT_H
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+
+// every entry point the program calls; X(name) for glad's glName
+#define GL_INTERCEPTED_CALLS(X) \
+    X(ActiveTexture) X(AttachShader) X(BeginQuery) X(BindBuffer) X(BindBufferBase) X(BindFramebuffer) \
+    X(BindRenderbuffer) X(BindTexture) X(BindVertexArray) X(BlitFramebuffer) X(BufferData) X(BufferSubData) \
+    X(CheckFramebufferStatus) X(Clear) X(ClearColor) X(ClearStencil) X(ClientWaitSync) X(ColorMask) \
+    X(CompileShader) X(CreateProgram) X(CreateShader) X(DeleteBuffers) X(DeleteFramebuffers) X(DeleteProgram) \
+    X(DeleteQueries) X(DeleteRenderbuffers) X(DeleteShader) X(DeleteSync) X(DeleteTextures) X(DeleteVertexArrays) \
+    X(DepthFunc) X(DepthMask) X(Disable) X(DrawElements) X(DrawElementsInstanced) X(Enable) \
+    X(EnableVertexAttribArray) X(EndQuery) X(FenceSync) X(Finish) X(FramebufferRenderbuffer) X(GenBuffers) \
+    X(GenFramebuffers) X(GenQueries) X(GenRenderbuffers) X(GenTextures) X(GenVertexArrays) X(GetBufferSubData) \
+    X(GetInteger64v) X(GetIntegerv) X(GetProgramInfoLog) X(GetProgramiv) X(GetQueryObjectiv) X(GetQueryObjectui64v) \
+    X(GetShaderInfoLog) X(GetShaderiv) X(GetStringi) X(GetUniformLocation) X(LinkProgram) X(MapBufferRange) \
+    X(PixelStorei) X(PolygonMode) X(QueryCounter) X(ReadPixels) X(RenderbufferStorage) X(ShaderSource) X(StencilFunc) \
+    X(StencilMask) X(StencilOp) X(TexImage2D) X(TexParameteri) X(TexSubImage2D) X(Uniform1f) X(Uniform1i) \
+    X(Uniform2f) X(Uniform2fv) X(Uniform3f) X(Uniform3fv) X(Uniform4f) X(Uniform4fv) X(UniformMatrix2fv) \
+    X(UniformMatrix3fv) X(UniformMatrix4fv) X(UnmapBuffer) X(UseProgram) X(VertexAttribDivisor) \
+    X(VertexAttribIPointer) X(VertexAttribPointer) X(Viewport)
+
+// the GlExtensions members; X(name, member)
+#define GL_INTERCEPTED_EXTENSIONS(X) \
+    X(ViewportIndexedf, viewportIndexedf) X(DispatchCompute, dispatchCompute) X(MemoryBarrier, memoryBarrier) \
+    X(MultiDrawElementsIndirect, multiDrawElementsIndirect) \
+    X(MultiDrawElementsIndirectCount, multiDrawElementsIndirectCount)
+
+enum GlCallId {
+#define GL_CALL_ID(name) GL_CALL_##name,
+#define GL_EXTENSION_CALL_ID(name, member) GL_CALL_##name,
+    GL_INTERCEPTED_CALLS(GL_CALL_ID)
+    GL_INTERCEPTED_EXTENSIONS(GL_EXTENSION_CALL_ID)
+#undef GL_CALL_ID
+#undef GL_EXTENSION_CALL_ID
+    GL_CALL_COUNT
+};
+
+inline const char* glCallName(int id)
+{
+    static const char* const names[GL_CALL_COUNT] = {
+#define GL_CALL_NAME(name) "gl" #name,
+#define GL_EXTENSION_CALL_NAME(name, member) "gl" #name,
+        GL_INTERCEPTED_CALLS(GL_CALL_NAME)
+        GL_INTERCEPTED_EXTENSIONS(GL_EXTENSION_CALL_NAME)
+#undef GL_CALL_NAME
+#undef GL_EXTENSION_CALL_NAME
+    };
+    return names[id];
+}
+
+struct GlCallCounts
+{
+    unsigned long long calls[GL_CALL_COUNT] = {};
+    unsigned long long redundant[GL_CALL_COUNT] = {};
+};
+
+// What the wrapped calls have set, to recognize a call that changes nothing. Everything
+// starts unknown, since calls made while the wrappers were not installed were not seen.
+struct GlShadowState
+{
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+    static const int TEXTURE_UNITS = 32;
+    static const int SLOTS = 16;
+
+    struct Slot
+    {
+        GLenum key;
+        GLuint value;
+    };
+
+    GLuint program = UNKNOWN;
+    GLuint vertexArray = UNKNOWN;
+    GLuint elementBuffer = UNKNOWN;     // belongs to the VAO: forgotten when it changes
+    GLuint drawFramebuffer = UNKNOWN;
+    GLuint readFramebuffer = UNKNOWN;
+    GLuint renderbuffer = UNKNOWN;
+    GLuint activeTexture = UNKNOWN;
+    GLuint textures2D[TEXTURE_UNITS];
+    GLuint depthMask = UNKNOWN;
+    GLuint depthFunc = UNKNOWN;
+    GLuint colorMask = UNKNOWN;
+    GLuint stencilMask = UNKNOWN;
+    GLuint polygonMode = UNKNOWN;
+    GLfloat clearColor[4];
+    bool clearColorKnown = false;
+    GLint viewport[4];
+    bool viewportKnown = false;
+    Slot buffers[SLOTS];                // by target, GL_ELEMENT_ARRAY_BUFFER aside
+    Slot capabilities[SLOTS];           // glEnable / glDisable
+    Slot pixelStore[SLOTS];
+
+    // uniform values by program << 32 | location, up to a 4x4 matrix
+    struct Uniform
+    {
+        unsigned int bytes;
+        unsigned char data[64];
+    };
+    std::unordered_map<uint64_t, Uniform> uniforms;
+
+    GlShadowState()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        *this = GlShadowState(0);
+    }
+
+    // true if 'field' already held 'value'; it holds it afterwards either way
+    static bool same(GLuint& field, GLuint value)
+    {
+        bool redundant = field == value;
+        field = value;
+        return redundant;
+    }
+
+    static bool same(Slot* slots, GLenum key, GLuint value)
+    {
+        for (int i = 0; i < SLOTS; i++)
+        {
+            if (slots[i].key == key)
+                return same(slots[i].value, value);
+            if (slots[i].key == 0)
+            {
+                slots[i].key = key;
+                slots[i].value = value;
+                return false;
+            }
+        }
+        return false;
+    }
+
+    static void forget(Slot* slots, GLuint value)
+    {
+        for (int i = 0; i < SLOTS; i++)
+            if (slots[i].key != 0 && slots[i].value == value)
+                slots[i].value = 0;
+    }
+
+    bool sameUniform(GLint location, const void* data, size_t bytes)
+    {
+        if (location < 0)
+            return true;                // no such uniform: the call does nothing
+        if (program == UNKNOWN || bytes > sizeof(Uniform::data))
+            return false;
+        Uniform& uniform = uniforms[(uint64_t)program << 32 | (uint32_t)location];
+        bool redundant = uniform.bytes == bytes && std::memcmp(uniform.data, data, bytes) == 0;
+        uniform.bytes = static_cast<unsigned int>(bytes);
+        std::memcpy(uniform.data, data, bytes);
+        return redundant;
+    }
+
+    void forgetProgram(GLuint id)
+    {
+        for (auto it = uniforms.begin(); it != uniforms.end();)
+            it = (it->first >> 32) == id ? uniforms.erase(it) : std::next(it);
+    }
+
+private:
+    explicit GlShadowState(int)
+    {
+        std::fill(textures2D, textures2D + TEXTURE_UNITS, GLuint(UNKNOWN));
+        std::fill(clearColor, clearColor + 4, 0.0f);
+        std::fill(viewport, viewport + 4, 0);
+        std::memset(buffers, 0, sizeof(buffers));
+        std::memset(capabilities, 0, sizeof(capabilities));
+        std::memset(pixelStore, 0, sizeof(pixelStore));
+    }
+};
+
+class GlCallStats
+{
+public:
+    GlCallCounts frame;          // since beginFrame()
+    GlCallCounts lastFrame;
+    GlCallCounts total;          // every finished frame since install()
+    unsigned long long frames = 0;
+    GlShadowState shadow;
+
+    bool installed() const { return active; }
+
+    void install();
+    void uninstall();
+
+    void count(int id, bool redundant)
+    {
+        frame.calls[id]++;
+        frame.redundant[id] += redundant;
+    }
+
+    // closes the frame that is being counted
+    void beginFrame()
+    {
+        if (!active)
+            return;
+        lastFrame = frame;
+        for (int i = 0; i < GL_CALL_COUNT; i++)
+        {
+            total.calls[i] += frame.calls[i];
+            total.redundant[i] += frame.redundant[i];
+        }
+        frames++;
+        frame = GlCallCounts();
+    }
+
+    // one line for the last frame, with the calls wasted most
+    void reportFrame(std::ostream& out) const
+    {
+        unsigned long long calls = 0, redundant = 0, draws = 0, uniforms = 0, binds = 0;
+        for (int i = 0; i < GL_CALL_COUNT; i++)
+        {
+            calls += lastFrame.calls[i];
+            redundant += lastFrame.redundant[i];
+            const char* name = glCallName(i);
+            if (std::strncmp(name, "glDraw", 6) == 0 || std::strncmp(name, "glMultiDraw", 11) == 0 ||
+                std::strcmp(name, "glDispatchCompute") == 0)
+                draws += lastFrame.calls[i];
+            else if (std::strncmp(name, "glUniform", 9) == 0)
+                uniforms += lastFrame.calls[i];
+            else if (std::strncmp(name, "glBind", 6) == 0 || i == GL_CALL_UseProgram || i == GL_CALL_ActiveTexture)
+                binds += lastFrame.calls[i];
+        }
+        out << "GL calls: " << calls << " last frame (" << draws << " draws, " << uniforms << " uniforms, " << binds
+            << " binds), " << redundant << " redundant";
+        int order[GL_CALL_COUNT];
+        int count = rank(lastFrame.redundant, order, 3);
+        for (int i = 0; i < count; i++)
+            out << (i == 0 ? ": " : ", ") << glCallName(order[i]) << " " << lastFrame.redundant[order[i]];
+        out << std::endl;
+    }
+
+    // the 'n' entry points called most per frame since install()
+    void reportTop(std::ostream& out, int n) const
+    {
+        if (frames == 0)
+            return;
+        int order[GL_CALL_COUNT];
+        int count = rank(total.calls, order, n);
+        out << "GL calls over " << frames << " frames, most frequent first:" << std::endl;
+        for (int i = 0; i < count; i++)
+        {
+            int id = order[i];
+            out << "  " << std::left << std::setw(34) << glCallName(id) << std::right << std::setw(10)
+                << std::fixed << std::setprecision(1) << (double)total.calls[id] / frames << " per frame, "
+                << std::setprecision(0) << 100.0 * total.redundant[id] / total.calls[id] << "% redundant" << std::endl;
+            out.unsetf(std::ios::fixed);
+            out << std::setprecision(6);
+        }
+    }
+
+private:
+    bool active = false;
+
+    // ids of the 'n' largest non-zero values, largest first
+    static int rank(const unsigned long long* values, int* order, int n)
+    {
+        int count = 0;
+        for (int i = 0; i < GL_CALL_COUNT; i++)
+            if (values[i])
+                order[count++] = i;
+        std::sort(order, order + count, [values](int a, int b) { return values[a] > values[b]; });
+        return std::min(count, n);
+    }
+};
+
+inline GlCallStats& glCallStats()
+{
+    static GlCallStats stats;
+    return stats;
+}
+
+// Redundancy checks by entry point; the template catches every call that has none.
+template <int Id>
+struct GlCallTag {};
+
+template <int Id, typename... Args>
+inline bool redundantGlCall(GlCallTag<Id>, Args...)
+{
+    return false;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_UseProgram>, GLuint program)
+{
+    return GlShadowState::same(glCallStats().shadow.program, program);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_BindVertexArray>, GLuint array)
+{
+    GlShadowState& s = glCallStats().shadow;
+    if (GlShadowState::same(s.vertexArray, array))
+        return true;
+    s.elementBuffer = GlShadowState::UNKNOWN;
+    return false;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_BindBuffer>, GLenum target, GLuint buffer)
+{
+    GlShadowState& s = glCallStats().shadow;
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+        return s.vertexArray != GlShadowState::UNKNOWN && GlShadowState::same(s.elementBuffer, buffer);
+    return GlShadowState::same(s.buffers, target, buffer);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_BindBufferBase>, GLenum target, GLuint, GLuint buffer)
+{
+    // binds the indexed point and the generic one; only the generic one is tracked
+    GlShadowState::same(glCallStats().shadow.buffers, target, buffer);
+    return false;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_ActiveTexture>, GLenum unit)
+{
+    return GlShadowState::same(glCallStats().shadow.activeTexture, unit);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_BindTexture>, GLenum target, GLuint texture)
+{
+    GlShadowState& s = glCallStats().shadow;
+    GLuint unit = s.activeTexture - GL_TEXTURE0;
+    if (target != GL_TEXTURE_2D || s.activeTexture == GlShadowState::UNKNOWN || unit >= GlShadowState::TEXTURE_UNITS)
+        return false;
+    return GlShadowState::same(s.textures2D[unit], texture);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_BindFramebuffer>, GLenum target, GLuint framebuffer)
+{
+    GlShadowState& s = glCallStats().shadow;
+    if (target == GL_DRAW_FRAMEBUFFER)
+        return GlShadowState::same(s.drawFramebuffer, framebuffer);
+    if (target == GL_READ_FRAMEBUFFER)
+        return GlShadowState::same(s.readFramebuffer, framebuffer);
+    bool redundant = s.drawFramebuffer == framebuffer && s.readFramebuffer == framebuffer;
+    s.drawFramebuffer = s.readFramebuffer = framebuffer;
+    return redundant;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_BindRenderbuffer>, GLenum, GLuint renderbuffer)
+{
+    return GlShadowState::same(glCallStats().shadow.renderbuffer, renderbuffer);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Enable>, GLenum capability)
+{
+    return GlShadowState::same(glCallStats().shadow.capabilities, capability, GL_TRUE);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Disable>, GLenum capability)
+{
+    return GlShadowState::same(glCallStats().shadow.capabilities, capability, GL_FALSE);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_DepthMask>, GLboolean flag)
+{
+    return GlShadowState::same(glCallStats().shadow.depthMask, flag);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_DepthFunc>, GLenum func)
+{
+    return GlShadowState::same(glCallStats().shadow.depthFunc, func);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_ColorMask>, GLboolean r, GLboolean g, GLboolean b, GLboolean a)
+{
+    return GlShadowState::same(glCallStats().shadow.colorMask, (r ? 1u : 0u) | (g ? 2u : 0u) | (b ? 4u : 0u) | (a ? 8u : 0u));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_StencilMask>, GLuint mask)
+{
+    return GlShadowState::same(glCallStats().shadow.stencilMask, mask);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_PolygonMode>, GLenum, GLenum mode)
+{
+    return GlShadowState::same(glCallStats().shadow.polygonMode, mode);
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_PixelStorei>, GLenum name, GLint value)
+{
+    return GlShadowState::same(glCallStats().shadow.pixelStore, name, static_cast<GLuint>(value));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_ClearColor>, GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+    GlShadowState& s = glCallStats().shadow;
+    const GLfloat color[4] = { r, g, b, a };
+    bool redundant = s.clearColorKnown && std::equal(color, color + 4, s.clearColor);
+    std::copy(color, color + 4, s.clearColor);
+    s.clearColorKnown = true;
+    return redundant;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Viewport>, GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    GlShadowState& s = glCallStats().shadow;
+    const GLint rect[4] = { x, y, width, height };
+    bool redundant = s.viewportKnown && std::equal(rect, rect + 4, s.viewport);
+    std::copy(rect, rect + 4, s.viewport);
+    s.viewportKnown = true;
+    return redundant;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Uniform1i>, GLint location, GLint v0)
+{
+    return glCallStats().shadow.sameUniform(location, &v0, sizeof(v0));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Uniform1f>, GLint location, GLfloat v0)
+{
+    return glCallStats().shadow.sameUniform(location, &v0, sizeof(v0));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Uniform2f>, GLint location, GLfloat v0, GLfloat v1)
+{
+    const GLfloat v[2] = { v0, v1 };
+    return glCallStats().shadow.sameUniform(location, v, sizeof(v));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Uniform3f>, GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+    const GLfloat v[3] = { v0, v1, v2 };
+    return glCallStats().shadow.sameUniform(location, v, sizeof(v));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Uniform4f>, GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+{
+    const GLfloat v[4] = { v0, v1, v2, v3 };
+    return glCallStats().shadow.sameUniform(location, v, sizeof(v));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Uniform2fv>, GLint location, GLsizei count, const GLfloat* value)
+{
+    return glCallStats().shadow.sameUniform(location, value, count * 2 * sizeof(GLfloat));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Uniform3fv>, GLint location, GLsizei count, const GLfloat* value)
+{
+    return glCallStats().shadow.sameUniform(location, value, count * 3 * sizeof(GLfloat));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_Uniform4fv>, GLint location, GLsizei count, const GLfloat* value)
+{
+    return glCallStats().shadow.sameUniform(location, value, count * 4 * sizeof(GLfloat));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_UniformMatrix2fv>, GLint location, GLsizei count, GLboolean, const GLfloat* value)
+{
+    return glCallStats().shadow.sameUniform(location, value, count * 4 * sizeof(GLfloat));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_UniformMatrix3fv>, GLint location, GLsizei count, GLboolean, const GLfloat* value)
+{
+    return glCallStats().shadow.sameUniform(location, value, count * 9 * sizeof(GLfloat));
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_UniformMatrix4fv>, GLint location, GLsizei count, GLboolean, const GLfloat* value)
+{
+    return glCallStats().shadow.sameUniform(location, value, count * 16 * sizeof(GLfloat));
+}
+
+// deleting or relinking drops what was known about the object
+inline bool redundantGlCall(GlCallTag<GL_CALL_LinkProgram>, GLuint program)
+{
+    glCallStats().shadow.forgetProgram(program);
+    return false;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_DeleteProgram>, GLuint program)
+{
+    glCallStats().shadow.forgetProgram(program);
+    return false;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_DeleteVertexArrays>, GLsizei n, const GLuint* arrays)
+{
+    GlShadowState& s = glCallStats().shadow;
+    for (GLsizei i = 0; i < n; i++)
+        if (arrays[i] == s.vertexArray)
+        {
+            s.vertexArray = 0;
+            s.elementBuffer = GlShadowState::UNKNOWN;
+        }
+    return false;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_DeleteBuffers>, GLsizei n, const GLuint* buffers)
+{
+    GlShadowState& s = glCallStats().shadow;
+    for (GLsizei i = 0; i < n; i++)
+    {
+        GlShadowState::forget(s.buffers, buffers[i]);
+        if (buffers[i] == s.elementBuffer)
+            s.elementBuffer = 0;
+    }
+    return false;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_DeleteTextures>, GLsizei n, const GLuint* textures)
+{
+    GlShadowState& s = glCallStats().shadow;
+    for (GLsizei i = 0; i < n; i++)
+        std::replace(s.textures2D, s.textures2D + GlShadowState::TEXTURE_UNITS, textures[i], 0u);
+    return false;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_DeleteFramebuffers>, GLsizei n, const GLuint* framebuffers)
+{
+    GlShadowState& s = glCallStats().shadow;
+    for (GLsizei i = 0; i < n; i++)
+    {
+        if (framebuffers[i] == s.drawFramebuffer)
+            s.drawFramebuffer = 0;
+        if (framebuffers[i] == s.readFramebuffer)
+            s.readFramebuffer = 0;
+    }
+    return false;
+}
+
+inline bool redundantGlCall(GlCallTag<GL_CALL_DeleteRenderbuffers>, GLsizei n, const GLuint* renderbuffers)
+{
+    GlShadowState& s = glCallStats().shadow;
+    for (GLsizei i = 0; i < n; i++)
+        if (renderbuffers[i] == s.renderbuffer)
+            s.renderbuffer = 0;
+    return false;
+}
+
+// the wrapper installed in place of one entry point
+template <int Id, typename Proc>
+struct GlHook;
+
+template <int Id, typename Result, typename... Args>
+struct GlHook<Id, Result (APIENTRYP)(Args...)>
+{
+    typedef Result (APIENTRYP Proc)(Args...);
+    static Proc original;
+
+    static Result APIENTRY call(Args... args)
+    {
+        glCallStats().count(Id, redundantGlCall(GlCallTag<Id>(), args...));
+        return original(args...);
+    }
+
+    static void install(Proc& pointer)
+    {
+        if (!pointer || pointer == &call)
+            return;
+        original = pointer;
+        pointer = &call;
+    }
+
+    static void uninstall(Proc& pointer)
+    {
+        if (pointer == &call)
+            pointer = original;
+    }
+};
+
+template <int Id, typename Result, typename... Args>
+typename GlHook<Id, Result (APIENTRYP)(Args...)>::Proc GlHook<Id, Result (APIENTRYP)(Args...)>::original = nullptr;
+
+inline void GlCallStats::install()
+{
+    if (active)
+        return;
+#define GL_HOOK_INSTALL(name) GlHook<GL_CALL_##name, decltype(glad_gl##name)>::install(glad_gl##name);
+#define GL_EXTENSION_HOOK_INSTALL(name, member) \
+    GlHook<GL_CALL_##name, decltype(GlExtensions::member)>::install(glExtensions().member);
+    GL_INTERCEPTED_CALLS(GL_HOOK_INSTALL)
+    GL_INTERCEPTED_EXTENSIONS(GL_EXTENSION_HOOK_INSTALL)
+#undef GL_HOOK_INSTALL
+#undef GL_EXTENSION_HOOK_INSTALL
+    shadow.reset();
+    frame = lastFrame = total = GlCallCounts();
+    frames = 0;
+    active = true;
+}
+
+inline void GlCallStats::uninstall()
+{
+    if (!active)
+        return;
+#define GL_HOOK_UNINSTALL(name) GlHook<GL_CALL_##name, decltype(glad_gl##name)>::uninstall(glad_gl##name);
+#define GL_EXTENSION_HOOK_UNINSTALL(name, member) \
+    GlHook<GL_CALL_##name, decltype(GlExtensions::member)>::uninstall(glExtensions().member);
+    GL_INTERCEPTED_CALLS(GL_HOOK_UNINSTALL)
+    GL_INTERCEPTED_EXTENSIONS(GL_EXTENSION_HOOK_UNINSTALL)
+#undef GL_HOOK_UNINSTALL
+#undef GL_EXTENSION_HOOK_UNINSTALL
+    active = false;
+}
+
+#endif
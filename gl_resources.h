@@ -0,0 +1,511 @@
+#pragma once
+//
+//  gl_resources.h
+//  3D Object Drawing
+//
+//  Move-only RAII handles for OpenGL objects and a registry of resident GPU memory.
+//
+
+#ifndef GL_RESOURCES_H
+#define GL_RESOURCES_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// what an allocation is used for; the memory report is grouped by these
+enum GpuMemoryCategory {
+    GPU_VERTEX_BUFFER,
+    GPU_INDEX_BUFFER,
+    GPU_UNIFORM_BUFFER,
+    GPU_STORAGE_BUFFER,
+    GPU_INDIRECT_BUFFER,
+    GPU_STAGING_BUFFER,
+    GPU_TEXTURE,
+    GPU_RENDER_TARGET,
+    GPU_OBJECT,          // VAOs, programs, FBOs: counted but own no sizeable memory
+    GPU_CATEGORY_COUNT
+};
+
+inline const char* gpuMemoryCategoryName(GpuMemoryCategory category)
+{
+    static const char* names[GPU_CATEGORY_COUNT] = {
+        "vertex buffers", "index buffers", "uniform buffers", "storage buffers",
+        "indirect buffers", "staging buffers", "textures", "render targets", "objects"
+    };
+    return names[category];
+}
+
+// GL names are only unique within one context. A thread that renders with a context of
+// its own sets a distinct tag, so its objects do not collide with the main context's below.
+inline unsigned int& glContextTag()
+{
+    static thread_local unsigned int tag = 0;
+    return tag;
+}
+
+// Central record of every live GL allocation: size, category and a short purpose label.
+// The handle types below keep it up to date; report() prints live memory per category.
+class GpuMemoryRegistry
+{
+public:
+    struct Allocation
+    {
+        GpuMemoryCategory category;
+        size_t bytes;
+        const char* purpose;
+    };
+
+    // 'kind' separates GL namespaces (a buffer and a texture may share the same name)
+    void record(unsigned int kind, GLuint name, GpuMemoryCategory category, size_t bytes, const char* purpose)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto inserted = allocations.insert(std::make_pair(key(kind, name), Allocation{ category, 0, purpose }));
+        Allocation& allocation = inserted.first->second;
+        if (inserted.second)
+            count[category]++;
+        else
+        {
+            live[allocation.category] -= allocation.bytes;
+            if (allocation.category != category)
+            {
+                count[allocation.category]--;
+                count[category]++;
+            }
+        }
+        allocation.category = category;
+        allocation.bytes = bytes;
+        allocation.purpose = purpose;
+        live[category] += bytes;
+        if (live[category] > peak[category])
+            peak[category] = live[category];
+        size_t total = totalBytesLocked();
+        if (total > peakTotal)
+            peakTotal = total;
+    }
+
+    void release(unsigned int kind, GLuint name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = allocations.find(key(kind, name));
+        if (it == allocations.end())
+            return;
+        live[it->second.category] -= it->second.bytes;
+        count[it->second.category]--;
+        allocations.erase(it);
+    }
+
+    size_t liveBytes(GpuMemoryCategory category)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return live[category];
+    }
+
+    size_t liveObjects()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return allocations.size();
+    }
+
+    size_t totalBytes()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return totalBytesLocked();
+    }
+
+    void report(std::ostream& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "GPU memory (live / peak):" << std::endl;
+        for (int i = 0; i < GPU_CATEGORY_COUNT; i++)
+        {
+            if (count[i] == 0 && peak[i] == 0)
+                continue;
+            out << "  " << std::left << std::setw(18) << gpuMemoryCategoryName((GpuMemoryCategory)i) << std::right
+                << std::setw(6) << count[i] << " objects "
+                << std::fixed << std::setprecision(1) << std::setw(10) << live[i] / 1024.0 << " KB / "
+                << std::setw(10) << peak[i] / 1024.0 << " KB" << std::endl;
+        }
+        out << "  total " << totalBytesLocked() / 1024.0 << " KB, peak " << peakTotal / 1024.0 << " KB" << std::endl;
+        out.unsetf(std::ios::floatfield);
+    }
+
+    // lists every live allocation with its purpose, grouped by category
+    void reportAllocations(std::ostream& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < GPU_CATEGORY_COUNT; i++)
+            for (const auto& entry : allocations)
+                if (entry.second.category == i)
+                    out << "  [" << gpuMemoryCategoryName(entry.second.category) << "] "
+                        << (entry.second.purpose ? entry.second.purpose : "unnamed") << ": "
+                        << entry.second.bytes << " bytes" << std::endl;
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Allocation> allocations;
+    size_t live[GPU_CATEGORY_COUNT] = {};
+    size_t peak[GPU_CATEGORY_COUNT] = {};
+    unsigned int count[GPU_CATEGORY_COUNT] = {};
+    size_t peakTotal = 0;
+
+    // callers hold 'mutex'
+    size_t totalBytesLocked() const
+    {
+        size_t total = 0;
+        for (int i = 0; i < GPU_CATEGORY_COUNT; i++)
+            total += live[i];
+        return total;
+    }
+
+    static uint64_t key(unsigned int kind, GLuint name)
+    {
+        return (static_cast<uint64_t>(kind) << 48) | (static_cast<uint64_t>(glContextTag() & 0xFFFF) << 32) | name;
+    }
+};
+
+inline GpuMemoryRegistry& gpuMemory()
+{
+    static GpuMemoryRegistry registry;
+    return registry;
+}
+
+// kinds used as registry keys
+enum GlObjectKind {
+    GL_KIND_BUFFER = 1,
+    GL_KIND_VERTEX_ARRAY,
+    GL_KIND_PROGRAM,
+    GL_KIND_TEXTURE,
+    GL_KIND_FRAMEBUFFER,
+    GL_KIND_RENDERBUFFER,
+    GL_KIND_QUERY
+};
+
+// Base for all handles: owns one GL name, deletes it on destruction, can be moved but not copied.
+// Handles must be destroyed while their context is still current.
+template <typename Traits>
+class GlHandle
+{
+public:
+    GlHandle() : name(0) {}
+
+    ~GlHandle()
+    {
+        reset();
+    }
+
+    GlHandle(const GlHandle&) = delete;
+    GlHandle& operator=(const GlHandle&) = delete;
+
+    GlHandle(GlHandle&& other) noexcept : name(other.name)
+    {
+        other.name = 0;
+    }
+
+    GlHandle& operator=(GlHandle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            name = other.name;
+            other.name = 0;
+        }
+        return *this;
+    }
+
+    GLuint id() const
+    {
+        return name;
+    }
+
+    explicit operator bool() const
+    {
+        return name != 0;
+    }
+
+    void reset()
+    {
+        if (name != 0)
+        {
+            gpuMemory().release(Traits::kind, name);
+            Traits::destroy(name);
+            name = 0;
+        }
+    }
+
+protected:
+    GLuint name;
+
+    void adopt(GLuint newName, GpuMemoryCategory category, const char* purpose)
+    {
+        reset();
+        name = newName;
+        gpuMemory().record(Traits::kind, name, category, 0, purpose);
+    }
+};
+
+struct GlBufferTraits
+{
+    static const unsigned int kind = GL_KIND_BUFFER;
+    static void destroy(GLuint name) { glDeleteBuffers(1, &name); }
+};
+
+struct GlVertexArrayTraits
+{
+    static const unsigned int kind = GL_KIND_VERTEX_ARRAY;
+    static void destroy(GLuint name) { glDeleteVertexArrays(1, &name); }
+};
+
+struct GlProgramTraits
+{
+    static const unsigned int kind = GL_KIND_PROGRAM;
+    static void destroy(GLuint name) { glDeleteProgram(name); }
+};
+
+struct GlTextureTraits
+{
+    static const unsigned int kind = GL_KIND_TEXTURE;
+    static void destroy(GLuint name) { glDeleteTextures(1, &name); }
+};
+
+struct GlFramebufferTraits
+{
+    static const unsigned int kind = GL_KIND_FRAMEBUFFER;
+    static void destroy(GLuint name) { glDeleteFramebuffers(1, &name); }
+};
+
+struct GlRenderbufferTraits
+{
+    static const unsigned int kind = GL_KIND_RENDERBUFFER;
+    static void destroy(GLuint name) { glDeleteRenderbuffers(1, &name); }
+};
+
+struct GlQueryTraits
+{
+    static const unsigned int kind = GL_KIND_QUERY;
+    static void destroy(GLuint name) { glDeleteQueries(1, &name); }
+};
+
+class GlBuffer : public GlHandle<GlBufferTraits>
+{
+public:
+    GlBuffer() {}
+
+    GlBuffer(GpuMemoryCategory category, const char* purpose)
+    {
+        create(category, purpose);
+    }
+
+    void create(GpuMemoryCategory category, const char* purpose)
+    {
+        GLuint newName;
+        glGenBuffers(1, &newName);
+        adopt(newName, category, purpose);
+        this->category = category;
+        this->purpose = purpose;
+        size = 0;
+    }
+
+    // binds to 'target' and (re)allocates the store with glBufferData
+    void data(GLenum target, size_t bytes, const void* contents, GLenum usage)
+    {
+        glBindBuffer(target, name);
+        glBufferData(target, bytes, contents, usage);
+        size = bytes;
+        gpuMemory().record(GL_KIND_BUFFER, name, category, bytes, purpose);
+    }
+
+    // overwrites part of the existing store; the store keeps its size
+    void subData(GLenum target, size_t offset, size_t bytes, const void* contents)
+    {
+        glBindBuffer(target, name);
+        glBufferSubData(target, offset, bytes, contents);
+    }
+
+    void bind(GLenum target) const
+    {
+        glBindBuffer(target, name);
+    }
+
+    size_t bytes() const
+    {
+        return size;
+    }
+
+private:
+    GpuMemoryCategory category = GPU_VERTEX_BUFFER;
+    const char* purpose = nullptr;
+    size_t size = 0;
+};
+
+class GlVertexArray : public GlHandle<GlVertexArrayTraits>
+{
+public:
+    GlVertexArray() {}
+
+    explicit GlVertexArray(const char* purpose)
+    {
+        create(purpose);
+    }
+
+    void create(const char* purpose)
+    {
+        GLuint newName;
+        glGenVertexArrays(1, &newName);
+        adopt(newName, GPU_OBJECT, purpose);
+    }
+
+    void bind() const
+    {
+        glBindVertexArray(name);
+    }
+};
+
+class GlProgram : public GlHandle<GlProgramTraits>
+{
+public:
+    GlProgram() {}
+
+    void create(const char* purpose)
+    {
+        adopt(glCreateProgram(), GPU_OBJECT, purpose);
+    }
+};
+
+// bytes per texel for the internal formats this project uses
+inline size_t glInternalFormatBytes(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_R8: return 1;
+    case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+    case GL_RGB8: case GL_SRGB8: case GL_DEPTH_COMPONENT24: return 3;
+    case GL_RGBA8: case GL_SRGB8_ALPHA8: case GL_R32F: case GL_R32UI: case GL_R32I: case GL_RG16F:
+    case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: case GL_R11F_G11F_B10F: return 4;
+    case GL_RGB16F: return 6;
+    case GL_RGBA16F: case GL_RG32F: return 8;
+    case GL_RGB32F: return 12;
+    case GL_RGBA32F: return 16;
+    default: return 4;
+    }
+}
+
+class GlTexture : public GlHandle<GlTextureTraits>
+{
+public:
+    GlTexture() {}
+
+    void create(GLenum target, GpuMemoryCategory category, const char* purpose)
+    {
+        GLuint newName;
+        glGenTextures(1, &newName);
+        adopt(newName, category, purpose);
+        this->target = target;
+        this->category = category;
+        this->purpose = purpose;
+    }
+
+    void bind() const
+    {
+        glBindTexture(target, name);
+    }
+
+    // allocates 'levels' mips without data (levels == 1 for render targets); GL 3.3 has no
+    // glTexStorage, so each level is specified with glTexImage2D
+    void image2D(GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type)
+    {
+        glBindTexture(target, name);
+        size_t bytes = 0;
+        for (GLsizei level = 0; level < levels; level++)
+        {
+            GLsizei w = width >> level, h = height >> level;
+            w = w ? w : 1;
+            h = h ? h : 1;
+            glTexImage2D(target, level, internalFormat, w, h, 0, format, type, NULL);
+            bytes += (size_t)w * h * glInternalFormatBytes(internalFormat);
+        }
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        gpuMemory().record(GL_KIND_TEXTURE, name, category, bytes, purpose);
+    }
+
+    // records memory for storage allocated by hand (glTexImage2D per level, streaming, ...)
+    void setResidentBytes(size_t bytes)
+    {
+        gpuMemory().record(GL_KIND_TEXTURE, name, category, bytes, purpose);
+    }
+
+    GLenum getTarget() const
+    {
+        return target;
+    }
+
+private:
+    GLenum target = GL_TEXTURE_2D;
+    GpuMemoryCategory category = GPU_TEXTURE;
+    const char* purpose = nullptr;
+};
+
+class GlRenderbuffer : public GlHandle<GlRenderbufferTraits>
+{
+public:
+    GlRenderbuffer() {}
+
+    void create(const char* purpose)
+    {
+        GLuint newName;
+        glGenRenderbuffers(1, &newName);
+        adopt(newName, GPU_RENDER_TARGET, purpose);
+        this->purpose = purpose;
+    }
+
+    void storage(GLenum internalFormat, GLsizei width, GLsizei height)
+    {
+        glBindRenderbuffer(GL_RENDERBUFFER, name);
+        glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, width, height);
+        gpuMemory().record(GL_KIND_RENDERBUFFER, name, GPU_RENDER_TARGET,
+            (size_t)width * height * glInternalFormatBytes(internalFormat), purpose);
+    }
+
+private:
+    const char* purpose = nullptr;
+};
+
+class GlFramebuffer : public GlHandle<GlFramebufferTraits>
+{
+public:
+    GlFramebuffer() {}
+
+    void create(const char* purpose)
+    {
+        GLuint newName;
+        glGenFramebuffers(1, &newName);
+        adopt(newName, GPU_OBJECT, purpose);
+    }
+
+    void bind(GLenum target = GL_FRAMEBUFFER) const
+    {
+        glBindFramebuffer(target, name);
+    }
+};
+
+class GlQuery : public GlHandle<GlQueryTraits>
+{
+public:
+    GlQuery() {}
+
+    void create(const char* purpose)
+    {
+        GLuint newName;
+        glGenQueries(1, &newName);
+        adopt(newName, GPU_OBJECT, purpose);
+    }
+};
+
+#endif
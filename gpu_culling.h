@@ -0,0 +1,390 @@
+#pragma once
+//
+//  gpu_culling.h
+//  3D Object Drawing
+//
+//  Frustum culling on the GPU: a compute pass tests every object's bounds and writes
+//  the indirect draw commands for the survivors, so the CPU submits one multi-draw no
+//  matter how many objects there are. Needs GL 4.3; see gl_extensions.h.
+//
+
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.h"
+#include "frame_arena.h"
+#include "gl_extensions.h"
+#include "gl_resources.h"
+#include "job_system.h"
+#include "render_queue.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+
+// one object as the shaders see it (std430)
+struct GpuObject
+{
+    glm::mat4 model;
+    glm::vec4 color;
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    glm::vec4 spinPivot;   // DrawSpin packed as the shaders read it
+    glm::vec4 spinAxis;
+};
+
+// layout read by glMultiDrawElementsIndirect
+struct GpuDrawCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLuint baseVertex;
+    GLuint baseInstance;
+};
+
+struct GpuCullStats
+{
+    unsigned int objects = 0;
+    unsigned int visible = 0;   // only updated by readVisibleCount()
+    bool indirectCount = false; // draw count read from the counter buffer (else one command per object)
+};
+
+class GpuCuller
+{
+public:
+    GpuCullStats stats;
+
+    // 'vertexBuffer' and 'indexBuffer' hold the 0..0.5 cube (position + color, 36 indices)
+    bool init(GLuint vertexBuffer, GLuint indexBuffer)
+    {
+        const GlExtensions& ext = glExtensions();
+        if (!ext.compute)
+            return false;
+        stats.indirectCount = ext.indirectCount;
+
+        cullProgram.reset(new Shader("cullShader.cs"));
+        drawProgram.reset(new Shader("indirectVertexShader.vs", "indirectFragmentShader.fs"));
+
+        objects.create(GPU_STORAGE_BUFFER, "culling objects");
+        commands.create(GPU_INDIRECT_BUFFER, "culled draw commands");
+        objectIndices.create(GPU_VERTEX_BUFFER, "object index per instance");
+        counter.create(GPU_INDIRECT_BUFFER, "visible draw counter");
+        GLuint zero = 0;
+        counter.data(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_DRAW);
+
+        vao.create("indirect cube VAO");
+        vao.bind();
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)12);
+        glEnableVertexAttribArray(1);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBindVertexArray(0);
+        return true;
+    }
+
+    bool ready() const
+    {
+        return cullProgram != nullptr;
+    }
+
+    // replaces the object set; buffers only grow
+    void upload(const GpuObject* data, size_t count)
+    {
+        sceneUploaded = false;
+        reserve(count);
+        objectCount = count;
+        stats.objects = static_cast<unsigned int>(count);
+        if (count != 0)
+            objects.subData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GpuObject), data);
+    }
+
+    // The scene's resident set: every item but the DRAW_MESH ones, which the cube-only draw
+    // cannot show, and the DRAW_COLLISION_ONLY ones. Uploaded when the scene changes; patchScene() keeps it current in between.
+    void uploadScene(const FrameVector<DrawItem>& items, FrameArena& arena)
+    {
+        GpuObject* data = arena.allocateArray<GpuObject>(items.size());
+        size_t count = 0;
+        dynamicItems.clear();
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            if (items[i].flags & (DRAW_MESH | DRAW_COLLISION_ONLY))
+                continue;
+            if (items[i].flags & (DRAW_ANIMATED | DRAW_STATEFUL))
+                dynamicItems.push_back(DynamicItem{ i, count });
+            data[count++] = toGpuObject(items[i].model, items[i].color, items[i].bounds, items[i].spin);
+        }
+        upload(data, count);
+        sceneItemCount = items.size();
+        sceneUploaded = true;
+    }
+
+    // Rewrites only the objects that follow the room state or the clock (fan, TV, bookshelf).
+    // 'items' is this frame's scene; it is uploaded whole if it no longer has the uploaded layout.
+    void patchScene(const FrameVector<DrawItem>& items, FrameArena& arena)
+    {
+        if (!sceneUploaded || items.size() != sceneItemCount)
+        {
+            uploadScene(items, arena);
+            return;
+        }
+        if (dynamicItems.empty())
+            return;
+        GpuObject* data = arena.allocateArray<GpuObject>(dynamicItems.size());
+        for (size_t i = 0; i < dynamicItems.size(); i++)
+        {
+            const DrawItem& item = items[dynamicItems[i].item];
+            data[i] = toGpuObject(item.model, item.color, item.bounds, item.spin);
+        }
+        // one subData per run of neighbouring objects
+        size_t first = 0;
+        for (size_t i = 1; i <= dynamicItems.size(); i++)
+        {
+            if (i < dynamicItems.size() && dynamicItems[i].object == dynamicItems[i - 1].object + 1)
+                continue;
+            objects.subData(GL_SHADER_STORAGE_BUFFER, dynamicItems[first].object * sizeof(GpuObject),
+                            (i - first) * sizeof(GpuObject), data + first);
+            first = i;
+        }
+    }
+
+    // the next patchScene() uploads the whole scene again
+    void invalidateScene()
+    {
+        sceneUploaded = false;
+    }
+
+    static GpuObject toGpuObject(const glm::mat4& model, const glm::vec4& color, const AABB& bounds,
+                                 const DrawSpin& spin = DrawSpin())
+    {
+        GpuObject object;
+        object.model = model;
+        object.color = color;
+        object.boundsMin = glm::vec4(bounds.min, 1.0f);
+        object.boundsMax = glm::vec4(bounds.max, 1.0f);
+        object.spinPivot = glm::vec4(spin.pivot, spin.speed);
+        object.spinAxis = glm::vec4(spin.axis, spin.phase);
+        return object;
+    }
+
+    // writes this frame's draw commands
+    void cull(const glm::mat4& viewProjection)
+    {
+        if (objectCount == 0)
+            return;
+        const GlExtensions& ext = glExtensions();
+        GLuint zero = 0;
+        counter.subData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+        cullProgram->use();
+        glUniform4fv(glGetUniformLocation(cullProgram->id(), "frustumPlanes"), 6, &frustum.planes[0][0]);
+        cullProgram->setInt("objectCount", static_cast<int>(objectCount));
+        cullProgram->setInt("indexCount", 36);
+        cullProgram->setInt("compact", stats.indirectCount ? 1 : 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objects.id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commands.id());
+        glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, counter.id());
+        ext.dispatchCompute(static_cast<GLuint>((objectCount + GROUP_SIZE - 1) / GROUP_SIZE), 1, 1);
+        ext.memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT |
+                          GL_ATOMIC_COUNTER_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+
+    // draws what cull() kept with one multi-draw; 'time' turns the animated objects
+    void draw(const glm::mat4& view, const glm::mat4& projection, float time)
+    {
+        if (objectCount == 0)
+            return;
+        const GlExtensions& ext = glExtensions();
+        drawProgram->use();
+        drawProgram->setMat4("view", view);
+        drawProgram->setMat4("projection", projection);
+        drawProgram->setFloat("time", time);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objects.id());
+        vao.bind();
+        commands.bind(GL_DRAW_INDIRECT_BUFFER);
+        GLsizei maxDraws = static_cast<GLsizei>(objectCount);
+        if (stats.indirectCount)
+        {
+            counter.bind(GL_PARAMETER_BUFFER);
+            ext.multiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, maxDraws, 0);
+        }
+        else
+        {
+            ext.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, maxDraws, 0);
+        }
+        glBindVertexArray(0);
+    }
+
+    // waits for the GPU; meant for reports and benchmarks, not every frame
+    unsigned int readVisibleCount()
+    {
+        GLuint visible = 0;
+        counter.bind(GL_ATOMIC_COUNTER_BUFFER);
+        glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &visible);
+        stats.visible = visible;
+        return visible;
+    }
+
+private:
+    static const size_t GROUP_SIZE = 64;   // local_size_x in cullShader.cs
+
+    std::unique_ptr<Shader> cullProgram;
+    std::unique_ptr<Shader> drawProgram;
+    GlBuffer objects;
+    GlBuffer commands;
+    GlBuffer objectIndices;
+    GlBuffer counter;
+    GlVertexArray vao;
+    size_t capacity = 0;
+    size_t objectCount = 0;
+
+    // where each animated or stateful scene item lives in 'objects'
+    struct DynamicItem
+    {
+        size_t item;
+        size_t object;
+    };
+    std::vector<DynamicItem> dynamicItems;
+    size_t sceneItemCount = 0;
+    bool sceneUploaded = false;
+
+    void reserve(size_t count)
+    {
+        if (count <= capacity)
+            return;
+        size_t newCapacity = capacity ? capacity : 256;
+        while (newCapacity < count)
+            newCapacity *= 2;
+        capacity = newCapacity;
+
+        objects.data(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GpuObject), nullptr, GL_DYNAMIC_DRAW);
+        commands.data(GL_DRAW_INDIRECT_BUFFER, capacity * sizeof(GpuDrawCommand), nullptr, GL_DYNAMIC_DRAW);
+
+        // instance attribute 0, 1, 2, ...: with baseInstance = object index it yields that index
+        std::vector<GLuint> indices(capacity);
+        for (size_t i = 0; i < capacity; i++)
+            indices[i] = static_cast<GLuint>(i);
+        vao.bind();
+        objectIndices.data(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, 0, (void*)0);
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+    }
+};
+
+// Times frustum culling of 'count' random cubes on the CPU (one thread, then the job
+// system) and on the GPU, and checks that both keep the same objects.
+inline void runCullingBenchmark(std::ostream& out, GpuCuller& gpu, JobSystem& jobs, const size_t* counts, int countCount)
+{
+    typedef std::chrono::steady_clock Clock;
+    const int WARMUP = 2, RUNS = 10;
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+
+    out << std::setw(10) << "objects" << std::setw(10) << "visible" << std::setw(16) << "CPU 1 thread"
+        << std::setw(12) << "CPU " << std::setw(2) << jobs.threadCount() << " threads" << std::setw(24) << "GPU dispatch + sync"
+        << (gpu.stats.indirectCount ? "" : "   (no indirect count: one command per object)") << std::endl;
+    for (int c = 0; c < countCount; c++)
+    {
+        size_t count = counts[c];
+
+        // cubes scattered through a box around the camera
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> position(-120.0f, 120.0f);
+        std::uniform_real_distribution<float> size(0.2f, 2.0f);
+        std::vector<GpuObject> scene(count);
+        std::vector<AABB> bounds(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 p(position(random), position(random) * 0.1f, position(random));
+            glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), p), glm::vec3(size(random)));
+            bounds[i] = cubeBounds(model);
+            scene[i] = GpuCuller::toGpuObject(model, glm::vec4(1.0f), bounds[i]);
+        }
+
+        // CPU, one thread: test and compact
+        std::vector<uint32_t> visibleIndices(count);
+        size_t cpuVisible = 0;
+        double singleMs = 0.0;
+        for (int run = 0; run < WARMUP + RUNS; run++)
+        {
+            auto start = Clock::now();
+            size_t kept = 0;
+            for (size_t i = 0; i < count; i++)
+                if (frustum.intersects(bounds[i]))
+                    visibleIndices[kept++] = static_cast<uint32_t>(i);
+            cpuVisible = kept;
+            if (run >= WARMUP)
+                singleMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        // CPU, job system: chunks append through an atomic cursor, like the compute shader
+        std::atomic<size_t> cursor(0);
+        const unsigned int CHUNK = 4096;
+        auto job = [&](unsigned int chunk, unsigned int) {
+            size_t begin = (size_t)chunk * CHUNK;
+            size_t end = std::min(count, begin + CHUNK);
+            uint32_t local[CHUNK];
+            size_t kept = 0;
+            for (size_t i = begin; i < end; i++)
+                if (frustum.intersects(bounds[i]))
+                    local[kept++] = static_cast<uint32_t>(i);
+            size_t slot = cursor.fetch_add(kept, std::memory_order_relaxed);
+            std::copy(local, local + kept, visibleIndices.begin() + slot);
+        };
+        double parallelMs = 0.0;
+        unsigned int chunks = static_cast<unsigned int>((count + CHUNK - 1) / CHUNK);
+        for (int run = 0; run < WARMUP + RUNS; run++)
+        {
+            cursor.store(0);
+            auto start = Clock::now();
+            jobs.parallelFor(chunks, job);
+            if (run >= WARMUP)
+                parallelMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        // GPU: upload once, then cull and read the counter back
+        gpu.upload(scene.data(), count);
+        unsigned int gpuVisible = 0;
+        double gpuMs = 0.0;
+        for (int run = 0; run < WARMUP + RUNS; run++)
+        {
+            glFinish();
+            auto start = Clock::now();
+            gpu.cull(projection * view);
+            gpuVisible = gpu.readVisibleCount();
+            if (run >= WARMUP)
+                gpuMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        out << std::fixed << std::setprecision(3)
+            << std::setw(10) << count << std::setw(10) << cpuVisible << std::setw(13) << singleMs / RUNS << " ms"
+            << std::setw(19) << parallelMs / RUNS << " ms" << std::setw(21) << gpuMs / RUNS << " ms";
+        if (gpuVisible != cpuVisible)
+            out << "   GPU kept " << gpuVisible;
+        out << std::defaultfloat << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,139 @@
+#pragma once
+//
+//  hlod.h
+//  3D Object Drawing
+//
+//  Hierarchical level of detail for furniture clusters: the parts of the clock, the
+//  table and the sofa are replaced by one precomputed proxy box each once the cluster
+//  covers only a few pixels.
+//
+
+#ifndef HLOD_H
+#define HLOD_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.h"
+#include "render_queue.h"
+
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// contiguous run of draw items that make up one piece of furniture
+struct ClusterRange
+{
+    size_t first = 0;
+    size_t end = 0;
+};
+
+// merged stand-in for a cluster, in the coordinates of the items it was built from
+struct HlodProxy
+{
+    AABB bounds;
+    glm::mat4 model;
+    glm::vec4 color;
+};
+
+struct HlodOptions
+{
+    bool enabled = true;
+    // a cluster switches to its proxy below the first size and back above the second,
+    // so one hovering around a single threshold does not flicker
+    float proxyBelowPixels = 24.0f;
+    float detailAbovePixels = 32.0f;
+};
+
+struct HlodStats
+{
+    unsigned int clusters = 0;
+    unsigned int proxies = 0;
+    unsigned int drawsSaved = 0;
+};
+
+class HlodSelector
+{
+public:
+    HlodOptions options;
+    HlodStats stats;
+
+    // One proxy per cluster: the box around all its parts, colored like its largest part.
+    // 'items' is a reference copy of the clusters (e.g. one room at the origin).
+    void buildProxies(const DrawItem* items, const ClusterRange* ranges, int clusterCount)
+    {
+        proxies.resize(clusterCount);
+        partCounts.resize(clusterCount);
+        for (int c = 0; c < clusterCount; c++)
+        {
+            AABB bounds;
+            float largestArea = -1.0f;
+            glm::vec4 color(1.0f);
+            for (size_t i = ranges[c].first; i < ranges[c].end; i++)
+            {
+                bounds.expand(items[i].bounds);
+                float area = items[i].bounds.surfaceArea();
+                if (area > largestArea)
+                {
+                    largestArea = area;
+                    color = items[i].color;
+                }
+            }
+            glm::mat4 identity(1.0f);
+            proxies[c].bounds = bounds;
+            proxies[c].model = glm::translate(identity, bounds.min) * glm::scale(identity, bounds.extent() * 2.0f);
+            proxies[c].color = color;
+            partCounts[c] = static_cast<unsigned int>(ranges[c].end - ranges[c].first);
+        }
+    }
+
+    int clusterCount() const { return static_cast<int>(proxies.size()); }
+    const HlodProxy& proxy(int cluster) const { return proxies[cluster]; }
+
+    // call once per frame before the select() calls; 'instances' is the number of placed clusters
+    void beginFrame(size_t instances, const glm::vec3& eye, float fovY, int viewportHeight)
+    {
+        if (useProxy.size() != instances)
+            useProxy.assign(instances, 0);
+        this->eye = eye;
+        // pixels covered by a unit length at unit distance
+        pixelsPerUnit = 0.5f * viewportHeight / std::tan(fovY * 0.5f);
+        stats = HlodStats();
+    }
+
+    // 'instance' identifies one placed cluster across frames; 'bounds' are its world bounds
+    bool select(size_t instance, int cluster, const AABB& bounds)
+    {
+        stats.clusters++;
+        unsigned char& proxied = useProxy[instance];
+        if (!options.enabled)
+        {
+            proxied = 0;
+            return false;
+        }
+
+        float radius = 0.5f * glm::length(bounds.extent());
+        float distance = glm::length(bounds.center() - eye);
+        float pixels = distance > radius ? radius / distance * pixelsPerUnit : FLT_MAX;
+        if (proxied && pixels > options.detailAbovePixels)
+            proxied = 0;
+        else if (!proxied && pixels < options.proxyBelowPixels)
+            proxied = 1;
+
+        if (proxied)
+        {
+            stats.proxies++;
+            stats.drawsSaved += partCounts[cluster] - 1;
+        }
+        return proxied != 0;
+    }
+
+private:
+    std::vector<HlodProxy> proxies;
+    std::vector<unsigned int> partCounts;
+    std::vector<unsigned char> useProxy;   // per instance, kept between frames for the hysteresis
+    glm::vec3 eye = glm::vec3(0.0f);
+    float pixelsPerUnit = 1.0f;
+};
+
+#endif
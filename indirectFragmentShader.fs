@@ -0,0 +1,9 @@
+#version 430 core
+flat in vec4 objectColor;
+
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = objectColor;
+}
@@ -0,0 +1,41 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in uint aObject;   // per instance; offset by the command's baseInstance
+
+struct Object
+{
+    mat4 model;
+    vec4 color;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    vec4 spinPivot;   // xyz: pivot, w: radians per second
+    vec4 spinAxis;    // xyz: unit axis, w: phase
+};
+
+layout (std430, binding = 0) readonly buffer Objects { Object objects[]; };
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float time;
+
+flat out vec4 objectColor;
+
+// same rotation as vertexShader.vs; static objects have a zero spin
+vec3 spin(vec3 p, vec4 pivot, vec4 axis)
+{
+    float angle = axis.w + pivot.w * time;
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 d = p - pivot.xyz;
+    d = d * c + cross(axis.xyz, d) * s + axis.xyz * dot(axis.xyz, d) * (1.0f - c);
+    return pivot.xyz + d;
+}
+
+void main()
+{
+    Object object = objects[aObject];
+    vec3 worldPos = spin((object.model * vec4(aPos, 1.0f)).xyz, object.spinPivot, object.spinAxis);
+    gl_Position = projection * view * vec4(worldPos, 1.0f);
+    objectColor = object.color;
+}
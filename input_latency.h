@@ -0,0 +1,259 @@
+#pragma once
+//
+//  input_latency.h
+//  3D Object Drawing
+//
+//  Times camera input from the callback that delivers it to the frame that first shows it:
+//  to the return of glfwSwapBuffers, and to the GPU timestamp at the end of that frame's
+//  commands. The display adds up to a refresh interval after that, which no API reports.
+//  An event belongs to the frame whose view matrix is latched after it arrives, so the
+//  distributions with early and late latching can be compared. Nothing waits on the GPU:
+//  timestamps are read a few frames late.
+//
+
+#ifndef INPUT_LATENCY_H
+#define INPUT_LATENCY_H
+
+#include <glad/glad.h>
+
+#include "gl_resources.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+enum LatchMode {
+    LATCH_EARLY,    // view matrix taken at the top of the frame, with the other camera updates
+    LATCH_LATE,     // cursor and keys sampled again right before the draws
+    LATCH_MODES
+};
+
+inline const char* latchModeName(int mode)
+{
+    return mode == LATCH_LATE ? "late latch" : "early latch";
+}
+
+// latencies in 0.1 ms bins up to 200 ms; longer ones share the last bin
+class LatencyHistogram
+{
+public:
+    static const int BIN_US = 100;
+    static const int BINS = 2000;
+
+    void add(int64_t ns)
+    {
+        ns = std::max<int64_t>(ns, 0);
+        bins[std::min<int64_t>(ns / (BIN_US * 1000), BINS - 1)]++;
+        count++;
+        sumNs += ns;
+        maxNs = std::max(maxNs, ns);
+    }
+
+    unsigned long long samples() const { return count; }
+    double meanMs() const { return count ? sumNs / 1e6 / count : 0.0; }
+    double maxMs() const { return maxNs / 1e6; }
+
+    // upper edge of the bin holding the 'fraction' quantile
+    double percentileMs(double fraction) const
+    {
+        if (!count)
+            return 0.0;
+        unsigned long long rank = static_cast<unsigned long long>(fraction * (count - 1)) + 1, seen = 0;
+        for (int i = 0; i < BINS; i++)
+        {
+            seen += bins[i];
+            if (seen >= rank)
+                return std::min((i + 1) * BIN_US / 1000.0, maxMs());
+        }
+        return maxMs();
+    }
+
+private:
+    unsigned int bins[BINS] = {};
+    unsigned long long count = 0;
+    double sumNs = 0.0;
+    int64_t maxNs = 0;
+};
+
+class InputLatency
+{
+public:
+    LatencyHistogram toSwap[LATCH_MODES];
+    LatencyHistogram toGpu[LATCH_MODES];
+    unsigned long long droppedEvents = 0;      // more than MAX_EVENTS in one frame
+    unsigned long long unresolvedFrames = 0;   // GPU timestamp not back after FRAME_SLOTS frames
+
+    bool active() const { return on; }
+
+    // creates the timestamp queries; needs the context
+    void start()
+    {
+        for (int i = 0; i < FRAME_SLOTS; i++)
+            frames[i].query.create("input latency timestamp");
+        on = true;
+        calibrate();
+    }
+
+    // releases the queries while the context still exists
+    void stop()
+    {
+        for (int i = 0; i < FRAME_SLOTS; i++)
+        {
+            frames[i].query.reset();
+            frames[i].pending = false;
+        }
+        on = false;
+    }
+
+    static int64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // an input that moves the camera arrived now
+    void inputEvent()
+    {
+        if (!on)
+            return;
+        if (pendingCount < MAX_EVENTS)
+            pending[pendingCount++] = nowNs();
+        else
+            droppedEvents++;
+    }
+
+    // the view matrix of this frame was just taken: every input so far is in it
+    void latch(LatchMode mode)
+    {
+        if (!on)
+            return;
+        Frame& frame = frames[current];
+        if (frame.pending)
+        {
+            unresolvedFrames++;
+            frame.pending = false;
+        }
+        frame.mode = mode;
+        frame.eventCount = pendingCount;
+        std::copy(pending, pending + pendingCount, frame.events);
+        pendingCount = 0;
+    }
+
+    // after the last command of the frame, right before glfwSwapBuffers
+    void beforeSwap()
+    {
+        if (!on)
+            return;
+        glQueryCounter(frames[current].query.id(), GL_TIMESTAMP);
+        if (++framesSinceCalibration >= CALIBRATION_FRAMES)
+            calibrate();
+    }
+
+    // right after glfwSwapBuffers returns; reads whichever older timestamps have arrived
+    void afterSwap()
+    {
+        if (!on)
+            return;
+        int64_t swapNs = nowNs();
+        Frame& frame = frames[current];
+        for (int i = 0; i < frame.eventCount; i++)
+            toSwap[frame.mode].add(swapNs - frame.events[i]);
+        frame.pending = frame.eventCount > 0;
+        current = (current + 1) % FRAME_SLOTS;
+        collectTimestamps();
+    }
+
+    // one line for 'mode', when it has samples
+    void reportLine(std::ostream& out, int mode) const
+    {
+        out << "input latency (" << latchModeName(mode) << "): " << toSwap[mode].samples() << " events, to swap p50 "
+            << toSwap[mode].percentileMs(0.5) << " ms p95 " << toSwap[mode].percentileMs(0.95) << " ms, to GPU done p50 "
+            << toGpu[mode].percentileMs(0.5) << " ms p95 " << toGpu[mode].percentileMs(0.95) << " ms" << std::endl;
+    }
+
+    // both distributions side by side
+    void report(std::ostream& out) const
+    {
+        out << "input latency in ms, from the input callback:" << std::endl;
+        for (int mode = 0; mode < LATCH_MODES; mode++)
+        {
+            if (!toSwap[mode].samples())
+            {
+                out << "  " << std::left << std::setw(12) << latchModeName(mode) << std::right << " no events" << std::endl;
+                continue;
+            }
+            const LatencyHistogram* stages[2] = { &toSwap[mode], &toGpu[mode] };
+            const char* stageNames[2] = { "to swap", "to GPU done" };
+            for (int s = 0; s < 2; s++)
+            {
+                const LatencyHistogram& h = *stages[s];
+                out << "  " << std::left << std::setw(12) << (s == 0 ? latchModeName(mode) : "") << std::setw(12)
+                    << stageNames[s] << std::right << std::fixed << std::setprecision(1) << std::setw(8) << h.samples()
+                    << " events  mean " << h.meanMs() << "  p50 " << h.percentileMs(0.5) << "  p95 "
+                    << h.percentileMs(0.95) << "  p99 " << h.percentileMs(0.99) << "  max " << h.maxMs() << std::endl;
+                out.unsetf(std::ios::fixed);
+                out << std::setprecision(6);
+            }
+        }
+        if (droppedEvents || unresolvedFrames)
+            out << "  " << droppedEvents << " events not timed (too many in one frame), " << unresolvedFrames
+                << " frames without a GPU timestamp" << std::endl;
+    }
+
+private:
+    // timestamps arrive a few frames late; a frame still out after this many is given up on
+    static const int FRAME_SLOTS = 8;
+    static const int MAX_EVENTS = 256;
+    static const int CALIBRATION_FRAMES = 120;
+
+    struct Frame
+    {
+        GlQuery query;
+        int mode = LATCH_EARLY;
+        int eventCount = 0;
+        bool pending = false;
+        int64_t events[MAX_EVENTS];
+    };
+
+    bool on = false;
+    Frame frames[FRAME_SLOTS];
+    int current = 0;
+    int64_t pending[MAX_EVENTS];
+    int pendingCount = 0;
+    int64_t gpuToCpuNs = 0;          // add to a GPU timestamp to get steady_clock time
+    int framesSinceCalibration = 0;
+
+    // the GPU clock against steady_clock, taken again now and then since the two drift apart
+    void calibrate()
+    {
+        int64_t before = nowNs();
+        GLint64 gpuNs = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNs);
+        int64_t after = nowNs();
+        gpuToCpuNs = before + (after - before) / 2 - gpuNs;
+        framesSinceCalibration = 0;
+    }
+
+    void collectTimestamps()
+    {
+        for (int i = 0; i < FRAME_SLOTS; i++)
+        {
+            Frame& frame = frames[(current + i) % FRAME_SLOTS];
+            if (!frame.pending)
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(frame.query.id(), GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;   // later frames were issued later
+            GLuint64 gpuNs = 0;
+            glGetQueryObjectui64v(frame.query.id(), GL_QUERY_RESULT, &gpuNs);
+            int64_t doneNs = static_cast<int64_t>(gpuNs) + gpuToCpuNs;
+            for (int e = 0; e < frame.eventCount; e++)
+                toGpu[frame.mode].add(doneNs - frame.events[e]);
+            frame.pending = false;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,148 @@
+#pragma once
+//
+//  job_system.h
+//  3D Object Drawing
+//
+//  Fixed pool of worker threads for data-parallel per-frame work.
+//
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include "trace_events.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Workers sleep until parallelFor() hands them a batch, then pull indices from a shared
+// counter until the batch is exhausted. The calling thread works on the batch too, so a
+// pool of N workers runs N + 1 jobs at once. parallelFor() returns only after every worker
+// has checked in for the batch, so no worker can still be touching it when the next one
+// starts. Nothing is allocated per batch: the job is passed as a function pointer and a
+// context pointer.
+class JobSystem
+{
+public:
+    // 'workers' extra threads; by default one per hardware thread besides the caller
+    explicit JobSystem(unsigned int workers = defaultWorkerCount())
+    {
+        for (unsigned int i = 0; i < workers; i++)
+            threads.emplace_back(&JobSystem::workerLoop, this, i + 1);
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // number of threads that can run jobs at once, including the caller; thread indices
+    // passed to jobs are in [0, threadCount())
+    unsigned int threadCount() const
+    {
+        return static_cast<unsigned int>(threads.size()) + 1;
+    }
+
+    // calls job(index, threadIndex) for every index in [0, count) and returns when all are
+    // done; must not be called from two threads at the same time
+    template <typename Job>
+    void parallelFor(unsigned int count, Job& job)
+    {
+        if (count == 0)
+            return;
+        if (threads.empty() || count == 1)
+        {
+            for (unsigned int i = 0; i < count; i++)
+                job(i, 0u);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batchInvoke = &invoke<Job>;
+            batchContext = &job;
+            batchCount = count;
+            next.store(0, std::memory_order_relaxed);
+            finishedWorkers = 0;
+            generation++;
+        }
+        wake.notify_all();
+        runBatch(0);
+        // wait for jobs still running on workers
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return finishedWorkers == threads.size(); });
+        batchContext = nullptr;
+    }
+
+    static unsigned int defaultWorkerCount()
+    {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        return hardware > 1 ? hardware - 1 : 0;
+    }
+
+private:
+    typedef void (*InvokeFunction)(void* context, unsigned int index, unsigned int thread);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool quit = false;
+    unsigned long long generation = 0;
+
+    InvokeFunction batchInvoke = nullptr;
+    void* batchContext = nullptr;
+    unsigned int batchCount = 0;
+    std::atomic<unsigned int> next{ 0 };
+    size_t finishedWorkers = 0;
+
+    template <typename Job>
+    static void invoke(void* context, unsigned int index, unsigned int thread)
+    {
+        (*static_cast<Job*>(context))(index, thread);
+    }
+
+    void runBatch(unsigned int thread)
+    {
+        TRACE_ZONE("job batch");
+        for (;;)
+        {
+            unsigned int index = next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= batchCount)
+                return;
+            batchInvoke(batchContext, index, thread);
+        }
+    }
+
+    void workerLoop(unsigned int thread)
+    {
+        tracer().nameThread("job worker " + std::to_string(thread));
+        unsigned long long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return quit || generation != seen; });
+                if (quit)
+                    return;
+                seen = generation;
+            }
+            runBatch(thread);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++finishedWorkers == threads.size())
+                done.notify_all();
+        }
+    }
+};
+
+#endif
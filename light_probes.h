@@ -0,0 +1,135 @@
+#pragma once
+//
+//  light_probes.h
+//  3D Object Drawing
+//
+//  Grid of baked irradiance probes for the objects that have no lightmap: the fan, the
+//  clock hands, the TV screen, the bookshelf doors and anything added at runtime. Each
+//  probe is an ambient cube, the irradiance (divided by pi) arriving at a surface facing
+//  each of the six axis directions; a shader blends the three facing the normal.
+//
+
+#ifndef LIGHT_PROBES_H
+#define LIGHT_PROBES_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+enum AmbientCubeFace {
+    AMBIENT_POS_X,
+    AMBIENT_NEG_X,
+    AMBIENT_POS_Y,
+    AMBIENT_NEG_Y,
+    AMBIENT_POS_Z,
+    AMBIENT_NEG_Z,
+    AMBIENT_FACES
+};
+
+struct LightProbe
+{
+    glm::vec3 cube[AMBIENT_FACES];
+    float weight;   // 0 for a probe that ended up inside furniture: its neighbours are used instead
+};
+
+static_assert(sizeof(LightProbe) == 76, "LightProbe is part of the lightmap file format");
+
+// Probes at origin + spacing * (i, j, k). A non-zero 'repeat' axis wraps positions into one
+// period first, so one room's probes serve every copy of it in an apartment.
+class ProbeGrid
+{
+public:
+    glm::vec3 origin = glm::vec3(0.0f);
+    glm::vec3 repeat = glm::vec3(0.0f);
+    float spacing = 1.0f;
+    int counts[3] = { 0, 0, 0 };
+    std::vector<LightProbe> probes;
+
+    bool empty() const { return probes.empty(); }
+
+    size_t index(int i, int j, int k) const
+    {
+        return (static_cast<size_t>(k) * counts[1] + j) * counts[0] + i;
+    }
+
+    glm::vec3 position(int i, int j, int k) const
+    {
+        return origin + spacing * glm::vec3(i, j, k);
+    }
+
+    // the weighted mean of the valid probes, for positions none of them reach
+    void computeFallback()
+    {
+        float total = 0.0f;
+        for (glm::vec3& face : fallback.cube)
+            face = glm::vec3(0.0f);
+        for (const LightProbe& probe : probes)
+        {
+            for (int f = 0; f < AMBIENT_FACES; f++)
+                fallback.cube[f] += probe.cube[f] * probe.weight;
+            total += probe.weight;
+        }
+        if (total > 0.0f)
+            for (glm::vec3& face : fallback.cube)
+                face /= total;
+        fallback.weight = 1.0f;
+    }
+
+    // trilinear blend of the eight probes around 'p', skipping invalid ones
+    void ambientCube(const glm::vec3& p, glm::vec3 cube[AMBIENT_FACES]) const
+    {
+        glm::vec3 local = wrap(p) - origin;
+        glm::vec3 cell = local / spacing;
+        int base[3];
+        float fraction[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float c = std::min(std::max(cell[axis], 0.0f), static_cast<float>(std::max(counts[axis] - 1, 0)));
+            base[axis] = std::min(static_cast<int>(c), std::max(counts[axis] - 2, 0));
+            fraction[axis] = counts[axis] > 1 ? c - base[axis] : 0.0f;
+        }
+        for (int f = 0; f < AMBIENT_FACES; f++)
+            cube[f] = glm::vec3(0.0f);
+        float total = 0.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            int i = std::min(base[0] + (corner & 1), counts[0] - 1);
+            int j = std::min(base[1] + ((corner >> 1) & 1), counts[1] - 1);
+            int k = std::min(base[2] + ((corner >> 2) & 1), counts[2] - 1);
+            float w = ((corner & 1) ? fraction[0] : 1.0f - fraction[0]) *
+                      (((corner >> 1) & 1) ? fraction[1] : 1.0f - fraction[1]) *
+                      (((corner >> 2) & 1) ? fraction[2] : 1.0f - fraction[2]);
+            if (probes.empty() || i < 0 || j < 0 || k < 0)
+                break;
+            const LightProbe& probe = probes[index(i, j, k)];
+            w *= probe.weight;
+            for (int f = 0; f < AMBIENT_FACES; f++)
+                cube[f] += probe.cube[f] * w;
+            total += w;
+        }
+        if (total <= 1e-6f)
+        {
+            std::copy(fallback.cube, fallback.cube + AMBIENT_FACES, cube);
+            return;
+        }
+        for (int f = 0; f < AMBIENT_FACES; f++)
+            cube[f] /= total;
+    }
+
+private:
+    LightProbe fallback = LightProbe();
+
+    glm::vec3 wrap(const glm::vec3& p) const
+    {
+        glm::vec3 wrapped = p;
+        glm::vec3 start = origin - glm::vec3(spacing * 0.5f);
+        for (int axis = 0; axis < 3; axis++)
+            if (repeat[axis] > 0.0f)
+                wrapped[axis] = p[axis] - std::floor((p[axis] - start[axis]) / repeat[axis]) * repeat[axis];
+        return wrapped;
+    }
+};
+
+#endif
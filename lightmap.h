@@ -0,0 +1,297 @@
+#pragma once
+//
+//  lightmap.h
+//  3D Object Drawing
+//
+//  Baked lighting as the runtime uses it: an atlas with the irradiance (divided by pi) of
+//  every face of the room's static cubes, plus the probe grid for everything else. The file
+//  is written by lightmap_baker.h. Each baked cube is found again by its bounds in room
+//  coordinates, so the bake of one room serves every room of an apartment.
+//
+//  Layout: LightmapFileHeader, surfaceCount LightmapSurfaces, atlasWidth * atlasHeight RGB
+//  floats (bottom row first), then the probes in ProbeGrid order.
+//
+
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frame_arena.h"
+#include "gl_resources.h"
+#include "light_probes.h"
+#include "render_queue.h"
+#include "shader.h"
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const uint32_t LIGHTMAP_MAGIC = 0x4D4C3344;   // "D3LM" read as bytes
+const uint32_t LIGHTMAP_VERSION = 1;
+// what load() accepts: the atlas and the face table (one row per surface) are textures
+const uint32_t LIGHTMAP_MAX_TEXTURE_SIZE = 16384;
+const int32_t LIGHTMAP_MAX_PROBES_PER_AXIS = 1024;
+
+// The faces of a cube are numbered axis * 2 + side; side 1 is where the cube's local
+// coordinate along the axis is 0.5. Texel (i, j) of a face w x h texels wide sits at
+// i / (w - 1), j / (h - 1) along the next two axes, so bilinear filtering never reaches
+// a neighbouring face in the atlas.
+const int LIGHTMAP_FACES = 6;
+
+struct LightmapFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t atlasWidth;
+    uint32_t atlasHeight;
+    uint32_t surfaceCount;
+    uint32_t samplesPerTexel;
+    int32_t probeCounts[3];
+    float probeSpacing;
+    glm::vec3 probeOrigin;
+    float reserved0;
+    glm::vec3 probeRepeat;
+    float reserved1;
+};
+
+// a baked cube; a face of zero width has no area (the thin sides of a flat panel)
+struct LightmapSurface
+{
+    glm::vec3 boundsMin;
+    uint32_t reserved0;
+    glm::vec3 boundsMax;
+    uint32_t reserved1;
+    uint16_t faces[LIGHTMAP_FACES][4];   // x, y, width, height in atlas texels
+};
+
+static_assert(sizeof(LightmapFileHeader) == 72, "LightmapFileHeader is part of the file format");
+static_assert(sizeof(LightmapSurface) == 80, "LightmapSurface is part of the file format");
+
+// items drawn with the shared cube whose pose and shape never change
+inline bool isLightmapped(const DrawItem& item)
+{
+    return !(item.flags & (DRAW_ANIMATED | DRAW_STATEFUL | DRAW_MESH | DRAW_BAKED)) && item.indexCount == 36;
+}
+
+class BakedLighting
+{
+public:
+    LightmapFileHeader header = LightmapFileHeader();
+    std::vector<LightmapSurface> surfaces;
+    std::vector<float> atlas;   // RGB
+    ProbeGrid probes;
+
+    bool loaded() const { return !surfaces.empty(); }
+
+    bool load(const std::string& path, std::ostream& out)
+    {
+        std::ifstream file(path, std::ios::binary);
+        LightmapFileHeader h;
+        if (!file.read(reinterpret_cast<char*>(&h), sizeof(h)))
+        {
+            out << "lightmap: cannot read " << path << std::endl;
+            return false;
+        }
+        if (h.magic != LIGHTMAP_MAGIC || h.version != LIGHTMAP_VERSION)
+        {
+            out << "lightmap: " << path << " is not a version " << LIGHTMAP_VERSION << " lightmap" << std::endl;
+            return false;
+        }
+        bool sizesValid = h.atlasWidth > 0 && h.atlasWidth <= LIGHTMAP_MAX_TEXTURE_SIZE &&
+                          h.atlasHeight > 0 && h.atlasHeight <= LIGHTMAP_MAX_TEXTURE_SIZE &&
+                          h.surfaceCount > 0 && h.surfaceCount <= LIGHTMAP_MAX_TEXTURE_SIZE;
+        for (int axis = 0; axis < 3; axis++)
+            sizesValid &= h.probeCounts[axis] > 0 && h.probeCounts[axis] <= LIGHTMAP_MAX_PROBES_PER_AXIS;
+        if (!sizesValid)
+        {
+            out << "lightmap: " << path << " has an invalid atlas, surface or probe count" << std::endl;
+            return false;
+        }
+
+        // the counts fix the file's size, so nothing is allocated for a file that does not match
+        size_t probeCount = static_cast<size_t>(h.probeCounts[0]) * h.probeCounts[1] * h.probeCounts[2];
+        size_t atlasFloats = static_cast<size_t>(h.atlasWidth) * h.atlasHeight * 3;
+        unsigned long long expectedBytes = sizeof(h) + (unsigned long long)h.surfaceCount * sizeof(LightmapSurface) +
+                                           atlasFloats * sizeof(float) + probeCount * sizeof(LightProbe);
+        file.seekg(0, std::ios::end);
+        unsigned long long fileBytes = static_cast<unsigned long long>(file.tellg());
+        file.seekg(sizeof(h), std::ios::beg);
+        if (!file || fileBytes != expectedBytes)
+        {
+            out << "lightmap: " << path << " is " << fileBytes << " bytes, its header describes " << expectedBytes << std::endl;
+            return false;
+        }
+
+        std::vector<LightmapSurface> newSurfaces(h.surfaceCount);
+        std::vector<float> newAtlas(atlasFloats);
+        std::vector<LightProbe> newProbes(probeCount);
+        file.read(reinterpret_cast<char*>(newSurfaces.data()), newSurfaces.size() * sizeof(LightmapSurface));
+        file.read(reinterpret_cast<char*>(newAtlas.data()), newAtlas.size() * sizeof(float));
+        file.read(reinterpret_cast<char*>(newProbes.data()), newProbes.size() * sizeof(LightProbe));
+        if (!file)
+        {
+            out << "lightmap: " << path << " is truncated" << std::endl;
+            return false;
+        }
+        for (const LightmapSurface& surface : newSurfaces)
+            for (int f = 0; f < LIGHTMAP_FACES; f++)
+                if ((uint32_t)surface.faces[f][0] + surface.faces[f][2] > h.atlasWidth ||
+                    (uint32_t)surface.faces[f][1] + surface.faces[f][3] > h.atlasHeight)
+                {
+                    out << "lightmap: " << path << " has a face outside its atlas" << std::endl;
+                    return false;
+                }
+        surfaces.swap(newSurfaces);
+        atlas.swap(newAtlas);
+        probes.probes.swap(newProbes);
+        header = h;
+        probes.origin = h.probeOrigin;
+        probes.repeat = h.probeRepeat;
+        probes.spacing = h.probeSpacing;
+        for (int axis = 0; axis < 3; axis++)
+            probes.counts[axis] = h.probeCounts[axis];
+        probes.computeFallback();
+        buildLookup();
+        out << "lightmap: " << surfaces.size() << " surfaces in a " << h.atlasWidth << "x" << h.atlasHeight << " atlas, "
+            << probeCount << " probes, " << h.samplesPerTexel << " samples per texel" << std::endl;
+        return true;
+    }
+
+    bool save(const std::string& path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(surfaces.data()), surfaces.size() * sizeof(LightmapSurface));
+        file.write(reinterpret_cast<const char*>(atlas.data()), atlas.size() * sizeof(float));
+        file.write(reinterpret_cast<const char*>(probes.probes.data()), probes.probes.size() * sizeof(LightProbe));
+        return static_cast<bool>(file);
+    }
+
+    // the atlas and the face table as textures; needs the context
+    void upload()
+    {
+        atlasTexture.create(GL_TEXTURE_2D, GPU_TEXTURE, "lightmap atlas");
+        atlasTexture.image2D(1, GL_RGB16F, header.atlasWidth, header.atlasHeight, GL_RGB, GL_FLOAT);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, header.atlasWidth, header.atlasHeight, GL_RGB, GL_FLOAT, atlas.data());
+        setFilter(GL_LINEAR);
+
+        std::vector<float> rects(surfaces.size() * LIGHTMAP_FACES * 4);
+        for (size_t s = 0; s < surfaces.size(); s++)
+            for (int f = 0; f < LIGHTMAP_FACES; f++)
+                for (int c = 0; c < 4; c++)
+                    rects[(s * LIGHTMAP_FACES + f) * 4 + c] = surfaces[s].faces[f][c];
+        faceTexture.create(GL_TEXTURE_2D, GPU_TEXTURE, "lightmap face table");
+        faceTexture.image2D(1, GL_RGBA32F, LIGHTMAP_FACES, static_cast<GLsizei>(surfaces.size()), GL_RGBA, GL_FLOAT);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, LIGHTMAP_FACES, static_cast<GLsizei>(surfaces.size()), GL_RGBA, GL_FLOAT,
+                        rects.data());
+        setFilter(GL_NEAREST);
+    }
+
+    // puts the textures on units 1 and 2 for this frame's draws
+    void bind(const Shader& shader, const glm::vec3& viewPos) const
+    {
+        glActiveTexture(GL_TEXTURE1);
+        atlasTexture.bind();
+        glActiveTexture(GL_TEXTURE2);
+        faceTexture.bind();
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("lightmap", 1);
+        shader.setInt("lightmapFaces", 2);
+        shader.setVec3("viewPos", viewPos);
+    }
+
+    // Gives items[first, end) of a room moved by 'offset' their lightmap slots; items the bake
+    // did not see (wall panels around openings, props) keep 0 and are lit by the probes.
+    size_t assign(FrameVector<DrawItem>& items, size_t first, size_t end, const glm::vec3& offset) const
+    {
+        size_t assigned = 0;
+        for (size_t i = first; i < end; i++)
+        {
+            DrawItem& item = items[i];
+            item.lightmap = 0;
+            if (!isLightmapped(item))
+                continue;
+            glm::vec3 min = item.bounds.min - offset, max = item.bounds.max - offset;
+            int slot = find(min, max);
+            if (slot >= 0)
+            {
+                item.lightmap = static_cast<unsigned int>(slot) + 1;
+                assigned++;
+            }
+        }
+        return assigned;
+    }
+
+private:
+    // centers are bucketed on a 1 cm grid, then the bounds matched within a millimetre
+    static uint64_t key(int x, int y, int z)
+    {
+        const uint64_t mask = 0x1FFFFF;
+        return ((static_cast<uint64_t>(x + (1 << 20)) & mask) << 42) | ((static_cast<uint64_t>(y + (1 << 20)) & mask) << 21) |
+               (static_cast<uint64_t>(z + (1 << 20)) & mask);
+    }
+
+    static int cell(float coordinate) { return static_cast<int>(std::floor(coordinate * 100.0f)); }
+
+    GlTexture atlasTexture;
+    GlTexture faceTexture;
+    std::unordered_multimap<uint64_t, uint32_t> lookup;
+
+    void buildLookup()
+    {
+        lookup.clear();
+        for (size_t s = 0; s < surfaces.size(); s++)
+        {
+            glm::vec3 center = (surfaces[s].boundsMin + surfaces[s].boundsMax) * 0.5f;
+            lookup.emplace(key(cell(center.x), cell(center.y), cell(center.z)), static_cast<uint32_t>(s));
+        }
+    }
+
+    // the surface with these room-local bounds, or -1; a center within a millimetre of a
+    // cell edge is looked up on both sides
+    int find(const glm::vec3& min, const glm::vec3& max) const
+    {
+        glm::vec3 center = (min + max) * 0.5f;
+        int low[3], high[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            low[axis] = cell(center[axis] - 1e-3f);
+            high[axis] = cell(center[axis] + 1e-3f);
+        }
+        for (int x = low[0]; x <= high[0]; x++)
+            for (int y = low[1]; y <= high[1]; y++)
+                for (int z = low[2]; z <= high[2]; z++)
+                {
+                    auto range = lookup.equal_range(key(x, y, z));
+                    for (auto it = range.first; it != range.second; ++it)
+                        if (near(surfaces[it->second].boundsMin, min) && near(surfaces[it->second].boundsMax, max))
+                            return static_cast<int>(it->second);
+                }
+        return -1;
+    }
+
+    static bool near(const glm::vec3& a, const glm::vec3& b)
+    {
+        glm::vec3 d = glm::abs(a - b);
+        return d.x < 1e-3f && d.y < 1e-3f && d.z < 1e-3f;
+    }
+
+    static void setFilter(GLint filter)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+};
+
+#endif
@@ -0,0 +1,612 @@
+#pragma once
+//
+//  lightmap_baker.h
+//  3D Object Drawing
+//
+//  Offline bake of the room's lighting. The static cubes are split into triangles under a
+//  BVH, and every lightmap texel and probe direction gathers irradiance by path tracing:
+//  one area light sampled directly at each vertex of the path, diffuse bounces picked by
+//  cosine. Texels are spread over all cores and refined in passes of growing
+//  sample counts; the file is rewritten after each pass, so an interrupted bake still
+//  leaves a usable lightmap.
+//
+
+#ifndef LIGHTMAP_BAKER_H
+#define LIGHTMAP_BAKER_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "bvh.h"
+#include "frame_arena.h"
+#include "job_system.h"
+#include "light_probes.h"
+#include "lightmap.h"
+#include "render_queue.h"
+#include "room_scene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// rectangle emitting 'radiance' towards the side cross(edgeU, edgeV) points to
+struct BakeLight
+{
+    glm::vec3 corner;
+    glm::vec3 edgeU;
+    glm::vec3 edgeV;
+    glm::vec3 radiance;
+};
+
+// four panels under the ceiling, one over each quarter of the room, facing down
+inline std::vector<BakeLight> ceilingLamps()
+{
+    const float SIZE = 0.5f;
+    const float xs[2] = { 1.0f, 4.6f };
+    const float zs[2] = { 0.5f, 3.5f };
+    std::vector<BakeLight> lamps;
+    for (float x : xs)
+        for (float z : zs)
+        {
+            BakeLight lamp;
+            lamp.corner = glm::vec3(x - SIZE * 0.5f, ROOM_CEILING_Y - 0.02f, z - SIZE * 0.5f);
+            lamp.edgeU = glm::vec3(SIZE, 0.0f, 0.0f);
+            lamp.edgeV = glm::vec3(0.0f, 0.0f, SIZE);
+            lamp.radiance = glm::vec3(36.0f, 33.5f, 29.0f);
+            lamps.push_back(lamp);
+        }
+    return lamps;
+}
+
+const int BAKE_FIRST_PASS_SAMPLES = 4;   // passes double from here
+const int BAKE_MAX_PASS_SAMPLES = 64;
+const size_t BAKE_BLOCK_POINTS = 256;    // texels or probe directions per job
+const int BAKE_MAX_FACE_TEXELS = 256;
+const float BAKE_RAY_OFFSET = 1e-3f;     // keeps a ray from hitting the surface it leaves
+const float BAKE_FAR = 1000.0f;
+
+struct LightmapBakeOptions
+{
+    float texelsPerUnit = 16.0f;
+    int samplesPerTexel = 256;   // over all passes
+    int bounces = 3;             // diffuse bounces after the first surface
+    float probeSpacing = 0.4f;
+    std::vector<BakeLight> lights = ceilingLamps();
+};
+
+struct LightmapBakeStats
+{
+    size_t triangles = 0;
+    size_t texels = 0;
+    size_t probes = 0;
+    int samples = 0;             // per texel so far
+    unsigned long long rays = 0;
+    double seconds = 0.0;
+};
+
+class LightmapBaker
+{
+public:
+    LightmapBakeOptions options;
+    LightmapBakeStats stats;
+
+    // The lightmapped items of 'items' (one room at the origin) become the surfaces; the probe
+    // grid fills 'room' and repeats every 'repeat' along the axes where it is non-zero.
+    void setScene(const FrameVector<DrawItem>& items, const AABB& room, const glm::vec3& repeat)
+    {
+        triangles.clear();
+        points.clear();
+        result = BakedLighting();
+        std::vector<FaceLayout> faces;
+        for (const DrawItem& item : items)
+            if (isLightmapped(item))
+                addSurface(item, faces);
+        packAtlas(faces);
+        for (const FaceLayout& face : faces)
+            addTexels(face);
+        texelCount = points.size();
+        addProbes(room, repeat);
+
+        std::vector<AABB> boxes(triangles.size());
+        for (size_t i = 0; i < triangles.size(); i++)
+        {
+            const Triangle& t = triangles[i];
+            boxes[i] = AABB(t.v0, t.v0);
+            boxes[i].expand(t.v0 + t.e1);
+            boxes[i].expand(t.v0 + t.e2);
+        }
+        bvh.build(boxes.data(), boxes.size());
+
+        stats = LightmapBakeStats();
+        stats.triangles = triangles.size();
+        stats.texels = texelCount;
+        stats.probes = result.probes.probes.size();
+        sums.assign(points.size(), glm::vec3(0.0f));
+        inside.assign(points.size(), 0);
+    }
+
+    // runs passes until options.samplesPerTexel, writing 'path' after each
+    bool bake(const std::string& path, JobSystem& jobs, std::ostream& out)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        std::vector<float> previous;
+        int passSamples = BAKE_FIRST_PASS_SAMPLES;
+        for (int pass = 0; stats.samples < options.samplesPerTexel; pass++)
+        {
+            Clock::time_point passStart = Clock::now();
+            int samples = std::min(passSamples, options.samplesPerTexel - stats.samples);
+            int firstSample = stats.samples;
+            size_t blocks = (points.size() + BAKE_BLOCK_POINTS - 1) / BAKE_BLOCK_POINTS;
+            // each block counts its rays locally and stores the total once
+            std::vector<unsigned long long> blockRays(blocks, 0);
+            auto job = [&](unsigned int block, unsigned int) {
+                unsigned long long rays = 0;
+                size_t end = std::min(points.size(), (block + 1) * BAKE_BLOCK_POINTS);
+                for (size_t p = block * BAKE_BLOCK_POINTS; p < end; p++)
+                    samplePoint(p, firstSample, samples, rays);
+                blockRays[block] = rays;
+            };
+            jobs.parallelFor(static_cast<unsigned int>(blocks), job);
+            stats.samples += samples;
+            if (pass > 0)
+                passSamples = std::min(passSamples * 2, BAKE_MAX_PASS_SAMPLES);
+
+            unsigned long long rays = 0;
+            for (unsigned long long count : blockRays)
+                rays += count;
+            double passSeconds = std::chrono::duration<double>(Clock::now() - passStart).count();
+            double raysPerSecond = passSeconds > 0.0 ? rays / passSeconds : 0.0;
+            stats.rays += rays;
+            stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            resolve();
+            double change = relativeChange(previous, result.atlas);
+            previous = result.atlas;
+            if (!result.save(path))
+            {
+                out << "lightmap: cannot write " << path << std::endl;
+                return false;
+            }
+            out << "lightmap pass " << pass + 1 << ": " << stats.samples << " samples per texel, " << passSeconds
+                << " s, " << raysPerSecond / 1e6 << " Mrays/s";
+            if (pass > 0)
+                out << ", " << change * 100.0 << "% change";
+            out << std::endl;
+        }
+        out << "lightmap: " << stats.texels << " texels and " << stats.probes << " probes over " << stats.triangles
+            << " triangles, " << stats.rays / 1e6 << " M rays in " << stats.seconds << " s on " << jobs.threadCount()
+            << " threads, written to " << path << std::endl;
+        return true;
+    }
+
+private:
+    struct Triangle
+    {
+        glm::vec3 v0, e1, e2;
+        glm::vec3 normal;   // outward for boxes; flat panels are seen from both sides
+        glm::vec3 albedo;
+        bool twoSided;
+    };
+
+    // a lightmap texel or one direction of a probe
+    struct BakePoint
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 jitterU, jitterV;   // texel footprint, zero for probes
+    };
+
+    struct FaceLayout
+    {
+        glm::mat4 model;
+        glm::vec3 normal;
+        uint32_t surface;
+        int face;
+        int width, height;
+        int x = 0, y = 0;
+    };
+
+    // PCG32: a stream per point and pass, so results do not depend on which thread ran them
+    struct Random
+    {
+        uint64_t state;
+
+        Random(uint64_t seed) : state(seed * 6364136223846793005ULL + 1442695040888963407ULL) { next(); }
+
+        uint32_t next()
+        {
+            uint64_t old = state;
+            state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+            uint32_t shifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+            uint32_t rotation = static_cast<uint32_t>(old >> 59u);
+            return (shifted >> rotation) | (shifted << ((32 - rotation) & 31));
+        }
+
+        float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+    };
+
+    std::vector<Triangle> triangles;
+    std::vector<BakePoint> points;   // texels, then six per probe
+    size_t texelCount = 0;
+    std::vector<glm::vec3> sums;
+    std::vector<uint32_t> inside;    // first bounces that hit the back of a box
+    std::vector<uint32_t> texelAtlas;   // atlas index of each texel
+    Bvh bvh;
+    BakedLighting result;
+
+    static glm::vec3 corner(const glm::mat4& model, int axis, int side, float u, float v)
+    {
+        glm::vec3 local(0.0f);
+        local[axis] = side * 0.5f;
+        local[(axis + 1) % 3] = u * 0.5f;
+        local[(axis + 2) % 3] = v * 0.5f;
+        return glm::vec3(model * glm::vec4(local, 1.0f));
+    }
+
+    // the triangles and face layouts of one cube, with the same face numbering as fragmentShader.fs
+    void addSurface(const DrawItem& item, std::vector<FaceLayout>& faces)
+    {
+        LightmapSurface surface = LightmapSurface();
+        surface.boundsMin = item.bounds.min;
+        surface.boundsMax = item.bounds.max;
+        uint32_t slot = static_cast<uint32_t>(result.surfaces.size());
+        const glm::mat4& model = item.model;
+        glm::vec3 center(model * glm::vec4(0.25f, 0.25f, 0.25f, 1.0f));
+        glm::vec3 albedo = glm::min(glm::vec3(item.color), glm::vec3(0.9f));
+        for (int axis = 0; axis < 3; axis++)
+        {
+            glm::vec3 along(model[axis]), u(model[(axis + 1) % 3]), v(model[(axis + 2) % 3]);
+            if (glm::dot(u, u) == 0.0f || glm::dot(v, v) == 0.0f)
+                continue;   // no area
+            bool flat = glm::dot(along, along) == 0.0f;
+            glm::vec3 n = glm::normalize(glm::cross(u, v));
+            for (int side = 0; side < 2; side++)
+            {
+                FaceLayout face;
+                face.model = model;
+                face.surface = slot;
+                face.face = axis * 2 + side;
+                if (flat)
+                    face.normal = side ? n : -n;
+                else
+                {
+                    glm::vec3 faceCenter = corner(model, axis, side, 0.5f, 0.5f);
+                    face.normal = glm::dot(n, faceCenter - center) > 0.0f ? n : -n;
+                }
+                face.width = texelsAlong(glm::length(u) * 0.5f);
+                face.height = texelsAlong(glm::length(v) * 0.5f);
+                faces.push_back(face);
+
+                // both faces of a panel are one two-sided quad
+                if (flat && side == 1)
+                    continue;
+                glm::vec3 p00 = corner(model, axis, side, 0.0f, 0.0f), p10 = corner(model, axis, side, 1.0f, 0.0f);
+                glm::vec3 p01 = corner(model, axis, side, 0.0f, 1.0f), p11 = corner(model, axis, side, 1.0f, 1.0f);
+                triangles.push_back({ p00, p10 - p00, p11 - p00, face.normal, albedo, flat });
+                triangles.push_back({ p00, p11 - p00, p01 - p00, face.normal, albedo, flat });
+            }
+        }
+        result.surfaces.push_back(surface);
+    }
+
+    int texelsAlong(float length) const
+    {
+        int texels = static_cast<int>(std::ceil(length * options.texelsPerUnit)) + 1;
+        return std::min(std::max(texels, 2), BAKE_MAX_FACE_TEXELS);
+    }
+
+    // shelves of faces sorted by height, in an atlas about as wide as it is tall
+    void packAtlas(std::vector<FaceLayout>& faces)
+    {
+        std::stable_sort(faces.begin(), faces.end(), [](const FaceLayout& a, const FaceLayout& b) {
+            return a.height != b.height ? a.height > b.height : a.width > b.width;
+        });
+        size_t area = 0;
+        int widest = 1;
+        for (const FaceLayout& face : faces)
+        {
+            area += static_cast<size_t>(face.width) * face.height;
+            widest = std::max(widest, face.width);
+        }
+        int width = std::max(widest, static_cast<int>(std::ceil(std::sqrt(area * 1.1))));
+        int x = 0, y = 0, shelfHeight = 0;
+        for (FaceLayout& face : faces)
+        {
+            if (x + face.width > width)
+            {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            face.x = x;
+            face.y = y;
+            x += face.width;
+            shelfHeight = std::max(shelfHeight, face.height);
+            uint16_t* rect = result.surfaces[face.surface].faces[face.face];
+            rect[0] = static_cast<uint16_t>(face.x);
+            rect[1] = static_cast<uint16_t>(face.y);
+            rect[2] = static_cast<uint16_t>(face.width);
+            rect[3] = static_cast<uint16_t>(face.height);
+        }
+        result.header.atlasWidth = static_cast<uint32_t>(width);
+        result.header.atlasHeight = static_cast<uint32_t>(std::max(y + shelfHeight, 1));
+        result.atlas.assign(static_cast<size_t>(result.header.atlasWidth) * result.header.atlasHeight * 3, 0.0f);
+        texelAtlas.clear();
+    }
+
+    void addTexels(const FaceLayout& face)
+    {
+        int axis = face.face / 2, side = face.face % 2;
+        glm::vec3 u = glm::vec3(face.model[(axis + 1) % 3]) * 0.5f, v = glm::vec3(face.model[(axis + 2) % 3]) * 0.5f;
+        for (int j = 0; j < face.height; j++)
+            for (int i = 0; i < face.width; i++)
+            {
+                BakePoint point;
+                point.position = corner(face.model, axis, side, i / float(face.width - 1), j / float(face.height - 1));
+                point.normal = face.normal;
+                point.jitterU = u / float(face.width - 1);
+                point.jitterV = v / float(face.height - 1);
+                points.push_back(point);
+                texelAtlas.push_back(static_cast<uint32_t>((face.y + j) * result.header.atlasWidth + face.x + i));
+            }
+    }
+
+    void addProbes(const AABB& room, const glm::vec3& repeat)
+    {
+        ProbeGrid& grid = result.probes;
+        grid.spacing = options.probeSpacing;
+        grid.repeat = repeat;
+        glm::vec3 extent = room.extent();
+        for (int axis = 0; axis < 3; axis++)
+            grid.counts[axis] = std::max(1, static_cast<int>(extent[axis] / grid.spacing));
+        // centered in the room, so no probe sits on a wall
+        grid.origin = room.center() - 0.5f * grid.spacing * glm::vec3(grid.counts[0] - 1, grid.counts[1] - 1, grid.counts[2] - 1);
+        grid.probes.assign(static_cast<size_t>(grid.counts[0]) * grid.counts[1] * grid.counts[2], LightProbe());
+        static const glm::vec3 directions[AMBIENT_FACES] = {
+            glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+            glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)
+        };
+        for (int k = 0; k < grid.counts[2]; k++)
+            for (int j = 0; j < grid.counts[1]; j++)
+                for (int i = 0; i < grid.counts[0]; i++)
+                    for (int f = 0; f < AMBIENT_FACES; f++)
+                        points.push_back({ grid.position(i, j, k), directions[f], glm::vec3(0.0f), glm::vec3(0.0f) });
+        LightmapFileHeader& h = result.header;
+        h.magic = LIGHTMAP_MAGIC;
+        h.version = LIGHTMAP_VERSION;
+        h.surfaceCount = static_cast<uint32_t>(result.surfaces.size());
+        for (int axis = 0; axis < 3; axis++)
+            h.probeCounts[axis] = grid.counts[axis];
+        h.probeSpacing = grid.spacing;
+        h.probeOrigin = grid.origin;
+        h.probeRepeat = grid.repeat;
+    }
+
+    void samplePoint(size_t index, int firstSample, int samples, unsigned long long& rays)
+    {
+        const BakePoint& point = points[index];
+        Random random((static_cast<uint64_t>(index) << 20) ^ static_cast<uint64_t>(firstSample));
+        glm::vec3 sum(0.0f);
+        uint32_t backHits = 0;
+        for (int s = 0; s < samples; s++)
+        {
+            glm::vec3 p = point.position;
+            if (index < texelCount)
+            {
+                // anywhere in the texel's footprint that is still on the face
+                p += point.jitterU * (random.uniform() - 0.5f) + point.jitterV * (random.uniform() - 0.5f);
+                p = glm::mix(point.position, p, 0.999f);
+            }
+            bool backface = false;
+            sum += gather(p, point.normal, random, 0, rays, &backface);
+            backHits += backface;
+        }
+        sums[index] += sum;
+        inside[index] += backHits;
+    }
+
+    // irradiance / pi at 'p' facing 'n': the lights directly, plus one bounce picked by cosine
+    glm::vec3 gather(const glm::vec3& p, const glm::vec3& n, Random& random, int bounce, unsigned long long& rays,
+                     bool* backface) const
+    {
+        glm::vec3 origin = p + n * BAKE_RAY_OFFSET;
+        glm::vec3 light = direct(origin, n, random, rays);
+        if (bounce >= options.bounces)
+            return light;
+        glm::vec3 direction = cosineDirection(n, random);
+        int object;
+        float t;
+        if (!trace(origin, direction, BAKE_FAR, object, t, rays))
+            return light;
+        const Triangle& hit = triangles[object];
+        glm::vec3 normal = hit.normal;
+        if (glm::dot(normal, direction) > 0.0f)
+        {
+            if (!hit.twoSided)
+            {
+                if (backface)
+                    *backface = true;   // started inside a box
+                return light;
+            }
+            normal = -normal;
+        }
+        return light + hit.albedo * gather(origin + direction * t, normal, random, bounce + 1, rays, nullptr);
+    }
+
+    // one shadow ray to a point on a light picked at random, weighted by the light count
+    glm::vec3 direct(const glm::vec3& origin, const glm::vec3& n, Random& random, unsigned long long& rays) const
+    {
+        if (options.lights.empty())
+            return glm::vec3(0.0f);
+        size_t count = options.lights.size();
+        const BakeLight& light = options.lights[random.next() % count];
+        glm::vec3 q = light.corner + light.edgeU * random.uniform() + light.edgeV * random.uniform();
+        glm::vec3 area = glm::cross(light.edgeU, light.edgeV);
+        glm::vec3 toLight = q - origin;
+        float distance2 = glm::dot(toLight, toLight);
+        glm::vec3 direction = toLight / std::sqrt(distance2);
+        float cosSurface = glm::dot(n, direction);
+        float cosLight = -glm::dot(area, direction);   // |area| times the cosine
+        if (cosSurface <= 0.0f || cosLight <= 0.0f)
+            return glm::vec3(0.0f);
+        int object;
+        float t;
+        if (trace(origin, toLight, 1.0f - 1e-4f, object, t, rays))
+            return glm::vec3(0.0f);
+        return light.radiance * (count * cosSurface * cosLight / (distance2 * 3.14159265f));
+    }
+
+    static glm::vec3 cosineDirection(const glm::vec3& n, Random& random)
+    {
+        float r = std::sqrt(random.uniform());
+        float phi = 6.28318531f * random.uniform();
+        glm::vec3 helper = std::fabs(n.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 tangent = glm::normalize(glm::cross(helper, n));
+        glm::vec3 bitangent = glm::cross(n, tangent);
+        return tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + n * std::sqrt(std::max(0.0f, 1.0f - r * r));
+    }
+
+    // nearest triangle along origin + t * direction for t in (0, maxT)
+    bool trace(const glm::vec3& origin, const glm::vec3& direction, float maxT, int& object, float& t,
+               unsigned long long& rays) const
+    {
+        rays++;
+        auto exact = [this](int index, const glm::vec3& o, const glm::vec3& d, float& hitT) {
+            // Moller-Trumbore
+            const Triangle& tri = triangles[index];
+            glm::vec3 pv = glm::cross(d, tri.e2);
+            float det = glm::dot(tri.e1, pv);
+            if (std::fabs(det) < 1e-12f)
+                return false;
+            float inverse = 1.0f / det;
+            glm::vec3 tv = o - tri.v0;
+            float u = glm::dot(tv, pv) * inverse;
+            if (u < 0.0f || u > 1.0f)
+                return false;
+            glm::vec3 qv = glm::cross(tv, tri.e1);
+            float v = glm::dot(d, qv) * inverse;
+            if (v < 0.0f || u + v > 1.0f)
+                return false;
+            hitT = glm::dot(tri.e2, qv) * inverse;
+            return hitT > 0.0f;
+        };
+        BvhHit hit = bvh.raycast(origin, direction, maxT, exact);
+        object = hit.object;
+        t = hit.t;
+        return hit.object >= 0;
+    }
+
+    // averages into the atlas and the probes; texels mostly inside furniture take their neighbours' light
+    void resolve()
+    {
+        float scale = 1.0f / std::max(stats.samples, 1);
+        float insideLimit = stats.samples * 0.5f;
+        std::vector<uint8_t> valid(result.atlas.size() / 3, 0);
+        std::fill(result.atlas.begin(), result.atlas.end(), 0.0f);
+        for (size_t i = 0; i < texelCount; i++)
+        {
+            glm::vec3 value = sums[i] * scale;
+            float* texel = &result.atlas[texelAtlas[i] * 3];
+            texel[0] = value.x;
+            texel[1] = value.y;
+            texel[2] = value.z;
+            valid[texelAtlas[i]] = inside[i] < insideLimit;
+        }
+        for (const LightmapSurface& surface : result.surfaces)
+            for (int f = 0; f < LIGHTMAP_FACES; f++)
+                dilate(surface.faces[f], valid);
+
+        float probeInsideLimit = stats.samples * 0.25f;
+        for (size_t p = 0; p < result.probes.probes.size(); p++)
+        {
+            LightProbe& probe = result.probes.probes[p];
+            uint32_t backHits = 0;
+            for (int f = 0; f < AMBIENT_FACES; f++)
+            {
+                size_t point = texelCount + p * AMBIENT_FACES + f;
+                probe.cube[f] = sums[point] * scale;
+                backHits += inside[point];
+            }
+            probe.weight = backHits < probeInsideLimit * AMBIENT_FACES ? 1.0f : 0.0f;
+        }
+        result.header.samplesPerTexel = static_cast<uint32_t>(stats.samples);
+    }
+
+    // fills invalid texels of one face from valid neighbours, a ring at a time
+    void dilate(const uint16_t* rect, std::vector<uint8_t>& valid)
+    {
+        int x0 = rect[0], y0 = rect[1], w = rect[2], h = rect[3];
+        int atlasWidth = static_cast<int>(result.header.atlasWidth);
+        for (int ring = 0; ring < 4; ring++)
+        {
+            std::vector<int> filled;
+            for (int y = y0; y < y0 + h; y++)
+                for (int x = x0; x < x0 + w; x++)
+                {
+                    if (valid[y * atlasWidth + x])
+                        continue;
+                    glm::vec3 total(0.0f);
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx < x0 || ny < y0 || nx >= x0 + w || ny >= y0 + h || !valid[ny * atlasWidth + nx])
+                                continue;
+                            const float* texel = &result.atlas[(ny * atlasWidth + nx) * 3];
+                            total += glm::vec3(texel[0], texel[1], texel[2]);
+                            count++;
+                        }
+                    if (!count)
+                        continue;
+                    float* texel = &result.atlas[(y * atlasWidth + x) * 3];
+                    texel[0] = total.x / count;
+                    texel[1] = total.y / count;
+                    texel[2] = total.z / count;
+                    filled.push_back(y * atlasWidth + x);
+                }
+            if (filled.empty())
+                break;
+            for (int index : filled)
+                valid[index] = 1;
+        }
+    }
+
+    // mean absolute difference over the mean value
+    static double relativeChange(const std::vector<float>& before, const std::vector<float>& after)
+    {
+        if (before.size() != after.size() || after.empty())
+            return 1.0;
+        double difference = 0.0, total = 0.0;
+        for (size_t i = 0; i < after.size(); i++)
+        {
+            difference += std::fabs(after[i] - before[i]);
+            total += after[i];
+        }
+        return total > 0.0 ? difference / total : 0.0;
+    }
+};
+
+// Bakes the room, closed and in its default state, into 'path'.
+inline bool bakeRoomLightmaps(const std::string& path, const LightmapBakeOptions& options, std::ostream& out)
+{
+    FrameArena arena(1 << 20);
+    FrameVector<DrawItem> items{ FrameAllocator<DrawItem>(arena) };
+    RoomOpening noOpenings[WALL_COUNT];
+    appendRoom(items, 0, glm::mat4(1.0f), noOpenings, RoomState());
+
+    LightmapBaker baker;
+    baker.options = options;
+    AABB room(glm::vec3(ROOM_MIN_X, ROOM_FLOOR_Y, ROOM_MIN_Z), glm::vec3(ROOM_MAX_X, ROOM_CEILING_Y, ROOM_MAX_Z));
+    baker.setScene(items, room, glm::vec3(ROOM_PITCH_X, 0.0f, ROOM_PITCH_Z));
+    JobSystem jobs;
+    return baker.bake(path, jobs, out);
+}
+
+#endif
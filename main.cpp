@@ -13,17 +13,88 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.h"
+#include "asset_pack.h"
 #include "camera.h"
 #include "basic_camera.h"
-
+#include "frame_arena.h"
+#include "render_queue.h"
+#include "occlusion_culling.h"
+#include "job_system.h"
+#include "room_scene.h"
+#include "stress_scene.h"
+#include "batch_renderer.h"
+#include "dynamic_resolution.h"
+#include "frame_capture.h"
+#include "gpu_culling.h"
+#include "mesh_import.h"
+#include "multi_view.h"
+#include "texture_streaming.h"
+#include "world_streaming.h"
+#include "trace_events.h"
+#include "gl_intercept.h"
+#include "input_latency.h"
+#include "gl_extensions.h"
+#include "bvh.h"
+#include "lightmap.h"
+#include "lightmap_baker.h"
+#include "clustered_lighting.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 
 using namespace std;
 
+#ifdef COUNT_FRAME_ALLOCATIONS
+// count every C++ heap allocation so the render loop can check that a steady-state
+// frame never reaches malloc (everything per-frame should come from the frame arena)
+void* operator new(std::size_t size)
+{
+    heapAllocationCounter().fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow* window);
+void moveCamera(GLFWwindow* window, float time);
+void lateLatchCamera(GLFWwindow* window);
+void renderScene(GLFWwindow* window);
+BatchOptions batchOptions();
+void pickObject(const FrameVector<DrawItem>& sceneItems, const glm::mat4& viewProjection, float viewShare, float time);
+bool cookAssetPack(const char* path, const CubeMesh& bed, const CubeMesh& pillow);
+void loadRoomEntities(const AssetPack& pack, const AssetPackEntry& entities, const AssetPackEntry& clusters, GLuint vao,
+                      FrameVector<DrawItem>& items, ClusterRange* ranges);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -47,6 +118,91 @@ bool openBookshelf = false;
 bool TVoff = false;
 bool ss1 , ss2 , ss3;
 
+// render queue options (1/2: depth pre-pass on/off, 3/4: front-to-back sort on/off, 5/6: overdraw view on/off)
+bool depthPrepassEnabled = false;
+bool frontToBackEnabled = true;
+bool overdrawViewEnabled = false;
+// software occlusion culling (7/8: on/off)
+bool occlusionCullingEnabled = false;
+// rooms of the apartment (--apartment COLUMNSxROWS, default a single room) and portal culling (9/0: on/off)
+int apartmentColumns = 1;
+int apartmentRows = 1;
+bool portalCullingEnabled = true;
+// frustum culling and draw submission on the GPU (K/L: on/off, needs GL 4.3); --cull-benchmark times it against the CPU
+bool gpuCullingEnabled = false;
+bool cullBenchmark = false;
+// camera collision against the scene BVH (M/N: on/off); a left click toggles the TV or bookshelf under the cursor
+Bvh sceneBvh;
+bool cameraCollisionEnabled = true;
+const float CAMERA_RADIUS = 0.2f;
+bool pickRequested = false;
+double pickX = 0.0, pickY = 0.0;
+// distant clock, table and sofa drawn as one proxy box each (I/J: on/off)
+bool hlodEnabled = true;
+// random crates per room (--scatter N); --stress-sweep renders 1e2 .. 1e6 objects and prints a scaling table
+int scatterPerRoom = 0;
+bool stressSweepEnabled = false;
+const unsigned int SCATTER_SEED = 4208;
+// offscreen rendering at a scale that keeps the scene pass within a GPU time budget (R/F: on/off, --frame-budget MS)
+bool dynamicResolutionEnabled = false;
+float frameBudgetMs = 16.0f;
+// records the window (--capture walk.y4m for one video stream, any other path for a PPM sequence; --capture-fps N)
+const char* capturePath = nullptr;
+int captureFps = 60;
+// renders the poses of a file to images on several hidden contexts and exits (--batch POSES, --batch-out PREFIX, --batch-threads N).
+// --batch-backend cpu renders them with the software rasterizer and no GL context; both renders with GL, then with
+// the CPU, and compares the images
+const char* batchPosesPath = nullptr;
+const char* batchOutputPrefix = "pose";
+unsigned int batchThreads = 0;
+BatchBackend batchBackend = BATCH_GL;
+// free camera on the left two thirds, top-down BasicCamera overview on the right, drawn in one submission (Q/E: on/off, --multi-view)
+bool multiViewEnabled = false;
+// --cook PACK writes geometry, shader sources and the room's entity table to one archive and exits; --pack PACK maps it at startup
+const char* cookPackPath = nullptr;
+const char* assetPackPath = nullptr;
+// furniture meshes (--import FILE.obj or FILE.glb, repeatable), stood in a row across every room
+std::vector<const char*> importPaths;
+// streamed textures on the floor, walls and furniture (F1/F2: on/off, --no-textures, --texture-budget MB,
+// --textures DIR with floor.ppm, plaster.ppm, wood.ppm and fabric.ppm; missing files are generated)
+bool texturesEnabled = true;
+int textureBudgetMB = 12;
+const char* textureDirectory = nullptr;
+// rooms cooked into chunk files in DIR and streamed in around the camera (--world DIR, --world-budget MB for their buffers)
+const char* worldDirectory = nullptr;
+int worldBudgetMB = 8;
+// Chrome trace of the frame phases and worker threads (F3/F4: record on/off, F5: write it now; written at exit too).
+// --trace FILE records from startup into FILE instead of trace.json; --trace-benchmark times a zone
+const char* tracePath = "trace.json";
+bool traceUsed = false;
+bool traceWriteRequested = false;
+// GL calls counted per frame, with the ones that set state to what it already was (F6/F7: on/off, --gl-stats).
+// The most frequent calls are listed when counting is switched off and at exit
+bool glStatsEnabled = false;
+// camera input timed from its callback to the swap and the GPU end of the frame that shows it (--latency; the
+// distributions are printed at exit). Late latching reads the cursor and keys again right before the draws and
+// re-uploads the view matrix (F8/F9: on/off, --late-latch)
+bool latencyEnabled = false;
+bool lateLatchEnabled = false;
+InputLatency inputLatency;
+// baked lighting: lightmaps on the room's static cubes, light probes for the rest (--lightmaps FILE, F10/F11: on/off).
+// --bake-lightmaps FILE path traces them on every core and exits (--bake-samples N per texel)
+const char* lightmapPath = nullptr;
+bool bakedLightingEnabled = true;
+const char* bakeLightmapPath = nullptr;
+int bakeSamples = 256;
+// point lights over the ceilings, tables and TVs, listed per view cluster on the CPU every frame (F12: on/off).
+// --lights N makes exactly N by adding coloured ones at random, --naive-lights loops over all of them per fragment,
+// --light-sweep times frames for 1 to 1024 lights, clustered and naive, then exits
+bool pointLightsEnabled = false;
+int pointLightCount = 0;
+bool naiveLightsEnabled = false;
+bool lightSweepEnabled = false;
+const char* PACKED_SHADERS[] = {
+    "vertexShader.vs", "fragmentShader.fs", "indirectVertexShader.vs", "indirectFragmentShader.fs", "cullShader.cs",
+    "multiViewVertexShader.vs", "multiViewWorldVertexShader.vs", "multiViewGeometryShader.gs"
+};
+
 // camera
 Camera camera(glm::vec3(2.0f, 1.5f, 3.0f));
 float lastX = SCR_WIDTH;
@@ -61,37 +217,198 @@ BasicCamera basic_camera(eyeX, eyeY, eyeZ, lookAtX, lookAtY, lookAtZ, V);
 // timing
 float deltaTime = 0.0f;    // time between current frame and last frame
 float lastFrame = 0.0f;
+float cameraMovedAt = 0.0f;    // the camera keys move the camera by the time since then
 
-glm::mat4 transformation(float transform_x, float transform_y, float transform_z, float rotate_x, float rotate_y,
-    float rotate_z, float scale_x, float scale_y, float scale_z) {
-    glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model;
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(transform_x, transform_y, transform_z));
-    rotateXMatrix = glm::rotate(identityMatrix, glm::radians(rotate_x), glm::vec3(1.0f, 0.0f, 0.0f));
-    rotateYMatrix = glm::rotate(identityMatrix, glm::radians(rotate_y), glm::vec3(0.0f, 1.0f, 0.0f));
-    rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotate_z), glm::vec3(0.0f, 0.0f, 1.0f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(scale_x, scale_y, scale_z));
-    model = translateMatrix * rotateXMatrix * rotateYMatrix * rotateZMatrix * scaleMatrix;
-    return model;
-}
+// per-frame memory: everything allocated here is released at the top of the next frame
+FrameArena frameArena(1 << 20);
+unsigned long long framesWithHeapAllocations = 0;
 
-int main()
+int main(int argc, char** argv)
 {
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--apartment") == 0 && i + 1 < argc)
+        {
+            if (std::sscanf(argv[++i], "%dx%d", &apartmentColumns, &apartmentRows) != 2 || apartmentColumns < 1 || apartmentRows < 1)
+            {
+                std::cout << "--apartment expects COLUMNSxROWS, e.g. 3x2" << std::endl;
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--scatter") == 0 && i + 1 < argc)
+        {
+            scatterPerRoom = std::atoi(argv[++i]);
+            if (scatterPerRoom < 0)
+            {
+                std::cout << "--scatter expects a count of props per room" << std::endl;
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+        {
+            frameBudgetMs = static_cast<float>(std::atof(argv[++i]));
+            if (frameBudgetMs <= 0.0f)
+            {
+                std::cout << "--frame-budget expects milliseconds, e.g. 8.3" << std::endl;
+                return -1;
+            }
+            dynamicResolutionEnabled = true;
+        }
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            capturePath = argv[++i];
+        else if (std::strcmp(argv[i], "--capture-fps") == 0 && i + 1 < argc)
+            captureFps = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            batchPosesPath = argv[++i];
+        else if (std::strcmp(argv[i], "--batch-out") == 0 && i + 1 < argc)
+            batchOutputPrefix = argv[++i];
+        else if (std::strcmp(argv[i], "--batch-threads") == 0 && i + 1 < argc)
+            batchThreads = static_cast<unsigned int>(std::max(0, std::atoi(argv[++i])));
+        else if (std::strcmp(argv[i], "--batch-backend") == 0 && i + 1 < argc)
+        {
+            const char* backend = argv[++i];
+            if (std::strcmp(backend, "gl") == 0)
+                batchBackend = BATCH_GL;
+            else if (std::strcmp(backend, "cpu") == 0)
+                batchBackend = BATCH_CPU;
+            else if (std::strcmp(backend, "both") == 0)
+                batchBackend = BATCH_BOTH;
+            else
+            {
+                std::cout << "--batch-backend expects gl, cpu or both" << std::endl;
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--multi-view") == 0)
+            multiViewEnabled = true;
+        else if (std::strcmp(argv[i], "--cook") == 0 && i + 1 < argc)
+            cookPackPath = argv[++i];
+        else if (std::strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+            assetPackPath = argv[++i];
+        else if (std::strcmp(argv[i], "--import") == 0 && i + 1 < argc)
+            importPaths.push_back(argv[++i]);
+        else if (std::strcmp(argv[i], "--no-textures") == 0)
+            texturesEnabled = false;
+        else if (std::strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+        {
+            textureBudgetMB = std::atoi(argv[++i]);
+            if (textureBudgetMB < 1)
+            {
+                std::cout << "--texture-budget expects megabytes, e.g. 16" << std::endl;
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--textures") == 0 && i + 1 < argc)
+            textureDirectory = argv[++i];
+        else if (std::strcmp(argv[i], "--world") == 0 && i + 1 < argc)
+            worldDirectory = argv[++i];
+        else if (std::strcmp(argv[i], "--world-budget") == 0 && i + 1 < argc)
+        {
+            worldBudgetMB = std::atoi(argv[++i]);
+            if (worldBudgetMB < 1)
+            {
+                std::cout << "--world-budget expects megabytes, e.g. 8" << std::endl;
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            tracePath = argv[++i];
+            traceUsed = true;
+            tracer().setEnabled(true);
+        }
+        else if (std::strcmp(argv[i], "--gl-stats") == 0)
+            glStatsEnabled = true;
+        else if (std::strcmp(argv[i], "--latency") == 0)
+            latencyEnabled = true;
+        else if (std::strcmp(argv[i], "--late-latch") == 0)
+            lateLatchEnabled = true;
+        else if (std::strcmp(argv[i], "--lightmaps") == 0 && i + 1 < argc)
+            lightmapPath = argv[++i];
+        else if (std::strcmp(argv[i], "--bake-lightmaps") == 0 && i + 1 < argc)
+            bakeLightmapPath = argv[++i];
+        else if (std::strcmp(argv[i], "--bake-samples") == 0 && i + 1 < argc)
+            bakeSamples = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+        {
+            pointLightCount = std::max(0, std::atoi(argv[++i]));
+            pointLightsEnabled = true;
+        }
+        else if (std::strcmp(argv[i], "--naive-lights") == 0)
+        {
+            naiveLightsEnabled = true;
+            pointLightsEnabled = true;
+        }
+        else if (std::strcmp(argv[i], "--light-sweep") == 0)
+            lightSweepEnabled = true;
+        else if (std::strcmp(argv[i], "--trace-benchmark") == 0)
+        {
+            runTraceBenchmark(std::cout, 10000000);
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--stress-sweep") == 0)
+            stressSweepEnabled = true;
+        else if (std::strcmp(argv[i], "--cull-benchmark") == 0)
+            cullBenchmark = true;
+        else if (std::strcmp(argv[i], "--bvh-benchmark") == 0)
+        {
+            runBvhBenchmark(std::cout, 100000);
+            return 0;
+        }
+    }
+
+    // nor does the lightmap bake
+    if (bakeLightmapPath)
+    {
+        LightmapBakeOptions bakeOptions;
+        bakeOptions.samplesPerTexel = bakeSamples;
+        return bakeRoomLightmaps(bakeLightmapPath, bakeOptions, std::cout) ? 0 : -1;
+    }
+
+    // the CPU backend needs neither a window nor a GL context
+    if (batchPosesPath && batchBackend == BATCH_CPU)
+    {
+        std::vector<CameraPose> poses;
+        if (!loadCameraPoses(batchPosesPath, poses, std::cout) || poses.empty())
+            return -1;
+        runSoftwareBatchRender(poses, batchOptions(), std::cout);
+        return 0;
+    }
+
+    // llvmpipe gives every context a pool of rasterizer threads; batch workers are already one
+    // per core, so each context gets a single thread unless the user chose otherwise
+    if (batchPosesPath && !std::getenv("LP_NUM_THREADS"))
+    {
+#ifdef _WIN32
+        _putenv_s("LP_NUM_THREADS", "1");
+#else
+        setenv("LP_NUM_THREADS", "1", 0);
+#endif
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+    if (batchPosesPath || cookPackPath)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
-    // glfw window creation
+    // glfw window creation; 4.3 enables GPU culling, everything else runs on 3.3
     // --------------------
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CSE 4208: Computer Graphics Laboratory", NULL, NULL);
     if (window == NULL)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CSE 4208: Computer Graphics Laboratory", NULL, NULL);
+    }
+    if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -101,6 +418,8 @@ int main()
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     // tell GLFW to capture our mouse
     //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -112,6 +431,42 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    glExtensions().load((GLADloadproc)glfwGetProcAddress);
+    std::cout << "OpenGL " << glExtensions().major << "." << glExtensions().minor
+        << (glExtensions().compute ? "" : " (no compute shaders: GPU culling disabled)") << std::endl;
+
+    // every GL object lives inside renderScene so it is released while the context still exists
+    tracer().nameThread("main");
+    renderScene(window);
+    if (traceUsed)
+        tracer().writeChromeTrace(tracePath, std::cout);
+    if (gpuMemory().liveObjects() != 0)
+    {
+        std::cout << "GL objects still alive at exit:" << std::endl;
+        gpuMemory().reportAllocations(std::cout);
+    }
+
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    glfwTerminate();
+    return 0;
+}
+
+// builds the room's GPU resources and runs the render loop until the window is closed
+// ---------------------------------------------------------------------------------------------------------
+void renderScene(GLFWwindow* window)
+{
+    // startup is timed to the first frame, so runs with and without --pack can be compared
+    auto startupBegin = std::chrono::steady_clock::now();
+    bool startupReported = false;
+    AssetPack assetPack;
+    double packMapMs = 0.0;
+    if (assetPackPath && !cookPackPath)
+    {
+        if (assetPack.open(assetPackPath))
+            shaderAssetPack() = &assetPack;
+        packMapMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+    }
 
     // configure global opengl state
     // -----------------------------
@@ -469,18 +824,42 @@ int main()
         glm::vec3(1.5f,  0.2f, -1.5f),
         glm::vec3(-1.3f,  1.0f, -1.5f)
     };*/
-    unsigned int VBO1, VAO1, EBO1;
-    glGenVertexArrays(1, &VAO1);
-    glGenBuffers(1, &VBO1);
-    glGenBuffers(1, &EBO1);
+    CubeMesh bedMesh = { bed_vertices, sizeof(bed_vertices), cube_indices, sizeof(cube_indices) };
+    CubeMesh pillowMesh = { pillow_vertices, sizeof(pillow_vertices), cube_indices, sizeof(cube_indices) };
+    if (cookPackPath)
+    {
+        cookAssetPack(cookPackPath, bedMesh, pillowMesh);
+        return;
+    }
 
-    glBindVertexArray(VAO1);
+    // with a pack the uploads read straight from its mapping
+    auto packed = [&](const char* name, AssetKind kind, const void*& data, size_t& bytes) {
+        if (const AssetPackEntry* entry = assetPack.find(name, kind))
+        {
+            data = assetPack.data(*entry);
+            bytes = static_cast<size_t>(entry->bytes);
+        }
+    };
+    const void* cubeIndices = cube_indices;
+    size_t cubeIndexBytes = sizeof(cube_indices);
+    const void* bedVertices = bed_vertices;
+    size_t bedVertexBytes = sizeof(bed_vertices);
+    const void* pillowVertices = pillow_vertices;
+    size_t pillowVertexBytes = sizeof(pillow_vertices);
+    packed("cube_indices", ASSET_INDICES, cubeIndices, cubeIndexBytes);
+    packed("bed_vertices", ASSET_VERTICES, bedVertices, bedVertexBytes);
+    packed("pillow_vertices", ASSET_VERTICES, pillowVertices, pillowVertexBytes);
+    bedMesh = { static_cast<const float*>(bedVertices), bedVertexBytes, static_cast<const unsigned int*>(cubeIndices), cubeIndexBytes };
+
+    GlVertexArray VAO1("room VAO");
+    GlBuffer VBO1(GPU_VERTEX_BUFFER, "cube vertices (bed colors)");
+    GlBuffer EBO1(GPU_INDEX_BUFFER, "cube indices");
+
+    VAO1.bind();
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO1);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(bed_vertices), bed_vertices, GL_STATIC_DRAW);
+    VBO1.data(GL_ARRAY_BUFFER, bedVertexBytes, bedVertices, GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO1);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
+    EBO1.data(GL_ELEMENT_ARRAY_BUFFER, cubeIndexBytes, cubeIndices, GL_STATIC_DRAW);
 
     // position attribute
    // glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
@@ -495,18 +874,15 @@ int main()
     glEnableVertexAttribArray(1);
 
 
-    unsigned int VBO2, VAO2, EBO2;
-    glGenVertexArrays(1, &VAO2);
-    glGenBuffers(1, &VBO2);
-    glGenBuffers(1, &EBO2);
+    GlVertexArray VAO2("pillow VAO");
+    GlBuffer VBO2(GPU_VERTEX_BUFFER, "cube vertices (pillow colors)");
+    GlBuffer EBO2(GPU_INDEX_BUFFER, "cube indices");
 
-    glBindVertexArray(VAO2);
+    VAO2.bind();
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO2);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(pillow_vertices), pillow_vertices, GL_STATIC_DRAW);
+    VBO2.data(GL_ARRAY_BUFFER, pillowVertexBytes, pillowVertices, GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO2);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
+    EBO2.data(GL_ELEMENT_ARRAY_BUFFER, cubeIndexBytes, cubeIndices, GL_STATIC_DRAW);
 
     // position attribute
    // glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
@@ -520,6 +896,167 @@ int main()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)12);
     glEnableVertexAttribArray(1);
 
+    // imported meshes get a VAO each and one placement shared by all rooms
+    std::vector<GpuMesh> importedMeshes;
+    std::vector<glm::mat4> importedPlacements;
+    for (const char* path : importPaths)
+    {
+        ImportedMesh mesh;
+        if (!importMesh(path, mesh, std::cout))
+            continue;
+        reportImport(path, mesh, std::cout);
+        glm::vec3 spot(0.5f + 1.2f * importedMeshes.size(), ROOM_FLOOR_Y, 0.5f * (ROOM_MIN_Z + ROOM_MAX_Z));
+        importedPlacements.push_back(standOnFloor(mesh.bounds, spot, 1.0f));
+        importedMeshes.emplace_back();
+        importedMeshes.back().upload(mesh);
+    }
+
+    gpuMemory().report(std::cout);
+
+    RenderQueue renderQueue;
+    float lastOverdrawReport = 0.0f;
+    JobSystem jobs;
+    OcclusionCuller occlusionCuller;
+    float lastOcclusionReport = 0.0f;
+    Apartment apartment;
+    buildApartment(apartment, apartmentColumns, apartmentRows);
+    scatterProps(apartment, scatterPerRoom, SCATTER_SEED);
+    float lastPortalReport = 0.0f;
+    bool sceneChanged = true;
+
+    // HLOD proxies are built once from a reference room at the origin, cooked into the pack when there is one.
+    // The pack's entity table is used for nothing else: every frame's rooms come from appendRoom, which
+    // cuts each room's own openings and applies the RoomState the table cannot hold.
+    HlodSelector hlod;
+    StressSweep stressSweep;
+    {
+        FrameVector<DrawItem> reference{ FrameAllocator<DrawItem>(frameArena) };
+        ClusterRange ranges[CLUSTER_COUNT];
+        const AssetPackEntry* entities = assetPack.find("room_entities", ASSET_ENTITIES);
+        const AssetPackEntry* clusters = assetPack.find("room_clusters", ASSET_CLUSTERS);
+        if (entities && clusters && assetPack.count<CookedCluster>(*clusters) == CLUSTER_COUNT)
+            loadRoomEntities(assetPack, *entities, *clusters, VAO1.id(), reference, ranges);
+        else
+        {
+            RoomOpening noOpenings[WALL_COUNT];
+            appendRoom(reference, VAO1.id(), glm::mat4(1.0f), noOpenings, RoomState(), ranges);
+        }
+        hlod.buildProxies(reference.data(), ranges, CLUSTER_COUNT);
+        stressSweep.plan(reference.size() + scatterPerRoom);
+    }
+    unsigned int lastHlodProxies = 0;
+    float lastHlodReport = 0.0f;
+    GpuCuller gpuCuller;
+    gpuCuller.init(VBO1.id(), EBO1.id());
+    float lastGpuCullReport = 0.0f;
+    DynamicResolution dynamicResolution;
+    float lastResolutionReport = 0.0f;
+    FrameCapture frameCapture;
+    float lastCaptureReport = 0.0f;
+    MultiViewRenderer multiView;
+    float lastMultiViewReport = 0.0f;
+    // added in RoomMaterial order: material m streams texture m - 1
+    TextureStreamer textureStreamer;
+    textureStreamer.options.budgetBytes = (size_t)textureBudgetMB * 1024 * 1024;
+    {
+        auto file = [](const char* name) { return textureDirectory ? std::string(textureDirectory) + "/" + name : std::string(); };
+        textureStreamer.add({ "floor", file("floor.ppm"), generateFloorTiles, 1024, 0.5f });
+        textureStreamer.add({ "plaster", file("plaster.ppm"), generatePlaster, 1024, 0.5f });
+        textureStreamer.add({ "wood", file("wood.ppm"), generateWood, 1024, 1.0f });
+        textureStreamer.add({ "fabric", file("fabric.ppm"), generateFabric, 512, 1.0f });
+        textureStreamer.start();
+    }
+    ourShader.use();
+    ourShader.setInt("albedo", 0);
+    setPointLightUnits(ourShader);
+    float lastTextureReport = 0.0f;
+    unsigned long long reportedTextureChanges = 0;
+    // the sweep rebuilds the apartment for every run, so it keeps all rooms resident
+    WorldStreamer worldStreamer;
+    worldStreamer.options.gpuBudgetBytes = (size_t)worldBudgetMB * 1024 * 1024;
+    if (worldDirectory && !stressSweepEnabled)
+    {
+        std::string signature = "rooms " + std::to_string(apartmentColumns) + "x" + std::to_string(apartmentRows) +
+            " scatter " + std::to_string(scatterPerRoom) + " seed " + std::to_string(SCATTER_SEED) +
+            " chunk " + std::to_string(CHUNK_ROOMS) + " pack " + std::to_string(ASSET_PACK_VERSION);
+        worldStreamer.start(worldDirectory, apartment, apartmentColumns, apartmentRows, signature);
+    }
+    float lastWorldReport = 0.0f;
+    unsigned long long reportedWorldChanges = 0;
+    BakedLighting bakedLighting;
+    if (lightmapPath && bakedLighting.load(lightmapPath, std::cout))
+        bakedLighting.upload();
+    ClusteredLighting clusteredLighting;
+    clusteredLighting.init();
+    std::vector<PointLight> pointLights;
+    bool pointLightingSet = false;
+    float lastClusterReport = 0.0f;
+    // the light sweep runs without vsync and waits for the GPU at the end of every frame
+    LightSweep lightSweep;
+    auto applyLightSweepRun = [&]() {
+        pointLightCount = static_cast<int>(lightSweep.run().lights);
+        naiveLightsEnabled = lightSweep.run().mode == POINT_LIGHTS_NAIVE;
+        pointLightsEnabled = true;
+    };
+    if (lightSweepEnabled)
+    {
+        glfwSwapInterval(0);
+        lightSweep.plan();
+        applyLightSweepRun();
+    }
+    GlCallStats& glStats = glCallStats();
+    float lastGlStatsReport = 0.0f;
+    if (latencyEnabled)
+        inputLatency.start();
+    float lastLatencyReport = 0.0f;
+    unsigned long long reportedLatencySamples = 0;
+    if (capturePath)
+    {
+        size_t length = std::strlen(capturePath);
+        bool y4m = length > 4 && std::strcmp(capturePath + length - 4, ".y4m") == 0;
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        frameCapture.start(capturePath, y4m ? CAPTURE_Y4M : CAPTURE_PPM, width, height, captureFps);
+    }
+
+    if (cullBenchmark)
+    {
+        if (!gpuCuller.ready())
+        {
+            std::cout << "--cull-benchmark needs an OpenGL 4.3 context" << std::endl;
+            return;
+        }
+        const size_t counts[] = { 10000, 100000, 1000000 };
+        runCullingBenchmark(std::cout, gpuCuller, jobs, counts, 3);
+        return;
+    }
+
+    if (batchPosesPath)
+    {
+        std::vector<CameraPose> poses;
+        if (!loadCameraPoses(batchPosesPath, poses, std::cout) || poses.empty())
+            return;
+        BatchOptions batch = batchOptions();
+        runBatchRender(poses, batch, bedMesh, std::cout);
+        if (batch.backend == BATCH_BOTH)
+            runSoftwareBatchRender(poses, batch, std::cout);
+        return;
+    }
+
+    // the sweep replaces the apartment with its first size and runs without vsync
+    auto applyStressRun = [&]() {
+        const StressRun& run = stressSweep.run();
+        buildApartment(apartment, run.columns, run.rows);
+        scatterProps(apartment, scatterPerRoom, SCATTER_SEED);
+        portalCullingEnabled = run.portalCulling;
+        camera = Camera(glm::vec3(2.0f, 1.5f, 3.0f));
+        sceneChanged = true;
+    };
+    if (stressSweepEnabled)
+    {
+        glfwSwapInterval(0);
+        applyStressRun();
+    }
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
@@ -531,18 +1068,49 @@ int main()
     // -----------
     while (!glfwWindowShouldClose(window))
     {
+        // release last frame's temporaries
+        // ---------------------------------
+        frameArena.reset();
+        TRACE_ZONE("frame");
+        auto cpuFrameStart = std::chrono::steady_clock::now();
+        unsigned long long heapAllocationsAtFrameStart = heapAllocationCounter().load(std::memory_order_relaxed);
+
         // per-frame time logic
         // --------------------
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // GL call counting is switched between frames, so every counted frame is whole
+        if (glStats.installed())
+        {
+            glStats.beginFrame();
+            if (currentFrame - lastGlStatsReport >= 1.0f)
+            {
+                glStats.reportFrame(std::cout);
+                lastGlStatsReport = currentFrame;
+            }
+        }
+        if (glStatsEnabled && !glStats.installed())
+            glStats.install();
+        else if (!glStatsEnabled && glStats.installed())
+        {
+            glStats.reportTop(std::cout, 10);
+            glStats.uninstall();
+        }
+
         // input
         // -----
         processInput(window);
 
         // render
         // ------
+        // into the scaled offscreen target when dynamic resolution is on; the window is only touched by the final blit
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        dynamicResolution.options.enabled = dynamicResolutionEnabled;
+        dynamicResolution.options.budgetMs = frameBudgetMs;
+        dynamicResolution.begin(framebufferWidth, framebufferHeight);
         glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -551,7 +1119,13 @@ int main()
         ourShader.use();
 
         // pass projection matrix to shader (note that in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        TRACE_ZONE_NAMED(cameraZone, "camera update");
+        float aspect = framebufferHeight > 0 ? (float)framebufferWidth / (float)framebufferHeight : (float)SCR_WIDTH / (float)SCR_HEIGHT;
+        const float FREE_VIEW_SHARE = 2.0f / 3.0f;
+        float windowAspect = aspect;
+        if (multiViewEnabled)
+            aspect *= FREE_VIEW_SHARE;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
         //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
         ourShader.setMat4("projection", projection);
 
@@ -559,73 +1133,15 @@ int main()
         glm::mat4 view = camera.GetViewMatrix();
         //glm::mat4 view = basic_camera.createViewMatrix();
         ourShader.setMat4("view", view);
+        if (!lateLatchEnabled)
+            inputLatency.latch(LATCH_EARLY);
 
-        glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model;
-
-
-
-        
-        //left wall
-        glm::mat4 scaleMatrix_wall = glm::scale(identityMatrix, glm::vec3(1.0f, 1.0f, 1.0f));
-        glm::mat4 modelLeftWall = transformation(-0.80f, -0.30f, -1.0f, 0.0f, 90.0f, 0.0f, -14.0f, 4.8f, 0.0f);
-        ourShader.setMat4("model", modelLeftWall * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(1.0f, 0.7f, 0.7f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        // Right wall
-        glm::mat4 modelRightWall = transformation(2.28 * 2.80f, -0.30f, 6.0f, 0.0f, 90.0f, 0.0f, 14.0f, 4.8f, 0.0f);
-        ourShader.setMat4("model", modelRightWall * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(1.0f, 0.7f, 0.7f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-
-        // Front wall
-        glm::mat4 modelFrontWall = transformation(-0.80f, -0.30f, -1.0f, 0.0f, 0.0f, 0.0f, 14.4f, 4.8f, 0.0f);
-        ourShader.setMat4("model", modelFrontWall * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(1.0f, 0.7f, 0.7f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        // back wall
-        glm::mat4 modelBackWall = transformation(-0.80f, -0.30f, 5.0f, 0.0f, 0.0f, 0.0f, 14.4f, 4.8f, 0.0f);
-        ourShader.setMat4("model", modelBackWall * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(1.0f, 0.7f, 0.7f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //// Top wall
-        glm::mat4 modelTopWall = transformation(-0.80f, 2.0f, -1.0f, 90.0f, 0.0f, 0.0f, 14.3f, 14.0f, 0.0f);
-        ourShader.setMat4("model", modelTopWall * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.95f, 0.95f, 0.95f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-
-        //// Bottom wall
-
-        float x_trans = -0.8f;
-        for (int i = 0; i < 10; i++)
-        {
-            float z_trans = -1.0f;
-            for (int it = 0; it < 10; it++)
-            {
-                glm::mat4 tile1 = transformation(x_trans, -0.30f, z_trans, 90.0f, 0.0f, 0.0f, 1.5f, 1.5f, 0.0f);
-                ourShader.setMat4("model", tile1 * scaleMatrix_wall);
-                ourShader.setVec4("color", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-                glBindVertexArray(VAO1);
-                glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-                z_trans += 0.77f;
-            }
-            x_trans += 0.77f;
-        }
-        
+        // the fan blades and clock hands are turned by the vertex shader
+        float animationTime = static_cast<float>(glfwGetTime());
+        ourShader.setFloat("time", animationTime);
+        TRACE_ZONE_END(cameraZone);
 
         //TV
-
         float a, b, c,x;
         
         if (!TVoff)
@@ -666,240 +1182,461 @@ int main()
             
         }
 
-        model = transformation(1.80f, 0.60f, x, 0.0f, 0.0f, 0.0f, 4.55f, 2.15f, 0.0f);
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(a, b, c, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //white
-        model = transformation(1.80f, 0.60f, -0.99f, 0.0f, 0.0f, 0.0f, 4.5f, 2.1f, 0.0f);
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-
-        //fan
-
-        currentFrame = static_cast<float>(glfwGetTime());
-        float rotationSpeed = 200000.0f;
-        float fanRotationAngle = 0.0f;
-        if (fanRotationEnabled)
-        {
-            fanRotationAngle = glm::radians(rotationSpeed * currentFrame);
-        }
-        for (int i = 0; i < 4; ++i) {
-            float rotateAngle = i * 90.0f + fanRotationAngle; // Update rotation angle
-            //white
-            glm::mat4 modelBlade = transformation(2.375f, 1.87f, 2.50f, 90.0f, 0.0f, rotateAngle, 2.50f, 0.5f, 0.03f);
-            ourShader.setMat4("model", modelBlade);
-            ourShader.setVec4("color", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-            glBindVertexArray(VAO1);
-            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-            //black
-            glm::mat4 modelBlade2 = transformation(2.375f, 1.86f, 2.50f, 90.0f, 0.0f, rotateAngle, 2.50f, 0.47f, 0.03f);
-            ourShader.setMat4("model", modelBlade2);
-            ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-            glBindVertexArray(VAO1);
-            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        TRACE_ZONE_NAMED(sceneZone, "scene update");
+        RoomState roomState;
+        roomState.fanRotating = fanRotationEnabled;
+        roomState.bookshelfOpen = openBookshelf;
+        roomState.tvColor = glm::vec4(a, b, c, 1.0f);
+        roomState.tvZ = x;
+
+        // with streaming, chunks load ahead of the camera and only resident rooms have objects
+        if (worldStreamer.active())
+        {
+            TRACE_ZONE("world streaming");
+            const WorldStreamingStats& ws = worldStreamer.stats;
+            unsigned long long residencyChanges = ws.loads + ws.unloads;
+            worldStreamer.update(apartment, camera.Position, deltaTime);
+            sceneChanged |= ws.loads + ws.unloads != residencyChanges;
+            unsigned long long changes = ws.loads + ws.unloads + ws.crossings;
+            if (currentFrame - lastWorldReport >= 1.0f && (changes != reportedWorldChanges || ws.loadingChunks))
+            {
+                worldStreamer.report(std::cout);
+                lastWorldReport = currentFrame;
+                reportedWorldChanges = changes;
+            }
+        }
+
+        // every room, seen or not: collisions and picking need the whole apartment, so a room
+        // that is not streamed in still has its walls, floor and ceiling (collision only).
+        // Each room's objects are contiguous, from cellFirst[cell] to cellFirst[cell + 1].
+        FrameVector<DrawItem> sceneItems{ FrameAllocator<DrawItem>(frameArena) };
+        sceneItems.reserve((160 + scatterPerRoom + importedMeshes.size()) * apartment.rooms.size());
+        int cellCount = apartment.cells.cellCount();
+        size_t* cellFirst = frameArena.allocateArray<size_t>(cellCount + 1);
+        ClusterRange* cellClusters = frameArena.allocateArray<ClusterRange>(cellCount * CLUSTER_COUNT);
+        for (int cell = 0; cell < cellCount; cell++)
+        {
+            cellFirst[cell] = sceneItems.size();
+            if (worldStreamer.active() && !worldStreamer.cellResident(cell))
+            {
+                for (int c = 0; c < CLUSTER_COUNT; c++)
+                    cellClusters[cell * CLUSTER_COUNT + c] = ClusterRange();
+                appendRoomShell(sceneItems, VAO1.id(), apartment.rooms[cell].placement, apartment.rooms[cell].openings,
+                                DRAW_COLLISION_ONLY);
+                continue;
+            }
+            appendRoom(sceneItems, VAO1.id(), apartment.rooms[cell].placement, apartment.rooms[cell].openings, roomState,
+                       &cellClusters[cell * CLUSTER_COUNT]);
+            appendRoomProps(sceneItems, VAO1.id(), apartment.rooms[cell]);
+            if (worldStreamer.active())
+                worldStreamer.bindBaked(cell, sceneItems, cellFirst[cell]);
+            if (bakedLightingEnabled && bakedLighting.loaded())
+                bakedLighting.assign(sceneItems, cellFirst[cell], sceneItems.size(),
+                                     glm::vec3(apartment.rooms[cell].placement[3]));
+            for (size_t m = 0; m < importedMeshes.size(); m++)
+            {
+                sceneItems.push_back(makeMeshDraw(importedMeshes[m], apartment.rooms[cell].placement * importedPlacements[m],
+                                                  glm::vec4(0.60f, 0.45f, 0.30f, 1.0f)));
+                sceneItems.back().material = MATERIAL_WOOD;
+            }
+        }
+        cellFirst[cellCount] = sceneItems.size();
+
+        // the BVH is built when the scene changes and then refit along the paths above whatever was switched (fan, doors, TV)
+        AABB* sceneBounds = frameArena.allocateArray<AABB>(sceneItems.size());
+        for (size_t i = 0; i < sceneItems.size(); i++)
+            sceneBounds[i] = sceneItems[i].bounds;
+        if (sceneChanged || sceneBvh.objectCount() != sceneItems.size())
+        {
+            sceneBvh.build(sceneBounds, sceneItems.size());
+            gpuCuller.invalidateScene();
+            sceneChanged = false;
         }
-        
-        //sofa
-        glm::mat4 sofa = transformation(0.78f, -0.3f, 4.6f, 0.0f, 0.0f, 0.0f, 5.2f, 1.5f, 0.6f);
-        ourShader.setMat4("model", sofa * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.80f, 0.65f, 0.5f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 sofaSeat = transformation(0.80f, -0.3f, 4.0f, 0.0f, 0.0f, 0.0f, 5.0f, 0.8f, 1.65f);
-        ourShader.setMat4("model", sofaSeat * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.8f, 0.7f, 0.6f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-
-        glm::mat4 sofaHandle = transformation(0.75f, -0.3f, 4.1f, 0.0f, 0.0f, 0.0f, 0.5f, 1.2f, 1.65f);
-        ourShader.setMat4("model", sofaHandle * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.87f, 0.72f, 0.53f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 sofaHandle2 = transformation(3.15f, -0.3f, 4.1f, 0.0f, 0.0f, 0.0f, 0.5f, 1.2f, 1.65f);
-        ourShader.setMat4("model", sofaHandle2 * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.87f, 0.72f, 0.53f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //table
-        glm::mat4 table = transformation(1.00f, 0.20f, 3.0f, 0.0f, 0.0f, 0.0f, 4.0f, 0.2f, 1.6f);
-        ourShader.setMat4("model", table * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.5f, 0.5f, 0.5f, 0.5f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //table leg
-        glm::mat4 tablel = transformation(1.00f, -0.3f, 3.0f, 0.0f, 0.0f, 0.0f, 0.3f, 1.0f, 0.3f);
-        ourShader.setMat4("model", tablel * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 tablel2 = transformation(1.00f, -0.3f, 3.65f, 0.0f, 0.0f, 0.0f, 0.3f, 1.0f, 0.3f);
-        ourShader.setMat4("model", tablel2 * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 tablel3 = transformation(2.8f, -0.3f, 3.65f, 0.0f, 0.0f, 0.0f, 0.3f, 1.0f, 0.3f);
-        ourShader.setMat4("model", tablel3 * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 tablel4 = transformation(2.8f, -0.3f, 3.0f, 0.0f, 0.0f, 0.0f, 0.3f, 1.0f, 0.3f);
-        ourShader.setMat4("model", tablel4 * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-
-        //Clock
-        glm::mat4 WallClock = transformation(6.10f, 1.00f, 3.0f, 0.0f, 90.0f, 0.0f, 1.5f, 1.5f, 0.3f);
-        ourShader.setMat4("model", WallClock* scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 time12 = transformation(6.09f, 1.67f, 2.65f, 0.0f, 90.0f, 0.0f, 0.1f, 0.1f, 0.3f);
-        ourShader.setMat4("model", time12 * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 time6 = transformation(6.09f, 1.05f, 2.65f, 0.0f, 90.0f, 0.0f, 0.1f, 0.1f, 0.3f);
-        ourShader.setMat4("model", time6 * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 time3 = transformation(6.09f, 1.36f, 2.96f, 0.0f, 90.0f, 0.0f, 0.1f, 0.1f, 0.3f);
-        ourShader.setMat4("model", time3 * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 time9 = transformation(6.09f, 1.36f, 2.34f, 0.0f, 90.0f, 0.0f, 0.1f, 0.1f, 0.3f);
-        ourShader.setMat4("model", time9 * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        float clockRotationAngle = glm::radians(600 * currentFrame);
-        glm::mat4 min = transformation(6.09f, 1.38f, 2.637f, 0.0f, 90.0f, clockRotationAngle, 0.05f, 0.55f, 0.05f);
-        ourShader.setMat4("model", min* scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        float clockRotationAngle2 = glm::radians(100 * currentFrame);
-        glm::mat4 hour = transformation(6.09f, 1.38f, 2.637f, 0.0f, 90.0f, clockRotationAngle2, 0.05f, 0.50f, 0.05f);
-        ourShader.setMat4("model", hour* scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-
-        // Book shelf
-        glm::mat4 rightWood = transformation(1.0f, -0.30f, 0.0f, 0.0f, 90.0f, 0.0f, 2.0f, 3.8f, 0.15f);
-        ourShader.setMat4("model", rightWood* scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.53f, 0.29f, 0.03f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 leftWood = transformation(0.0f, -0.30f, 0.0f, 0.0f, 90.0f, 0.0f, 2.0f, 3.8f, 0.15f);
-        ourShader.setMat4("model", leftWood * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.53f, 0.29f, 0.03f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 backWood = transformation(-0.00f, -0.30f, -0.9f, 0.0f, 0.0f, 0.0f, 2.0f, 3.8f, 0.0f);
-        ourShader.setMat4("model", backWood * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.38f, 0.22f, 0.07f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 bottomWood = transformation(0.00f, -0.29f, -1.0f, 90.0f, 0.0f, 0.0f, 2.1f, 2.0f, 1.3f);
-        ourShader.setMat4("model", bottomWood * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.36f, 0.18f, 0.07f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 topWood = transformation(0.00f, 1.6f, -1.04f, 90.0f, 0.0f, 0.0f, 2.1f, 2.0f, 0.15f);
-        ourShader.setMat4("model", topWood * scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.36f, 0.18f, 0.07f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        float openAngle;
-        if (!openBookshelf)
-            openAngle = 0.0f;
         else
-            openAngle = -120.0f;
+            sceneBvh.refit(sceneBounds);
 
-        glm::mat4 frontWood = transformation(-0.00f, -0.30f, 0.02f, 0.0f, openAngle, 0.0f, 1.0f, 3.8f, 0.0f);
-        ourShader.setMat4("model", frontWood* scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.53f, 0.29f, 0.03f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        if (pickRequested)
+        {
+            pickRequested = false;
+            // with the overview on, the camera's view is the left part of the window
+            pickObject(sceneItems, projection * view, multiViewEnabled ? FREE_VIEW_SHARE : 1.0f, animationTime);
+        }
 
-        glm::mat4 frontWood2 = transformation(1.05f, -0.30f, 0.02f, 0.0f, 180-openAngle, 0.0f, 1.0f, 3.8f, 0.0f);
-        ourShader.setMat4("model", frontWood2* scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.53f, 0.29f, 0.03f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        TRACE_ZONE_END(sceneZone);
 
+        // objects are collected into this frame's draw list and drawn together at the end,
+        // so the render queue can order them and choose the passes
+        TRACE_ZONE_NAMED(visibilityZone, "visibility");
+        FrameVector<DrawItem> drawList{ FrameAllocator<DrawItem>(frameArena) };
+        drawList.reserve(sceneItems.size());
 
-        glm::mat4 s1 = transformation(0.00f, 1.0f, -1.04f, 90.0f, 0.0f, 0.0f, 2.1f, 2.0f, 0.15f);
-        ourShader.setMat4("model", s1* scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.36f, 0.18f, 0.07f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        // the overview looks down on the whole apartment from above the ceilings
+        ViewSetup views[2];
+        Frustum overviewFrustum;
+        if (multiViewEnabled)
+        {
+            AABB apartmentBounds;
+            for (int cell = 0; cell < cellCount; cell++)
+                apartmentBounds.expand(apartment.cells.cellBounds(cell));
+            float renderWidth = static_cast<float>(dynamicResolution.stats.width);
+            float renderHeight = static_cast<float>(dynamicResolution.stats.height);
+            float split = std::floor(renderWidth * FREE_VIEW_SHARE);
+            views[0] = { view, projection, 0.0f, 0.0f, split, renderHeight };
+            views[1].x = split;
+            views[1].y = 0.0f;
+            views[1].width = renderWidth - split;
+            views[1].height = renderHeight;
+            topDownOverview(basic_camera, apartmentBounds, ROOM_CEILING_Y, glm::radians(45.0f),
+                            windowAspect * (1.0f - FREE_VIEW_SHARE), views[1].view, views[1].projection);
+            overviewFrustum = Frustum::fromMatrix(views[1].projection * views[1].view);
+        }
 
-        glm::mat4 s2 = transformation(0.00f ,0.4f, -1.04f, 90.0f, 0.0f, 0.0f, 2.1f, 2.0f, 0.15f);
-        ourShader.setMat4("model", s2* scaleMatrix_wall);
-        ourShader.setVec4("color", glm::vec4(0.36f, 0.18f, 0.07f, 1.0f));
-        glBindVertexArray(VAO1);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        // GPU culling tests the whole resident scene in its compute pass, so only the imported
+        // meshes, the last items of each room, are collected for it here
+        bool gpuCulled = gpuCullingEnabled && gpuCuller.ready() && !multiViewEnabled;
+        Frustum cameraFrustum;
+        if (gpuCulled)
+            cameraFrustum = Frustum::fromMatrix(projection * view);
+
+        // only rooms seen through a chain of doors and windows from the camera's room, plus,
+        // with the overview on, whatever it sees: one union list is sorted and submitted once
+        if (portalCullingEnabled && !gpuCulled)
+            apartment.cells.computeVisibility(camera.Position, projection * view);
+        hlod.options.enabled = hlodEnabled;
+        hlod.beginFrame(cellCount * CLUSTER_COUNT, camera.Position, glm::radians(camera.Zoom), framebufferHeight);
+        for (int cell = 0; cell < cellCount; cell++)
+        {
+            if (gpuCulled)
+            {
+                if (worldStreamer.active() && !worldStreamer.cellResident(cell))
+                    continue;
+                for (size_t i = cellFirst[cell + 1] - importedMeshes.size(); i < cellFirst[cell + 1]; i++)
+                    if (cameraFrustum.intersects(sceneItems[i].bounds))
+                        drawList.push_back(sceneItems[i]);
+                continue;
+            }
+            bool freeCell = !portalCullingEnabled || apartment.cells.isCellVisible(cell);
+            bool overviewCell = multiViewEnabled && overviewFrustum.intersects(apartment.cells.cellBounds(cell));
+            if ((!freeCell && !overviewCell) || (worldStreamer.active() && !worldStreamer.cellResident(cell)))
+                continue;
+            auto visible = [&](const AABB& bounds) {
+                return (freeCell && (!portalCullingEnabled || apartment.cells.isVisible(cell, bounds))) ||
+                       (overviewCell && overviewFrustum.intersects(bounds));
+            };
+
+            // furniture far enough away is drawn as its proxy box instead of its parts
+            const glm::mat4& placement = apartment.rooms[cell].placement;
+            const ClusterRange* clusters = &cellClusters[cell * CLUSTER_COUNT];
+            bool proxied[CLUSTER_COUNT];
+            for (int c = 0; c < CLUSTER_COUNT; c++)
+            {
+                const HlodProxy& proxy = hlod.proxy(c);
+                AABB proxyBounds = transformAABB(placement, proxy.bounds);
+                proxied[c] = hlod.select(cell * CLUSTER_COUNT + c, c, proxyBounds);
+                if (proxied[c] && visible(proxyBounds))
+                    drawList.push_back(makeCubeDraw(placement * proxy.model, proxy.color, VAO1.id()));
+            }
 
+            // keep the objects that fall inside a portal's view of the room
+            for (size_t i = cellFirst[cell]; i < cellFirst[cell + 1]; i++)
+            {
+                bool replaced = false;
+                for (int c = 0; c < CLUSTER_COUNT; c++)
+                    replaced |= proxied[c] && i >= clusters[c].first && i < clusters[c].end;
+                if (!replaced && visible(sceneItems[i].bounds))
+                    drawList.push_back(sceneItems[i]);
+            }
+        }
+        // at most once a second, and quiet while the count holds
+        if (!gpuCulled && hlod.stats.proxies != lastHlodProxies && currentFrame - lastHlodReport >= 1.0f)
+        {
+            std::cout << "HLOD: " << hlod.stats.proxies << " of " << hlod.stats.clusters << " furniture clusters as proxies, "
+                << hlod.stats.drawsSaved << " draws saved" << std::endl;
+            lastHlodProxies = hlod.stats.proxies;
+            lastHlodReport = currentFrame;
+        }
+        if (portalCullingEnabled && !gpuCulled && currentFrame - lastPortalReport >= 1.0f)
+        {
+            const PortalStats& ps = apartment.cells.stats;
+            std::cout << "portals: " << ps.visibleCells << " of " << ps.cells << " rooms visible"
+                << (ps.cameraOutside ? " (camera outside)" : "") << ", " << ps.portalsPassed << " of "
+                << ps.portalsTested << " portals passed, " << drawList.size() << " draws, " << ps.ms << " ms" << std::endl;
+            lastPortalReport = currentFrame;
+        }
+
+        // drop what the walls, sofa and bookshelf hide before anything reaches GL
+        // (from the free camera only, so not while the overview needs them)
+        if (occlusionCullingEnabled && !multiViewEnabled && !gpuCulled)
+        {
+            occlusionCuller.cull(drawList, projection * view, jobs, frameArena);
+            if (currentFrame - lastOcclusionReport >= 1.0f)
+            {
+                const OcclusionStats& os = occlusionCuller.stats;
+                std::cout << "occlusion: " << os.culled << " occluded + " << os.offscreen << " offscreen of " << os.tested
+                    << " (" << os.occluders << " occluders, " << os.occluderTriangles << " triangles), raster "
+                    << os.rasterMs << " ms, test " << os.testMs << " ms" << std::endl;
+                lastOcclusionReport = currentFrame;
+            }
+        }
+
+        TRACE_ZONE_END(visibilityZone);
+
+        // the visible textured surfaces ask for the mips their size on screen needs; this frame's
+        // share of decoded pixels is uploaded, and whatever is resident is bound
+        MaterialBinding* materials = nullptr;
+        if (texturesEnabled)
+        {
+            TRACE_ZONE("texture streaming");
+            float pixelsPerUnit = framebufferHeight * 0.5f / std::tan(glm::radians(camera.Zoom) * 0.5f);
+            textureStreamer.beginFrame();
+            for (const DrawItem& item : drawList)
+                if (item.material != MATERIAL_NONE)
+                    textureStreamer.request(item.material - 1, item.bounds, camera.Position, pixelsPerUnit);
+            textureStreamer.update();
+            materials = frameArena.allocateArray<MaterialBinding>(MATERIAL_COUNT);
+            materials[MATERIAL_NONE] = MaterialBinding();
+            for (int m = MATERIAL_NONE + 1; m < MATERIAL_COUNT; m++)
+            {
+                materials[m].texture = textureStreamer.residentTexture(m - 1);
+                materials[m].repeatsPerUnit = textureStreamer.repeatsPerUnit(m - 1);
+            }
+            glActiveTexture(GL_TEXTURE0);
+            // quiet once everything has settled
+            const TextureStreamingStats& ts = textureStreamer.stats;
+            unsigned long long changes = ts.levelsUploaded + ts.levelsEvicted;
+            if (currentFrame - lastTextureReport >= 1.0f && (changes != reportedTextureChanges || ts.pendingDecodes))
+            {
+                textureStreamer.report(std::cout);
+                lastTextureReport = currentFrame;
+                reportedTextureChanges = changes;
+            }
+        }
+
+        // The input that arrived while the frame was prepared turns the camera before anything is drawn.
+        // Culling above used the earlier view, so a fast turn can show an object culled a moment ago at the edge.
+        if (lateLatchEnabled)
+        {
+            TRACE_ZONE("late latch");
+            lateLatchCamera(window);
+            view = camera.GetViewMatrix();
+            ourShader.use();
+            ourShader.setMat4("view", view);
+            if (multiViewEnabled)
+                views[0].view = view;
+            inputLatency.latch(LATCH_LATE);
+        }
+
+        // draw everything collected above
+        TRACE_ZONE_NAMED(drawZone, "draw submission");
+        renderQueue.options.materials = materials;
+        renderQueue.options.depthPrepass = depthPrepassEnabled;
+        renderQueue.options.frontToBack = frontToBackEnabled;
+        renderQueue.options.overdrawView = overdrawViewEnabled;
+        // the multi-view path and the GPU-culled multi-draw stay unlit
+        bool baked = bakedLightingEnabled && bakedLighting.loaded() && !multiViewEnabled;
+        renderQueue.options.probes = baked ? &bakedLighting.probes : nullptr;
+        if (baked)
+            bakedLighting.bind(ourShader, camera.Position);
+        // point lights are clustered against the view after the late latch; the ceiling lamps are in the bake
+        bool pointLit = pointLightsEnabled && !multiViewEnabled;
+        if (pointLit)
+        {
+            TRACE_ZONE("light clusters");
+            gatherSceneLights(pointLights, apartment, roomState, !baked, pointLightCount, animationTime);
+            clusteredLighting.build(pointLights, view, projection, jobs);
+            clusteredLighting.upload();
+            clusteredLighting.bind(ourShader, naiveLightsEnabled ? POINT_LIGHTS_NAIVE : POINT_LIGHTS_CLUSTERED,
+                                   glm::vec3(0.35f), camera.Position);
+            if (currentFrame - lastClusterReport >= 1.0f && !lightSweepEnabled)
+            {
+                const ClusterStats& cs = clusteredLighting.stats;
+                std::cout << "point lights" << (naiveLightsEnabled ? " (naive)" : "") << ": " << cs.visibleLights << " of "
+                    << cs.lights << " in view, " << cs.occupiedClusters << " of " << LIGHT_CLUSTER_COUNT << " clusters lit, "
+                    << (cs.occupiedClusters ? static_cast<double>(cs.indices) / cs.occupiedClusters : 0.0)
+                    << " lights per lit cluster (at most " << cs.maxPerCluster << "), listed in " << cs.buildMs << " ms";
+                if (cs.dropped)
+                    std::cout << ", " << cs.dropped << " over the per-cluster limit";
+                std::cout << std::endl;
+                lastClusterReport = currentFrame;
+            }
+        }
+        else if (pointLightingSet)
+            ourShader.setInt("pointLighting", POINT_LIGHTS_OFF);
+        pointLightingSet = pointLit;
+        if (multiViewEnabled)
+        {
+            multiView.draw(renderQueue, drawList, views, ourShader, animationTime, camera.Position, frameArena, VAO1.id());
+            if (currentFrame - lastMultiViewReport >= 1.0f)
+            {
+                std::cout << "multi-view (" << multiViewPathName(multiView.path()) << "): " << drawList.size()
+                    << " objects in the union of both views, " << multiView.drawCalls << " draw calls" << std::endl;
+                lastMultiViewReport = currentFrame;
+            }
+        }
+        else if (gpuCulled)
+        {
+            // the scene stays on the GPU between changes; the compute pass culls it against the
+            // frustum and writes the draws, and one multi-draw submits them
+            gpuCuller.patchScene(sceneItems, frameArena);
+            gpuCuller.cull(projection * view);
+            gpuCuller.draw(view, projection, animationTime);
+            // imported meshes are not cubes, so they go through the queue after the multi-draw
+            if (!importedMeshes.empty())
+            {
+                ourShader.use();
+                renderQueue.execute(drawList, ourShader, camera.Position, frameArena, VAO1.id());
+            }
+            if (currentFrame - lastGpuCullReport >= 1.0f)
+            {
+                std::cout << "GPU culling: " << gpuCuller.readVisibleCount() << " of " << gpuCuller.stats.objects << " drawn"
+                    << (gpuCuller.stats.indirectCount ? " (indirect count)" : " (one command per object)") << std::endl;
+                lastGpuCullReport = currentFrame;
+            }
+        }
+        else
+            renderQueue.execute(drawList, ourShader, camera.Position, frameArena, VAO1.id());
+        if (overdrawViewEnabled && currentFrame - lastOverdrawReport >= 1.0f)
+        {
+            std::cout << "overdraw: " << renderQueue.stats.averageOverdraw << " writes per covered pixel, "
+                << renderQueue.stats.coveredPixels * 100.0 << "% covered, "
+                << renderQueue.stats.drawCalls + renderQueue.stats.prepassDrawCalls << " draw calls" << std::endl;
+            lastOverdrawReport = currentFrame;
+        }
+
+        // stretch the scaled image over the window
+        dynamicResolution.end();
+        TRACE_ZONE_END(drawZone);
+        if (dynamicResolutionEnabled && currentFrame - lastResolutionReport >= 1.0f)
+        {
+            const DynamicResolutionStats& rs = dynamicResolution.stats;
+            std::cout << "dynamic resolution: " << rs.width << "x" << rs.height << " (scale " << rs.scale << "), scene "
+                << rs.gpuMs << " ms of " << frameBudgetMs << " ms budget" << std::endl;
+            lastResolutionReport = currentFrame;
+        }
+
+        // queue this frame's readback; pixels from a few frames ago go to the writer thread
+        if (frameCapture.active())
+        {
+            frameCapture.capture(deltaTime * 1000.0);
+            if (currentFrame - lastCaptureReport >= 1.0f)
+            {
+                frameCapture.report(std::cout);
+                lastCaptureReport = currentFrame;
+            }
+        }
+
+        // a warmed-up frame should not have touched the heap (only counted with COUNT_FRAME_ALLOCATIONS)
+        if (frameArena.getStats().frames > 2 && heapAllocationCounter().load(std::memory_order_relaxed) != heapAllocationsAtFrameStart)
+            framesWithHeapAllocations++;
+
+        if (stressSweepEnabled)
+        {
+            // CPU side only: everything up to the swap, which is where the driver may wait for the GPU
+            double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuFrameStart).count();
+            unsigned long long triangles = 0;
+            for (const DrawItem& item : drawList)
+                triangles += item.indexCount / 3;
+            unsigned int drawCalls = gpuCulled ? 1
+                : renderQueue.stats.drawCalls + renderQueue.stats.prepassDrawCalls;
+            if (stressSweep.record(cpuMs, drawCalls, triangles, sceneItems.size()))
+            {
+                if (stressSweep.done())
+                {
+                    stressSweep.report(std::cout);
+                    glfwSetWindowShouldClose(window, true);
+                }
+                else
+                    applyStressRun();
+            }
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            TRACE_ZONE("glfwSwapBuffers");
+            inputLatency.beforeSwap();
+            glfwSwapBuffers(window);
+            inputLatency.afterSwap();
+        }
+        if (lightSweepEnabled)
+        {
+            glFinish();
+            double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuFrameStart).count();
+            if (lightSweep.record(frameMs, clusteredLighting.stats))
+            {
+                if (lightSweep.done())
+                {
+                    lightSweep.report(std::cout);
+                    glfwSetWindowShouldClose(window, true);
+                }
+                else
+                    applyLightSweepRun();
+            }
+        }
+        if (inputLatency.active() && currentFrame - lastLatencyReport >= 1.0f)
+        {
+            int mode = lateLatchEnabled ? LATCH_LATE : LATCH_EARLY;
+            unsigned long long samples = inputLatency.toSwap[LATCH_EARLY].samples() + inputLatency.toSwap[LATCH_LATE].samples();
+            if (samples != reportedLatencySamples)
+                inputLatency.reportLine(std::cout, mode);
+            reportedLatencySamples = samples;
+            lastLatencyReport = currentFrame;
+        }
+        {
+            // the mouse and scroll callbacks turn the camera from in here
+            TRACE_ZONE("glfwPollEvents");
+            glfwPollEvents();
+        }
+        if (traceWriteRequested)
+        {
+            tracer().writeChromeTrace(tracePath, std::cout);
+            traceWriteRequested = false;
+        }
+
+        if (!startupReported)
+        {
+            double startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+            std::cout << "startup: first frame after " << startupMs << " ms, assets from ";
+            if (assetPack.isOpen())
+                std::cout << "pack " << assetPackPath << " (" << assetPack.size() << " bytes, mapped in " << packMapMs << " ms)" << std::endl;
+            else
+                std::cout << "source files" << std::endl;
+            startupReported = true;
+        }
     }
 
-    // optional: de-allocate all resources once they've outlived their purpose:
+    // GL objects are released by their destructors when this function returns
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAO1);
-    glDeleteBuffers(1, &VBO1);
-    glDeleteBuffers(1, &EBO1);
-
-
-    glDeleteVertexArrays(1, &VAO2);
-    glDeleteBuffers(1, &VBO2);
-    glDeleteBuffers(1, &EBO2);
-
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
-    return 0;
+    if (inputLatency.active())
+    {
+        inputLatency.report(std::cout);
+        inputLatency.stop();
+    }
+    if (glStats.installed())
+    {
+        glStats.beginFrame();
+        glStats.reportTop(std::cout, 10);
+        glStats.uninstall();
+    }
+    frameCapture.stop();
+    textureStreamer.stop();
+    if (worldStreamer.active())
+    {
+        worldStreamer.report(std::cout);
+        worldStreamer.stop(apartment);
+    }
+    gpuMemory().report(std::cout);
+    frameArena.printStats(std::cout);
+#ifdef COUNT_FRAME_ALLOCATIONS
+    std::cout << "frames with heap allocations after warm-up: " << framesWithHeapAllocations << std::endl;
+#endif
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow* window)
 {
+    TRACE_ZONE("processInput");
     if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && fanRotationEnabled == false)
     {
         fanRotationEnabled = true;
@@ -931,47 +1668,147 @@ void processInput(GLFWwindow* window)
     }
    
 
+    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+        depthPrepassEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+        depthPrepassEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+        frontToBackEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
+        frontToBackEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS)
+        overdrawViewEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS)
+        overdrawViewEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS)
+        occlusionCullingEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS)
+        occlusionCullingEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
+        gpuCullingEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
+        gpuCullingEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS)
+        portalCullingEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS)
+        portalCullingEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+        multiViewEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+        multiViewEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS)
+        texturesEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS)
+        texturesEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS)
+    {
+        tracer().setEnabled(true);
+        traceUsed = true;
+    }
+    else if (glfwGetKey(window, GLFW_KEY_F4) == GLFW_PRESS)
+        tracer().setEnabled(false);
+    // once per press
+    static bool writeKeyHeld = false;
+    bool writeKey = glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+    if (writeKey && !writeKeyHeld && traceUsed)
+        traceWriteRequested = true;
+    writeKeyHeld = writeKey;
+    if (glfwGetKey(window, GLFW_KEY_F6) == GLFW_PRESS)
+        glStatsEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_F7) == GLFW_PRESS)
+        glStatsEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_F8) == GLFW_PRESS)
+        lateLatchEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS)
+        lateLatchEnabled = false;
+    static bool lightKeyHeld = false;
+    bool lightKey = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+    if (lightKey && !lightKeyHeld && !lightSweepEnabled)
+        pointLightsEnabled = !pointLightsEnabled;
+    lightKeyHeld = lightKey;
+    if (glfwGetKey(window, GLFW_KEY_F10) == GLFW_PRESS)
+        bakedLightingEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_F11) == GLFW_PRESS)
+        bakedLightingEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
+        dynamicResolutionEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
+        dynamicResolutionEnabled = false;
+
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
+        hlodEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
+        hlodEnabled = false;
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS)
+        cameraCollisionEnabled = true;
+    else if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS)
+        cameraCollisionEnabled = false;
+
+    moveCamera(window, lastFrame);
+}
+
+// turns and moves the camera by the keys held, for the time since it last moved
+// ------------------------------------------------------------------------------
+void moveCamera(GLFWwindow* window, float time)
+{
+    float elapsed = time - cameraMovedAt;
+    cameraMovedAt = time;
+
     if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(YAW_R, deltaTime);
+        camera.ProcessKeyboard(YAW_R, elapsed);
     }
     if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(YAW_L, deltaTime);
+        camera.ProcessKeyboard(YAW_L, elapsed);
     }
     if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(PITCH_D, deltaTime);
+        camera.ProcessKeyboard(PITCH_D, elapsed);
     }
     if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(PITCH_U, deltaTime);
+        camera.ProcessKeyboard(PITCH_U, elapsed);
     }
     if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(ROLL_R, deltaTime);
+        camera.ProcessKeyboard(ROLL_R, elapsed);
     }
     if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(ROLL_L, deltaTime);
+        camera.ProcessKeyboard(ROLL_L, elapsed);
     }
 
+    glm::vec3 positionBeforeMove = camera.Position;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        camera.ProcessKeyboard(FORWARD, elapsed);
     }
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        camera.ProcessKeyboard(BACKWARD, elapsed);
     }
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        camera.ProcessKeyboard(LEFT, elapsed);
     }
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        camera.ProcessKeyboard(RIGHT, elapsed);
     }
+    // the camera is a sphere: stop it at walls and furniture and slide along them
+    if (cameraCollisionEnabled && camera.Position != positionBeforeMove)
+        camera.Position = slideSphere(sceneBvh, positionBeforeMove, camera.Position, CAMERA_RADIUS);
+}
+
+// late latch: the cursor where it is now and the keys held until now, just before the draws
+// -----------------------------------------------------------------------------------------
+void lateLatchCamera(GLFWwindow* window)
+{
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    mouse_callback(window, xpos, ypos);
+    moveCamera(window, static_cast<float>(glfwGetTime()));
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -980,6 +1817,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
+    // The offscreen targets of dynamic resolution follow on the next frame.
     glViewport(0, 0, width, height);
 }
 
@@ -1004,6 +1842,9 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
+    // a position the late latch has already read moves nothing
+    if (xoffset != 0.0f || yoffset != 0.0f)
+        inputLatency.inputEvent();
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
@@ -1013,3 +1854,172 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
+
+// glfw: pressing a key that moves the camera starts an input latency sample
+// --------------------------------------------------------------------------
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    static const int CAMERA_KEYS[] = { GLFW_KEY_W, GLFW_KEY_A, GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_U, GLFW_KEY_Y,
+                                       GLFW_KEY_X, GLFW_KEY_V, GLFW_KEY_Z, GLFW_KEY_B };
+    if (action == GLFW_PRESS && std::find(std::begin(CAMERA_KEYS), std::end(CAMERA_KEYS), key) != std::end(CAMERA_KEYS))
+        inputLatency.inputEvent();
+}
+
+// glfw: a left click picks the object under the cursor in the next frame
+// ----------------------------------------------------------------------
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+    {
+        glfwGetCursorPos(window, &pickX, &pickY);
+        pickRequested = true;
+    }
+}
+
+// casts the cursor ray through the scene BVH and toggles what it hits first; 'viewProjection'
+// is drawn into the left 'viewShare' of the window, and clicks outside it are ignored
+// --------------------------------------------------------------------------
+void pickObject(const FrameVector<DrawItem>& sceneItems, const glm::mat4& viewProjection, float viewShare, float time)
+{
+    int width, height;
+    glfwGetWindowSize(glfwGetCurrentContext(), &width, &height);
+    if (width <= 0 || height <= 0)
+        return;
+    float viewWidth = width * viewShare;
+    if (pickX < 0.0 || pickX >= viewWidth)
+        return;
+    float ndcX = 2.0f * static_cast<float>(pickX) / viewWidth - 1.0f;
+    float ndcY = 1.0f - 2.0f * static_cast<float>(pickY) / height;
+    glm::mat4 inverse = glm::inverse(viewProjection);
+    glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+    auto start = std::chrono::steady_clock::now();
+    BvhHit hit = sceneBvh.raycast(origin, direction, 1.0f,
+        [&](int object, const glm::vec3& o, const glm::vec3& d, float& t) {
+            return intersectRayCube(modelAt(sceneItems[object], time), o, d, 1.0f, t);
+        });
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    if (hit.object < 0)
+        return;
+
+    unsigned int flags = sceneItems[hit.object].flags;
+    if (flags & DRAW_PICK_TV)
+    {
+        TVoff = !TVoff;
+        ss1 = true, ss2 = false, ss3 = false;
+    }
+    else if (flags & DRAW_PICK_BOOKSHELF)
+    {
+        openBookshelf = !openBookshelf;
+    }
+    std::cout << "picked object " << hit.object << " of " << sceneItems.size() << " in " << us << " us"
+        << ((flags & DRAW_PICK_TV) ? ": TV" : (flags & DRAW_PICK_BOOKSHELF) ? ": bookshelf" : "") << std::endl;
+}
+
+// the batch render settings from the command line
+// ------------------------------------------------
+BatchOptions batchOptions()
+{
+    BatchOptions batch;
+    batch.threads = batchThreads;
+    batch.outputPrefix = batchOutputPrefix;
+    batch.apartmentColumns = apartmentColumns;
+    batch.apartmentRows = apartmentRows;
+    batch.scatterPerRoom = scatterPerRoom;
+    batch.scatterSeed = SCATTER_SEED;
+    batch.backend = batchBackend;
+    return batch;
+}
+
+// writes the room's geometry, every shader source and the reference room's draws to one pack
+// ---------------------------------------------------------------------------------------------------------
+bool cookAssetPack(const char* path, const CubeMesh& bed, const CubeMesh& pillow)
+{
+    AssetPackWriter writer;
+    writer.add("bed_vertices", ASSET_VERTICES, bed.vertices, bed.vertexBytes, 6 * sizeof(float));
+    writer.add("pillow_vertices", ASSET_VERTICES, pillow.vertices, pillow.vertexBytes, 6 * sizeof(float));
+    writer.add("cube_indices", ASSET_INDICES, bed.indices, bed.indexBytes, sizeof(unsigned int));
+    for (const char* shader : PACKED_SHADERS)
+    {
+        if (!writer.addFile(shader, ASSET_SHADER))
+        {
+            std::cout << "cook: cannot read " << shader << std::endl;
+            return false;
+        }
+    }
+
+    FrameVector<DrawItem> reference{ FrameAllocator<DrawItem>(frameArena) };
+    ClusterRange ranges[CLUSTER_COUNT];
+    RoomOpening noOpenings[WALL_COUNT];
+    appendRoom(reference, 0, glm::mat4(1.0f), noOpenings, RoomState(), ranges);
+    std::vector<CookedEntity> entities(reference.size());
+    for (size_t i = 0; i < reference.size(); i++)
+    {
+        const DrawItem& item = reference[i];
+        CookedEntity& entity = entities[i];
+        entity.model = item.model;
+        entity.color = item.color;
+        entity.boundsMin = item.bounds.min;
+        entity.flags = item.flags;
+        entity.boundsMax = item.bounds.max;
+        entity.indexCount = static_cast<uint32_t>(item.indexCount);
+        entity.spinPivot = item.spin.pivot;
+        entity.spinSpeed = item.spin.speed;
+        entity.spinAxis = item.spin.axis;
+        entity.spinPhase = item.spin.phase;
+        entity.material = item.material;
+    }
+    CookedCluster clusters[CLUSTER_COUNT];
+    for (int c = 0; c < CLUSTER_COUNT; c++)
+        clusters[c] = { static_cast<uint32_t>(ranges[c].first), static_cast<uint32_t>(ranges[c].end) };
+    writer.add("room_entities", ASSET_ENTITIES, entities.data(), entities.size() * sizeof(CookedEntity), sizeof(CookedEntity));
+    writer.add("room_clusters", ASSET_CLUSTERS, clusters, sizeof(clusters), sizeof(CookedCluster));
+
+    if (!writer.write(path))
+    {
+        std::cout << "cook: cannot write " << path << std::endl;
+        return false;
+    }
+    std::cout << "cook: wrote " << path << " (" << entities.size() << " room entities, "
+        << sizeof(PACKED_SHADERS) / sizeof(PACKED_SHADERS[0]) << " shaders)" << std::endl;
+    return true;
+}
+
+// rebuilds the reference room's draws (no openings, default RoomState) from the pack's entity table,
+// as appendRoom would; only the HLOD proxy build reads them
+// ---------------------------------------------------------------------------------------------------------
+void loadRoomEntities(const AssetPack& pack, const AssetPackEntry& entities, const AssetPackEntry& clusters, GLuint vao,
+                      FrameVector<DrawItem>& items, ClusterRange* ranges)
+{
+    const CookedEntity* entity = pack.array<CookedEntity>(entities);
+    size_t count = pack.count<CookedEntity>(entities);
+    items.reserve(items.size() + count);
+    for (size_t i = 0; i < count; i++, entity++)
+    {
+        DrawItem item;
+        item.model = entity->model;
+        item.color = entity->color;
+        item.bounds = AABB(entity->boundsMin, entity->boundsMax);
+        item.vao = vao;
+        item.indexCount = static_cast<GLsizei>(entity->indexCount);
+        item.indexType = GL_UNSIGNED_INT;
+        item.indexOffset = 0;
+        item.flags = entity->flags;
+        item.material = entity->material < MATERIAL_COUNT ? entity->material : static_cast<unsigned int>(MATERIAL_NONE);
+        item.lightmap = 0;
+        item.spin.pivot = entity->spinPivot;
+        item.spin.speed = entity->spinSpeed;
+        item.spin.axis = entity->spinAxis;
+        item.spin.phase = entity->spinPhase;
+        items.push_back(item);
+    }
+    const CookedCluster* cluster = pack.array<CookedCluster>(clusters);
+    for (int c = 0; c < CLUSTER_COUNT; c++)
+    {
+        ranges[c].first = std::min<size_t>(cluster[c].first, count);
+        ranges[c].end = std::min<size_t>(cluster[c].end, count);
+    }
+}
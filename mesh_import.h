@@ -0,0 +1,640 @@
+#pragma once
+//
+//  mesh_import.h
+//  3D Object Drawing
+//
+//  Imports furniture meshes from Wavefront OBJ and binary glTF (.glb). The file is read
+//  in one pass (OBJ in fixed-size chunks, GLB chunk by chunk), vertices are welded, the
+//  triangles reordered for the vertex cache and against overdraw (mesh_optimizer.h), and
+//  the result quantized: 16-bit positions and, under 65536 vertices, 16-bit indices.
+//
+//  Only positions are kept: the shaders color every object with a flat uniform color.
+//  Quantized positions lie in the 0..0.5 cube, so the dequantizing matrix turns a mesh
+//  into an object the culling, picking and BVH code treat like any cube, by its box.
+//
+
+#ifndef MESH_IMPORT_H
+#define MESH_IMPORT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.h"
+#include "gl_resources.h"
+#include "mesh_optimizer.h"
+#include "render_queue.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct MeshImportStats
+{
+    size_t fileBytes = 0;
+    size_t sourceVertices = 0;     // as listed in the file
+    size_t triangles = 0;          // after welding dropped the degenerate ones
+    float acmrBefore = 0.0f;       // FIFO cache of 16, file order after welding
+    float acmrAfter = 0.0f;
+    double parseMs = 0.0;
+    double optimizeMs = 0.0;       // weld, vertex cache, overdraw, vertex fetch
+    double quantizeMs = 0.0;
+};
+
+struct ImportedMesh
+{
+    std::vector<uint16_t> positions;   // x, y, z, 0 per vertex, normalized to 0..0.5 of 'bounds'
+    std::vector<uint16_t> indices16;   // one of the two is filled
+    std::vector<uint32_t> indices32;
+    size_t vertexCount = 0;
+    AABB bounds;                       // of the source positions
+    glm::mat4 dequantize;              // the 0..0.5 cube onto 'bounds'
+    MeshImportStats stats;
+
+    GLenum indexType() const { return indices32.empty() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+    size_t indexCount() const { return indices32.empty() ? indices16.size() : indices32.size(); }
+    size_t vertexBytes() const { return positions.size() * sizeof(uint16_t); }
+    size_t indexBytes() const { return indices32.empty() ? indices16.size() * sizeof(uint16_t) : indices32.size() * sizeof(uint32_t); }
+    const void* indexData() const { return indices32.empty() ? static_cast<const void*>(indices16.data()) : indices32.data(); }
+};
+
+// Wavefront OBJ: 'v' and 'f' records (any of v, v/t, v//n, v/t/n, negative indices
+// relative to the end); polygons are fanned into triangles, everything else is skipped
+inline bool parseObj(std::FILE* file, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices, std::string& error)
+{
+    const size_t CHUNK = 1 << 16;
+    std::vector<char> buffer(CHUNK + 1);
+    std::vector<long> polygon;
+    size_t carry = 0;
+    size_t lineNumber = 0;
+    bool eof = false;
+    while (!eof || carry > 0)
+    {
+        size_t read = eof ? 0 : std::fread(buffer.data() + carry, 1, buffer.size() - 1 - carry, file);
+        eof = eof || read == 0;
+        size_t filled = carry + read;
+        // whole lines only, unless the file ends without a newline
+        size_t end = filled;
+        while (end > 0 && buffer[end - 1] != '\n')
+            end--;
+        if (end == 0)
+        {
+            if (!eof)
+            {
+                if (filled == buffer.size() - 1)
+                    buffer.resize(buffer.size() * 2);   // a line longer than the chunk
+                carry = filled;
+                continue;
+            }
+            end = filled;
+        }
+
+        char* line = buffer.data();
+        char* stop = buffer.data() + end;
+        char saved = buffer[end];
+        buffer[end] = '\0';
+        while (line < stop)
+        {
+            char* next = static_cast<char*>(std::memchr(line, '\n', stop - line));
+            if (next)
+                *next = '\0';
+            else
+                next = stop;
+            lineNumber++;
+
+            while (*line == ' ' || *line == '\t')
+                line++;
+            if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+            {
+                char* p = line + 2;
+                glm::vec3 v;
+                v.x = std::strtof(p, &p);
+                v.y = std::strtof(p, &p);
+                v.z = std::strtof(p, &p);
+                positions.push_back(v);
+            }
+            else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+            {
+                polygon.clear();
+                char* p = line + 2;
+                for (;;)
+                {
+                    char* after;
+                    long index = std::strtol(p, &after, 10);
+                    if (after == p)
+                        break;
+                    // 1-based, or negative from the vertices read so far
+                    index = index > 0 ? index - 1 : static_cast<long>(positions.size()) + index;
+                    if (index < 0)
+                    {
+                        error = "line " + std::to_string(lineNumber) + ": face refers to a vertex before the first";
+                        return false;
+                    }
+                    polygon.push_back(index);
+                    p = after;
+                    while (*p && *p != ' ' && *p != '\t' && *p != '\r')
+                        p++;   // texture and normal indices
+                }
+                for (size_t k = 2; k < polygon.size(); k++)
+                {
+                    indices.push_back(static_cast<uint32_t>(polygon[0]));
+                    indices.push_back(static_cast<uint32_t>(polygon[k - 1]));
+                    indices.push_back(static_cast<uint32_t>(polygon[k]));
+                }
+            }
+            line = next + 1;
+        }
+        buffer[end] = saved;
+
+        carry = filled - end;
+        std::memmove(buffer.data(), buffer.data() + end, carry);
+    }
+    for (uint32_t index : indices)
+        if (index >= positions.size())
+        {
+            error = "face refers to vertex " + std::to_string(index + 1) + " of " + std::to_string(positions.size());
+            return false;
+        }
+    return true;
+}
+
+// Just enough JSON for a glTF header: objects, arrays, numbers, strings, literals.
+struct JsonValue
+{
+    enum Kind { NONE, NUMBER, STRING, ARRAY, OBJECT, LITERAL } kind = NONE;
+    double number = 0.0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* get(const char* key) const
+    {
+        for (const auto& member : members)
+            if (member.first == key)
+                return &member.second;
+        return nullptr;
+    }
+    const JsonValue* at(size_t i) const
+    {
+        return kind == ARRAY && i < items.size() ? &items[i] : nullptr;
+    }
+    double numberOr(const char* key, double fallback) const
+    {
+        const JsonValue* value = get(key);
+        return value && value->kind == NUMBER ? value->number : fallback;
+    }
+};
+
+class JsonParser
+{
+public:
+    JsonParser(const char* text, size_t length) : p(text), end(text + length) {}
+
+    bool parse(JsonValue& value, int depth = 0)
+    {
+        skip();
+        if (p >= end || depth > 64)
+            return false;
+        if (*p == '{')
+        {
+            value.kind = JsonValue::OBJECT;
+            p++;
+            skip();
+            if (p < end && *p == '}')
+                return ++p, true;
+            for (;;)
+            {
+                std::string key;
+                skip();
+                if (!string(key))
+                    return false;
+                skip();
+                if (p >= end || *p++ != ':')
+                    return false;
+                value.members.emplace_back(std::move(key), JsonValue());
+                if (!parse(value.members.back().second, depth + 1))
+                    return false;
+                skip();
+                if (p < end && *p == ',')
+                    p++;
+                else if (p < end && *p == '}')
+                    return ++p, true;
+                else
+                    return false;
+            }
+        }
+        if (*p == '[')
+        {
+            value.kind = JsonValue::ARRAY;
+            p++;
+            skip();
+            if (p < end && *p == ']')
+                return ++p, true;
+            for (;;)
+            {
+                value.items.emplace_back();
+                if (!parse(value.items.back(), depth + 1))
+                    return false;
+                skip();
+                if (p < end && *p == ',')
+                    p++;
+                else if (p < end && *p == ']')
+                    return ++p, true;
+                else
+                    return false;
+            }
+        }
+        if (*p == '"')
+        {
+            value.kind = JsonValue::STRING;
+            return string(value.text);
+        }
+        if (*p == '-' || (*p >= '0' && *p <= '9'))
+        {
+            value.kind = JsonValue::NUMBER;
+            std::string digits;
+            while (p < end && *p && std::strchr("+-.eE0123456789", *p))
+                digits += *p++;
+            value.number = std::strtod(digits.c_str(), nullptr);
+            return true;
+        }
+        value.kind = JsonValue::LITERAL;   // true, false, null
+        while (p < end && *p >= 'a' && *p <= 'z')
+            value.text += *p++;
+        return !value.text.empty();
+    }
+
+private:
+    const char* p;
+    const char* end;
+
+    void skip()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    // escapes are kept as written; glTF keys and the values read here never need them
+    bool string(std::string& out)
+    {
+        if (p >= end || *p != '"')
+            return false;
+        for (p++; p < end && *p != '"'; p++)
+        {
+            if (*p == '\\' && p + 1 < end)
+                out += *p++;
+            out += *p;
+        }
+        return p < end && *p++ == '"';
+    }
+};
+
+// Binary glTF 2.0: the triangle primitives of every mesh the default scene's nodes place
+// (every mesh, untransformed, if there is no scene), with float positions and the
+// GLB's own binary chunk as the only buffer.
+class GlbReader
+{
+public:
+    bool read(std::FILE* file, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices, std::string& error)
+    {
+        uint32_t header[3];
+        if (std::fread(header, sizeof(header), 1, file) != 1 || header[0] != 0x46546C67u || header[1] != 2)
+            return fail(error, "not a glTF 2.0 binary");
+        std::string json;
+        for (;;)
+        {
+            uint32_t chunk[2];
+            if (std::fread(chunk, sizeof(chunk), 1, file) != 1)
+                break;
+            if (chunk[1] == 0x4E4F534Au)   // JSON
+            {
+                json.resize(chunk[0]);
+                if (chunk[0] && std::fread(&json[0], chunk[0], 1, file) != 1)
+                    return fail(error, "truncated JSON chunk");
+            }
+            else if (chunk[1] == 0x004E4942u)   // BIN
+            {
+                binary.resize(chunk[0]);
+                if (chunk[0] && std::fread(binary.data(), chunk[0], 1, file) != 1)
+                    return fail(error, "truncated binary chunk");
+            }
+            else if (std::fseek(file, chunk[0], SEEK_CUR) != 0)
+                break;
+        }
+        JsonParser parser(json.data(), json.size());
+        if (json.empty() || !parser.parse(document) || document.kind != JsonValue::OBJECT)
+            return fail(error, "bad JSON chunk");
+
+        out = &positions;
+        outIndices = &indices;
+        const JsonValue* scenes = document.get("scenes");
+        if (scenes && scenes->kind == JsonValue::ARRAY && !scenes->items.empty())
+        {
+            const JsonValue* scene = scenes->at(static_cast<size_t>(document.numberOr("scene", 0.0)));
+            const JsonValue* roots = scene ? scene->get("nodes") : nullptr;
+            if (roots)
+                for (const JsonValue& root : roots->items)
+                    if (!visitNode(static_cast<size_t>(root.number), glm::mat4(1.0f), 0, error))
+                        return false;
+        }
+        else if (const JsonValue* meshes = document.get("meshes"))
+        {
+            for (size_t m = 0; m < meshes->items.size(); m++)
+                if (!appendMesh(m, glm::mat4(1.0f), error))
+                    return false;
+        }
+        return true;
+    }
+
+private:
+    JsonValue document;
+    std::vector<uint8_t> binary;
+    std::vector<glm::vec3>* out = nullptr;
+    std::vector<uint32_t>* outIndices = nullptr;
+
+    static bool fail(std::string& error, const char* message)
+    {
+        error = message;
+        return false;
+    }
+
+    const JsonValue* element(const char* array, double index) const
+    {
+        const JsonValue* list = document.get(array);
+        return list && index >= 0.0 ? list->at(static_cast<size_t>(index)) : nullptr;
+    }
+
+    static glm::mat4 nodeMatrix(const JsonValue& node)
+    {
+        glm::mat4 m(1.0f);
+        const JsonValue* matrix = node.get("matrix");
+        if (matrix && matrix->items.size() == 16)
+        {
+            for (int i = 0; i < 16; i++)
+                m[i / 4][i % 4] = static_cast<float>(matrix->items[i].number);   // column major, as glm
+            return m;
+        }
+        const JsonValue* t = node.get("translation");
+        const JsonValue* r = node.get("rotation");
+        const JsonValue* s = node.get("scale");
+        if (t && t->items.size() == 3)
+            m = glm::translate(m, glm::vec3(t->items[0].number, t->items[1].number, t->items[2].number));
+        if (r && r->items.size() == 4)
+        {
+            float x = static_cast<float>(r->items[0].number), y = static_cast<float>(r->items[1].number);
+            float z = static_cast<float>(r->items[2].number), w = static_cast<float>(r->items[3].number);
+            glm::mat4 rotation(1.0f);
+            rotation[0] = glm::vec4(1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w), 0.0f);
+            rotation[1] = glm::vec4(2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w), 0.0f);
+            rotation[2] = glm::vec4(2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y), 0.0f);
+            m = m * rotation;
+        }
+        if (s && s->items.size() == 3)
+            m = glm::scale(m, glm::vec3(s->items[0].number, s->items[1].number, s->items[2].number));
+        return m;
+    }
+
+    bool visitNode(size_t index, const glm::mat4& parent, int depth, std::string& error)
+    {
+        const JsonValue* node = element("nodes", static_cast<double>(index));
+        if (!node || depth > 64)
+            return fail(error, "bad node hierarchy");
+        glm::mat4 world = parent * nodeMatrix(*node);
+        if (const JsonValue* mesh = node->get("mesh"))
+            if (!appendMesh(static_cast<size_t>(mesh->number), world, error))
+                return false;
+        if (const JsonValue* children = node->get("children"))
+            for (const JsonValue& child : children->items)
+                if (!visitNode(static_cast<size_t>(child.number), world, depth + 1, error))
+                    return false;
+        return true;
+    }
+
+    // bytes of an accessor's elements in the binary chunk; false if they do not fit
+    bool accessorData(double index, size_t elementBytes, const uint8_t*& data, size_t& count, size_t& stride,
+                      int& componentType, std::string& error)
+    {
+        const JsonValue* accessor = element("accessors", index);
+        if (!accessor)
+            return fail(error, "missing accessor");
+        if (accessor->get("sparse"))
+            return fail(error, "sparse accessors are not supported");
+        const JsonValue* view = element("bufferViews", accessor->numberOr("bufferView", -1.0));
+        if (!view)
+            return fail(error, "accessor without a buffer view");
+        if (view->numberOr("buffer", 0.0) != 0.0)
+            return fail(error, "only the GLB binary chunk is supported as a buffer");
+        componentType = static_cast<int>(accessor->numberOr("componentType", 0.0));
+        count = static_cast<size_t>(accessor->numberOr("count", 0.0));
+        size_t offset = static_cast<size_t>(view->numberOr("byteOffset", 0.0) + accessor->numberOr("byteOffset", 0.0));
+        stride = static_cast<size_t>(view->numberOr("byteStride", 0.0));
+        if (stride == 0)
+            stride = elementBytes;
+        if (count > 0 && (offset > binary.size() || (count - 1) * stride + elementBytes > binary.size() - offset))
+            return fail(error, "accessor outside the binary chunk");
+        data = binary.data() + offset;
+        return true;
+    }
+
+    bool appendMesh(size_t index, const glm::mat4& world, std::string& error)
+    {
+        const JsonValue* mesh = element("meshes", static_cast<double>(index));
+        const JsonValue* primitives = mesh ? mesh->get("primitives") : nullptr;
+        if (!primitives)
+            return fail(error, "missing mesh");
+        for (const JsonValue& primitive : primitives->items)
+        {
+            if (primitive.numberOr("mode", 4.0) != 4.0)
+                continue;   // points and lines
+            const JsonValue* attributes = primitive.get("attributes");
+            const JsonValue* position = attributes ? attributes->get("POSITION") : nullptr;
+            if (!position)
+                continue;
+            const uint8_t* data;
+            size_t count, stride;
+            int componentType;
+            if (!accessorData(position->number, 12, data, count, stride, componentType, error))
+                return false;
+            if (componentType != 5126)
+                return fail(error, "positions must be floats");
+
+            size_t base = out->size();
+            for (size_t i = 0; i < count; i++, data += stride)
+            {
+                float p[3];
+                std::memcpy(p, data, sizeof(p));
+                out->push_back(glm::vec3(world * glm::vec4(p[0], p[1], p[2], 1.0f)));
+            }
+
+            double indexAccessor = primitive.numberOr("indices", -1.0);
+            if (indexAccessor < 0.0)
+            {
+                for (size_t i = 0; i + 2 < count; i += 3)
+                    for (size_t k = 0; k < 3; k++)
+                        outIndices->push_back(static_cast<uint32_t>(base + i + k));
+                continue;
+            }
+            const JsonValue* accessor = element("accessors", indexAccessor);
+            int type = accessor ? static_cast<int>(accessor->numberOr("componentType", 0.0)) : 0;
+            size_t size = type == 5121 ? 1 : type == 5123 ? 2 : type == 5125 ? 4 : 0;
+            if (size == 0)
+                return fail(error, "unsupported index type");
+            size_t indexCount, indexStride;
+            if (!accessorData(indexAccessor, size, data, indexCount, indexStride, type, error))
+                return false;
+            indexCount -= indexCount % 3;   // an incomplete last triangle
+            for (size_t i = 0; i < indexCount; i++, data += indexStride)
+            {
+                uint32_t v = 0;
+                std::memcpy(&v, data, size);   // little endian
+                if (v >= count)
+                    return fail(error, "index outside the primitive's vertices");
+                outIndices->push_back(static_cast<uint32_t>(base + v));
+            }
+        }
+        return true;
+    }
+};
+
+// Reads, optimizes and quantizes 'path' (.obj or .glb). Problems are written to 'errors'.
+inline bool importMesh(const char* path, ImportedMesh& mesh, std::ostream& errors)
+{
+    auto begin = std::chrono::steady_clock::now();
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file)
+    {
+        errors << "import: cannot open " << path << std::endl;
+        return false;
+    }
+    std::fseek(file, 0, SEEK_END);
+    long fileBytes = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    positions.reserve(fileBytes > 0 ? fileBytes / 64 : 0);   // a rough guess either way
+    indices.reserve(fileBytes > 0 ? fileBytes / 16 : 0);
+    std::string error;
+    size_t length = std::strlen(path);
+    bool glb = length > 4 && (std::strcmp(path + length - 4, ".glb") == 0 || std::strcmp(path + length - 4, ".GLB") == 0);
+    bool ok = glb ? GlbReader().read(file, positions, indices, error) : parseObj(file, positions, indices, error);
+    std::fclose(file);
+    if (!ok || indices.empty())
+    {
+        errors << "import: " << path << ": " << (ok ? "no triangles" : error) << std::endl;
+        return false;
+    }
+    auto parsed = std::chrono::steady_clock::now();
+
+    mesh.stats = MeshImportStats();
+    mesh.stats.fileBytes = static_cast<size_t>(fileBytes);
+    mesh.stats.sourceVertices = positions.size();
+    weldVertices(positions, indices);
+    mesh.stats.acmrBefore = simulateAcmr(indices.data(), indices.size(), positions.size());
+    optimizeVertexCache(indices, positions.size());
+    optimizeOverdraw(indices, positions);
+    optimizeVertexFetch(indices, positions);
+    mesh.stats.acmrAfter = simulateAcmr(indices.data(), indices.size(), positions.size());
+    mesh.stats.triangles = indices.size() / 3;
+    auto optimized = std::chrono::steady_clock::now();
+
+    mesh.bounds = AABB();
+    for (const glm::vec3& p : positions)
+        mesh.bounds.expand(p);
+    // a flat mesh still needs an invertible matrix for picking
+    glm::vec3 extent = glm::max(mesh.bounds.extent(), glm::vec3(1e-4f));
+    mesh.dequantize = glm::scale(glm::translate(glm::mat4(1.0f), mesh.bounds.min), 2.0f * extent);
+    mesh.vertexCount = positions.size();
+    mesh.positions.resize(positions.size() * 4);
+    for (size_t v = 0; v < positions.size(); v++)
+    {
+        glm::vec3 t = glm::clamp((positions[v] - mesh.bounds.min) / extent, 0.0f, 1.0f) * (0.5f * 65535.0f);
+        mesh.positions[v * 4 + 0] = static_cast<uint16_t>(t.x + 0.5f);
+        mesh.positions[v * 4 + 1] = static_cast<uint16_t>(t.y + 0.5f);
+        mesh.positions[v * 4 + 2] = static_cast<uint16_t>(t.z + 0.5f);
+        mesh.positions[v * 4 + 3] = 0;
+    }
+    mesh.indices16.clear();
+    mesh.indices32.clear();
+    if (positions.size() <= 65536)
+        mesh.indices16.assign(indices.begin(), indices.end());
+    else
+        mesh.indices32.swap(indices);
+    auto quantized = std::chrono::steady_clock::now();
+
+    mesh.stats.parseMs = std::chrono::duration<double, std::milli>(parsed - begin).count();
+    mesh.stats.optimizeMs = std::chrono::duration<double, std::milli>(optimized - parsed).count();
+    mesh.stats.quantizeMs = std::chrono::duration<double, std::milli>(quantized - optimized).count();
+    return true;
+}
+
+inline void reportImport(const char* path, const ImportedMesh& mesh, std::ostream& out)
+{
+    const MeshImportStats& s = mesh.stats;
+    double totalMs = s.parseMs + s.optimizeMs + s.quantizeMs;
+    double megabytes = s.fileBytes / (1024.0 * 1024.0);
+    out << "import: " << path << ": " << s.triangles << " triangles, " << s.sourceVertices << " -> " << mesh.vertexCount
+        << " vertices, ACMR " << s.acmrBefore << " -> " << s.acmrAfter << ", "
+        << (mesh.vertexBytes() + mesh.indexBytes()) / 1024.0 << " KiB with "
+        << (mesh.indexType() == GL_UNSIGNED_SHORT ? 16 : 32) << "-bit indices; "
+        << totalMs << " ms (parse " << s.parseMs << ", optimize " << s.optimizeMs << ", quantize " << s.quantizeMs
+        << "), " << (totalMs > 0.0 ? megabytes / (totalMs / 1000.0) : 0.0) << " MB/s" << std::endl;
+}
+
+// GPU copy of an imported mesh, laid out like the cube VAO: attribute 0 is the position
+// (normalized 16-bit integers here), attribute 1 stays at its default.
+struct GpuMesh
+{
+    GlVertexArray vao;
+    GlBuffer vertices;
+    GlBuffer indices;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    glm::mat4 dequantize = glm::mat4(1.0f);
+    AABB bounds;
+
+    void upload(const ImportedMesh& mesh)
+    {
+        vao.create("imported mesh VAO");
+        vertices.create(GPU_VERTEX_BUFFER, "imported mesh vertices");
+        indices.create(GPU_INDEX_BUFFER, "imported mesh indices");
+        vao.bind();
+        vertices.data(GL_ARRAY_BUFFER, mesh.vertexBytes(), mesh.positions.data(), GL_STATIC_DRAW);
+        indices.data(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBytes(), mesh.indexData(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(uint16_t), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+        indexCount = static_cast<GLsizei>(mesh.indexCount());
+        indexType = mesh.indexType();
+        dequantize = mesh.dequantize;
+        bounds = mesh.bounds;
+    }
+};
+
+// scales 'bounds' so its largest side is 'size' and stands it on 'floor' (its base centered there)
+inline glm::mat4 standOnFloor(const AABB& bounds, const glm::vec3& floor, float size)
+{
+    glm::vec3 extent = bounds.extent();
+    float largest = std::max(extent.x, std::max(extent.y, extent.z));
+    float scale = largest > 0.0f ? size / largest : 1.0f;
+    glm::vec3 base(bounds.center().x, bounds.min.y, bounds.center().z);
+    glm::mat4 identity(1.0f);
+    return glm::translate(identity, floor) * glm::scale(identity, glm::vec3(scale)) * glm::translate(identity, -base);
+}
+
+inline DrawItem makeMeshDraw(const GpuMesh& mesh, const glm::mat4& model, const glm::vec4& color, unsigned int flags = 0)
+{
+    DrawItem item = makeCubeDraw(model * mesh.dequantize, color, mesh.vao.id(), flags | DRAW_MESH);
+    item.indexCount = mesh.indexCount;
+    item.indexType = mesh.indexType;
+    return item;
+}
+
+#endif
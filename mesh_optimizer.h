@@ -0,0 +1,335 @@
+#pragma once
+//
+//  mesh_optimizer.h
+//  3D Object Drawing
+//
+//  Index buffer optimizations for imported meshes: welding, triangle order for the
+//  post-transform vertex cache (Forsyth's linear-speed algorithm), cluster order against
+//  overdraw (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+//  Overdraw") and vertex order for fetch locality.
+//
+
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Average cache miss ratio: vertex shader runs per triangle through a FIFO cache of
+// 'cacheSize' entries. 0.5 is the ideal for a large regular grid, 3 means no reuse.
+inline float simulateAcmr(const uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16)
+{
+    if (indexCount < 3)
+        return 0.0f;
+    std::vector<uint32_t> stamp(vertexCount, 0);   // time the vertex entered the cache
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t v = indices[i];
+        if (time - stamp[v] > cacheSize)
+        {
+            stamp[v] = time++;
+            misses++;
+        }
+    }
+    return static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+}
+
+// Merges vertices with bitwise equal positions (-0 and +0 count as equal). 'indices' is
+// rewritten to the unique vertices, which replace 'positions'; triangles that collapse
+// are dropped.
+inline void weldVertices(std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+    size_t capacity = 16;
+    while (capacity < positions.size() * 2)
+        capacity *= 2;
+    const uint32_t EMPTY = 0xFFFFFFFFu;
+    std::vector<uint32_t> table(capacity, EMPTY);
+    std::vector<uint32_t> remap(positions.size());
+    size_t unique = 0;
+    auto bits = [](float f) {
+        uint32_t u;
+        f = f == 0.0f ? 0.0f : f;
+        std::memcpy(&u, &f, sizeof(u));
+        return u;
+    };
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        const glm::vec3& p = positions[i];
+        uint32_t h = bits(p.x) * 73856093u ^ bits(p.y) * 19349663u ^ bits(p.z) * 83492791u;
+        size_t slot = (h ^ (h >> 16)) & (capacity - 1);
+        for (;;)
+        {
+            uint32_t candidate = table[slot];
+            if (candidate == EMPTY)
+            {
+                table[slot] = static_cast<uint32_t>(unique);
+                positions[unique] = p;   // unique <= i, so nothing unread is overwritten
+                remap[i] = static_cast<uint32_t>(unique++);
+                break;
+            }
+            const glm::vec3& q = positions[candidate];
+            if (bits(q.x) == bits(p.x) && bits(q.y) == bits(p.y) && bits(q.z) == bits(p.z))
+            {
+                remap[i] = candidate;
+                break;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+    }
+    positions.resize(unique);
+
+    size_t kept = 0;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        uint32_t a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+        if (a == b || b == c || c == a)
+            continue;
+        indices[kept++] = a;
+        indices[kept++] = b;
+        indices[kept++] = c;
+    }
+    indices.resize(kept);
+}
+
+// Forsyth's vertex cache optimization: greedily emits the triangle whose vertices score
+// best, favouring vertices recently used (in the simulated LRU cache) and vertices with
+// few triangles left, so they are finished before they leave the cache.
+inline void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    const int CACHE_SIZE = 32;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // triangles of each vertex, compressed rows
+    std::vector<uint32_t> valence(vertexCount, 0);
+    for (uint32_t v : indices)
+        valence[v]++;
+    std::vector<uint32_t> first(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        first[v + 1] = first[v] + valence[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    auto vertexScore = [&](int cachePosition, uint32_t remaining) {
+        if (remaining == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = 0.75f;   // the last triangle's vertices: same score, so no strips are forced
+            else
+                score = std::pow(1.0f - (cachePosition - 3) / float(CACHE_SIZE - 3), 1.5f);
+        }
+        return score + 2.0f / std::sqrt(static_cast<float>(remaining));
+    };
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, valence[v]);
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    std::vector<bool> emitted(triangleCount, false);
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    uint32_t cache[CACHE_SIZE + 3];
+    int cacheCount = 0;
+    size_t scanCursor = 0;
+    long best = 0;
+    for (size_t t = 1; t < triangleCount; t++)
+        if (triangleScore[t] > triangleScore[best])
+            best = static_cast<long>(t);
+
+    while (best >= 0)
+    {
+        emitted[best] = true;
+        const uint32_t* triangle = &indices[best * 3];
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // the triangle's vertices move to the front of the cache, the rest shift back
+        uint32_t next[CACHE_SIZE + 3];
+        int nextCount = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = triangle[k];
+            next[nextCount++] = v;
+            uint32_t* row = &adjacency[first[v]];
+            for (uint32_t r = 0; r < valence[v]; r++)
+                if (row[r] == static_cast<uint32_t>(best))
+                {
+                    row[r] = row[--valence[v]];
+                    break;
+                }
+        }
+        for (int c = 0; c < cacheCount; c++)
+        {
+            uint32_t v = cache[c];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                next[nextCount++] = v;
+        }
+        for (int c = CACHE_SIZE; c < nextCount; c++)
+        {
+            cachePosition[next[c]] = -1;   // fell out
+            score[next[c]] = vertexScore(-1, valence[next[c]]);
+        }
+        cacheCount = std::min(nextCount, CACHE_SIZE);
+        std::memcpy(cache, next, cacheCount * sizeof(uint32_t));
+
+        // rescore the cached vertices and pick the best triangle around them
+        for (int c = 0; c < cacheCount; c++)
+        {
+            cachePosition[cache[c]] = c;
+            score[cache[c]] = vertexScore(c, valence[cache[c]]);
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        for (int c = 0; c < cacheCount; c++)
+        {
+            uint32_t v = cache[c];
+            const uint32_t* row = &adjacency[first[v]];
+            for (uint32_t r = 0; r < valence[v]; r++)
+            {
+                uint32_t t = row[r];
+                float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                if (s > bestScore)
+                {
+                    bestScore = s;
+                    best = t;
+                }
+            }
+        }
+        // nothing left next to the cache: continue with the next triangle not yet drawn
+        if (best < 0)
+        {
+            while (scanCursor < triangleCount && emitted[scanCursor])
+                scanCursor++;
+            if (scanCursor < triangleCount)
+                best = static_cast<long>(scanCursor);
+        }
+    }
+    indices.swap(output);
+}
+
+// Splits the cache-ordered triangles into clusters where the cache restarts (or where a
+// cluster's own ACMR is within 'threshold' of the whole mesh's) and draws the clusters
+// that face outward first: from most viewpoints they cover the ones facing inward.
+inline void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+                             float threshold = 1.05f)
+{
+    const unsigned int CACHE_SIZE = 16;
+    const size_t MIN_CLUSTER = 32;   // triangles, before a soft split is allowed
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2 * MIN_CLUSTER)
+        return;
+    float meshAcmr = simulateAcmr(indices.data(), indices.size(), positions.size(), CACHE_SIZE);
+
+    std::vector<size_t> clusterStart;
+    std::vector<uint32_t> stamp(positions.size(), 0);
+    uint32_t time = CACHE_SIZE + 1;
+    size_t clusterMisses = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = indices[t * 3 + k];
+            if (time - stamp[v] > CACHE_SIZE)
+            {
+                stamp[v] = time++;
+                misses++;
+            }
+        }
+        size_t clusterSize = clusterStart.empty() ? 0 : t - clusterStart.back();
+        bool hard = misses == 3;   // nothing reused: the optimizer jumped elsewhere
+        bool soft = clusterSize >= MIN_CLUSTER &&
+                    static_cast<float>(clusterMisses) / clusterSize <= threshold * meshAcmr;
+        if (clusterStart.empty() || hard || soft)
+        {
+            clusterStart.push_back(t);
+            clusterMisses = 0;
+        }
+        clusterMisses += misses;
+    }
+    clusterStart.push_back(triangleCount);
+    size_t clusterCount = clusterStart.size() - 1;
+
+    // area-weighted centroid and normal of each cluster and of the mesh
+    std::vector<glm::vec3> centroid(clusterCount, glm::vec3(0.0f)), normal(clusterCount, glm::vec3(0.0f));
+    std::vector<float> area(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+        {
+            const glm::vec3& a = positions[indices[t * 3]];
+            const glm::vec3& b = positions[indices[t * 3 + 1]];
+            const glm::vec3& d = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float twiceArea = glm::length(n);
+            centroid[c] += (a + b + d) * (twiceArea / 3.0f);
+            normal[c] += n;
+            area[c] += twiceArea;
+        }
+        meshCentroid += centroid[c];
+        meshArea += area[c];
+    }
+    if (meshArea <= 0.0f)
+        return;
+    meshCentroid /= meshArea;
+
+    std::vector<float> outward(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float length = glm::length(normal[c]);
+        if (area[c] > 0.0f && length > 0.0f)
+            outward[c] = glm::dot(centroid[c] / area[c] - meshCentroid, normal[c] / length);
+    }
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+        order[c] = static_cast<uint32_t>(c);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return outward[a] > outward[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (uint32_t c : order)
+        output.insert(output.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+    indices.swap(output);
+}
+
+// Renumbers the vertices in the order the index buffer first uses them, so the vertex
+// fetches of consecutive triangles hit neighbouring memory.
+inline void optimizeVertexFetch(std::vector<uint32_t>& indices, std::vector<glm::vec3>& positions)
+{
+    const uint32_t UNUSED = 0xFFFFFFFFu;
+    std::vector<uint32_t> remap(positions.size(), UNUSED);
+    std::vector<glm::vec3> reordered;
+    reordered.reserve(positions.size());
+    for (uint32_t& v : indices)
+    {
+        if (remap[v] == UNUSED)
+        {
+            remap[v] = static_cast<uint32_t>(reordered.size());
+            reordered.push_back(positions[v]);
+        }
+        v = remap[v];
+    }
+    positions.swap(reordered);   // vertices no triangle uses are dropped
+}
+
+#endif
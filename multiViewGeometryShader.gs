@@ -0,0 +1,24 @@
+#version 410 core
+// one invocation per view: each copies the triangle into its camera and viewport
+layout (triangles, invocations = 2) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+uniform mat4 viewProjections[2];
+
+in vec3 cubePos[];
+
+out vec3 worldPos;
+out vec3 localPos;
+
+void main()
+{
+    for (int i = 0; i < 3; i++)
+    {
+        worldPos = gl_in[i].gl_Position.xyz;
+        localPos = cubePos[i];
+        gl_Position = viewProjections[gl_InvocationID] * gl_in[i].gl_Position;
+        gl_ViewportIndex = gl_InvocationID;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
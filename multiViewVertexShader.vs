@@ -0,0 +1,34 @@
+#version 410 core
+#extension GL_ARB_shader_viewport_layer_array : require
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+
+out vec3 worldPos;
+out vec3 localPos;
+
+uniform mat4 model;
+// every draw is instanced once per view; the instance picks the camera and the viewport
+uniform mat4 viewProjections[2];
+
+// same rotation as vertexShader.vs
+uniform float time;
+uniform vec4 spinPivot;
+uniform vec4 spinAxis;
+
+vec3 spin(vec3 p)
+{
+    float angle = spinAxis.w + spinPivot.w * time;
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 d = p - spinPivot.xyz;
+    d = d * c + cross(spinAxis.xyz, d) * s + spinAxis.xyz * dot(spinAxis.xyz, d) * (1.0f - c);
+    return spinPivot.xyz + d;
+}
+
+void main()
+{
+    worldPos = spin((model * vec4(aPos, 1.0f)).xyz);
+    localPos = aPos * 2.0f;
+    gl_Position = viewProjections[gl_InstanceID] * vec4(worldPos, 1.0f);
+    gl_ViewportIndex = gl_InstanceID;
+}
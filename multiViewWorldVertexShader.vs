@@ -0,0 +1,29 @@
+#version 410 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+
+uniform mat4 model;
+
+out vec3 cubePos;   // passed on as the fragment shader's localPos
+
+// same rotation as vertexShader.vs
+uniform float time;
+uniform vec4 spinPivot;
+uniform vec4 spinAxis;
+
+vec3 spin(vec3 p)
+{
+    float angle = spinAxis.w + spinPivot.w * time;
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 d = p - spinPivot.xyz;
+    d = d * c + cross(spinAxis.xyz, d) * s + spinAxis.xyz * dot(spinAxis.xyz, d) * (1.0f - c);
+    return spinPivot.xyz + d;
+}
+
+// world space out; multiViewGeometryShader.gs projects it once per view
+void main()
+{
+    gl_Position = vec4(spin((model * vec4(aPos, 1.0f)).xyz), 1.0f);
+    cubePos = aPos * 2.0f;
+}
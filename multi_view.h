@@ -0,0 +1,160 @@
+#pragma once
+//
+//  multi_view.h
+//  3D Object Drawing
+//
+//  Draws one culled draw list into two viewports at once: the free camera and a
+//  top-down BasicCamera overview of the apartment. Every draw is submitted once; the
+//  vertex shader (ARB_shader_viewport_layer_array) or a geometry shader (GL 4.1)
+//  sends each triangle to both views. Without either it falls back to two passes.
+//
+
+#ifndef MULTI_VIEW_H
+#define MULTI_VIEW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "basic_camera.h"
+#include "bounds.h"
+#include "clustered_lighting.h"
+#include "frame_arena.h"
+#include "gl_extensions.h"
+#include "render_queue.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+enum MultiViewPath {
+    MULTI_VIEW_VERTEX,      // instanced draws, gl_ViewportIndex written by the vertex shader
+    MULTI_VIEW_GEOMETRY,    // geometry shader with one invocation per view
+    MULTI_VIEW_TWO_PASSES   // GL 3.3: the draw list is submitted once per view
+};
+
+inline const char* multiViewPathName(MultiViewPath path)
+{
+    static const char* names[] = { "vertex shader viewport index", "geometry shader", "two passes" };
+    return names[path];
+}
+
+struct ViewSetup
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    float x, y, width, height;   // viewport in pixels
+};
+
+// Looks straight down on 'bounds' from a BasicCamera high enough for the whole area to
+// fit. The near plane sits just under 'ceilingY' so the ceilings do not hide the rooms.
+inline void topDownOverview(BasicCamera& camera, const AABB& bounds, float ceilingY, float fovY, float aspect,
+                            glm::mat4& view, glm::mat4& projection)
+{
+    glm::vec3 center = bounds.center();
+    glm::vec3 half = bounds.extent() * 0.5f;
+    float distance = std::max(half.z, half.x / aspect) / std::tan(fovY * 0.5f) * 1.05f;   // from the floor
+    float eyeY = bounds.min.y + distance;
+    camera.changeEye(center.x, eyeY, center.z);
+    camera.changeLookAt(center.x, bounds.min.y, center.z);
+    camera.changeViewUpVector(glm::vec3(0.0f, 0.0f, -1.0f));   // -z is up on screen
+    view = camera.createViewMatrix();
+    float nearPlane = std::max(eyeY - (ceilingY - 0.02f), 0.1f);
+    projection = glm::perspective(fovY, aspect, nearPlane, distance + 1.0f);
+}
+
+class MultiViewRenderer
+{
+public:
+    unsigned int drawCalls = 0;   // last draw(), both views together
+
+    // the program is only compiled when multi-view is first used
+    MultiViewPath path()
+    {
+        if (!initialized)
+            init();
+        return chosen;
+    }
+
+    // 'single' is the regular one-view program, used by the two-pass fallback; its
+    // 'time' uniform must already be set
+    void draw(RenderQueue& queue, const FrameVector<DrawItem>& items, const ViewSetup views[2], const Shader& single,
+              float time, const glm::vec3& eye, FrameArena& arena, GLuint cubeVao)
+    {
+        GLint fullViewport[4];
+        glGetIntegerv(GL_VIEWPORT, fullViewport);
+        bool overdrawView = queue.options.overdrawView;
+        queue.options.overdrawView = false;   // its full-screen pass assumes a single view
+
+        drawCalls = 0;
+        if (path() == MULTI_VIEW_TWO_PASSES)
+        {
+            single.use();
+            for (int v = 0; v < 2; v++)
+            {
+                glViewport(static_cast<GLint>(views[v].x), static_cast<GLint>(views[v].y),
+                           static_cast<GLsizei>(views[v].width), static_cast<GLsizei>(views[v].height));
+                single.setMat4("projection", views[v].projection);
+                single.setMat4("view", views[v].view);
+                queue.execute(items, single, eye, arena, cubeVao);
+                drawCalls += queue.stats.drawCalls + queue.stats.prepassDrawCalls;
+            }
+        }
+        else
+        {
+            const GlExtensions& ext = glExtensions();
+            for (int v = 0; v < 2; v++)
+                ext.viewportIndexedf(v, views[v].x, views[v].y, views[v].width, views[v].height);
+            program->use();
+            program->setMat4("viewProjections[0]", views[0].projection * views[0].view);
+            program->setMat4("viewProjections[1]", views[1].projection * views[1].view);
+            program->setFloat("time", time);
+            queue.options.instances = chosen == MULTI_VIEW_VERTEX ? 2 : 1;
+            queue.execute(items, *program, eye, arena, cubeVao);
+            queue.options.instances = 1;
+            drawCalls = queue.stats.drawCalls + queue.stats.prepassDrawCalls;
+            single.use();
+        }
+
+        queue.options.overdrawView = overdrawView;
+        glViewport(fullViewport[0], fullViewport[1], fullViewport[2], fullViewport[3]);   // resets every viewport
+    }
+
+private:
+    bool initialized = false;
+    MultiViewPath chosen = MULTI_VIEW_TWO_PASSES;
+    std::unique_ptr<Shader> program;
+
+    void init()
+    {
+        initialized = true;
+        const GlExtensions& ext = glExtensions();
+        if (ext.vertexViewportIndex)
+        {
+            program.reset(new Shader("multiViewVertexShader.vs", "fragmentShader.fs"));
+            if (program->linked())
+            {
+                program->use();
+                setPointLightUnits(*program);
+                chosen = MULTI_VIEW_VERTEX;
+                return;
+            }
+        }
+        if (ext.viewportArray)
+        {
+            program.reset(new Shader("multiViewWorldVertexShader.vs", "multiViewGeometryShader.gs", "fragmentShader.fs"));
+            if (program->linked())
+            {
+                program->use();
+                setPointLightUnits(*program);
+                chosen = MULTI_VIEW_GEOMETRY;
+                return;
+            }
+        }
+        program.reset();
+        chosen = MULTI_VIEW_TWO_PASSES;
+    }
+};
+
+#endif
@@ -0,0 +1,365 @@
+#pragma once
+//
+//  occlusion_culling.h
+//  3D Object Drawing
+//
+//  CPU software occlusion culling: large occluders are rasterized into a low-resolution
+//  depth buffer with SIMD edge functions, then every object's bounding box is tested
+//  against it (hierarchically, through a max-depth mip) before it is submitted to GL.
+//
+
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frame_arena.h"
+#include "job_system.h"
+#include "render_queue.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct OcclusionStats
+{
+    unsigned int occluders = 0;
+    unsigned int occluderTriangles = 0;   // after near-plane clipping
+    unsigned int tested = 0;
+    unsigned int culled = 0;              // hidden behind occluders
+    unsigned int offscreen = 0;           // bounds entirely outside the view
+    double rasterMs = 0.0;
+    double testMs = 0.0;
+};
+
+class OcclusionCuller
+{
+public:
+    // the buffer is split into TILE_WIDTH x TILE_HEIGHT tiles, each rasterized by one job;
+    // BLOCK is the size of the max-depth blocks used to reject whole areas at once
+    static const int TILE_WIDTH = 64;
+    static const int TILE_HEIGHT = 32;
+    static const int BLOCK = 8;
+
+    OcclusionStats stats;
+
+    // width must be a multiple of TILE_WIDTH, height of TILE_HEIGHT
+    OcclusionCuller(int width = 256, int height = 192)
+        : width(width), height(height),
+          tilesX(width / TILE_WIDTH), tilesY(height / TILE_HEIGHT),
+          blocksX(width / BLOCK), blocksY(height / BLOCK),
+          depth(width * height), blockMaxDepth(blocksX * blocksY), bins(tilesX * tilesY)
+    {
+    }
+
+    // rasterizes the DRAW_OCCLUDER items, then removes every item whose bounds are hidden
+    void cull(FrameVector<DrawItem>& items, const glm::mat4& viewProjection, JobSystem& jobs, FrameArena& arena)
+    {
+        typedef std::chrono::high_resolution_clock Clock;
+        Clock::time_point start = Clock::now();
+
+        beginFrame(viewProjection);
+        for (const DrawItem& item : items)
+            if (item.flags & DRAW_OCCLUDER)
+                addOccluder(item.model);
+        rasterize(jobs);
+
+        Clock::time_point rastered = Clock::now();
+
+        // test in chunks so large scenes spread over the workers
+        const unsigned int chunk = 256;
+        size_t count = items.size();
+        unsigned char* visible = arena.allocateArray<unsigned char>(count);
+        unsigned int* offscreenPerChunk = arena.allocateArray<unsigned int>((count + chunk - 1) / chunk);
+        auto test = [&](unsigned int c, unsigned int) {
+            unsigned int offscreen = 0;
+            size_t end = std::min(count, (size_t)(c + 1) * chunk);
+            for (size_t i = (size_t)c * chunk; i < end; i++)
+            {
+                Visibility v = testBounds(items[i].bounds);
+                visible[i] = v == VISIBLE;
+                offscreen += v == OFFSCREEN;
+            }
+            offscreenPerChunk[c] = offscreen;
+        };
+        unsigned int chunks = static_cast<unsigned int>((count + chunk - 1) / chunk);
+        jobs.parallelFor(chunks, test);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++)
+            if (visible[i])
+                items[kept++] = items[i];
+        items.resize(kept);
+
+        stats.tested = static_cast<unsigned int>(count);
+        stats.offscreen = 0;
+        for (unsigned int c = 0; c < chunks; c++)
+            stats.offscreen += offscreenPerChunk[c];
+        stats.culled = static_cast<unsigned int>(count - kept) - stats.offscreen;
+        stats.rasterMs = std::chrono::duration<double, std::milli>(rastered - start).count();
+        stats.testMs = std::chrono::duration<double, std::milli>(Clock::now() - rastered).count();
+    }
+
+    // clears the buffer for a new view
+    void beginFrame(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        triangles.clear();
+        for (std::vector<uint32_t>& bin : bins)
+            bin.clear();
+        stats.occluders = 0;
+        stats.occluderTriangles = 0;
+    }
+
+    // queues the 12 triangles of the 0..0.5 cube under 'model'
+    void addOccluder(const glm::mat4& model)
+    {
+        static const unsigned char corners[8][3] = {
+            { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+            { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 }
+        };
+        static const unsigned char faces[12][3] = {
+            { 0, 2, 1 }, { 0, 3, 2 }, { 4, 5, 6 }, { 4, 6, 7 },
+            { 0, 1, 5 }, { 0, 5, 4 }, { 3, 7, 6 }, { 3, 6, 2 },
+            { 0, 4, 7 }, { 0, 7, 3 }, { 1, 2, 6 }, { 1, 6, 5 }
+        };
+        glm::mat4 mvp = viewProjection * model;
+        glm::vec4 clip[8];
+        for (int i = 0; i < 8; i++)
+            clip[i] = mvp * glm::vec4(corners[i][0] * 0.5f, corners[i][1] * 0.5f, corners[i][2] * 0.5f, 1.0f);
+        for (int f = 0; f < 12; f++)
+            addClipTriangle(clip[faces[f][0]], clip[faces[f][1]], clip[faces[f][2]]);
+        stats.occluders++;
+    }
+
+    // bins the queued triangles and rasterizes every tile as a separate job
+    void rasterize(JobSystem& jobs)
+    {
+        for (uint32_t t = 0; t < triangles.size(); t++)
+        {
+            const ScreenTriangle& tri = triangles[t];
+            int x0 = clampToInt(std::floor(std::min(tri.x[0], std::min(tri.x[1], tri.x[2]))), 0, width - 1) / TILE_WIDTH;
+            int x1 = clampToInt(std::ceil(std::max(tri.x[0], std::max(tri.x[1], tri.x[2]))), 0, width - 1) / TILE_WIDTH;
+            int y0 = clampToInt(std::floor(std::min(tri.y[0], std::min(tri.y[1], tri.y[2]))), 0, height - 1) / TILE_HEIGHT;
+            int y1 = clampToInt(std::ceil(std::max(tri.y[0], std::max(tri.y[1], tri.y[2]))), 0, height - 1) / TILE_HEIGHT;
+            for (int ty = y0; ty <= y1; ty++)
+                for (int tx = x0; tx <= x1; tx++)
+                    bins[ty * tilesX + tx].push_back(t);
+        }
+        stats.occluderTriangles = static_cast<unsigned int>(triangles.size());
+
+        auto tileJob = [this](unsigned int tile, unsigned int) { rasterizeTile(tile); };
+        jobs.parallelFor(tilesX * tilesY, tileJob);
+    }
+
+    // false when the box is certainly hidden behind occluders or outside the view
+    bool isVisible(const AABB& box) const
+    {
+        return testBounds(box) == VISIBLE;
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const float* depthBuffer() const { return depth.data(); }
+
+private:
+    enum Visibility { VISIBLE, OCCLUDED, OFFSCREEN };
+
+    struct ScreenTriangle
+    {
+        float x[3], y[3], z[3];   // pixels, depth in [0, 1]
+    };
+
+    int width, height;
+    int tilesX, tilesY;
+    int blocksX, blocksY;
+    glm::mat4 viewProjection;
+    std::vector<float> depth;
+    std::vector<float> blockMaxDepth;   // farthest occluder depth in each BLOCK x BLOCK area
+    std::vector<ScreenTriangle> triangles;
+    std::vector<std::vector<uint32_t> > bins;
+
+    // float to int without overflow for coordinates far off screen
+    static int clampToInt(float v, int lo, int hi)
+    {
+        return v <= (float)lo ? lo : (v >= (float)hi ? hi : (int)v);
+    }
+
+    // clips against the near plane (z > -w) and queues the result in screen space
+    void addClipTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+    {
+        const glm::vec4 in[3] = { a, b, c };
+        glm::vec4 out[4];
+        int n = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const glm::vec4& p = in[i];
+            const glm::vec4& q = in[(i + 1) % 3];
+            float dp = p.z + p.w, dq = q.z + q.w;
+            if (dp >= 0.0f)
+                out[n++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+                out[n++] = p + (q - p) * (dp / (dp - dq));
+        }
+        if (n < 3)
+            return;
+        float sx[4], sy[4], sz[4];
+        for (int i = 0; i < n; i++)
+        {
+            float w = std::max(out[i].w, 1e-6f);
+            sx[i] = (out[i].x / w * 0.5f + 0.5f) * width;
+            sy[i] = (out[i].y / w * 0.5f + 0.5f) * height;
+            sz[i] = std::min(std::max(out[i].z / w * 0.5f + 0.5f, 0.0f), 1.0f);
+        }
+        // fan the clipped polygon into triangles
+        for (int k = 1; k + 1 < n; k++)
+        {
+            ScreenTriangle tri;
+            tri.x[0] = sx[0]; tri.y[0] = sy[0]; tri.z[0] = sz[0];
+            tri.x[1] = sx[k]; tri.y[1] = sy[k]; tri.z[1] = sz[k];
+            tri.x[2] = sx[k + 1]; tri.y[2] = sy[k + 1]; tri.z[2] = sz[k + 1];
+            triangles.push_back(tri);
+        }
+    }
+
+    void rasterizeTile(unsigned int tile)
+    {
+        int tx0 = (tile % tilesX) * TILE_WIDTH, ty0 = (tile / tilesX) * TILE_HEIGHT;
+        int tx1 = tx0 + TILE_WIDTH, ty1 = ty0 + TILE_HEIGHT;
+
+        for (int y = ty0; y < ty1; y++)
+            std::fill(depth.begin() + y * width + tx0, depth.begin() + y * width + tx1, 1.0f);
+
+        for (uint32_t index : bins[tile])
+            rasterizeTriangle(triangles[index], tx0, ty0, tx1, ty1);
+
+        // farthest depth per block, for hierarchical rejection in testBounds()
+        for (int by = ty0 / BLOCK; by < ty1 / BLOCK; by++)
+        {
+            for (int bx = tx0 / BLOCK; bx < tx1 / BLOCK; bx++)
+            {
+                float farthest = 0.0f;
+                for (int y = by * BLOCK; y < (by + 1) * BLOCK; y++)
+                    for (int x = bx * BLOCK; x < (bx + 1) * BLOCK; x++)
+                        farthest = std::max(farthest, depth[y * width + x]);
+                blockMaxDepth[by * blocksX + bx] = farthest;
+            }
+        }
+    }
+
+    // edge-function rasterization of one triangle into the tile [tx0, tx1) x [ty0, ty1),
+    // SimdFloat::WIDTH pixels per step; keeps the nearest depth
+    void rasterizeTriangle(const ScreenTriangle& t, int tx0, int ty0, int tx1, int ty1)
+    {
+        float x0 = t.x[0], y0 = t.y[0], z0 = t.z[0];
+        float x1 = t.x[1], y1 = t.y[1], z1 = t.z[1];
+        float x2 = t.x[2], y2 = t.y[2], z2 = t.z[2];
+        float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+        if (std::fabs(area) < 1e-8f)
+            return;
+        if (area < 0.0f)
+        {
+            std::swap(x1, x2); std::swap(y1, y2); std::swap(z1, z2);
+            area = -area;
+        }
+
+        int minX = clampToInt(std::floor(std::min(x0, std::min(x1, x2))), tx0, tx1);
+        int maxX = clampToInt(std::ceil(std::max(x0, std::max(x1, x2))), tx0, tx1);
+        int minY = clampToInt(std::floor(std::min(y0, std::min(y1, y2))), ty0, ty1);
+        int maxY = clampToInt(std::ceil(std::max(y0, std::max(y1, y2))), ty0, ty1);
+        if (minX >= maxX || minY >= maxY)
+            return;
+        minX -= (minX - tx0) % SimdFloat::WIDTH;   // step in whole vectors inside the tile
+
+        // E(x, y) = A x + B y + C is positive inside for counter-clockwise triangles
+        float A0 = y0 - y1, B0 = x1 - x0, C0 = -(A0 * x0 + B0 * y0);
+        float A1 = y1 - y2, B1 = x2 - x1, C1 = -(A1 * x1 + B1 * y1);
+        float A2 = y2 - y0, B2 = x0 - x2, C2 = -(A2 * x2 + B2 * y2);
+        // push every edge out by 1/1000 pixel so rounding leaves no cracks between triangles sharing an edge
+        C0 += 1e-3f * (std::fabs(A0) + std::fabs(B0));
+        C1 += 1e-3f * (std::fabs(A1) + std::fabs(B1));
+        C2 += 1e-3f * (std::fabs(A2) + std::fabs(B2));
+        // depth plane z = dzdx x + dzdy y + zc
+        float dzdx = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) / area;
+        float dzdy = ((z2 - z0) * (x1 - x0) - (z1 - z0) * (x2 - x0)) / area;
+        float zc = z0 - dzdx * x0 - dzdy * y0;
+
+        const SimdFloat zero = SimdFloat::set1(0.0f);
+        const SimdFloat one = SimdFloat::set1(1.0f);
+        const SimdFloat a0 = SimdFloat::set1(A0), a1 = SimdFloat::set1(A1), a2 = SimdFloat::set1(A2);
+        const SimdFloat dzx = SimdFloat::set1(dzdx);
+        const SimdFloat ramp = SimdFloat::ramp();
+
+        for (int y = minY; y < maxY; y++)
+        {
+            float py = y + 0.5f;
+            SimdFloat row0 = SimdFloat::set1(B0 * py + C0);
+            SimdFloat row1 = SimdFloat::set1(B1 * py + C1);
+            SimdFloat row2 = SimdFloat::set1(B2 * py + C2);
+            SimdFloat rowZ = SimdFloat::set1(dzdy * py + zc);
+            float* line = &depth[y * width];
+            for (int x = minX; x < maxX; x += SimdFloat::WIDTH)
+            {
+                SimdFloat px = SimdFloat::set1(x + 0.5f) + ramp;
+                SimdFloat e0 = a0 * px + row0;
+                SimdFloat e1 = a1 * px + row1;
+                SimdFloat e2 = a2 * px + row2;
+                SimdFloat inside = simdAnd(simdAnd(simdGreaterEqual(e0, zero), simdGreaterEqual(e1, zero)), simdGreaterEqual(e2, zero));
+                if (simdMask(inside) == 0)
+                    continue;
+                SimdFloat z = simdMin(simdMax(dzx * px + rowZ, zero), one);
+                SimdFloat old = SimdFloat::load(line + x);
+                simdSelect(inside, simdMin(old, z), old).store(line + x);
+            }
+        }
+    }
+
+    Visibility testBounds(const AABB& box) const
+    {
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1.0f;
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec4 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z, 1.0f);
+            glm::vec4 clip = viewProjection * corner;
+            // crossing the near plane: cannot be bounded on screen, keep it
+            if (clip.w <= 1e-5f || clip.z < -clip.w)
+                return VISIBLE;
+            float invW = 1.0f / clip.w;
+            float sx = (clip.x * invW * 0.5f + 0.5f) * width;
+            float sy = (clip.y * invW * 0.5f + 0.5f) * height;
+            minX = std::min(minX, sx); maxX = std::max(maxX, sx);
+            minY = std::min(minY, sy); maxY = std::max(maxY, sy);
+            nearest = std::min(nearest, clip.z * invW * 0.5f + 0.5f);
+        }
+        if (maxX < 0.0f || maxY < 0.0f || minX > width || minY > height || nearest > 1.0f)
+            return OFFSCREEN;
+
+        int x0 = clampToInt(std::floor(minX), 0, width), x1 = clampToInt(std::ceil(maxX), 0, width);
+        int y0 = clampToInt(std::floor(minY), 0, height), y1 = clampToInt(std::ceil(maxY), 0, height);
+        if (x1 <= x0) x1 = std::min(width, x0 + 1), x0 = x1 - 1;
+        if (y1 <= y0) y1 = std::min(height, y0 + 1), y0 = y1 - 1;
+
+        // the object is hidden when every covered pixel has an occluder nearer than its nearest point
+        for (int by = y0 / BLOCK; by <= (y1 - 1) / BLOCK; by++)
+        {
+            for (int bx = x0 / BLOCK; bx <= (x1 - 1) / BLOCK; bx++)
+            {
+                if (blockMaxDepth[by * blocksX + bx] < nearest)
+                    continue;   // the whole block is in front
+                int px0 = std::max(x0, bx * BLOCK), px1 = std::min(x1, (bx + 1) * BLOCK);
+                int py0 = std::max(y0, by * BLOCK), py1 = std::min(y1, (by + 1) * BLOCK);
+                for (int y = py0; y < py1; y++)
+                    for (int x = px0; x < px1; x++)
+                        if (depth[y * width + x] >= nearest)
+                            return VISIBLE;
+            }
+        }
+        return OCCLUDED;
+    }
+};
+
+#endif
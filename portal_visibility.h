@@ -0,0 +1,261 @@
+#pragma once
+//
+//  portal_visibility.h
+//  3D Object Drawing
+//
+//  Cells (rooms) connected by portals (door and window openings). Starting in the
+//  camera's cell, the view frustum is narrowed through every portal it can see, so only
+//  rooms visible through a chain of openings are drawn.
+//
+
+#ifndef PORTAL_VISIBILITY_H
+#define PORTAL_VISIBILITY_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <chrono>
+#include <vector>
+
+enum PortalKind {
+    PORTAL_DOOR,
+    PORTAL_WINDOW
+};
+
+struct Portal
+{
+    PortalKind kind;
+    int cells[2];
+    glm::vec3 corners[4];   // planar convex quad, corners in order around the edge
+};
+
+struct PortalStats
+{
+    unsigned int cells = 0;
+    unsigned int visibleCells = 0;
+    unsigned int portalsTested = 0;
+    unsigned int portalsPassed = 0;
+    bool cameraOutside = false;   // eye is in no cell; every cell in the view frustum was kept
+    double ms = 0.0;
+};
+
+class PortalGraph
+{
+public:
+    PortalStats stats;
+
+    // a cell is walkable space; the eye is in the cell whose bounds contain it
+    int addCell(const AABB& bounds)
+    {
+        cells.push_back(CellState());
+        cells.back().bounds = bounds;
+        return static_cast<int>(cells.size()) - 1;
+    }
+
+    int addPortal(int cellA, int cellB, PortalKind kind, const glm::vec3 corners[4])
+    {
+        Portal portal;
+        portal.kind = kind;
+        portal.cells[0] = cellA;
+        portal.cells[1] = cellB;
+        for (int i = 0; i < 4; i++)
+            portal.corners[i] = corners[i];
+        portals.push_back(portal);
+        int index = static_cast<int>(portals.size()) - 1;
+        cells[cellA].portals.push_back(index);
+        cells[cellB].portals.push_back(index);
+        return index;
+    }
+
+    int cellCount() const { return static_cast<int>(cells.size()); }
+    const AABB& cellBounds(int cell) const { return cells[cell].bounds; }
+    const std::vector<Portal>& getPortals() const { return portals; }
+
+    // -1 when the point is in no cell
+    int findCell(const glm::vec3& p) const
+    {
+        for (size_t i = 0; i < cells.size(); i++)
+            if (cells[i].bounds.contains(p))
+                return static_cast<int>(i);
+        return -1;
+    }
+
+    // decides which cells are visible this frame and the volumes they are seen through
+    void computeVisibility(const glm::vec3& eye, const glm::mat4& viewProjection)
+    {
+        auto start = std::chrono::steady_clock::now();
+        stats = PortalStats();
+        stats.cells = static_cast<unsigned int>(cells.size());
+        for (CellState& cell : cells)
+        {
+            cell.frustumCount = 0;
+            cell.onPath = false;
+        }
+
+        viewFrustum = Frustum::fromMatrix(viewProjection);
+        int eyeCell = findCell(eye);
+        if (eyeCell < 0)
+        {
+            // outside the layout (or inside a wall): there is no portal to look through
+            stats.cameraOutside = true;
+            for (CellState& cell : cells)
+                if (viewFrustum.intersects(cell.bounds))
+                    addView(cell, viewFrustum);
+        }
+        else
+        {
+            visit(eyeCell, viewFrustum, eye, 0);
+        }
+
+        for (const CellState& cell : cells)
+            stats.visibleCells += cell.frustumCount != 0;
+        stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool isCellVisible(int cell) const
+    {
+        return cells[cell].frustumCount != 0;
+    }
+
+    // whether an object of 'cell' can be seen through any of the openings that reach the cell
+    bool isVisible(int cell, const AABB& bounds) const
+    {
+        const CellState& state = cells[cell];
+        if (state.frustumCount > MAX_CELL_VIEWS)
+            return viewFrustum.intersects(bounds);
+        for (int i = 0; i < state.frustumCount; i++)
+            if (state.views[i].intersects(bounds))
+                return true;
+        return false;
+    }
+
+private:
+    // a cell reached along more paths than this is tested against the whole view frustum
+    static const int MAX_CELL_VIEWS = 4;
+    // portal chains longer than this are not followed
+    static const int MAX_DEPTH = 16;
+    static const int MAX_POLYGON = Frustum::MAX_PLANES + 4;
+
+    struct CellState
+    {
+        AABB bounds;
+        std::vector<int> portals;
+        Frustum views[MAX_CELL_VIEWS];
+        int frustumCount = 0;   // may exceed MAX_CELL_VIEWS; see isVisible()
+        bool onPath = false;
+    };
+
+    std::vector<CellState> cells;
+    std::vector<Portal> portals;
+    Frustum viewFrustum;
+
+    static void addView(CellState& cell, const Frustum& view)
+    {
+        if (cell.frustumCount < MAX_CELL_VIEWS)
+            cell.views[cell.frustumCount] = view;
+        cell.frustumCount++;
+    }
+
+    void visit(int cellIndex, const Frustum& view, const glm::vec3& eye, int depth)
+    {
+        CellState& cell = cells[cellIndex];
+        addView(cell, view);
+        if (depth == MAX_DEPTH)
+            return;
+
+        cell.onPath = true;
+        for (int portalIndex : cell.portals)
+        {
+            const Portal& portal = portals[portalIndex];
+            int other = portal.cells[0] == cellIndex ? portal.cells[1] : portal.cells[0];
+            if (cells[other].onPath)
+                continue;
+            stats.portalsTested++;
+
+            // portal plane facing into the other cell
+            glm::vec3 normal = glm::normalize(glm::cross(portal.corners[1] - portal.corners[0], portal.corners[2] - portal.corners[0]));
+            if (glm::dot(normal, cells[other].bounds.center() - portal.corners[0]) < 0.0f)
+                normal = -normal;
+            glm::vec4 portalPlane(normal, -glm::dot(normal, portal.corners[0]));
+            float eyeDistance = Frustum::distance(portalPlane, eye);
+
+            const float DOORWAY = 0.05f;
+            if (eyeDistance > DOORWAY)
+                continue;   // seen from behind: the opening leads back toward the eye
+
+            if (eyeDistance > -DOORWAY)
+            {
+                // standing in the opening: the quad is edge-on, look through unchanged
+                stats.portalsPassed++;
+                visit(other, view, eye, depth + 1);
+                continue;
+            }
+
+            glm::vec3 polygon[MAX_POLYGON];
+            int vertices = clipToFrustum(portal.corners, view, polygon);
+            if (vertices < 3)
+                continue;
+            stats.portalsPassed++;
+
+            // pyramid from the eye through the visible part of the opening
+            Frustum narrowed;
+            glm::vec3 centroid(0.0f);
+            for (int i = 0; i < vertices; i++)
+                centroid += polygon[i];
+            centroid /= static_cast<float>(vertices);
+            for (int i = 0; i < vertices && narrowed.count < Frustum::MAX_PLANES - 1; i++)
+            {
+                glm::vec3 a = polygon[i] - eye;
+                glm::vec3 b = polygon[(i + 1) % vertices] - eye;
+                glm::vec3 n = glm::cross(a, b);
+                if (glm::dot(n, n) < 1e-12f)
+                    continue;
+                glm::vec4 plane(n, -glm::dot(n, eye));
+                if (Frustum::distance(plane, centroid) < 0.0f)
+                    plane = -plane;
+                narrowed.addPlane(plane);
+            }
+            narrowed.addPlane(portalPlane);   // nothing on the near side of the opening
+            visit(other, narrowed, eye, depth + 1);
+        }
+        cell.onPath = false;
+    }
+
+    // Sutherland-Hodgman clip of the quad against every plane of 'view'
+    static int clipToFrustum(const glm::vec3 quad[4], const Frustum& view, glm::vec3* out)
+    {
+        glm::vec3 buffers[2][MAX_POLYGON];
+        int count = 4;
+        for (int i = 0; i < 4; i++)
+            buffers[0][i] = quad[i];
+
+        int current = 0;
+        for (int p = 0; p < view.count && count >= 3; p++)
+        {
+            const glm::vec4& plane = view.planes[p];
+            const glm::vec3* in = buffers[current];
+            glm::vec3* result = buffers[current ^ 1];
+            int resultCount = 0;
+            for (int i = 0; i < count && resultCount < MAX_POLYGON - 1; i++)
+            {
+                const glm::vec3& a = in[i];
+                const glm::vec3& b = in[(i + 1) % count];
+                float da = Frustum::distance(plane, a);
+                float db = Frustum::distance(plane, b);
+                if (da >= 0.0f)
+                    result[resultCount++] = a;
+                if ((da >= 0.0f) != (db >= 0.0f))
+                    result[resultCount++] = a + (b - a) * (da / (da - db));
+            }
+            count = resultCount;
+            current ^= 1;
+        }
+
+        for (int i = 0; i < count; i++)
+            out[i] = buffers[current][i];
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,403 @@
+#pragma once
+//
+//  render_queue.h
+//  3D Object Drawing
+//
+//  Per-frame draw list: front-to-back ordering, optional depth pre-pass and an
+//  overdraw visualization.
+//
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.h"
+#include "frame_arena.h"
+#include "light_probes.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// DrawItem::flags
+enum DrawItemFlags {
+    DRAW_OCCLUDER = 1 << 0,         // large opaque object worth rasterizing into the occlusion buffer
+    // what a mouse click on the object toggles
+    DRAW_PICK_TV = 1 << 1,
+    DRAW_PICK_BOOKSHELF = 1 << 2,
+    DRAW_ANIMATED = 1 << 3,         // 'spin' is applied by the vertex shader
+    DRAW_MESH = 1 << 4,             // an imported mesh, not the shared cube: the GPU culler leaves it out
+    DRAW_STATEFUL = 1 << 5,         // pose follows RoomState (a stopped fan blade): never baked into a world chunk
+    DRAW_BAKED = 1 << 6,            // drawn from a world chunk's buffers, already in world space: the shader gets
+                                    // an identity model, 'model' still describes the cube for culling and picking
+    DRAW_COLLISION_ONLY = 1 << 7    // a wall of a room that is not loaded: in the scene BVH, never drawn
+};
+
+// Rotation evaluated on the GPU: the object is turned by phase + speed * time radians about
+// 'axis' (unit length, world space) through 'pivot'. Two vec4s, as the shaders receive it.
+struct DrawSpin
+{
+    glm::vec3 pivot = glm::vec3(0.0f);
+    float speed = 0.0f;              // radians per second
+    glm::vec3 axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float phase = 0.0f;              // radians
+};
+
+// one glDrawElements call with the uniforms it needs
+struct DrawItem
+{
+    glm::mat4 model;                 // with DRAW_ANIMATED: the pose at angle 0
+    glm::vec4 color;
+    AABB bounds;                     // with DRAW_ANIMATED: everything the object sweeps through
+    GLuint vao;
+    GLsizei indexCount;
+    GLenum indexType;                // GL_UNSIGNED_INT for the cube, 16 bits for most imported meshes
+    size_t indexOffset;              // bytes into the VAO's element buffer
+    unsigned int flags;
+    unsigned int material;           // index into RenderQueueOptions::materials; 0 is the flat color
+    unsigned int lightmap;           // baked lightmap slot + 1 (BakedLighting::assign); 0: lit by the probes
+    DrawSpin spin;
+};
+
+inline DrawItem makeCubeDraw(const glm::mat4& model, const AABB& bounds, const glm::vec4& color, GLuint vao,
+                             unsigned int flags = 0)
+{
+    DrawItem item;
+    item.model = model;
+    item.color = color;
+    item.bounds = bounds;
+    item.vao = vao;
+    item.indexCount = 36;
+    item.indexType = GL_UNSIGNED_INT;
+    item.indexOffset = 0;
+    item.flags = flags;
+    item.material = 0;
+    item.lightmap = 0;
+    return item;
+}
+
+inline DrawItem makeCubeDraw(const glm::mat4& model, const glm::vec4& color, GLuint vao, unsigned int flags = 0)
+{
+    return makeCubeDraw(model, cubeBounds(model), color, vao, flags);
+}
+
+// Object that keeps turning without its data changing: 'model' is the pose at angle 0,
+// and the bounds cover the circles its corners trace around the axis.
+inline DrawItem makeAnimatedCubeDraw(const glm::mat4& model, const glm::vec4& color, GLuint vao, const DrawSpin& spin,
+                                     unsigned int flags = 0)
+{
+    DrawItem item = makeCubeDraw(model, color, vao, flags | DRAW_ANIMATED);
+    item.spin = spin;
+    AABB swept;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 local((corner & 1) ? 0.5f : 0.0f, (corner & 2) ? 0.5f : 0.0f, (corner & 4) ? 0.5f : 0.0f);
+        glm::vec3 p(model * glm::vec4(local, 1.0f));
+        glm::vec3 center = spin.pivot + spin.axis * glm::dot(p - spin.pivot, spin.axis);
+        float radius = glm::length(p - center);
+        // a circle of normal n reaches radius * sqrt(1 - n_i^2) along axis i
+        glm::vec3 reach = radius * glm::sqrt(glm::max(glm::vec3(1.0f) - spin.axis * spin.axis, glm::vec3(0.0f)));
+        swept.expand(center - reach);
+        swept.expand(center + reach);
+    }
+    item.bounds = swept;
+    return item;
+}
+
+// the model matrix the vertex shader ends up using at 'time', for CPU-side queries such as picking
+inline glm::mat4 modelAt(const DrawItem& item, float time)
+{
+    if (!(item.flags & DRAW_ANIMATED))
+        return item.model;
+    glm::mat4 identity(1.0f);
+    float angle = item.spin.phase + item.spin.speed * time;
+    return glm::translate(identity, item.spin.pivot) * glm::rotate(identity, angle, item.spin.axis) *
+           glm::translate(identity, -item.spin.pivot) * item.model;
+}
+
+// albedo texture of a material, projected along the dominant axis of each face in world space
+struct MaterialBinding
+{
+    GLuint texture = 0;            // 0: nothing resident yet, the item is drawn flat
+    float repeatsPerUnit = 1.0f;   // texture repeats per world unit
+};
+
+// the 'lighting' uniform of fragmentShader.fs
+enum LightingMode {
+    LIGHTING_NONE,        // the flat color as it is
+    LIGHTING_LIGHTMAP,    // times the baked lightmap of the face
+    LIGHTING_PROBES       // times the ambient cube blended from the nearest probes
+};
+
+struct RenderQueueOptions
+{
+    bool frontToBack = true;     // sort opaque draws by camera distance before drawing
+    bool depthPrepass = false;   // lay down depth first, then shade only the visible surface
+    bool overdrawView = false;   // replace the image by a heat map of fragment writes per pixel
+    GLsizei instances = 1;       // per draw; the multi-view shader picks its view from gl_InstanceID
+    const MaterialBinding* materials = nullptr;   // indexed by DrawItem::material, bound on texture unit 0
+    // Baked lighting: items with a lightmap slot read the lightmap that BakedLighting::bind put on units 1
+    // and 2, the others get an ambient cube from these probes. Null draws everything unlit.
+    const ProbeGrid* probes = nullptr;
+};
+
+struct RenderQueueStats
+{
+    unsigned int drawCalls = 0;
+    unsigned int prepassDrawCalls = 0;
+    // filled only while overdrawView is on
+    double averageOverdraw = 0.0;   // fragment writes per covered pixel
+    double coveredPixels = 0.0;     // fraction of the screen written at least once
+};
+
+// Draws a frame's DrawItems. The order and the passes are chosen here so the code that
+// builds the scene does not have to care about overdraw.
+class RenderQueue
+{
+public:
+    RenderQueueOptions options;
+    RenderQueueStats stats;
+
+    // 'cubeVao' must hold the 0..0.5 cube; it is reused as the full-screen quad of the overdraw view.
+    // The shader's 'time' uniform must already be set for animated items.
+    void execute(const FrameVector<DrawItem>& items, const Shader& shader, const glm::vec3& eye,
+                 FrameArena& arena, GLuint cubeVao)
+    {
+        stats.drawCalls = 0;
+        stats.prepassDrawCalls = 0;
+
+        uint32_t* order = sortOrder(items, eye, arena);
+        size_t count = items.size();
+
+        if (options.overdrawView)
+        {
+            // every fragment that passes the depth test increments the stencil value of its pixel
+            glEnable(GL_STENCIL_TEST);
+            glClearStencil(0);
+            glClear(GL_STENCIL_BUFFER_BIT);
+            glStencilFunc(GL_ALWAYS, 0, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+        }
+
+        if (options.depthPrepass)
+        {
+            // same program with color writes off keeps the depth values bit-identical to the main pass
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            if (options.overdrawView)
+                glStencilMask(0x00);   // pre-pass writes are not shading work
+            drawRange(items, order, count, shader, stats.prepassDrawCalls);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glStencilMask(0xFF);
+            glDepthFunc(GL_LEQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        drawRange(items, order, count, shader, stats.drawCalls);
+
+        if (options.depthPrepass)
+        {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+
+        if (options.overdrawView)
+        {
+            measureOverdraw();
+            drawOverdrawHeatMap(shader, cubeVao);
+            glDisable(GL_STENCIL_TEST);
+        }
+    }
+
+private:
+    std::vector<GLubyte> stencilReadback;
+
+    // front-to-back order of the items as indices, allocated in the frame arena
+    uint32_t* sortOrder(const FrameVector<DrawItem>& items, const glm::vec3& eye, FrameArena& arena)
+    {
+        size_t count = items.size();
+        uint32_t* order = arena.allocateArray<uint32_t>(count);
+        for (size_t i = 0; i < count; i++)
+            order[i] = static_cast<uint32_t>(i);
+        if (!options.frontToBack)
+            return order;
+
+        // key = squared distance from the eye to the bounds' center
+        float* key = arena.allocateArray<float>(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 d = items[i].bounds.center() - eye;
+            key[i] = glm::dot(d, d);
+        }
+        std::stable_sort(order, order + count, [key](uint32_t a, uint32_t b) { return key[a] < key[b]; });
+        return order;
+    }
+
+    void drawRange(const FrameVector<DrawItem>& items, const uint32_t* order, size_t count,
+                   const Shader& shader, unsigned int& drawCalls)
+    {
+        GLuint boundVao = 0;
+        GLuint boundTexture = 0;   // the 'textured' uniform is false between passes
+        int boundLighting = LIGHTING_NONE;
+        bool spinning = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            const DrawItem& item = items[order[i]];
+            shader.setMat4("model", (item.flags & DRAW_BAKED) ? glm::mat4(1.0f) : item.model);
+            shader.setVec4("color", item.color);
+            // static items far outnumber animated ones, so the spin uniforms are only touched on a change
+            if (item.flags & DRAW_ANIMATED)
+            {
+                setSpin(shader, item.spin);
+                spinning = true;
+            }
+            else if (spinning)
+            {
+                setSpin(shader, DrawSpin());
+                spinning = false;
+            }
+            if (item.vao != boundVao)
+            {
+                glBindVertexArray(item.vao);
+                boundVao = item.vao;
+            }
+            const MaterialBinding* material = options.materials && item.material ? &options.materials[item.material] : nullptr;
+            GLuint texture = material ? material->texture : 0;
+            if (texture != boundTexture)
+            {
+                if (texture)
+                {
+                    glBindTexture(GL_TEXTURE_2D, texture);
+                    shader.setFloat("textureRepeat", material->repeatsPerUnit);
+                }
+                if (!texture || !boundTexture)
+                    shader.setBool("textured", texture != 0);
+                boundTexture = texture;
+            }
+            if (options.probes)
+            {
+                int lighting = item.lightmap ? LIGHTING_LIGHTMAP : LIGHTING_PROBES;
+                if (lighting != boundLighting)
+                {
+                    shader.setInt("lighting", lighting);
+                    boundLighting = lighting;
+                }
+                if (item.lightmap)
+                    shader.setInt("lightmapSlot", static_cast<int>(item.lightmap - 1));
+                else
+                {
+                    glm::vec3 cube[AMBIENT_FACES];
+                    options.probes->ambientCube(item.bounds.center(), cube);
+                    shader.setVec3Array("ambientCube", cube, AMBIENT_FACES);
+                }
+            }
+            const void* indices = reinterpret_cast<const void*>(item.indexOffset);
+            if (options.instances > 1)
+                glDrawElementsInstanced(GL_TRIANGLES, item.indexCount, item.indexType, indices, options.instances);
+            else
+                glDrawElements(GL_TRIANGLES, item.indexCount, item.indexType, indices);
+            drawCalls++;
+        }
+        if (spinning)
+            setSpin(shader, DrawSpin());
+        if (boundTexture)
+            shader.setBool("textured", false);
+        if (boundLighting != LIGHTING_NONE)
+            shader.setInt("lighting", LIGHTING_NONE);
+    }
+
+    static void setSpin(const Shader& shader, const DrawSpin& spin)
+    {
+        shader.setVec4("spinPivot", glm::vec4(spin.pivot, spin.speed));
+        shader.setVec4("spinAxis", glm::vec4(spin.axis, spin.phase));
+    }
+
+    void measureOverdraw()
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        size_t pixels = (size_t)viewport[2] * viewport[3];
+        if (stencilReadback.size() != pixels)
+            stencilReadback.resize(pixels);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, stencilReadback.data());
+
+        unsigned long long writes = 0, covered = 0;
+        for (size_t i = 0; i < pixels; i++)
+        {
+            writes += stencilReadback[i];
+            covered += stencilReadback[i] != 0;
+        }
+        stats.averageOverdraw = covered ? (double)writes / covered : 0.0;
+        stats.coveredPixels = pixels ? (double)covered / pixels : 0.0;
+    }
+
+    // one full-screen quad per overdraw level, drawn where the stencil count matches
+    void drawOverdrawHeatMap(const Shader& shader, GLuint cubeVao)
+    {
+        static const glm::vec4 heat[] = {
+            glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),   // 0: never written
+            glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),   // 1: ideal
+            glm::vec4(0.0f, 1.0f, 0.0f, 1.0f),
+            glm::vec4(1.0f, 1.0f, 0.0f, 1.0f),
+            glm::vec4(1.0f, 0.5f, 0.0f, 1.0f),
+            glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),   // 5 or more
+        };
+        const int levels = sizeof(heat) / sizeof(heat[0]);
+
+        // the cube flattened to z = 0 and stretched over clip space is a full-screen quad; the
+        // caller's matrices are read back first and restored once the levels are drawn
+        static const char* const matrices[] = { "projection", "view", "model" };
+        glm::mat4 saved[3];
+        for (int m = 0; m < 3; m++)
+            saved[m] = uniformMat4(shader, matrices[m]);
+        glm::mat4 identity(1.0f);
+        glm::mat4 quad = glm::translate(identity, glm::vec3(-1.0f, -1.0f, 0.0f)) * glm::scale(identity, glm::vec3(4.0f, 4.0f, 0.0f));
+        shader.setMat4("projection", identity);
+        shader.setMat4("view", identity);
+        shader.setMat4("model", quad);
+
+        // the levels are flat colors: no baked light, and no point lights (pointLighting 0 is
+        // POINT_LIGHTS_OFF), which are put back for the caller's next draw
+        GLint pointLightingLocation = glGetUniformLocation(shader.id(), "pointLighting");
+        GLint pointLighting = 0;
+        if (pointLightingLocation != -1)
+            glGetUniformiv(shader.id(), pointLightingLocation, &pointLighting);
+        shader.setInt("lighting", LIGHTING_NONE);
+        shader.setInt("pointLighting", 0);
+
+        glDisable(GL_DEPTH_TEST);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        glBindVertexArray(cubeVao);
+        for (int level = 0; level < levels; level++)
+        {
+            if (level == levels - 1)
+                glStencilFunc(GL_LEQUAL, level, 0xFF);   // ref <= stencil
+            else
+                glStencilFunc(GL_EQUAL, level, 0xFF);
+            shader.setVec4("color", heat[level]);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        }
+        glEnable(GL_DEPTH_TEST);
+        if (pointLighting != 0)
+            shader.setInt("pointLighting", pointLighting);
+        for (int m = 0; m < 3; m++)
+            shader.setMat4(matrices[m], saved[m]);
+    }
+
+    // the value the program holds for a mat4 uniform; identity if it has none by that name
+    static glm::mat4 uniformMat4(const Shader& shader, const char* name)
+    {
+        glm::mat4 value(1.0f);
+        GLint location = glGetUniformLocation(shader.id(), name);
+        if (location != -1)
+            glGetUniformfv(shader.id(), location, &value[0][0]);
+        return value;
+    }
+};
+
+#endif
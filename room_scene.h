@@ -0,0 +1,560 @@
+#pragma once
+//
+//  room_scene.h
+//  3D Object Drawing
+//
+//  The living room (walls, floor, TV, fan, sofa, table, clock, bookshelf) as draw items,
+//  and apartments built from copies of it joined by door and window openings.
+//
+
+#ifndef ROOM_SCENE_H
+#define ROOM_SCENE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.h"
+#include "frame_arena.h"
+#include "hlod.h"
+#include "portal_visibility.h"
+#include "render_queue.h"
+#include "static_math.h"
+
+#include <random>
+#include <vector>
+
+// DrawItem::material of the room's surfaces; each is one streamed texture
+enum RoomMaterial {
+    MATERIAL_NONE,          // flat color
+    MATERIAL_FLOOR_TILES,
+    MATERIAL_PLASTER,       // walls and ceiling
+    MATERIAL_WOOD,
+    MATERIAL_FABRIC,
+    MATERIAL_COUNT
+};
+
+inline glm::mat4 transformation(float transform_x, float transform_y, float transform_z, float rotate_x, float rotate_y,
+    float rotate_z, float scale_x, float scale_y, float scale_z) {
+    glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
+    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model;
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(transform_x, transform_y, transform_z));
+    rotateXMatrix = glm::rotate(identityMatrix, glm::radians(rotate_x), glm::vec3(1.0f, 0.0f, 0.0f));
+    rotateYMatrix = glm::rotate(identityMatrix, glm::radians(rotate_y), glm::vec3(0.0f, 1.0f, 0.0f));
+    rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotate_z), glm::vec3(0.0f, 0.0f, 1.0f));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(scale_x, scale_y, scale_z));
+    model = translateMatrix * rotateXMatrix * rotateYMatrix * rotateZMatrix * scaleMatrix;
+    return model;
+}
+
+// room extent, in the room's own coordinates
+const float ROOM_MIN_X = -0.80f;
+const float ROOM_MAX_X = 6.40f;
+const float ROOM_FLOOR_Y = -0.30f;
+const float ROOM_TOP_Y = 2.10f;
+const float ROOM_MIN_Z = -1.0f;
+const float ROOM_MAX_Z = 5.0f;
+const float ROOM_RIGHT_WALL_X = 2.28f * 2.80f;
+const float ROOM_CEILING_Y = 2.0f;   // underside of the top wall
+
+// where the openings go: clear of the TV, clock, sofa and bookshelf
+const float SIDE_OPENING_Z = 0.5f;   // center on the left and right walls
+const float END_OPENING_X = 5.2f;    // center on the front and back walls
+const float OPENING_WIDTH = 1.2f;
+const float DOOR_TOP_Y = 1.7f;
+const float WINDOW_BOTTOM_Y = 0.6f;
+const float WINDOW_TOP_Y = 1.5f;
+
+enum RoomWall {
+    WALL_LEFT,
+    WALL_RIGHT,
+    WALL_FRONT,
+    WALL_BACK,
+    WALL_COUNT
+};
+
+// a hole in one wall, in room coordinates: 'center' runs along the wall (z for the
+// left and right walls, x for the front and back walls)
+struct RoomOpening
+{
+    bool present = false;
+    float center = 0.0f;
+    float width = 0.0f;
+    float bottom = 0.0f;
+    float top = 0.0f;
+};
+
+inline RoomOpening makeOpening(PortalKind kind, float center)
+{
+    RoomOpening opening;
+    opening.present = true;
+    opening.center = center;
+    opening.width = OPENING_WIDTH;
+    opening.bottom = kind == PORTAL_DOOR ? ROOM_FLOOR_Y : WINDOW_BOTTOM_Y;
+    opening.top = kind == PORTAL_DOOR ? DOOR_TOP_Y : WINDOW_TOP_Y;
+    return opening;
+}
+
+// furniture drawn as several parts that can be swapped for one HLOD proxy
+enum RoomCluster {
+    CLUSTER_SOFA,
+    CLUSTER_TABLE,
+    CLUSTER_CLOCK,
+    CLUSTER_COUNT
+};
+
+// the switchable parts of the room; the fan and the clock hands turn in the vertex shader
+struct RoomState
+{
+    bool fanRotating = false;
+    bool bookshelfOpen = false;
+    glm::vec4 tvColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    float tvZ = -0.97f;             // the screen sits a little further out while it is on
+};
+
+// Turning about the z axis that transformation() rotates by 'rz': the pivot and axis are
+// where its translation and x/y rotations put that axis. Angles are in transformation()'s degrees.
+inline DrawSpin spinAboutLocalZ(const glm::mat4& placement, float transform_x, float transform_y, float transform_z,
+                                float rotate_x, float rotate_y, float phaseDegrees, float degreesPerSecond)
+{
+    glm::mat4 base = placement * transformation(transform_x, transform_y, transform_z, rotate_x, rotate_y, 0.0f, 1.0f, 1.0f, 1.0f);
+    DrawSpin spin;
+    spin.pivot = glm::vec3(base[3]);
+    spin.axis = glm::normalize(glm::vec3(base[2]));
+    spin.phase = glm::radians(phaseDegrees);
+    spin.speed = glm::radians(degreesPerSecond);
+    return spin;
+}
+
+// box between two corners of the 0..0.5 cube's space; zero extent makes a flat panel
+inline glm::mat4 boxBetween(const glm::vec3& min, const glm::vec3& max)
+{
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    return glm::translate(identityMatrix, min) * glm::scale(identityMatrix, (max - min) * 2.0f);
+}
+
+// Appends one wall as the panels around its opening. 'fixed' is the wall's x (left,
+// right) or z (front, back); the wall spans [from, to] along the other horizontal axis.
+inline void appendWallWithOpening(FrameVector<DrawItem>& list, GLuint vao, const glm::mat4& placement,
+                                  bool alongZ, float fixed, float from, float to, const RoomOpening& opening,
+                                  const glm::vec4& color)
+{
+    auto panel = [&](float a0, float a1, float y0, float y1) {
+        if (a1 <= a0 || y1 <= y0)
+            return;
+        glm::vec3 min = alongZ ? glm::vec3(fixed, y0, a0) : glm::vec3(a0, y0, fixed);
+        glm::vec3 max = alongZ ? glm::vec3(fixed, y1, a1) : glm::vec3(a1, y1, fixed);
+        list.push_back(makeCubeDraw(placement * boxBetween(min, max), color, vao, DRAW_OCCLUDER));
+        list.back().material = MATERIAL_PLASTER;
+    };
+    float left = opening.center - opening.width * 0.5f;
+    float right = opening.center + opening.width * 0.5f;
+    panel(from, left, ROOM_FLOOR_Y, ROOM_TOP_Y);
+    panel(right, to, ROOM_FLOOR_Y, ROOM_TOP_Y);
+    panel(left, right, ROOM_FLOOR_Y, opening.bottom);
+    panel(left, right, opening.top, ROOM_TOP_Y);
+}
+
+// A part of the room whose pose never changes, with its model matrix and bounds in room
+// coordinates. The tables below are evaluated by the compiler; appendRoom only moves them
+// by the room's placement.
+struct StaticColor
+{
+    float r = 1.0f, g = 1.0f, b = 1.0f, a = 1.0f;
+};
+
+struct StaticPart
+{
+    StaticMat4 model;
+    StaticBounds bounds;
+    StaticColor color;
+    unsigned int flags = 0;
+    unsigned int material = MATERIAL_NONE;
+};
+
+constexpr StaticPart staticPart(const StaticMat4& model, const StaticColor& color, unsigned int flags = 0,
+                                unsigned int material = MATERIAL_NONE)
+{
+    StaticPart part;
+    part.model = model;
+    part.bounds = staticCubeBounds(model);
+    part.color = color;
+    part.flags = flags;
+    part.material = material;
+    return part;
+}
+
+template <size_t N>
+struct StaticParts
+{
+    StaticPart parts[N];
+};
+
+const StaticColor WALL_COLOR = { 1.0f, 0.7f, 0.7f, 1.0f };
+
+// the walls without an opening, indexed by RoomWall
+constexpr StaticPart ROOM_CLOSED_WALLS[WALL_COUNT] = {
+    staticPart(staticTransformation(-0.80f, -0.30f, -1.0f, 0.0f, 90.0f, 0.0f, -14.0f, 4.8f, 0.0f), WALL_COLOR, DRAW_OCCLUDER, MATERIAL_PLASTER),
+    staticPart(staticTransformation(2.28 * 2.80f, -0.30f, 6.0f, 0.0f, 90.0f, 0.0f, 14.0f, 4.8f, 0.0f), WALL_COLOR, DRAW_OCCLUDER, MATERIAL_PLASTER),
+    staticPart(staticTransformation(-0.80f, -0.30f, -1.0f, 0.0f, 0.0f, 0.0f, 14.4f, 4.8f, 0.0f), WALL_COLOR, DRAW_OCCLUDER, MATERIAL_PLASTER),
+    staticPart(staticTransformation(-0.80f, -0.30f, 5.0f, 0.0f, 0.0f, 0.0f, 14.4f, 4.8f, 0.0f), WALL_COLOR, DRAW_OCCLUDER, MATERIAL_PLASTER)
+};
+
+constexpr StaticPart ROOM_CEILING[] = {
+    staticPart(staticTransformation(-0.80f, 2.0f, -1.0f, 90.0f, 0.0f, 0.0f, 14.3f, 14.0f, 0.0f), { 0.95f, 0.95f, 0.95f, 1.0f }, DRAW_OCCLUDER, MATERIAL_PLASTER)
+};
+
+// 10 x 10 tiles, stepped in float as the loop that used to place them did
+constexpr StaticParts<100> staticFloorTiles()
+{
+    StaticParts<100> tiles;
+    float x_trans = -0.8f;
+    for (int i = 0; i < 10; i++)
+    {
+        float z_trans = -1.0f;
+        for (int it = 0; it < 10; it++)
+        {
+            tiles.parts[i * 10 + it] = staticPart(staticTransformation(x_trans, -0.30f, z_trans, 90.0f, 0.0f, 0.0f, 1.5f, 1.5f, 0.0f),
+                                                  StaticColor(), 0, MATERIAL_FLOOR_TILES);
+            z_trans += 0.77f;
+        }
+        x_trans += 0.77f;
+    }
+    return tiles;
+}
+
+constexpr StaticParts<100> ROOM_FLOOR = staticFloorTiles();
+
+// the frame behind the screen; the screen itself moves with RoomState
+constexpr StaticPart ROOM_TV_FRAME[] = {
+    staticPart(staticTransformation(1.80f, 0.60f, -0.99f, 0.0f, 0.0f, 0.0f, 4.5f, 2.1f, 0.0f), { 1.0f, 1.0f, 1.0f, 1.0f }, DRAW_PICK_TV)
+};
+
+constexpr StaticPart ROOM_SOFA[] = {
+    staticPart(staticTransformation(0.78f, -0.3f, 4.6f, 0.0f, 0.0f, 0.0f, 5.2f, 1.5f, 0.6f), { 0.80f, 0.65f, 0.5f, 1.0f }, DRAW_OCCLUDER, MATERIAL_FABRIC),
+    staticPart(staticTransformation(0.80f, -0.3f, 4.0f, 0.0f, 0.0f, 0.0f, 5.0f, 0.8f, 1.65f), { 0.8f, 0.7f, 0.6f, 1.0f }, DRAW_OCCLUDER, MATERIAL_FABRIC),
+    staticPart(staticTransformation(0.75f, -0.3f, 4.1f, 0.0f, 0.0f, 0.0f, 0.5f, 1.2f, 1.65f), { 0.87f, 0.72f, 0.53f, 1.0f }, 0, MATERIAL_FABRIC),
+    staticPart(staticTransformation(3.15f, -0.3f, 4.1f, 0.0f, 0.0f, 0.0f, 0.5f, 1.2f, 1.65f), { 0.87f, 0.72f, 0.53f, 1.0f }, 0, MATERIAL_FABRIC)
+};
+
+// the top, then the legs
+constexpr StaticPart ROOM_TABLE[] = {
+    staticPart(staticTransformation(1.00f, 0.20f, 3.0f, 0.0f, 0.0f, 0.0f, 4.0f, 0.2f, 1.6f), { 0.5f, 0.5f, 0.5f, 0.5f }, 0, MATERIAL_WOOD),
+    staticPart(staticTransformation(1.00f, -0.3f, 3.0f, 0.0f, 0.0f, 0.0f, 0.3f, 1.0f, 0.3f), { 0.0f, 0.0f, 0.0f, 0.5f }),
+    staticPart(staticTransformation(1.00f, -0.3f, 3.65f, 0.0f, 0.0f, 0.0f, 0.3f, 1.0f, 0.3f), { 0.0f, 0.0f, 0.0f, 0.5f }),
+    staticPart(staticTransformation(2.8f, -0.3f, 3.65f, 0.0f, 0.0f, 0.0f, 0.3f, 1.0f, 0.3f), { 0.0f, 0.0f, 0.0f, 0.5f }),
+    staticPart(staticTransformation(2.8f, -0.3f, 3.0f, 0.0f, 0.0f, 0.0f, 0.3f, 1.0f, 0.3f), { 0.0f, 0.0f, 0.0f, 0.5f })
+};
+
+// the face and the ticks at 12, 6, 3 and 9; the hands turn
+constexpr StaticPart ROOM_CLOCK_FACE[] = {
+    staticPart(staticTransformation(6.10f, 1.00f, 3.0f, 0.0f, 90.0f, 0.0f, 1.5f, 1.5f, 0.3f), { 1.0f, 1.0f, 1.0f, 1.0f }),
+    staticPart(staticTransformation(6.09f, 1.67f, 2.65f, 0.0f, 90.0f, 0.0f, 0.1f, 0.1f, 0.3f), { 0.0f, 0.0f, 0.0f, 1.0f }),
+    staticPart(staticTransformation(6.09f, 1.05f, 2.65f, 0.0f, 90.0f, 0.0f, 0.1f, 0.1f, 0.3f), { 0.0f, 0.0f, 0.0f, 1.0f }),
+    staticPart(staticTransformation(6.09f, 1.36f, 2.96f, 0.0f, 90.0f, 0.0f, 0.1f, 0.1f, 0.3f), { 0.0f, 0.0f, 0.0f, 1.0f }),
+    staticPart(staticTransformation(6.09f, 1.36f, 2.34f, 0.0f, 90.0f, 0.0f, 0.1f, 0.1f, 0.3f), { 0.0f, 0.0f, 0.0f, 1.0f })
+};
+
+// sides, back, bottom and top; the doors open with RoomState
+constexpr StaticPart ROOM_BOOKSHELF_FRAME[] = {
+    staticPart(staticTransformation(1.0f, -0.30f, 0.0f, 0.0f, 90.0f, 0.0f, 2.0f, 3.8f, 0.15f), { 0.53f, 0.29f, 0.03f, 1.0f }, DRAW_OCCLUDER | DRAW_PICK_BOOKSHELF, MATERIAL_WOOD),
+    staticPart(staticTransformation(0.0f, -0.30f, 0.0f, 0.0f, 90.0f, 0.0f, 2.0f, 3.8f, 0.15f), { 0.53f, 0.29f, 0.03f, 1.0f }, DRAW_OCCLUDER | DRAW_PICK_BOOKSHELF, MATERIAL_WOOD),
+    staticPart(staticTransformation(-0.00f, -0.30f, -0.9f, 0.0f, 0.0f, 0.0f, 2.0f, 3.8f, 0.0f), { 0.38f, 0.22f, 0.07f, 1.0f }, DRAW_OCCLUDER | DRAW_PICK_BOOKSHELF, MATERIAL_WOOD),
+    staticPart(staticTransformation(0.00f, -0.29f, -1.0f, 90.0f, 0.0f, 0.0f, 2.1f, 2.0f, 1.3f), { 0.36f, 0.18f, 0.07f, 1.0f }, DRAW_PICK_BOOKSHELF, MATERIAL_WOOD),
+    staticPart(staticTransformation(0.00f, 1.6f, -1.04f, 90.0f, 0.0f, 0.0f, 2.1f, 2.0f, 0.15f), { 0.36f, 0.18f, 0.07f, 1.0f }, DRAW_PICK_BOOKSHELF, MATERIAL_WOOD)
+};
+
+constexpr StaticPart ROOM_BOOKSHELF_SHELVES[] = {
+    staticPart(staticTransformation(0.00f, 1.0f, -1.04f, 90.0f, 0.0f, 0.0f, 2.1f, 2.0f, 0.15f), { 0.36f, 0.18f, 0.07f, 1.0f }, DRAW_PICK_BOOKSHELF, MATERIAL_WOOD),
+    staticPart(staticTransformation(0.00f, 0.4f, -1.04f, 90.0f, 0.0f, 0.0f, 2.1f, 2.0f, 0.15f), { 0.36f, 0.18f, 0.07f, 1.0f }, DRAW_PICK_BOOKSHELF, MATERIAL_WOOD)
+};
+
+// Appends [parts, parts + count) moved into the world by 'placement'. Rooms are only ever
+// translated, and then the matrices and bounds are just offset.
+inline void appendStaticParts(FrameVector<DrawItem>& drawList, GLuint vao, const glm::mat4& placement,
+                              const StaticPart* parts, size_t count)
+{
+    glm::vec3 offset(placement[3]);
+    bool translation = placement == glm::translate(glm::mat4(1.0f), offset);
+    for (size_t i = 0; i < count; i++)
+    {
+        const StaticPart& part = parts[i];
+        glm::vec4 color(part.color.r, part.color.g, part.color.b, part.color.a);
+        glm::mat4 model = part.model.toGlm();
+        if (translation)
+        {
+            model[3] += glm::vec4(offset, 0.0f);
+            AABB bounds = part.bounds.toAABB();
+            drawList.push_back(makeCubeDraw(model, AABB(bounds.min + offset, bounds.max + offset), color, vao, part.flags));
+        }
+        else
+            drawList.push_back(makeCubeDraw(placement * model, color, vao, part.flags));
+        drawList.back().material = part.material;
+    }
+}
+
+template <size_t N>
+inline void appendStaticParts(FrameVector<DrawItem>& drawList, GLuint vao, const glm::mat4& placement,
+                              const StaticPart (&parts)[N])
+{
+    appendStaticParts(drawList, vao, placement, parts, N);
+}
+
+// Appends the room's shell: its four walls with their openings, the ceiling and the floor.
+// appendRoom starts with these; alone they stand in for a room whose contents are not loaded.
+inline void appendRoomShell(FrameVector<DrawItem>& drawList, GLuint vao, const glm::mat4& placement,
+                            const RoomOpening openings[WALL_COUNT], unsigned int flags = 0)
+{
+    size_t first = drawList.size();
+    const glm::vec4 wallColor(WALL_COLOR.r, WALL_COLOR.g, WALL_COLOR.b, WALL_COLOR.a);
+
+    // left, right, front and back walls
+    const bool alongZ[WALL_COUNT] = { true, true, false, false };
+    const float fixed[WALL_COUNT] = { ROOM_MIN_X, ROOM_RIGHT_WALL_X, ROOM_MIN_Z, ROOM_MAX_Z };
+    for (int wall = 0; wall < WALL_COUNT; wall++)
+    {
+        if (openings[wall].present)
+            appendWallWithOpening(drawList, vao, placement, alongZ[wall], fixed[wall],
+                                  alongZ[wall] ? ROOM_MIN_Z : ROOM_MIN_X, alongZ[wall] ? ROOM_MAX_Z + 1.0f : ROOM_MAX_X,
+                                  openings[wall], wallColor);
+        else
+            appendStaticParts(drawList, vao, placement, &ROOM_CLOSED_WALLS[wall], 1);
+    }
+
+    //// Top wall
+    appendStaticParts(drawList, vao, placement, ROOM_CEILING);
+
+    //// Bottom wall
+    appendStaticParts(drawList, vao, placement, ROOM_FLOOR.parts);
+
+    for (size_t i = first; i < drawList.size(); i++)
+        drawList[i].flags |= flags;
+}
+
+// Appends every object of one room. 'placement' moves the room into the world;
+// 'openings' (indexed by RoomWall) cut doors and windows into its walls. When given,
+// 'clusters' (indexed by RoomCluster) receives where each piece of furniture landed.
+// Everything but the TV screen, the fan, the clock hands and the bookshelf doors comes
+// from the compile-time tables above.
+inline void appendRoom(FrameVector<DrawItem>& drawList, GLuint vao, const glm::mat4& placement,
+                       const RoomOpening openings[WALL_COUNT], const RoomState& state,
+                       ClusterRange* clusters = nullptr)
+{
+    auto beginCluster = [&](RoomCluster cluster) {
+        if (clusters)
+            clusters[cluster].first = drawList.size();
+    };
+    auto endCluster = [&](RoomCluster cluster) {
+        if (clusters)
+            clusters[cluster].end = drawList.size();
+    };
+
+    auto drawCube = [&](const glm::mat4& cubeModel, const glm::vec4& color, unsigned int flags = 0,
+                        unsigned int material = MATERIAL_NONE) {
+        drawList.push_back(makeCubeDraw(placement * cubeModel, color, vao, flags));
+        drawList.back().material = material;
+    };
+
+    // a part whose rz turns at a constant rate; stopped parts are plain static draws
+    auto drawSpinning = [&](float tx, float ty, float tz, float rx, float ry, float phaseDegrees, float degreesPerSecond,
+                            float sx, float sy, float sz, const glm::vec4& color) {
+        if (degreesPerSecond == 0.0f)
+        {
+            drawCube(transformation(tx, ty, tz, rx, ry, phaseDegrees, sx, sy, sz), color, DRAW_STATEFUL);
+            return;
+        }
+        glm::mat4 rest = placement * transformation(tx, ty, tz, rx, ry, 0.0f, sx, sy, sz);
+        drawList.push_back(makeAnimatedCubeDraw(rest, color, vao,
+                                                spinAboutLocalZ(placement, tx, ty, tz, rx, ry, phaseDegrees, degreesPerSecond)));
+    };
+
+    glm::mat4 model;
+    appendRoomShell(drawList, vao, placement, openings);
+
+
+    //TV
+    model = transformation(1.80f, 0.60f, state.tvZ, 0.0f, 0.0f, 0.0f, 4.55f, 2.15f, 0.0f);
+    drawCube(model, state.tvColor, DRAW_STATEFUL | DRAW_PICK_TV);
+
+    //white
+    appendStaticParts(drawList, vao, placement, ROOM_TV_FRAME);
+
+
+    //fan
+
+    float rotationSpeed = 200000.0f;
+    float fanDegreesPerSecond = 0.0f;
+    if (state.fanRotating)
+    {
+        fanDegreesPerSecond = glm::radians(rotationSpeed);   // same rate the angle used to be rebuilt at
+    }
+    for (int i = 0; i < 4; ++i) {
+        float rotateAngle = i * 90.0f; // blade's angle at time 0
+        //white
+        drawSpinning(2.375f, 1.87f, 2.50f, 90.0f, 0.0f, rotateAngle, fanDegreesPerSecond, 2.50f, 0.5f, 0.03f, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+        //black
+        drawSpinning(2.375f, 1.86f, 2.50f, 90.0f, 0.0f, rotateAngle, fanDegreesPerSecond, 2.50f, 0.47f, 0.03f, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+
+    //sofa
+    beginCluster(CLUSTER_SOFA);
+    appendStaticParts(drawList, vao, placement, ROOM_SOFA);
+    endCluster(CLUSTER_SOFA);
+
+    //table
+    beginCluster(CLUSTER_TABLE);
+    appendStaticParts(drawList, vao, placement, ROOM_TABLE);
+    endCluster(CLUSTER_TABLE);
+
+    //Clock
+    beginCluster(CLUSTER_CLOCK);
+    appendStaticParts(drawList, vao, placement, ROOM_CLOCK_FACE);
+
+    float minuteDegreesPerSecond = glm::radians(600.0f);
+    drawSpinning(6.09f, 1.38f, 2.637f, 0.0f, 90.0f, 0.0f, minuteDegreesPerSecond, 0.05f, 0.55f, 0.05f, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    float hourDegreesPerSecond = glm::radians(100.0f);
+    drawSpinning(6.09f, 1.38f, 2.637f, 0.0f, 90.0f, 0.0f, hourDegreesPerSecond, 0.05f, 0.50f, 0.05f, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+
+    endCluster(CLUSTER_CLOCK);
+
+    // Book shelf
+    appendStaticParts(drawList, vao, placement, ROOM_BOOKSHELF_FRAME);
+
+    float openAngle;
+    if (!state.bookshelfOpen)
+        openAngle = 0.0f;
+    else
+        openAngle = -120.0f;
+
+    glm::mat4 frontWood = transformation(-0.00f, -0.30f, 0.02f, 0.0f, openAngle, 0.0f, 1.0f, 3.8f, 0.0f);
+    drawCube(frontWood, glm::vec4(0.53f, 0.29f, 0.03f, 1.0f), DRAW_OCCLUDER | DRAW_STATEFUL | DRAW_PICK_BOOKSHELF, MATERIAL_WOOD);
+
+    glm::mat4 frontWood2 = transformation(1.05f, -0.30f, 0.02f, 0.0f, 180-openAngle, 0.0f, 1.0f, 3.8f, 0.0f);
+    drawCube(frontWood2, glm::vec4(0.53f, 0.29f, 0.03f, 1.0f), DRAW_OCCLUDER | DRAW_STATEFUL | DRAW_PICK_BOOKSHELF, MATERIAL_WOOD);
+
+    appendStaticParts(drawList, vao, placement, ROOM_BOOKSHELF_SHELVES);
+}
+
+// loose furniture added to a room (see scatterProps), in room coordinates
+struct RoomProp
+{
+    glm::mat4 model;
+    glm::vec4 color;
+};
+
+// copy of the room placed in an apartment
+struct RoomInstance
+{
+    glm::mat4 placement;
+    RoomOpening openings[WALL_COUNT];
+    std::vector<RoomProp> props;
+};
+
+inline void appendRoomProps(FrameVector<DrawItem>& drawList, GLuint vao, const RoomInstance& room)
+{
+    for (const RoomProp& prop : room.props)
+    {
+        drawList.push_back(makeCubeDraw(room.placement * prop.model, prop.color, vao));
+        drawList.back().material = MATERIAL_WOOD;
+    }
+}
+
+// Rooms on a grid, one portal cell each. Neighbours along x share a door; along z the
+// first column shares a door and the others an interior window. rooms[i] belongs to cell i.
+struct Apartment
+{
+    PortalGraph cells;
+    std::vector<RoomInstance> rooms;
+};
+
+const float ROOM_PITCH_X = ROOM_MAX_X - ROOM_MIN_X;
+const float ROOM_PITCH_Z = ROOM_MAX_Z - ROOM_MIN_Z;
+
+inline void buildApartment(Apartment& apartment, int columns, int rows)
+{
+    apartment = Apartment();
+    for (int row = 0; row < rows; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            glm::vec3 offset(column * ROOM_PITCH_X, 0.0f, row * ROOM_PITCH_Z);
+            RoomInstance room;
+            room.placement = glm::translate(glm::mat4(1.0f), offset);
+            if (column > 0)
+                room.openings[WALL_LEFT] = makeOpening(PORTAL_DOOR, SIDE_OPENING_Z);
+            if (column + 1 < columns)
+                room.openings[WALL_RIGHT] = makeOpening(PORTAL_DOOR, SIDE_OPENING_Z);
+            PortalKind endKind = column == 0 ? PORTAL_DOOR : PORTAL_WINDOW;
+            if (row > 0)
+                room.openings[WALL_FRONT] = makeOpening(endKind, END_OPENING_X);
+            if (row + 1 < rows)
+                room.openings[WALL_BACK] = makeOpening(endKind, END_OPENING_X);
+            apartment.rooms.push_back(room);
+            apartment.cells.addCell(AABB(offset + glm::vec3(ROOM_MIN_X, ROOM_FLOOR_Y, ROOM_MIN_Z),
+                                         offset + glm::vec3(ROOM_MAX_X, ROOM_TOP_Y, ROOM_MAX_Z)));
+        }
+    }
+
+    // openings between neighbours; the two walls of a shared opening are cut identically
+    for (int row = 0; row < rows; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            int cell = row * columns + column;
+            glm::vec3 offset(column * ROOM_PITCH_X, 0.0f, row * ROOM_PITCH_Z);
+            if (column + 1 < columns)
+            {
+                const RoomOpening& o = apartment.rooms[cell].openings[WALL_RIGHT];
+                float x = offset.x + (ROOM_RIGHT_WALL_X + ROOM_MAX_X) * 0.5f;   // between the two walls
+                float z0 = offset.z + o.center - o.width * 0.5f, z1 = offset.z + o.center + o.width * 0.5f;
+                glm::vec3 corners[4] = {
+                    glm::vec3(x, o.bottom, z0), glm::vec3(x, o.bottom, z1),
+                    glm::vec3(x, o.top, z1), glm::vec3(x, o.top, z0)
+                };
+                apartment.cells.addPortal(cell, cell + 1, PORTAL_DOOR, corners);
+            }
+            if (row + 1 < rows)
+            {
+                const RoomOpening& o = apartment.rooms[cell].openings[WALL_BACK];
+                float z = offset.z + ROOM_MAX_Z;
+                float x0 = offset.x + o.center - o.width * 0.5f, x1 = offset.x + o.center + o.width * 0.5f;
+                glm::vec3 corners[4] = {
+                    glm::vec3(x0, o.bottom, z), glm::vec3(x1, o.bottom, z),
+                    glm::vec3(x1, o.top, z), glm::vec3(x0, o.top, z)
+                };
+                apartment.cells.addPortal(cell, cell + columns, column == 0 ? PORTAL_DOOR : PORTAL_WINDOW, corners);
+            }
+        }
+    }
+}
+
+// Drops 'perRoom' crates and stools on the floor of every room, so the object count can
+// be raised without changing the furniture. The same seed always gives the same layout.
+inline void scatterProps(Apartment& apartment, int perRoom, unsigned int seed)
+{
+    static const glm::vec4 woods[] = {
+        glm::vec4(0.55f, 0.40f, 0.25f, 1.0f), glm::vec4(0.42f, 0.30f, 0.18f, 1.0f),
+        glm::vec4(0.70f, 0.55f, 0.35f, 1.0f), glm::vec4(0.35f, 0.22f, 0.12f, 1.0f)
+    };
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> x(-0.5f, 6.0f), z(-0.5f, 4.5f);
+    std::uniform_real_distribution<float> size(0.1f, 0.5f), height(0.1f, 0.8f), yaw(0.0f, 90.0f);
+    std::uniform_int_distribution<int> wood(0, 3);
+
+    for (RoomInstance& room : apartment.rooms)
+    {
+        room.props.resize(perRoom);
+        for (RoomProp& prop : room.props)
+        {
+            float w = size(random), d = size(random), h = height(random);
+            // the cube spans 0..0.5, so scale by twice the wanted size
+            prop.model = transformation(x(random), ROOM_FLOOR_Y, z(random), 0.0f, yaw(random), 0.0f,
+                                        2.0f * w, 2.0f * h, 2.0f * d);
+            prop.color = woods[wood(random)];
+        }
+    }
+}
+
+#endif
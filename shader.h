@@ -12,6 +12,10 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "asset_pack.h"
+#include "gl_extensions.h"
+#include "gl_resources.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -20,130 +24,217 @@
 class Shader
 {
 public:
-    unsigned int ID;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
+        // 1. retrieve the vertex/fragment source code from the asset pack or filePath
         std::string vertexCode;
         std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
+        const char* vShaderCode;
+        const char* fShaderCode;
+        GLint vShaderLength, fShaderLength;
+        loadSource(vertexPath, vertexCode, vShaderCode, vShaderLength);
+        loadSource(fragmentPath, fragmentCode, fShaderCode, fShaderLength);
         // 2. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glShaderSource(vertex, 1, &vShaderCode, &vShaderLength);
         glCompileShader(vertex);
         checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glShaderSource(fragment, 1, &fShaderCode, &fShaderLength);
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        program.create("shader program");
+        glAttachShader(program.id(), vertex);
+        glAttachShader(program.id(), fragment);
+        glLinkProgram(program.id());
+        checkCompileErrors(program.id(), "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
 
     }
+    // vertex + geometry + fragment program (the geometry stage needs a GL 3.2 context)
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath)
+    {
+        const char* paths[3] = { vertexPath, geometryPath, fragmentPath };
+        const GLenum stages[3] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+        const char* names[3] = { "VERTEX", "GEOMETRY", "FRAGMENT" };
+        program.create("shader program");
+        unsigned int shaders[3];
+        for (int i = 0; i < 3; i++)
+        {
+            std::string code;
+            const char* source;
+            GLint length;
+            loadSource(paths[i], code, source, length);
+            shaders[i] = glCreateShader(stages[i]);
+            glShaderSource(shaders[i], 1, &source, &length);
+            glCompileShader(shaders[i]);
+            checkCompileErrors(shaders[i], names[i]);
+            glAttachShader(program.id(), shaders[i]);
+        }
+        glLinkProgram(program.id());
+        checkCompileErrors(program.id(), "PROGRAM");
+        for (int i = 0; i < 3; i++)
+            glDeleteShader(shaders[i]);
+    }
+    // compute-only program (needs a GL 4.3 context)
+    // ------------------------------------------------------------------------
+    explicit Shader(const char* computePath)
+    {
+        std::string computeCode;
+        const char* cShaderCode;
+        GLint cShaderLength;
+        loadSource(computePath, computeCode, cShaderCode, cShaderLength);
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, &cShaderLength);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+        program.create("compute program");
+        glAttachShader(program.id(), compute);
+        glLinkProgram(program.id());
+        checkCompileErrors(program.id(), "PROGRAM");
+        glDeleteShader(compute);
+    }
+    // the GL program name, for the calls these helpers do not wrap
+    // ------------------------------------------------------------------------
+    GLuint id() const
+    {
+        return program.id();
+    }
+    // false when compiling or linking failed (the errors have been printed)
+    // ------------------------------------------------------------------------
+    bool linked() const
+    {
+        GLint success = 0;
+        if (program)
+            glGetProgramiv(program.id(), GL_LINK_STATUS, &success);
+        return success != 0;
+    }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     {
-        glUseProgram(ID);
+        glUseProgram(program.id());
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
-    void setBool(const std::string& name, bool value) const
+    void setBool(const char* name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(glGetUniformLocation(program.id(), name), (int)value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
+    void setInt(const char* name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(glGetUniformLocation(program.id(), name), value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
+    void setFloat(const char* name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(glGetUniformLocation(program.id(), name), value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+    void setVec2(const char* name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(glGetUniformLocation(program.id(), name), 1, &value[0]);
     }
-    void setVec2(const std::string& name, float x, float y) const
+    void setVec2(const char* name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(glGetUniformLocation(program.id(), name), x, y);
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
+    void setVec3(const char* name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(glGetUniformLocation(program.id(), name), 1, &value[0]);
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+    void setVec3(const char* name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(glGetUniformLocation(program.id(), name), x, y, z);
+    }
+    void setVec3Array(const char* name, const glm::vec3* values, int count) const
+    {
+        glUniform3fv(glGetUniformLocation(program.id(), name), count, &values[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
+    void setVec4(const char* name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(glGetUniformLocation(program.id(), name), 1, &value[0]);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w) const
+    void setVec4(const char* name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(glGetUniformLocation(program.id(), name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
+    void setMat2(const char* name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(glGetUniformLocation(program.id(), name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
+    void setMat3(const char* name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(glGetUniformLocation(program.id(), name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    void setMat4(const char* name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(program.id(), name), 1, GL_FALSE, &mat[0][0]);
     }
 
+    // std::string overloads kept for callers that build names at runtime; string literals
+    // bind to the const char* versions above and never construct a temporary std::string
+    // ------------------------------------------------------------------------
+    void setBool(const std::string& name, bool value) const { setBool(name.c_str(), value); }
+    void setInt(const std::string& name, int value) const { setInt(name.c_str(), value); }
+    void setFloat(const std::string& name, float value) const { setFloat(name.c_str(), value); }
+    void setVec2(const std::string& name, const glm::vec2& value) const { setVec2(name.c_str(), value); }
+    void setVec3(const std::string& name, const glm::vec3& value) const { setVec3(name.c_str(), value); }
+    void setVec4(const std::string& name, const glm::vec4& value) const { setVec4(name.c_str(), value); }
+    void setMat2(const std::string& name, const glm::mat2& mat) const { setMat2(name.c_str(), mat); }
+    void setMat3(const std::string& name, const glm::mat3& mat) const { setMat3(name.c_str(), mat); }
+    void setMat4(const std::string& name, const glm::mat4& mat) const { setMat4(name.c_str(), mat); }
+
 private:
+    // owned: deleted with the shader, moved but never copied
+    GlProgram program;
+
+    // points 'code' at the source: straight into the mapped asset pack when it has the
+    // file, otherwise at 'storage' read from disk
+    // ------------------------------------------------------------------------
+    static void loadSource(const char* path, std::string& storage, const char*& code, GLint& length)
+    {
+        const AssetPack* pack = shaderAssetPack();
+        const AssetPackEntry* entry = pack ? pack->find(path, ASSET_SHADER) : nullptr;
+        if (entry)
+        {
+            code = pack->array<char>(*entry);
+            length = static_cast<GLint>(entry->bytes);
+            return;
+        }
+        std::ifstream file;
+        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            file.open(path);
+            std::stringstream stream;
+            stream << file.rdbuf();
+            file.close();
+            storage = stream.str();
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        }
+        code = storage.c_str();
+        length = static_cast<GLint>(storage.size());
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
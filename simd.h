@@ -0,0 +1,106 @@
+#pragma once
+//
+//  simd.h
+//  3D Object Drawing
+//
+//  Thin wrapper over the widest float vector the compiler targets (AVX, SSE2 or scalar),
+//  used by the CPU rasterizers.
+//
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__AVX__)
+#define SIMD_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+
+#if defined(SIMD_AVX)
+
+struct SimdFloat
+{
+    static const int WIDTH = 8;
+    __m256 v;
+
+    SimdFloat() {}
+    SimdFloat(__m256 v) : v(v) {}
+    static SimdFloat set1(float x) { return _mm256_set1_ps(x); }
+    static SimdFloat ramp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+    static SimdFloat load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline SimdFloat simdMin(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a.v, b.v); }
+inline SimdFloat simdMax(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a.v, b.v); }
+// comparison results are lane masks (all bits set where true)
+inline SimdFloat simdGreaterEqual(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline SimdFloat simdLess(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline SimdFloat simdAnd(SimdFloat a, SimdFloat b) { return _mm256_and_ps(a.v, b.v); }
+// mask ? a : b
+inline SimdFloat simdSelect(SimdFloat mask, SimdFloat a, SimdFloat b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+inline int simdMask(SimdFloat mask) { return _mm256_movemask_ps(mask.v); }
+
+#elif defined(SIMD_SSE)
+
+struct SimdFloat
+{
+    static const int WIDTH = 4;
+    __m128 v;
+
+    SimdFloat() {}
+    SimdFloat(__m128 v) : v(v) {}
+    static SimdFloat set1(float x) { return _mm_set1_ps(x); }
+    static SimdFloat ramp() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+    static SimdFloat load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm_add_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a.v, b.v); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a.v, b.v); }
+inline SimdFloat simdMin(SimdFloat a, SimdFloat b) { return _mm_min_ps(a.v, b.v); }
+inline SimdFloat simdMax(SimdFloat a, SimdFloat b) { return _mm_max_ps(a.v, b.v); }
+inline SimdFloat simdGreaterEqual(SimdFloat a, SimdFloat b) { return _mm_cmpge_ps(a.v, b.v); }
+inline SimdFloat simdLess(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a.v, b.v); }
+inline SimdFloat simdAnd(SimdFloat a, SimdFloat b) { return _mm_and_ps(a.v, b.v); }
+inline SimdFloat simdSelect(SimdFloat mask, SimdFloat a, SimdFloat b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+inline int simdMask(SimdFloat mask) { return _mm_movemask_ps(mask.v); }
+
+#else
+
+// scalar fallback: one lane, masks are 0.0 / 1.0
+struct SimdFloat
+{
+    static const int WIDTH = 1;
+    float v;
+
+    SimdFloat() {}
+    SimdFloat(float v) : v(v) {}
+    static SimdFloat set1(float x) { return x; }
+    static SimdFloat ramp() { return 0.0f; }
+    static SimdFloat load(const float* p) { return *p; }
+    void store(float* p) const { *p = v; }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return a.v + b.v; }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return a.v - b.v; }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return a.v * b.v; }
+inline SimdFloat simdMin(SimdFloat a, SimdFloat b) { return std::min(a.v, b.v); }
+inline SimdFloat simdMax(SimdFloat a, SimdFloat b) { return std::max(a.v, b.v); }
+inline SimdFloat simdGreaterEqual(SimdFloat a, SimdFloat b) { return a.v >= b.v ? 1.0f : 0.0f; }
+inline SimdFloat simdLess(SimdFloat a, SimdFloat b) { return a.v < b.v ? 1.0f : 0.0f; }
+inline SimdFloat simdAnd(SimdFloat a, SimdFloat b) { return (a.v != 0.0f && b.v != 0.0f) ? 1.0f : 0.0f; }
+inline SimdFloat simdSelect(SimdFloat mask, SimdFloat a, SimdFloat b) { return mask.v != 0.0f ? a : b; }
+inline int simdMask(SimdFloat mask) { return mask.v != 0.0f ? 1 : 0; }
+
+#endif
+
+#endif
@@ -0,0 +1,452 @@
+#pragma once
+//
+//  software_rasterizer.h
+//  3D Object Drawing
+//
+//  CPU backend for the flat-colored draw lists the render loop builds, for machines without
+//  a GPU: DrawItems go in with the view and projection, an RGBA image comes out laid out as
+//  glReadPixels returns it. Draws are transformed, clipped and binned into tiles by one job
+//  per chunk of the list, then every tile is rasterized by its own job with SIMD edge
+//  functions and a depth test (GL_LESS), taking the chunks in order so ties resolve in
+//  submission order as they do in GL. Vertices are snapped to 1/256 pixel and shared edges
+//  follow a top-left rule, so adjacent triangles neither overlap nor leave cracks.
+//
+
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <glm/glm.hpp>
+
+#include "frame_arena.h"
+#include "job_system.h"
+#include "render_queue.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+struct SoftwareRasterStats
+{
+    unsigned int draws = 0;
+    unsigned int triangles = 0;            // submitted
+    unsigned int rasterTriangles = 0;      // after clipping, degenerate ones dropped
+    unsigned int binnedTriangles = 0;      // triangle and tile pairs
+    unsigned long long pixelsWritten = 0;  // passed the depth test
+    double geometryMs = 0.0;               // transform, clip, set up and bin
+    double rasterMs = 0.0;
+};
+
+// vertex positions 'stride' floats apart and the indices into them, for items drawn from 'vao'
+struct SoftwareMesh
+{
+    const float* vertices = nullptr;
+    unsigned int stride = 3;
+    size_t vertexCount = 0;
+    const void* indices = nullptr;
+    size_t indexBytes = 0;
+};
+
+class SoftwareRasterizer
+{
+public:
+    static const int TILE_SIZE = 64;       // a multiple of every SimdFloat::WIDTH
+    static const int SUBPIXEL_STEPS = 256; // vertex snapping, as GL implementations do
+
+    SoftwareRasterStats stats;
+    bool frontToBack = true;               // as RenderQueueOptions: fewer pixels shaded and then overwritten
+    glm::vec4 clearColor = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+
+    SoftwareRasterizer(int width, int height)
+        : width(width), height(height),
+          tilesX((width + TILE_SIZE - 1) / TILE_SIZE), tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+          stride(tilesX * TILE_SIZE),
+          color(static_cast<size_t>(stride) * tilesY * TILE_SIZE), depth(color.size()), tilePixels(tilesX * tilesY)
+    {
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // Items of 'vao' are drawn from 'mesh', which must outlive the rasterizer. Items of any
+    // other VAO are taken to be the 36-index 0..0.5 cube that every room is built from.
+    void setMesh(GLuint vao, const SoftwareMesh& mesh)
+    {
+        for (MeshBinding& binding : meshes)
+            if (binding.vao == vao)
+            {
+                binding.mesh = mesh;
+                return;
+            }
+        meshes.push_back({ vao, mesh });
+    }
+
+    // draws 'items' as RenderQueue::execute does with the flat-color shader, after clearing;
+    // 'time' turns the animated ones as the vertex shader would
+    void render(const FrameVector<DrawItem>& items, const glm::mat4& view, const glm::mat4& projection, float time,
+                const glm::vec3& eye, JobSystem& jobs, FrameArena& arena)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        stats = SoftwareRasterStats();
+        stats.draws = static_cast<unsigned int>(items.size());
+
+        uint32_t* order = sortOrder(items, eye, arena);
+        glm::mat4 viewProjection = projection * view;
+        size_t count = items.size();
+        unsigned int chunkCount = static_cast<unsigned int>(std::min<size_t>(jobs.threadCount() * 4, std::max<size_t>(count, 1)));
+        if (chunks.size() < chunkCount)
+            chunks.resize(chunkCount);
+        size_t perChunk = (count + chunkCount - 1) / chunkCount;
+        auto geometry = [&](unsigned int c, unsigned int) {
+            Chunk& chunk = chunks[c];
+            chunk.begin(tilesX * tilesY);
+            size_t end = std::min(count, (c + 1) * perChunk);
+            for (size_t i = c * perChunk; i < end; i++)
+                addItem(chunk, items[order[i]], viewProjection, time);
+        };
+        jobs.parallelFor(chunkCount, geometry);
+        for (unsigned int c = 0; c < chunkCount; c++)
+        {
+            stats.triangles += chunks[c].submitted;
+            stats.rasterTriangles += static_cast<unsigned int>(chunks[c].triangles.size());
+            stats.binnedTriangles += chunks[c].binned;
+        }
+        Clock::time_point binned = Clock::now();
+
+        uint32_t clear = packColor(clearColor);
+        auto tileJob = [&](unsigned int tile, unsigned int) { rasterizeTile(tile, chunkCount, clear); };
+        jobs.parallelFor(tilesX * tilesY, tileJob);
+        for (unsigned long long pixels : tilePixels)
+            stats.pixelsWritten += pixels;
+
+        stats.geometryMs = std::chrono::duration<double, std::milli>(binned - start).count();
+        stats.rasterMs = std::chrono::duration<double, std::milli>(Clock::now() - binned).count();
+    }
+
+    // width * height RGBA pixels, bottom row first, as glReadPixels returns them
+    void readPixels(uint8_t* rgba) const
+    {
+        for (int y = 0; y < height; y++)
+            std::memcpy(rgba + static_cast<size_t>(y) * width * 4, &color[static_cast<size_t>(y) * stride], width * 4);
+    }
+
+private:
+    // edge functions E = a x + b y + c are positive inside; a pixel center exactly on an edge is
+    // inside when the edge is 'inclusive', which holds for exactly one of two triangles sharing it
+    struct RasterTriangle
+    {
+        float a[3], b[3], c[3];
+        float dzdx, dzdy, zc;              // depth plane in window space
+        int minX, minY, maxX, maxY;        // pixel bounds, max exclusive
+        uint32_t color;
+        unsigned char inclusive;           // bit per edge
+    };
+
+    // the triangles of a contiguous range of the sorted list, and the tiles each one touches
+    struct Chunk
+    {
+        std::vector<RasterTriangle> triangles;
+        std::vector<std::vector<uint32_t> > bins;
+        unsigned int submitted = 0;
+        unsigned int binned = 0;
+
+        void begin(int tileCount)
+        {
+            triangles.clear();
+            if (bins.size() != static_cast<size_t>(tileCount))
+                bins.assign(tileCount, std::vector<uint32_t>());
+            for (std::vector<uint32_t>& bin : bins)
+                bin.clear();
+            submitted = 0;
+            binned = 0;
+        }
+    };
+
+    struct MeshBinding
+    {
+        GLuint vao;
+        SoftwareMesh mesh;
+    };
+
+    int width, height;
+    int tilesX, tilesY;
+    int stride;                             // pixels per row, whole tiles so SIMD steps never leave a row
+    std::vector<uint32_t> color;
+    std::vector<float> depth;
+    std::vector<unsigned long long> tilePixels;
+    std::vector<Chunk> chunks;
+    std::vector<MeshBinding> meshes;
+
+    static uint32_t packColor(const glm::vec4& c)
+    {
+        uint32_t packed = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            float channel = std::min(std::max(c[i], 0.0f), 1.0f);
+            packed |= static_cast<uint32_t>(channel * 255.0f + 0.5f) << (8 * i);   // bytes R, G, B, A in memory
+        }
+        return packed;
+    }
+
+    static int clampToInt(float v, int lo, int hi)
+    {
+        return v <= (float)lo ? lo : (v >= (float)hi ? hi : (int)v);
+    }
+
+    // same order as RenderQueue
+    uint32_t* sortOrder(const FrameVector<DrawItem>& items, const glm::vec3& eye, FrameArena& arena) const
+    {
+        size_t count = items.size();
+        uint32_t* order = arena.allocateArray<uint32_t>(count);
+        for (size_t i = 0; i < count; i++)
+            order[i] = static_cast<uint32_t>(i);
+        if (!frontToBack)
+            return order;
+        float* key = arena.allocateArray<float>(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 d = items[i].bounds.center() - eye;
+            key[i] = glm::dot(d, d);
+        }
+        std::stable_sort(order, order + count, [key](uint32_t a, uint32_t b) { return key[a] < key[b]; });
+        return order;
+    }
+
+    const SoftwareMesh* findMesh(GLuint vao) const
+    {
+        for (const MeshBinding& binding : meshes)
+            if (binding.vao == vao)
+                return &binding.mesh;
+        return nullptr;
+    }
+
+    void addItem(Chunk& chunk, const DrawItem& item, const glm::mat4& viewProjection, float time)
+    {
+        glm::mat4 mvp = viewProjection * ((item.flags & DRAW_BAKED) ? glm::mat4(1.0f) : modelAt(item, time));
+        uint32_t rgba = packColor(item.color);
+        const SoftwareMesh* mesh = findMesh(item.vao);
+        if (!mesh)
+        {
+            // the corners and triangles of the room's cube (cube_indices in main.cpp)
+            static const unsigned char corners[8][3] = {
+                { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+                { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 }
+            };
+            static const unsigned char faces[12][3] = {
+                { 0, 3, 2 }, { 2, 1, 0 }, { 1, 2, 6 }, { 6, 5, 1 },
+                { 4, 5, 6 }, { 6, 7, 4 }, { 4, 7, 3 }, { 3, 0, 4 },
+                { 6, 2, 3 }, { 3, 7, 6 }, { 0, 1, 5 }, { 5, 4, 0 }
+            };
+            glm::vec4 clip[8];
+            for (int i = 0; i < 8; i++)
+                clip[i] = mvp * glm::vec4(corners[i][0] * 0.5f, corners[i][1] * 0.5f, corners[i][2] * 0.5f, 1.0f);
+            for (int f = 0; f < 12; f++)
+                addClipTriangle(chunk, clip[faces[f][0]], clip[faces[f][1]], clip[faces[f][2]], rgba);
+            chunk.submitted += 12;
+            return;
+        }
+        size_t indexSize = item.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+        size_t first = item.indexOffset / indexSize;
+        size_t available = mesh->indexBytes / indexSize;
+        size_t last = std::min(first + static_cast<size_t>(item.indexCount), available);
+        glm::vec4 clip[3];
+        for (size_t i = first; i + 3 <= last; i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                size_t index = indexSize == 2 ? static_cast<const uint16_t*>(mesh->indices)[i + k]
+                                              : static_cast<const uint32_t*>(mesh->indices)[i + k];
+                if (index >= mesh->vertexCount)
+                    index = 0;
+                const float* p = mesh->vertices + index * mesh->stride;
+                clip[k] = mvp * glm::vec4(p[0], p[1], p[2], 1.0f);
+            }
+            addClipTriangle(chunk, clip[0], clip[1], clip[2], rgba);
+            chunk.submitted++;
+        }
+    }
+
+    // clips against the view volume (near and far included, as GL does) and sets up the result
+    void addClipTriangle(Chunk& chunk, const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, uint32_t rgba)
+    {
+        // distance to each plane of -w <= x, y, z <= w
+        auto outside = [](const glm::vec4& p) {
+            return (p.x < -p.w) | (p.x > p.w) << 1 | (p.y < -p.w) << 2 | (p.y > p.w) << 3 | (p.z < -p.w) << 4 | (p.z > p.w) << 5;
+        };
+        int codeA = outside(a), codeB = outside(b), codeC = outside(c);
+        if (codeA & codeB & codeC)
+            return;
+        glm::vec4 polygon[9] = { a, b, c };
+        int n = 3;
+        int planes = codeA | codeB | codeC;
+        for (int plane = 0; plane < 6 && n >= 3; plane++)
+        {
+            if (!(planes & (1 << plane)))
+                continue;
+            glm::vec4 clipped[9];
+            int m = 0;
+            for (int i = 0; i < n; i++)
+            {
+                const glm::vec4& p = polygon[i];
+                const glm::vec4& q = polygon[(i + 1) % n];
+                float dp = planeDistance(p, plane), dq = planeDistance(q, plane);
+                if (dp >= 0.0f)
+                    clipped[m++] = p;
+                if ((dp >= 0.0f) != (dq >= 0.0f))
+                    clipped[m++] = p + (q - p) * (dp / (dp - dq));
+            }
+            std::copy(clipped, clipped + m, polygon);
+            n = m;
+        }
+        if (n < 3)
+            return;
+        float sx[9], sy[9], sz[9];
+        for (int i = 0; i < n; i++)
+        {
+            float invW = 1.0f / polygon[i].w;
+            sx[i] = snap((polygon[i].x * invW * 0.5f + 0.5f) * width);
+            sy[i] = snap((polygon[i].y * invW * 0.5f + 0.5f) * height);
+            sz[i] = std::min(std::max(polygon[i].z * invW * 0.5f + 0.5f, 0.0f), 1.0f);
+        }
+        for (int k = 1; k + 1 < n; k++)
+            setupTriangle(chunk, sx[0], sy[0], sz[0], sx[k], sy[k], sz[k], sx[k + 1], sy[k + 1], sz[k + 1], rgba);
+    }
+
+    static float planeDistance(const glm::vec4& p, int plane)
+    {
+        float axis = plane < 2 ? p.x : (plane < 4 ? p.y : p.z);
+        return (plane & 1) ? p.w - axis : p.w + axis;
+    }
+
+    static float snap(float v)
+    {
+        return std::floor(v * SUBPIXEL_STEPS + 0.5f) / SUBPIXEL_STEPS;
+    }
+
+    void setupTriangle(Chunk& chunk, float x0, float y0, float z0, float x1, float y1, float z1, float x2, float y2,
+                       float z2, uint32_t rgba)
+    {
+        float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+        if (area == 0.0f)
+            return;
+        if (area < 0.0f)
+        {
+            std::swap(x1, x2); std::swap(y1, y2); std::swap(z1, z2);
+            area = -area;
+        }
+        RasterTriangle t;
+        const float xs[3] = { x0, x1, x2 }, ys[3] = { y0, y1, y2 };
+        t.inclusive = 0;
+        for (int e = 0; e < 3; e++)
+        {
+            int f = (e + 1) % 3;
+            t.a[e] = ys[e] - ys[f];
+            t.b[e] = xs[f] - xs[e];
+            t.c[e] = -(t.a[e] * xs[e] + t.b[e] * ys[e]);
+            if (t.a[e] > 0.0f || (t.a[e] == 0.0f && t.b[e] > 0.0f))
+                t.inclusive |= 1 << e;
+        }
+        t.dzdx = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) / area;
+        t.dzdy = ((z2 - z0) * (x1 - x0) - (z1 - z0) * (x2 - x0)) / area;
+        t.zc = z0 - t.dzdx * x0 - t.dzdy * y0;
+        // pixels whose centers can be inside
+        t.minX = clampToInt(std::ceil(std::min(x0, std::min(x1, x2)) - 0.5f), 0, width);
+        t.maxX = clampToInt(std::floor(std::max(x0, std::max(x1, x2)) - 0.5f) + 1.0f, 0, width);
+        t.minY = clampToInt(std::ceil(std::min(y0, std::min(y1, y2)) - 0.5f), 0, height);
+        t.maxY = clampToInt(std::floor(std::max(y0, std::max(y1, y2)) - 0.5f) + 1.0f, 0, height);
+        if (t.minX >= t.maxX || t.minY >= t.maxY)
+            return;
+        t.color = rgba;
+
+        uint32_t index = static_cast<uint32_t>(chunk.triangles.size());
+        chunk.triangles.push_back(t);
+        for (int ty = t.minY / TILE_SIZE; ty <= (t.maxY - 1) / TILE_SIZE; ty++)
+            for (int tx = t.minX / TILE_SIZE; tx <= (t.maxX - 1) / TILE_SIZE; tx++)
+            {
+                chunk.bins[ty * tilesX + tx].push_back(index);
+                chunk.binned++;
+            }
+    }
+
+    void rasterizeTile(unsigned int tile, unsigned int chunkCount, uint32_t clear)
+    {
+        int tx0 = (tile % tilesX) * TILE_SIZE, ty0 = (tile / tilesX) * TILE_SIZE;
+        int tx1 = tx0 + TILE_SIZE, ty1 = ty0 + TILE_SIZE;
+        for (int y = ty0; y < ty1; y++)
+        {
+            std::fill(color.begin() + y * stride + tx0, color.begin() + y * stride + tx1, clear);
+            std::fill(depth.begin() + y * stride + tx0, depth.begin() + y * stride + tx1, 1.0f);
+        }
+        unsigned long long written = 0;
+        for (unsigned int c = 0; c < chunkCount; c++)
+        {
+            const Chunk& chunk = chunks[c];
+            for (uint32_t index : chunk.bins[tile])
+                written += rasterizeTriangle(chunk.triangles[index], tx0, ty0, tx1, ty1);
+        }
+        tilePixels[tile] = written;
+    }
+
+    static SimdFloat edgeInside(SimdFloat e, bool inclusive)
+    {
+        const SimdFloat zero = SimdFloat::set1(0.0f);
+        return inclusive ? simdGreaterEqual(e, zero) : simdLess(zero, e);
+    }
+
+    // SimdFloat::WIDTH pixels per step within the tile; returns the pixels written
+    unsigned int rasterizeTriangle(const RasterTriangle& t, int tx0, int ty0, int tx1, int ty1)
+    {
+        int minX = std::max(t.minX, tx0), maxX = std::min(t.maxX, tx1);
+        int minY = std::max(t.minY, ty0), maxY = std::min(t.maxY, ty1);
+        if (minX >= maxX || minY >= maxY)
+            return 0;
+        minX -= (minX - tx0) % SimdFloat::WIDTH;
+
+        const bool in0 = (t.inclusive & 1) != 0, in1 = (t.inclusive & 2) != 0, in2 = (t.inclusive & 4) != 0;
+        const SimdFloat zero = SimdFloat::set1(0.0f);
+        const SimdFloat one = SimdFloat::set1(1.0f);
+        const SimdFloat a0 = SimdFloat::set1(t.a[0]), a1 = SimdFloat::set1(t.a[1]), a2 = SimdFloat::set1(t.a[2]);
+        const SimdFloat dzx = SimdFloat::set1(t.dzdx);
+        const SimdFloat ramp = SimdFloat::ramp();
+        unsigned int written = 0;
+
+        for (int y = minY; y < maxY; y++)
+        {
+            float py = y + 0.5f;
+            SimdFloat row0 = SimdFloat::set1(t.b[0] * py + t.c[0]);
+            SimdFloat row1 = SimdFloat::set1(t.b[1] * py + t.c[1]);
+            SimdFloat row2 = SimdFloat::set1(t.b[2] * py + t.c[2]);
+            SimdFloat rowZ = SimdFloat::set1(t.dzdy * py + t.zc);
+            float* depthLine = &depth[static_cast<size_t>(y) * stride];
+            uint32_t* colorLine = &color[static_cast<size_t>(y) * stride];
+            for (int x = minX; x < maxX; x += SimdFloat::WIDTH)
+            {
+                SimdFloat px = SimdFloat::set1(x + 0.5f) + ramp;
+                SimdFloat inside = simdAnd(simdAnd(edgeInside(a0 * px + row0, in0), edgeInside(a1 * px + row1, in1)),
+                                           edgeInside(a2 * px + row2, in2));
+                if (simdMask(inside) == 0)
+                    continue;
+                SimdFloat z = simdMin(simdMax(dzx * px + rowZ, zero), one);
+                SimdFloat old = SimdFloat::load(depthLine + x);
+                SimdFloat pass = simdAnd(inside, simdLess(z, old));
+                int mask = simdMask(pass);
+                if (mask == 0)
+                    continue;
+                simdSelect(pass, z, old).store(depthLine + x);
+                for (int lane = 0; lane < SimdFloat::WIDTH; lane++)
+                    if (mask & (1 << lane))
+                    {
+                        colorLine[x + lane] = t.color;
+                        written++;
+                    }
+            }
+        }
+        return written;
+    }
+};
+
+#endif
@@ -0,0 +1,131 @@
+#pragma once
+//
+//  static_math.h
+//  3D Object Drawing
+//
+//  Just enough matrix and trigonometry to evaluate transformation() at compile time:
+//  tables of StaticPart built from literals cost nothing when the program runs. Matrices
+//  are column major, m[column][row], like glm's.
+//
+
+#ifndef STATIC_MATH_H
+#define STATIC_MATH_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+struct StaticMat4
+{
+    float m[4][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } };
+
+    glm::mat4 toGlm() const
+    {
+        return glm::mat4(glm::vec4(m[0][0], m[0][1], m[0][2], m[0][3]), glm::vec4(m[1][0], m[1][1], m[1][2], m[1][3]),
+                         glm::vec4(m[2][0], m[2][1], m[2][2], m[2][3]), glm::vec4(m[3][0], m[3][1], m[3][2], m[3][3]));
+    }
+};
+
+struct StaticVec3
+{
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+};
+
+// sine and cosine of an angle in degrees. Multiples of 90 are exact, so the
+// axis-aligned furniture gets exact zeros where glm::rotate leaves rounding error.
+struct StaticSinCos
+{
+    float sin = 0.0f, cos = 1.0f;
+};
+
+constexpr StaticSinCos staticSinCos(float degrees)
+{
+    double d = degrees;
+    while (d >= 180.0)
+        d -= 360.0;
+    while (d < -180.0)
+        d += 360.0;
+    StaticSinCos result;
+    if (d == 0.0 || d == 90.0 || d == -90.0 || d == -180.0)
+    {
+        result.sin = d == 90.0 ? 1.0f : d == -90.0 ? -1.0f : 0.0f;
+        result.cos = d == 0.0 ? 1.0f : d == -180.0 ? -1.0f : 0.0f;
+        return result;
+    }
+    // Taylor series in [-pi, pi]; the terms are below double precision by n = 30
+    double x = d * 3.14159265358979323846 / 180.0;
+    double sinTerm = x, cosTerm = 1.0, s = 0.0, c = 0.0;
+    for (int n = 0; n < 15; n++)
+    {
+        s += sinTerm;
+        c += cosTerm;
+        sinTerm *= -x * x / ((2 * n + 2) * (2 * n + 3));
+        cosTerm *= -x * x / ((2 * n + 1) * (2 * n + 2));
+    }
+    result.sin = static_cast<float>(s);
+    result.cos = static_cast<float>(c);
+    return result;
+}
+
+constexpr StaticMat4 staticMultiply(const StaticMat4& a, const StaticMat4& b)
+{
+    StaticMat4 result;
+    for (int column = 0; column < 4; column++)
+        for (int row = 0; row < 4; row++)
+        {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++)
+                sum += a.m[k][row] * b.m[column][k];
+            result.m[column][row] = sum;
+        }
+    return result;
+}
+
+// transformation() of room_scene.h: translate * rotateX * rotateY * rotateZ * scale, angles in degrees
+constexpr StaticMat4 staticTransformation(float transform_x, float transform_y, float transform_z, float rotate_x,
+                                          float rotate_y, float rotate_z, float scale_x, float scale_y, float scale_z)
+{
+    StaticSinCos ax = staticSinCos(rotate_x), ay = staticSinCos(rotate_y), az = staticSinCos(rotate_z);
+    StaticMat4 rx, ry, rz;
+    rx.m[1][1] = ax.cos; rx.m[1][2] = ax.sin; rx.m[2][1] = -ax.sin; rx.m[2][2] = ax.cos;
+    ry.m[0][0] = ay.cos; ry.m[0][2] = -ay.sin; ry.m[2][0] = ay.sin; ry.m[2][2] = ay.cos;
+    rz.m[0][0] = az.cos; rz.m[0][1] = az.sin; rz.m[1][0] = -az.sin; rz.m[1][1] = az.cos;
+    StaticMat4 result = staticMultiply(staticMultiply(rx, ry), rz);
+    const float scale[3] = { scale_x, scale_y, scale_z };
+    for (int column = 0; column < 3; column++)
+        for (int row = 0; row < 3; row++)
+            result.m[column][row] *= scale[column];
+    result.m[3][0] = transform_x;
+    result.m[3][1] = transform_y;
+    result.m[3][2] = transform_z;
+    return result;
+}
+
+// cubeBounds() of bounds.h: the 0..0.5 cube under 'model'
+struct StaticBounds
+{
+    StaticVec3 min, max;
+
+    AABB toAABB() const
+    {
+        return AABB(glm::vec3(min.x, min.y, min.z), glm::vec3(max.x, max.y, max.z));
+    }
+};
+
+constexpr StaticBounds staticCubeBounds(const StaticMat4& model)
+{
+    float low[3] = { model.m[3][0], model.m[3][1], model.m[3][2] };
+    float high[3] = { low[0], low[1], low[2] };
+    for (int column = 0; column < 3; column++)
+        for (int row = 0; row < 3; row++)
+        {
+            float extent = model.m[column][row] * 0.5f;
+            (extent < 0.0f ? low : high)[row] += extent;
+        }
+    StaticBounds bounds;
+    bounds.min = { low[0], low[1], low[2] };
+    bounds.max = { high[0], high[1], high[2] };
+    return bounds;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+//
+//  stress_scene.h
+//  3D Object Drawing
+//
+//  Scaling sweep: the apartment is regrown to 1e2 .. 1e6 objects and each size is
+//  rendered for a few frames through the normal render loop, with and without portal
+//  culling, recording CPU time, draw calls and triangles.
+//
+
+#ifndef STRESS_SCENE_H
+#define STRESS_SCENE_H
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+// one apartment size and culling setting of the sweep
+struct StressRun
+{
+    size_t targetObjects = 0;
+    int columns = 1;
+    int rows = 1;
+    bool portalCulling = true;
+    int warmupFrames = 3;
+    int measuredFrames = 5;
+};
+
+struct StressSample
+{
+    StressRun run;
+    size_t objects = 0;
+    double cpuMs = 0.0;              // averaged over the measured frames
+    double drawCalls = 0.0;
+    double triangles = 0.0;
+};
+
+class StressSweep
+{
+public:
+    // 'perRoom' is what one room contributes including its scattered props
+    void plan(size_t perRoom)
+    {
+        runs.clear();
+        samples.clear();
+        objectsPerRoom = std::max<size_t>(perRoom, 1);
+        for (size_t target = 100; target <= 1000000; target *= 10)
+        {
+            StressRun run;
+            run.targetObjects = target;
+            size_t rooms = std::max<size_t>(1, (target + objectsPerRoom / 2) / objectsPerRoom);
+            run.columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(rooms))));
+            run.rows = static_cast<int>((rooms + run.columns - 1) / run.columns);
+            // big scenes take long per frame, small ones are noisy: aim for about a million objects drawn in total
+            run.measuredFrames = static_cast<int>(std::min<size_t>(60, std::max<size_t>(5, 1000000 / target)));
+            for (int culling = 1; culling >= 0; culling--)
+            {
+                run.portalCulling = culling != 0;
+                runs.push_back(run);
+            }
+        }
+        current = 0;
+        frame = 0;
+    }
+
+    bool done() const { return current >= runs.size(); }
+    const StressRun& run() const { return runs[current]; }
+
+    // Call once per rendered frame. Returns true when the run changed and the scene has to
+    // be rebuilt from run() before the next frame.
+    bool record(double cpuMs, unsigned int drawCalls, unsigned long long triangles, size_t objects)
+    {
+        const StressRun& r = runs[current];
+        if (frame == 0)
+        {
+            StressSample sample;
+            sample.run = r;
+            samples.push_back(sample);
+        }
+        StressSample& sample = samples.back();
+        if (frame >= r.warmupFrames)
+        {
+            sample.objects = objects;
+            sample.cpuMs += cpuMs / r.measuredFrames;
+            sample.drawCalls += static_cast<double>(drawCalls) / r.measuredFrames;
+            sample.triangles += static_cast<double>(triangles) / r.measuredFrames;
+        }
+        if (++frame < r.warmupFrames + r.measuredFrames)
+            return false;
+        frame = 0;
+        current++;
+        return true;
+    }
+
+    void report(std::ostream& out) const
+    {
+        out << "stress sweep (" << objectsPerRoom << " objects per room)" << std::endl;
+        out << std::setw(9) << "objects" << std::setw(8) << "rooms" << std::setw(9) << "portals"
+            << std::setw(12) << "CPU ms" << std::setw(12) << "draws" << std::setw(14) << "triangles" << std::endl;
+        for (const StressSample& s : samples)
+        {
+            out << std::setw(9) << s.objects << std::setw(8) << s.run.columns * s.run.rows
+                << std::setw(9) << (s.run.portalCulling ? "on" : "off")
+                << std::setw(12) << std::fixed << std::setprecision(3) << s.cpuMs
+                << std::setw(12) << std::setprecision(0) << s.drawCalls
+                << std::setw(14) << s.triangles << std::endl;
+            out.unsetf(std::ios::fixed);
+            out << std::setprecision(6);
+        }
+    }
+
+private:
+    std::vector<StressRun> runs;
+    std::vector<StressSample> samples;
+    size_t objectsPerRoom = 1;
+    size_t current = 0;
+    int frame = 0;
+};
+
+#endif
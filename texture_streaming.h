@@ -0,0 +1,730 @@
+#pragma once
+//
+//  texture_streaming.h
+//  3D Object Drawing
+//
+//  Streams material textures without hitches on the render thread. Worker threads
+//  decode images and build their mip chains; the render thread uploads a bounded number
+//  of bytes per frame through a ring of pixel unpack buffers, coarsest mips first, and
+//  refines each texture only as far as its on-screen size needs. Resident mips stay
+//  under a memory budget: the least recently used detail that is not needed is evicted.
+//
+
+#ifndef TEXTURE_STREAMING_H
+#define TEXTURE_STREAMING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "gl_resources.h"
+#include "trace_events.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// RGBA8 mip chain, level 0 first; level l is max(1, width >> l) x max(1, height >> l)
+struct TextureImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<uint8_t>> levels;
+
+    int levelWidth(int level) const { return std::max(1, width >> level); }
+    int levelHeight(int level) const { return std::max(1, height >> level); }
+};
+
+// fills 'rgba' with a size x size image that tiles seamlessly
+typedef void (*TextureGenerator)(int size, std::vector<uint8_t>& rgba);
+
+struct StreamedTextureDesc
+{
+    const char* name;
+    std::string path;             // binary PPM; empty or unreadable: 'generate' is used
+    TextureGenerator generate;
+    int size;                     // of the generated image
+    float repeatsPerUnit;         // texture repeats per world unit
+};
+
+// Reads a binary PPM (P6, maxval 255) as RGBA; false if the file is missing or not one.
+inline bool readPpm(const std::string& path, int& width, int& height, std::vector<uint8_t>& rgba)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    std::string magic;
+    file >> magic;
+    int values[3];
+    for (int i = 0; i < 3 && file; i++)
+    {
+        file >> std::ws;
+        while (file.peek() == '#')
+        {
+            std::string comment;
+            std::getline(file, comment);
+            file >> std::ws;
+        }
+        file >> values[i];
+    }
+    if (!file || magic != "P6" || values[0] <= 0 || values[1] <= 0 || values[2] != 255)
+        return false;
+    file.get();   // the single whitespace before the pixels
+    width = values[0];
+    height = values[1];
+    std::vector<uint8_t> rgb((size_t)width * height * 3);
+    file.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+    if (!file)
+        return false;
+    rgba.resize((size_t)width * height * 4);
+    for (size_t i = 0, n = (size_t)width * height; i < n; i++)
+    {
+        rgba[i * 4 + 0] = rgb[i * 3 + 0];
+        rgba[i * 4 + 1] = rgb[i * 3 + 1];
+        rgba[i * 4 + 2] = rgb[i * 3 + 2];
+        rgba[i * 4 + 3] = 255;
+    }
+    return true;
+}
+
+// box-filters level 0 down to 1x1; odd sizes repeat their last row or column
+inline void buildMipChain(TextureImage& image)
+{
+    for (int level = 1; image.levelWidth(level - 1) > 1 || image.levelHeight(level - 1) > 1; level++)
+    {
+        const std::vector<uint8_t>& source = image.levels[level - 1];
+        int sw = image.levelWidth(level - 1), sh = image.levelHeight(level - 1);
+        int w = image.levelWidth(level), h = image.levelHeight(level);
+        std::vector<uint8_t> mip((size_t)w * h * 4);
+        for (int y = 0; y < h; y++)
+        {
+            int y0 = std::min(y * 2, sh - 1), y1 = std::min(y * 2 + 1, sh - 1);
+            for (int x = 0; x < w; x++)
+            {
+                int x0 = std::min(x * 2, sw - 1), x1 = std::min(x * 2 + 1, sw - 1);
+                for (int c = 0; c < 4; c++)
+                {
+                    int sum = source[((size_t)y0 * sw + x0) * 4 + c] + source[((size_t)y0 * sw + x1) * 4 + c] +
+                              source[((size_t)y1 * sw + x0) * 4 + c] + source[((size_t)y1 * sw + x1) * 4 + c];
+                    mip[((size_t)y * w + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+        image.levels.push_back(std::move(mip));
+    }
+}
+
+// Procedural stand-ins for the material images, used when no file is given. They are
+// close to white so the draw's color still tints them.
+// ---------------------------------------------------------------------------------------------------------
+
+// value noise on a 'period' x 'period' lattice that wraps, so the texture tiles
+inline float latticeValue(int x, int y, int period, unsigned int seed)
+{
+    x = ((x % period) + period) % period;
+    y = ((y % period) + period) % period;
+    unsigned int h = (unsigned int)x * 374761393u + (unsigned int)y * 668265263u + seed * 2246822519u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return ((h ^ (h >> 16)) & 0xFFFF) / 65535.0f;
+}
+
+inline float tileableNoise(float x, float y, int period, unsigned int seed)
+{
+    int ix = (int)std::floor(x), iy = (int)std::floor(y);
+    float fx = x - ix, fy = y - iy;
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fy = fy * fy * (3.0f - 2.0f * fy);
+    float a = latticeValue(ix, iy, period, seed), b = latticeValue(ix + 1, iy, period, seed);
+    float c = latticeValue(ix, iy + 1, period, seed), d = latticeValue(ix + 1, iy + 1, period, seed);
+    return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fy;
+}
+
+// 'octaves' of noise starting at 'period' cells across the image, in 0..1
+inline float tileableFractal(float u, float v, int period, int octaves, unsigned int seed)
+{
+    float sum = 0.0f, amplitude = 0.5f, total = 0.0f;
+    for (int i = 0; i < octaves; i++, period *= 2, amplitude *= 0.5f)
+    {
+        sum += amplitude * tileableNoise(u * period, v * period, period, seed + i);
+        total += amplitude;
+    }
+    return sum / total;
+}
+
+inline void putGray(std::vector<uint8_t>& rgba, size_t pixel, float r, float g, float b)
+{
+    rgba[pixel * 4 + 0] = static_cast<uint8_t>(std::min(std::max(r, 0.0f), 1.0f) * 255.0f + 0.5f);
+    rgba[pixel * 4 + 1] = static_cast<uint8_t>(std::min(std::max(g, 0.0f), 1.0f) * 255.0f + 0.5f);
+    rgba[pixel * 4 + 2] = static_cast<uint8_t>(std::min(std::max(b, 0.0f), 1.0f) * 255.0f + 0.5f);
+    rgba[pixel * 4 + 3] = 255;
+}
+
+// 4 x 4 mottled ceramic tiles with grout lines
+inline void generateFloorTiles(int size, std::vector<uint8_t>& rgba)
+{
+    rgba.resize((size_t)size * size * 4);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            float u = (float)x / size, v = (float)y / size;
+            float tu = u * 4.0f - std::floor(u * 4.0f), tv = v * 4.0f - std::floor(v * 4.0f);
+            float edge = std::min(std::min(tu, 1.0f - tu), std::min(tv, 1.0f - tv));
+            float value;
+            if (edge < 0.025f)
+                value = 0.62f;
+            else
+                value = 0.86f + 0.14f * tileableFractal(u, v, 8, 4, 11) - (edge < 0.05f ? 0.05f : 0.0f);
+            putGray(rgba, (size_t)y * size + x, value, value, value * 0.98f);
+        }
+}
+
+inline void generatePlaster(int size, std::vector<uint8_t>& rgba)
+{
+    rgba.resize((size_t)size * size * 4);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            float u = (float)x / size, v = (float)y / size;
+            float value = 0.84f + 0.12f * tileableFractal(u, v, 16, 5, 23) + 0.04f * tileableNoise(u * 256, v * 256, 256, 29);
+            putGray(rgba, (size_t)y * size + x, value, value, value);
+        }
+}
+
+// planks along u with growth rings bent by noise
+inline void generateWood(int size, std::vector<uint8_t>& rgba)
+{
+    rgba.resize((size_t)size * size * 4);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            float u = (float)x / size, v = (float)y / size;
+            int plank = (int)(v * 4.0f);
+            float ring = v * 48.0f + 3.0f * tileableFractal(u, v, 4, 3, 41 + plank);
+            float grain = 0.5f + 0.5f * std::sin(ring * 6.2831853f);
+            float value = 0.78f + 0.18f * grain + 0.06f * latticeValue(plank, 0, 4, 43);
+            if (v * 4.0f - plank < 0.02f)
+                value *= 0.6f;   // gap between planks
+            putGray(rgba, (size_t)y * size + x, value, value * 0.96f, value * 0.92f);
+        }
+}
+
+// plain weave: threads alternate over and under every 4 pixels
+inline void generateFabric(int size, std::vector<uint8_t>& rgba)
+{
+    rgba.resize((size_t)size * size * 4);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            bool over = ((x / 4) + (y / 4)) & 1;
+            float across = (over ? (y % 4) : (x % 4)) / 3.0f;
+            float value = 0.80f + 0.14f * std::sin(across * 3.1415927f) +
+                          0.06f * tileableFractal((float)x / size, (float)y / size, 32, 2, 59);
+            putGray(rgba, (size_t)y * size + x, value, value, value);
+        }
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+struct TextureStreamingOptions
+{
+    size_t budgetBytes = 12 * 1024 * 1024;         // resident mips of all streamed textures
+    size_t uploadBytesPerFrame = 1024 * 1024;      // pixel data copied to the GPU per frame
+    unsigned int decodeThreads = 2;
+};
+
+struct TextureStreamingStats
+{
+    size_t residentBytes = 0;
+    size_t uploadedBytes = 0;               // last update()
+    double updateMs = 0.0;                  // render thread time of the last update()
+    unsigned int pendingDecodes = 0;
+    unsigned long long decodes = 0;         // finished, since start
+    double decodeMs = 0.0;                  // worker time, summed
+    unsigned long long levelsUploaded = 0;
+    unsigned long long levelsEvicted = 0;
+    unsigned long long uploadStalls = 0;    // frames that skipped uploading because the next PBO was still in use
+};
+
+class TextureStreamer
+{
+public:
+    TextureStreamingOptions options;
+    TextureStreamingStats stats;
+
+    TextureStreamer() {}
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    ~TextureStreamer()
+    {
+        stop();
+    }
+
+    // textures can only be added before start(); returns the index for request()
+    int add(const StreamedTextureDesc& desc)
+    {
+        entries.emplace_back(new Entry());
+        entries.back()->desc = desc;
+        entries.back()->width = desc.size;
+        return static_cast<int>(entries.size()) - 1;
+    }
+
+    void start()
+    {
+        stop();
+        for (std::unique_ptr<Entry>& entry : entries)
+            entry->texture.create(GL_TEXTURE_2D, GPU_TEXTURE, "streamed texture");
+        for (int i = 0; i < RING_SIZE; i++)
+        {
+            ring[i].create(GPU_STAGING_BUFFER, "texture upload PBO");
+            ring[i].data(GL_PIXEL_UNPACK_BUFFER, options.uploadBytesPerFrame, nullptr, GL_STREAM_DRAW);
+            fences[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        quit = false;
+        for (unsigned int i = 0; i < std::max(options.decodeThreads, 1u); i++)
+            workers.emplace_back(&TextureStreamer::decodeLoop, this);
+        running = true;
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+            jobs.clear();
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+        finished.clear();
+        for (int i = 0; i < RING_SIZE; i++)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+            ring[i].reset();
+        }
+        for (std::unique_ptr<Entry>& entry : entries)
+        {
+            entry->texture.reset();
+            entry->decoded.reset();
+            entry->decodeQueued = false;
+            entry->levelCount = entry->residentBase = 0;
+            entry->uploadingLevel = -1;
+            entry->residentBytes = 0;
+        }
+        running = false;
+    }
+
+    // starts a frame: textures not requested until update() count as unused
+    void beginFrame()
+    {
+        frame++;
+        for (std::unique_ptr<Entry>& entry : entries)
+            entry->wanted = INT_MAX;
+    }
+
+    // A surface of 'bounds' uses the texture this frame. 'pixelsPerUnit' is the number of
+    // pixels one world unit covers at distance 1: viewport height / (2 tan(fovY / 2)).
+    void request(int texture, const AABB& bounds, const glm::vec3& eye, float pixelsPerUnit)
+    {
+        Entry& entry = *entries[texture];
+        glm::vec3 closest = glm::clamp(eye, bounds.min, bounds.max);
+        float distance = std::max(glm::length(eye - closest), 0.05f);
+        float texelsPerPixel = entry.width * entry.desc.repeatsPerUnit * distance / pixelsPerUnit;
+        int level = texelsPerPixel > 1.0f ? static_cast<int>(std::floor(std::log2(texelsPerPixel))) : 0;
+        entry.wanted = std::min(entry.wanted, level);
+        entry.lastUsed = frame;
+    }
+
+    // Once per frame after the requests: takes finished decodes, queues new ones, evicts
+    // and uploads. Leaves GL_PIXEL_UNPACK_BUFFER unbound.
+    void update()
+    {
+        auto begin = std::chrono::steady_clock::now();
+        stats.uploadedBytes = 0;
+        collectDecodes();
+        for (std::unique_ptr<Entry>& entry : entries)
+        {
+            Entry& e = *entry;
+            bool needsDetail = e.levelCount == 0 || e.wanted < e.residentBase || e.uploadingLevel >= 0;
+            if (needsDetail && e.wanted != INT_MAX)
+                e.lastNeeded = frame;
+            if (needsDetail && !e.decoded && !e.decodeQueued && e.wanted != INT_MAX)
+                queueDecode(e);
+            else if (e.decoded && e.uploadingLevel < 0 && frame - e.lastNeeded > KEEP_DECODED_FRAMES)
+                e.decoded.reset();   // re-decoded if the camera comes back closer
+        }
+        makeRoom(0);   // the budget may have been lowered
+        upload();
+        stats.residentBytes = 0;
+        for (std::unique_ptr<Entry>& entry : entries)
+            stats.residentBytes += entry->residentBytes;
+        stats.updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // 0 while nothing of the texture is resident; the caller then draws untextured
+    GLuint residentTexture(int texture) const
+    {
+        const Entry& entry = *entries[texture];
+        return entry.residentBase < entry.levelCount ? entry.texture.id() : 0;
+    }
+
+    float repeatsPerUnit(int texture) const
+    {
+        return entries[texture]->desc.repeatsPerUnit;
+    }
+
+    void report(std::ostream& out) const
+    {
+        out << "textures: " << stats.residentBytes / (1024.0 * 1024.0) << " of " << options.budgetBytes / (1024.0 * 1024.0)
+            << " MB resident, " << stats.uploadedBytes / 1024 << " KB uploaded in " << stats.updateMs << " ms, "
+            << stats.pendingDecodes << " decodes pending (" << stats.decodes << " done, "
+            << (stats.decodes ? stats.decodeMs / stats.decodes : 0.0) << " ms each), " << stats.levelsUploaded
+            << " mips uploaded, " << stats.levelsEvicted << " evicted, " << stats.uploadStalls << " stalls; top mip:";
+        for (const std::unique_ptr<Entry>& entry : entries)
+        {
+            out << " " << entry->desc.name << " ";
+            if (entry->residentBase < entry->levelCount)
+                out << entry->levelWidth(entry->residentBase);
+            else
+                out << "-";
+        }
+        out << std::endl;
+    }
+
+private:
+    static const int RING_SIZE = 3;                    // PBOs in flight
+    static const int PINNED_SIZE = 32;                 // mips this small are never evicted
+    static const unsigned long long KEEP_DECODED_FRAMES = 300;
+
+    struct Entry
+    {
+        StreamedTextureDesc desc;
+        GlTexture texture;
+        int width = 0;                 // of level 0; the generator's size until the first decode
+        int height = 0;
+        int levelCount = 0;            // 0 until the first decode
+        int residentBase = 0;          // finest complete level; == levelCount when none
+        int uploadingLevel = -1;       // allocated, rows [0, uploadRow) copied
+        int uploadRow = 0;
+        int wanted = INT_MAX;          // finest level this frame's requests need
+        unsigned long long lastUsed = 0;
+        unsigned long long lastNeeded = 0;
+        size_t residentBytes = 0;
+        bool decodeQueued = false;
+        std::unique_ptr<TextureImage> decoded;
+
+        int levelWidth(int level) const { return std::max(1, width >> level); }
+        int levelHeight(int level) const { return std::max(1, height >> level); }
+        size_t levelBytes(int level) const { return (size_t)levelWidth(level) * levelHeight(level) * 4; }
+    };
+
+    // a run of rows of one level, copied to 'offset' in this frame's PBO
+    struct UploadSlice
+    {
+        Entry* entry;
+        int level;
+        int row;
+        int rows;
+        size_t offset;
+    };
+
+    std::vector<std::unique_ptr<Entry>> entries;
+    unsigned long long frame = 0;
+    bool running = false;
+
+    GlBuffer ring[RING_SIZE];
+    GLsync fences[RING_SIZE] = {};
+    int nextSlot = 0;
+    std::vector<UploadSlice> slices;
+
+    // entry indices travel render thread -> 'jobs' -> worker -> 'finished' -> render thread
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<int> jobs;
+    std::vector<std::pair<int, std::unique_ptr<TextureImage>>> finished;
+    unsigned int inProgress = 0;
+    unsigned long long decodesDone = 0;
+    double decodeMsDone = 0.0;
+    bool quit = false;
+
+    int indexOf(const Entry& entry) const
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+            if (entries[i].get() == &entry)
+                return static_cast<int>(i);
+        return -1;
+    }
+
+    void queueDecode(Entry& entry)
+    {
+        entry.decodeQueued = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(indexOf(entry));
+        }
+        wake.notify_one();
+    }
+
+    void collectDecodes()
+    {
+        std::vector<std::pair<int, std::unique_ptr<TextureImage>>> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.swap(finished);
+            stats.pendingDecodes = static_cast<unsigned int>(jobs.size()) + inProgress;
+            stats.decodes = decodesDone;
+            stats.decodeMs = decodeMsDone;
+        }
+        for (auto& result : done)
+        {
+            Entry& entry = *entries[result.first];
+            entry.decodeQueued = false;
+            std::unique_ptr<TextureImage>& image = result.second;
+            if (entry.levelCount == 0)
+            {
+                entry.width = image->width;
+                entry.height = image->height;
+                entry.levelCount = static_cast<int>(image->levels.size());
+                entry.residentBase = entry.levelCount;
+                entry.texture.bind();
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.levelCount - 1);
+            }
+            else if (image->width != entry.width || image->height != entry.height)
+            {
+                std::cout << "textures: " << entry.desc.name << " changed size on disk, keeping the resident mips" << std::endl;
+                continue;
+            }
+            entry.decoded = std::move(image);
+        }
+    }
+
+    static bool evictable(const Entry& entry)
+    {
+        return entry.uploadingLevel < 0 && entry.residentBase < entry.levelCount - 1 &&
+               std::max(entry.levelWidth(entry.residentBase), entry.levelHeight(entry.residentBase)) > PINNED_SIZE;
+    }
+
+    // Evicts until 'bytes' for a mip of 'level' fit in the budget. Detail finer than this
+    // frame's requests goes first, least recently used texture first; then the finest mip of
+    // any texture that is more detailed than 'level', so textures under pressure end up with
+    // similar detail. False if that is not enough.
+    bool makeRoom(size_t bytes, int level = INT_MAX)
+    {
+        for (;;)
+        {
+            size_t resident = 0;
+            for (std::unique_ptr<Entry>& entry : entries)
+                resident += entry->residentBytes;
+            if (resident + bytes <= options.budgetBytes)
+                return true;
+            Entry* victim = nullptr;
+            for (std::unique_ptr<Entry>& entry : entries)
+                if (evictable(*entry) && entry->residentBase < entry->wanted &&
+                    (!victim || entry->lastUsed < victim->lastUsed))
+                    victim = entry.get();
+            if (!victim)
+                for (std::unique_ptr<Entry>& entry : entries)
+                    if (evictable(*entry) && entry->residentBase < level &&
+                        (!victim || entry->residentBase < victim->residentBase))
+                        victim = entry.get();
+            if (!victim)
+                return false;
+            evictLevel(*victim);
+        }
+    }
+
+    // drops the finest resident mip; sampling moves to the next one first
+    void evictLevel(Entry& entry)
+    {
+        int level = entry.residentBase;
+        entry.texture.bind();
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        entry.residentBase = level + 1;
+        entry.residentBytes -= entry.levelBytes(level);
+        entry.texture.setResidentBytes(entry.residentBytes);
+        stats.levelsEvicted++;
+    }
+
+    // the texture whose next upload is the coarsest, so every texture gets its small mips first
+    Entry* nextUpload(const std::vector<Entry*>& blocked)
+    {
+        Entry* best = nullptr;
+        int bestLevel = -1;
+        for (std::unique_ptr<Entry>& entry : entries)
+        {
+            Entry& e = *entry;
+            if (!e.decoded || std::find(blocked.begin(), blocked.end(), &e) != blocked.end())
+                continue;
+            int level;
+            if (e.uploadingLevel >= 0)
+                level = e.uploadingLevel;
+            else if (e.wanted < e.residentBase)
+                level = e.residentBase - 1;
+            else
+                continue;
+            if (level > bestLevel)
+            {
+                best = &e;
+                bestLevel = level;
+            }
+        }
+        return best;
+    }
+
+    void upload()
+    {
+        int slot = nextSlot;
+        if (fences[slot])
+        {
+            // never wait: when the GPU still reads this PBO, uploads resume next frame
+            if (glClientWaitSync(fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                stats.uploadStalls++;
+                return;
+            }
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+        }
+
+        // plan this frame's rows; new levels are allocated now, while no PBO is bound
+        slices.clear();
+        std::vector<Entry*> blocked;
+        size_t capacity = ring[slot].bytes();
+        size_t used = 0;
+        while (Entry* entry = nextUpload(blocked))
+        {
+            if (entry->uploadingLevel < 0)
+            {
+                int level = entry->residentBase - 1;
+                if (!makeRoom(entry->levelBytes(level), level))
+                {
+                    blocked.push_back(entry);
+                    continue;
+                }
+                entry->texture.bind();
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, entry->levelWidth(level), entry->levelHeight(level), 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                entry->uploadingLevel = level;
+                entry->uploadRow = 0;
+                entry->residentBytes += entry->levelBytes(level);
+                entry->texture.setResidentBytes(entry->residentBytes);
+            }
+            int level = entry->uploadingLevel;
+            size_t rowBytes = (size_t)entry->levelWidth(level) * 4;
+            int rows = std::min(entry->levelHeight(level) - entry->uploadRow, static_cast<int>((capacity - used) / rowBytes));
+            if (rows <= 0)
+                break;
+            slices.push_back({ entry, level, entry->uploadRow, rows, used });
+            used += rows * rowBytes;
+            entry->uploadRow += rows;
+            if (entry->uploadRow == entry->levelHeight(level))
+                blocked.push_back(entry);   // one level per texture and frame; it completes below
+        }
+        if (slices.empty())
+            return;
+
+        ring[slot].bind(GL_PIXEL_UNPACK_BUFFER);
+        uint8_t* mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, used,
+                                                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        if (!mapped)
+        {
+            for (const UploadSlice& slice : slices)
+                slice.entry->uploadRow = std::min(slice.entry->uploadRow, slice.row);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return;
+        }
+        for (const UploadSlice& slice : slices)
+        {
+            size_t rowBytes = (size_t)slice.entry->levelWidth(slice.level) * 4;
+            std::memcpy(mapped + slice.offset, slice.entry->decoded->levels[slice.level].data() + slice.row * rowBytes,
+                        slice.rows * rowBytes);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        for (const UploadSlice& slice : slices)
+        {
+            Entry& entry = *slice.entry;
+            entry.texture.bind();
+            glTexSubImage2D(GL_TEXTURE_2D, slice.level, 0, slice.row, entry.levelWidth(slice.level), slice.rows,
+                            GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(slice.offset));
+            if (slice.row + slice.rows == entry.levelHeight(slice.level))
+            {
+                // the GL orders the copy before any later draw that samples the level
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, slice.level);
+                entry.residentBase = slice.level;
+                entry.uploadingLevel = -1;
+                stats.levelsUploaded++;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        nextSlot = (slot + 1) % RING_SIZE;
+        stats.uploadedBytes = used;
+    }
+
+    void decodeLoop()
+    {
+        tracer().nameThread("texture decode");
+        for (;;)
+        {
+            int index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !jobs.empty(); });
+                if (quit)
+                    return;
+                index = jobs.front();
+                jobs.pop_front();
+                inProgress++;
+            }
+            // 'desc' is not changed after start(), so it can be read without the lock
+            const StreamedTextureDesc& desc = entries[index]->desc;
+            TRACE_ZONE_NAMED(zone, "texture decode");
+            auto begin = std::chrono::steady_clock::now();
+            std::unique_ptr<TextureImage> image(new TextureImage());
+            image->levels.resize(1);
+            if (desc.path.empty() || !readPpm(desc.path, image->width, image->height, image->levels[0]))
+            {
+                image->width = image->height = desc.size;
+                desc.generate(desc.size, image->levels[0]);
+            }
+            buildMipChain(*image);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            TRACE_ZONE_END(zone);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.emplace_back(index, std::move(image));
+            inProgress--;
+            decodesDone++;
+            decodeMsDone += ms;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,251 @@
+#pragma once
+//
+//  trace_events.h
+//  3D Object Drawing
+//
+//  Scoped timing zones written as Chrome trace events, to be opened in Perfetto or
+//  chrome://tracing. TRACE_ZONE("name") times the rest of its scope, TRACE_ZONE_NAMED and
+//  TRACE_ZONE_END a zone that ends early; each thread appends to its own buffer without
+//  locks, and writeChromeTrace() reads every buffer while the threads keep recording.
+//  With tracing switched off a zone costs one relaxed load and a branch; building with
+//  DISABLE_TRACING removes the zones altogether.
+//
+
+#ifndef TRACE_EVENTS_H
+#define TRACE_EVENTS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 'name' must outlive the trace: zones are named by string literals
+struct TraceEvent
+{
+    const char* name;
+    int64_t beginNs;
+    int64_t endNs;
+};
+
+// Events of one thread, in blocks that are allocated as it needs them and never move. Only
+// the owning thread appends; 'count' is published after the event is written, so readers
+// see whole events.
+class TraceBuffer
+{
+public:
+    static const size_t BLOCK_EVENTS = 4096;
+    static const size_t MAX_BLOCKS = 256;     // a million events per thread, then the rest are dropped
+
+    TraceBuffer(uint32_t threadId, const std::string& threadName) : threadId(threadId), threadName(threadName)
+    {
+        for (std::atomic<TraceEvent*>& block : blocks)
+            block.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~TraceBuffer()
+    {
+        for (std::atomic<TraceEvent*>& block : blocks)
+            delete[] block.load(std::memory_order_relaxed);
+    }
+
+    TraceBuffer(const TraceBuffer&) = delete;
+    TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+    void push(const TraceEvent& event)
+    {
+        size_t n = count.load(std::memory_order_relaxed);
+        size_t block = n / BLOCK_EVENTS;
+        if (block >= MAX_BLOCKS)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        TraceEvent* events = blocks[block].load(std::memory_order_relaxed);
+        if (!events)
+        {
+            events = new TraceEvent[BLOCK_EVENTS];
+            blocks[block].store(events, std::memory_order_release);
+        }
+        events[n % BLOCK_EVENTS] = event;
+        count.store(n + 1, std::memory_order_release);
+    }
+
+    // events [0, size()) can be read from any thread
+    size_t size() const { return count.load(std::memory_order_acquire); }
+    const TraceEvent& operator[](size_t i) const
+    {
+        return blocks[i / BLOCK_EVENTS].load(std::memory_order_acquire)[i % BLOCK_EVENTS];
+    }
+    unsigned long long droppedEvents() const { return dropped.load(std::memory_order_relaxed); }
+
+    const uint32_t threadId;
+    std::string threadName;     // guarded by the tracer's lock
+
+private:
+    std::atomic<TraceEvent*> blocks[MAX_BLOCKS];
+    std::atomic<size_t> count{ 0 };
+    std::atomic<unsigned long long> dropped{ 0 };
+};
+
+class Tracer
+{
+public:
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+    void setEnabled(bool enable) { on.store(enable, std::memory_order_relaxed); }
+
+    int64_t nowNs() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // the calling thread's buffer, created the first time it records; the lock is taken once per thread
+    TraceBuffer& threadBuffer()
+    {
+        thread_local TraceBuffer* buffer = nullptr;
+        if (!buffer)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uint32_t id = static_cast<uint32_t>(buffers.size()) + 1;
+            buffers.emplace_back(new TraceBuffer(id, "thread " + std::to_string(id)));
+            buffer = buffers.back().get();
+        }
+        return *buffer;
+    }
+
+    // names the calling thread in the trace, e.g. "texture decode"
+    void nameThread(const std::string& name)
+    {
+        TraceBuffer& buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer.threadName = name;
+    }
+
+    // Writes everything recorded so far as Chrome trace JSON; recording may go on meanwhile.
+    bool writeChromeTrace(const std::string& path, std::ostream& log)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            log << "trace: cannot write " << path << std::endl;
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"3D Object Drawing\"}}";
+        size_t events = 0;
+        unsigned long long dropped = 0;
+        char line[256];
+        for (const std::unique_ptr<TraceBuffer>& buffer : buffers)
+        {
+            file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+                 << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+            size_t count = buffer->size();
+            for (size_t i = 0; i < count; i++)
+            {
+                const TraceEvent& event = (*buffer)[i];
+                std::snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                              event.name, buffer->threadId, event.beginNs / 1000.0, (event.endNs - event.beginNs) / 1000.0);
+                file << line;
+            }
+            events += count;
+            dropped += buffer->droppedEvents();
+        }
+        file << "\n]}\n";
+        log << "trace: " << events << " events from " << buffers.size() << " threads written to " << path;
+        if (dropped)
+            log << " (" << dropped << " dropped, buffers full)";
+        log << std::endl;
+        return static_cast<bool>(file);
+    }
+
+private:
+    std::atomic<bool> on{ false };
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::mutex mutex;     // guards 'buffers' and the thread names, not the events
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+};
+
+inline Tracer& tracer()
+{
+    static Tracer instance;
+    return instance;
+}
+
+// Times its scope, or up to end(). A zone that starts while tracing is off records nothing.
+class TraceZone
+{
+public:
+    explicit TraceZone(const char* name) : name(tracer().enabled() ? name : nullptr)
+    {
+        if (this->name)
+            beginNs = tracer().nowNs();
+    }
+
+    ~TraceZone()
+    {
+        end();
+    }
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+    void end()
+    {
+        if (!name)
+            return;
+        Tracer& t = tracer();
+        t.threadBuffer().push({ name, beginNs, t.nowNs() });
+        name = nullptr;
+    }
+
+private:
+    const char* name;
+    int64_t beginNs = 0;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// TRACE_ZONE_NAMED declares the zone as 'var', for a zone that TRACE_ZONE_END(var) closes
+// before its scope does
+#ifdef DISABLE_TRACING
+#define TRACE_ZONE(name)
+#define TRACE_ZONE_NAMED(var, name)
+#define TRACE_ZONE_END(var)
+#else
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_ZONE_NAMED(var, name) TraceZone var(name)
+#define TRACE_ZONE_END(var) var.end()
+#endif
+
+// Cost of a zone with tracing off and on, so the zones can be left in place.
+inline void runTraceBenchmark(std::ostream& out, unsigned int zones)
+{
+    Tracer& t = tracer();
+    bool wasEnabled = t.enabled();
+    auto time = [&](bool enable, unsigned int count) {
+        t.setEnabled(enable);
+        auto begin = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            TRACE_ZONE("benchmark");
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / count;
+    };
+    time(false, zones);   // warm up
+    double off = time(false, zones);
+    // the buffers hold a million events per thread, more would be dropped
+    unsigned int recorded = std::min<unsigned int>(zones, TraceBuffer::BLOCK_EVENTS * TraceBuffer::MAX_BLOCKS / 2);
+    double on = time(true, recorded);
+    t.setEnabled(wasEnabled);
+    out << "trace zones: " << off << " ns each with tracing off, " << on << " ns with tracing on ("
+        << zones << " and " << recorded << " zones)" << std::endl;
+}
+
+#endif
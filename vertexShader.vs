@@ -3,14 +3,34 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 
 out vec4 color;
+out vec3 worldPos;   // textured materials are projected in world space
+out vec3 localPos;   // 0..1 across the cube: where on its face a lightmapped fragment is
 
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// fan blades and clock hands turn here, so their model matrix never changes (see DrawSpin)
+uniform float time;
+uniform vec4 spinPivot;   // xyz: pivot, w: angular speed in radians per second
+uniform vec4 spinAxis;    // xyz: unit axis, w: phase in radians; all zero for static objects
+
+vec3 spin(vec3 p)
+{
+    float angle = spinAxis.w + spinPivot.w * time;
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 d = p - spinPivot.xyz;
+    // Rodrigues' rotation formula
+    d = d * c + cross(spinAxis.xyz, d) * s + spinAxis.xyz * dot(spinAxis.xyz, d) * (1.0f - c);
+    return spinPivot.xyz + d;
+}
+
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0f);
+    worldPos = spin((model * vec4(aPos, 1.0f)).xyz);
+    localPos = aPos * 2.0f;
+    gl_Position = projection * view * vec4(worldPos, 1.0f);
     color = vec4(aColor, 1.0f);
 }
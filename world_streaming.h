@@ -0,0 +1,727 @@
+#pragma once
+//
+//  world_streaming.h
+//  3D Object Drawing
+//
+//  Keeps only the apartment around the camera resident. The rooms are cooked into
+//  chunk files of CHUNK_ROOMS x CHUNK_ROOMS rooms: their props and their static
+//  geometry baked into world space. I/O threads read and decode chunks ahead of the
+//  camera's direction of travel; the render thread uploads a bounded number of bytes
+//  per frame and never lets the chunks' buffers exceed a GPU memory budget.
+//
+
+#ifndef WORLD_STREAMING_H
+#define WORLD_STREAMING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "asset_pack.h"
+#include "bounds.h"
+#include "frame_arena.h"
+#include "gl_resources.h"
+#include "render_queue.h"
+#include "room_scene.h"
+#include "trace_events.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+const int CHUNK_ROOMS = 2;   // rooms along each side of a chunk
+
+// a room as stored in its chunk file; the baked cubes are 36 indices each, in appendRoom's order
+struct WorldChunkRoom
+{
+    glm::mat4 placement;
+    RoomOpening openings[WALL_COUNT];
+    uint32_t cell;
+    uint32_t propFirst;
+    uint32_t propCount;
+    uint32_t bakedFirstIndex;
+    uint32_t bakedCount;
+};
+
+// items whose geometry never changes with RoomState; the others keep using the shared cube
+inline bool isBakeable(const DrawItem& item)
+{
+    return !(item.flags & (DRAW_ANIMATED | DRAW_STATEFUL | DRAW_PICK_TV | DRAW_PICK_BOOKSHELF | DRAW_MESH));
+}
+
+// the 0..0.5 cube of 'model' as 8 world-space corners and 12 triangles
+inline void bakeCube(const glm::mat4& model, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices)
+{
+    static const uint32_t faces[36] = {
+        0, 2, 3, 0, 3, 1,   4, 5, 7, 4, 7, 6,   0, 4, 6, 0, 6, 2,
+        1, 3, 7, 1, 7, 5,   0, 1, 5, 0, 5, 4,   2, 6, 7, 2, 7, 3
+    };
+    uint32_t base = static_cast<uint32_t>(vertices.size());
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 local((corner & 1) ? 0.5f : 0.0f, (corner & 2) ? 0.5f : 0.0f, (corner & 4) ? 0.5f : 0.0f);
+        vertices.push_back(glm::vec3(model * glm::vec4(local, 1.0f)));
+    }
+    for (uint32_t index : faces)
+        indices.push_back(base + index);
+}
+
+struct WorldStreamingOptions
+{
+    float loadRadius = 14.0f;                    // chunks this close to the camera or its predicted position load
+    float unloadRadius = 22.0f;                  // and unload beyond this distance from the camera
+    float lookaheadSeconds = 1.5f;               // how far along the direction of travel to predict
+    size_t gpuBudgetBytes = 8 * 1024 * 1024;     // hard limit for the chunks' vertex and index buffers
+    size_t uploadBytesPerFrame = 256 * 1024;
+    unsigned int ioThreads = 2;
+    unsigned int readsInFlight = 4;
+};
+
+struct WorldStreamingStats
+{
+    unsigned int chunks = 0;
+    unsigned int residentChunks = 0;
+    unsigned int loadingChunks = 0;              // reading, decoded or uploading
+    size_t gpuBytes = 0;                         // allocated for resident and uploading chunks
+    size_t cpuBytes = 0;                         // decoded data waiting for upload
+    size_t uploadedBytes = 0;                    // last update()
+    unsigned long long loads = 0;
+    unsigned long long unloads = 0;
+    unsigned long long evictions = 0;            // resident chunks dropped to stay in the budget
+    unsigned long long budgetWaits = 0;          // frames an upload could not start for lack of budget
+    double loadLatencyMs = 0.0;                  // request to resident, summed over 'loads'
+    double worstLoadLatencyMs = 0.0;
+    double decodeMs = 0.0;                       // I/O thread time, summed
+    // chunk boundaries the camera crossed, and how those frames went
+    unsigned long long crossings = 0;
+    unsigned long long hitches = 0;              // crossing frames over twice the average frame time
+    unsigned long long misses = 0;               // crossed into a chunk that was not resident yet
+    double worstCrossingMs = 0.0;
+    double averageFrameMs = 0.0;
+};
+
+class WorldStreamer
+{
+public:
+    WorldStreamingOptions options;
+    WorldStreamingStats stats;
+
+    WorldStreamer() {}
+    WorldStreamer(const WorldStreamer&) = delete;
+    WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+    // the apartment may be gone by now, so its props are not put back
+    ~WorldStreamer()
+    {
+        if (!running)
+            return;
+        joinWorkers();
+        dropChunks();
+    }
+
+    bool active() const
+    {
+        return running;
+    }
+
+    // Cooks 'apartment' into 'directory' unless the chunk files there already hold this
+    // 'signature', then starts the I/O threads. The rooms' props move into the chunk files:
+    // apartment.rooms[cell].props is filled while the cell's chunk is resident.
+    bool start(const std::string& directory, Apartment& apartment, int columns, int rows, const std::string& signature)
+    {
+        stop(apartment);
+        this->columns = columns;
+        this->rows = rows;
+        chunkColumns = (columns + CHUNK_ROOMS - 1) / CHUNK_ROOMS;
+        chunkRows = (rows + CHUNK_ROOMS - 1) / CHUNK_ROOMS;
+        std::string indexPath = directory + "/world.txt";
+        if (readSignature(indexPath) != signature)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            if (!cook(directory, apartment) || !writeSignature(indexPath, signature))
+            {
+                std::cout << "world: cannot write chunk files to " << directory << std::endl;
+                return false;
+            }
+            std::cout << "world: cooked " << chunkColumns * chunkRows << " chunks into " << directory << " in "
+                << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() << " ms" << std::endl;
+        }
+
+        chunks.clear();
+        for (int cz = 0; cz < chunkRows; cz++)
+            for (int cx = 0; cx < chunkColumns; cx++)
+            {
+                chunks.emplace_back(new Chunk());
+                Chunk& chunk = *chunks.back();
+                chunk.path = chunkPath(directory, cx, cz);
+                for (int cell : chunkCells(cx, cz))
+                {
+                    chunk.cells.push_back(cell);
+                    chunk.bounds.expand(apartment.cells.cellBounds(cell).min);
+                    chunk.bounds.expand(apartment.cells.cellBounds(cell).max);
+                }
+            }
+        for (RoomInstance& room : apartment.rooms)
+            std::vector<RoomProp>().swap(room.props);
+        cellBaked.assign(columns * rows, BakedRoom());
+
+        stats = WorldStreamingStats();
+        stats.chunks = static_cast<unsigned int>(chunks.size());
+        quit = false;
+        for (unsigned int i = 0; i < std::max(options.ioThreads, 1u); i++)
+            workers.emplace_back(&WorldStreamer::readLoop, this);
+        running = true;
+        return true;
+    }
+
+    // Joins the I/O threads and drops every chunk. 'apartment', the one given to start(), gets
+    // all its props back from the chunk files, so it can be drawn whole or streamed again.
+    void stop(Apartment& apartment)
+    {
+        if (!running)
+            return;
+        joinWorkers();
+        for (const std::unique_ptr<Chunk>& chunk : chunks)
+        {
+            std::unique_ptr<ChunkData> data = read(chunk->path, cellBaked.size());
+            if (!data)
+            {
+                std::cout << "world: cannot read the props back from " << chunk->path << std::endl;
+                continue;
+            }
+            for (const WorldChunkRoom& room : data->rooms)
+                apartment.rooms[room.cell].props.assign(data->props.begin() + room.propFirst,
+                                                        data->props.begin() + room.propFirst + room.propCount);
+        }
+        dropChunks();
+    }
+
+    // true while the cell's chunk is resident; the other cells have nothing to draw
+    bool cellResident(int cell) const
+    {
+        return cellBaked[cell].chunk && cellBaked[cell].chunk->state == CHUNK_RESIDENT;
+    }
+
+    // Moves the cell's static items, appended from 'first' on by appendRoom in the cooked
+    // order, onto the chunk's baked buffers. Items are left on the shared cube if the
+    // room no longer matches what was cooked.
+    void bindBaked(int cell, FrameVector<DrawItem>& items, size_t first) const
+    {
+        const BakedRoom& baked = cellBaked[cell];
+        if (!cellResident(cell))
+            return;
+        uint32_t count = 0;
+        for (size_t i = first; i < items.size(); i++)
+            count += isBakeable(items[i]);
+        if (count != baked.count)
+            return;
+        size_t offset = (size_t)baked.firstIndex * sizeof(uint32_t);
+        for (size_t i = first; i < items.size(); i++)
+        {
+            DrawItem& item = items[i];
+            if (!isBakeable(item))
+                continue;
+            item.vao = baked.chunk->vao.id();
+            item.indexOffset = offset;
+            item.flags |= DRAW_BAKED;
+            offset += 36 * sizeof(uint32_t);
+        }
+    }
+
+    // Once per frame before the scene is built: decides what should be resident around
+    // 'position', takes finished reads, unloads, and uploads within this frame's share.
+    void update(Apartment& apartment, const glm::vec3& position, float deltaTime)
+    {
+        stats.uploadedBytes = 0;
+        trackMotion(position, deltaTime);
+        glm::vec3 predicted = position + velocity * options.lookaheadSeconds;
+
+        for (std::unique_ptr<Chunk>& chunk : chunks)
+        {
+            Chunk& c = *chunk;
+            float near = distanceTo(c.bounds, position);
+            c.priority = std::min(near, distanceTo(c.bounds, predicted));
+            c.wanted = c.priority <= options.loadRadius;
+            c.keep = c.wanted || near <= options.unloadRadius;
+        }
+
+        collectReads();
+        for (std::unique_ptr<Chunk>& chunk : chunks)
+            if (!chunk->keep && chunk->state != CHUNK_ON_DISK && chunk->state != CHUNK_READING)
+                unload(*chunk, apartment);
+        queueReads();
+        upload(apartment);
+
+        stats.residentChunks = stats.loadingChunks = 0;
+        stats.gpuBytes = stats.cpuBytes = 0;
+        for (std::unique_ptr<Chunk>& chunk : chunks)
+        {
+            stats.residentChunks += chunk->state == CHUNK_RESIDENT;
+            stats.loadingChunks += chunk->state != CHUNK_RESIDENT && chunk->state != CHUNK_ON_DISK;
+            stats.gpuBytes += chunk->gpuBytes;
+            if (chunk->data)
+                stats.cpuBytes += chunk->data->bytes();
+        }
+    }
+
+    void report(std::ostream& out) const
+    {
+        out << "world: " << stats.residentChunks << " of " << stats.chunks << " chunks resident, " << stats.loadingChunks
+            << " loading, " << stats.gpuBytes / 1024 << " of " << options.gpuBudgetBytes / 1024 << " KB GPU, "
+            << stats.cpuBytes / 1024 << " KB decoded; load latency "
+            << (stats.loads ? stats.loadLatencyMs / stats.loads : 0.0) << " ms (worst " << stats.worstLoadLatencyMs
+            << ", decode " << (stats.loads ? stats.decodeMs / stats.loads : 0.0) << "), " << stats.evictions << " evicted, "
+            << stats.budgetWaits << " budget waits; " << stats.crossings << " chunk crossings, " << stats.hitches
+            << " hitches (worst " << stats.worstCrossingMs << " ms vs " << stats.averageFrameMs << " ms average), "
+            << stats.misses << " into unloaded chunks" << std::endl;
+    }
+
+private:
+    enum ChunkState {
+        CHUNK_ON_DISK,
+        CHUNK_READING,     // queued for or on an I/O thread
+        CHUNK_DECODED,     // in memory, waiting for upload budget
+        CHUNK_UPLOADING,   // buffers allocated, filled over several frames
+        CHUNK_RESIDENT
+    };
+
+    // what an I/O thread makes of a chunk file
+    struct ChunkData
+    {
+        std::vector<WorldChunkRoom> rooms;
+        std::vector<RoomProp> props;
+        std::vector<glm::vec3> vertices;
+        std::vector<uint32_t> indices;
+        double decodeMs = 0.0;
+
+        size_t vertexBytes() const { return vertices.size() * sizeof(glm::vec3); }
+        size_t indexBytes() const { return indices.size() * sizeof(uint32_t); }
+        size_t bytes() const { return vertexBytes() + indexBytes() + props.size() * sizeof(RoomProp); }
+    };
+
+    struct Chunk
+    {
+        std::string path;
+        AABB bounds;
+        std::vector<int> cells;
+        ChunkState state = CHUNK_ON_DISK;
+        float priority = 0.0f;                 // distance to the camera or its predicted position
+        bool wanted = false;
+        bool keep = false;
+        std::chrono::steady_clock::time_point requested;
+        std::unique_ptr<ChunkData> data;
+        GlBuffer vertexBuffer;
+        GlBuffer indexBuffer;
+        GlVertexArray vao;
+        size_t uploaded = 0;                   // bytes of vertices, then indices, copied so far
+        size_t gpuBytes = 0;
+    };
+
+    struct BakedRoom
+    {
+        const Chunk* chunk = nullptr;
+        uint32_t firstIndex = 0;
+        uint32_t count = 0;
+    };
+
+    int columns = 0, rows = 0;
+    int chunkColumns = 0, chunkRows = 0;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::vector<BakedRoom> cellBaked;
+    bool running = false;
+
+    glm::vec3 lastPosition = glm::vec3(0.0f);
+    glm::vec3 velocity = glm::vec3(0.0f);
+    int lastChunk = -1;
+    bool moving = false;
+
+    // chunk indices travel render thread -> 'jobs' -> I/O thread -> 'finished' -> render thread
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<int> jobs;
+    std::vector<std::pair<int, std::unique_ptr<ChunkData>>> finished;
+    bool quit = false;
+
+    static std::string chunkPath(const std::string& directory, int cx, int cz)
+    {
+        return directory + "/chunk_" + std::to_string(cx) + "_" + std::to_string(cz) + ".pak";
+    }
+
+    std::vector<int> chunkCells(int cx, int cz) const
+    {
+        std::vector<int> cells;
+        for (int row = cz * CHUNK_ROOMS; row < std::min(rows, (cz + 1) * CHUNK_ROOMS); row++)
+            for (int column = cx * CHUNK_ROOMS; column < std::min(columns, (cx + 1) * CHUNK_ROOMS); column++)
+                cells.push_back(row * columns + column);
+        return cells;
+    }
+
+    static std::string readSignature(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    static bool writeSignature(const std::string& path, const std::string& signature)
+    {
+        std::ofstream file(path);
+        file << signature << "\n";
+        return static_cast<bool>(file);
+    }
+
+    // one pack per chunk: its rooms, their props and their static cubes in world space
+    bool cook(const std::string& directory, const Apartment& apartment)
+    {
+        FrameArena arena(1 << 20);
+        for (int cz = 0; cz < chunkRows; cz++)
+            for (int cx = 0; cx < chunkColumns; cx++)
+            {
+                std::vector<WorldChunkRoom> rooms;
+                std::vector<RoomProp> props;
+                std::vector<glm::vec3> vertices;
+                std::vector<uint32_t> indices;
+                for (int cell : chunkCells(cx, cz))
+                {
+                    const RoomInstance& instance = apartment.rooms[cell];
+                    WorldChunkRoom room = {};
+                    room.placement = instance.placement;
+                    std::copy(instance.openings, instance.openings + WALL_COUNT, room.openings);
+                    room.cell = static_cast<uint32_t>(cell);
+                    room.propFirst = static_cast<uint32_t>(props.size());
+                    room.propCount = static_cast<uint32_t>(instance.props.size());
+                    room.bakedFirstIndex = static_cast<uint32_t>(indices.size());
+                    props.insert(props.end(), instance.props.begin(), instance.props.end());
+
+                    arena.reset();
+                    FrameVector<DrawItem> items{ FrameAllocator<DrawItem>(arena) };
+                    appendRoom(items, 0, instance.placement, instance.openings, RoomState());
+                    appendRoomProps(items, 0, instance);
+                    for (const DrawItem& item : items)
+                        if (isBakeable(item))
+                        {
+                            bakeCube(item.model, vertices, indices);
+                            room.bakedCount++;
+                        }
+                    rooms.push_back(room);
+                }
+                AssetPackWriter writer;
+                writer.add("rooms", ASSET_ROOMS, rooms.data(), rooms.size() * sizeof(WorldChunkRoom), sizeof(WorldChunkRoom));
+                writer.add("props", ASSET_PROPS, props.data(), props.size() * sizeof(RoomProp), sizeof(RoomProp));
+                writer.add("vertices", ASSET_VERTICES, vertices.data(), vertices.size() * sizeof(glm::vec3), sizeof(glm::vec3));
+                writer.add("indices", ASSET_INDICES, indices.data(), indices.size() * sizeof(uint32_t), sizeof(uint32_t));
+                if (!writer.write(chunkPath(directory, cx, cz)))
+                    return false;
+            }
+        return true;
+    }
+
+    static float distanceTo(const AABB& bounds, const glm::vec3& point)
+    {
+        return glm::length(point - glm::clamp(point, bounds.min, bounds.max));
+    }
+
+    // velocity for the prediction, and the frame time around chunk crossings
+    void trackMotion(const glm::vec3& position, float deltaTime)
+    {
+        double frameMs = deltaTime * 1000.0;
+        if (moving && deltaTime > 0.0f)
+        {
+            glm::vec3 current = (position - lastPosition) / deltaTime;
+            velocity = glm::mix(velocity, current, 0.2f);
+            stats.averageFrameMs = stats.averageFrameMs == 0.0 ? frameMs : stats.averageFrameMs * 0.95 + frameMs * 0.05;
+        }
+        lastPosition = position;
+        moving = true;
+
+        int cx = static_cast<int>(std::floor((position.x - ROOM_MIN_X) / (ROOM_PITCH_X * CHUNK_ROOMS)));
+        int cz = static_cast<int>(std::floor((position.z - ROOM_MIN_Z) / (ROOM_PITCH_Z * CHUNK_ROOMS)));
+        int current = cx >= 0 && cz >= 0 && cx < chunkColumns && cz < chunkRows ? cz * chunkColumns + cx : -1;
+        if (current != lastChunk && lastChunk != -1 && current != -1)
+        {
+            stats.crossings++;
+            stats.worstCrossingMs = std::max(stats.worstCrossingMs, frameMs);
+            if (frameMs > 2.0 * stats.averageFrameMs)
+                stats.hitches++;
+            if (chunks[current]->state != CHUNK_RESIDENT)
+                stats.misses++;
+        }
+        lastChunk = current;
+    }
+
+    int indexOf(const Chunk& chunk) const
+    {
+        for (size_t i = 0; i < chunks.size(); i++)
+            if (chunks[i].get() == &chunk)
+                return static_cast<int>(i);
+        return -1;
+    }
+
+    // nearest first, a few at a time so a change of direction is not stuck behind a long queue
+    void queueReads()
+    {
+        unsigned int inFlight = 0;
+        for (std::unique_ptr<Chunk>& chunk : chunks)
+            inFlight += chunk->state == CHUNK_READING;
+        while (inFlight < options.readsInFlight)
+        {
+            Chunk* next = nullptr;
+            for (std::unique_ptr<Chunk>& chunk : chunks)
+                if (chunk->wanted && chunk->state == CHUNK_ON_DISK && (!next || chunk->priority < next->priority))
+                    next = chunk.get();
+            if (!next)
+                return;
+            next->state = CHUNK_READING;
+            next->requested = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(indexOf(*next));
+            }
+            wake.notify_one();
+            inFlight++;
+        }
+    }
+
+    void collectReads()
+    {
+        std::vector<std::pair<int, std::unique_ptr<ChunkData>>> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.swap(finished);
+        }
+        for (auto& result : done)
+        {
+            Chunk& chunk = *chunks[result.first];
+            if (!result.second)
+            {
+                std::cout << "world: cannot read " << chunk.path << std::endl;
+                chunk.state = CHUNK_ON_DISK;
+                chunk.wanted = false;
+                continue;
+            }
+            // the camera may have turned away while it was read
+            chunk.state = chunk.keep ? CHUNK_DECODED : CHUNK_ON_DISK;
+            if (chunk.keep)
+                chunk.data = std::move(result.second);
+        }
+    }
+
+    void joinWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+            jobs.clear();
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    // no cell may keep pointing at a chunk that is deleted here
+    void dropChunks()
+    {
+        finished.clear();
+        cellBaked.assign(cellBaked.size(), BakedRoom());
+        chunks.clear();
+        running = false;
+    }
+
+    void unload(Chunk& chunk, Apartment& apartment)
+    {
+        if (chunk.state == CHUNK_RESIDENT)
+        {
+            for (int cell : chunk.cells)
+            {
+                std::vector<RoomProp>().swap(apartment.rooms[cell].props);
+                cellBaked[cell] = BakedRoom();
+            }
+            stats.unloads++;
+        }
+        chunk.vao.reset();
+        chunk.vertexBuffer.reset();
+        chunk.indexBuffer.reset();
+        chunk.gpuBytes = 0;
+        chunk.uploaded = 0;
+        chunk.data.reset();
+        chunk.state = CHUNK_ON_DISK;
+    }
+
+    // Frees resident chunks outside the load radius, farthest first, until 'bytes' more fit.
+    bool makeRoom(size_t bytes, Apartment& apartment)
+    {
+        for (;;)
+        {
+            size_t used = 0;
+            for (std::unique_ptr<Chunk>& chunk : chunks)
+                used += chunk->gpuBytes;
+            if (used + bytes <= options.gpuBudgetBytes)
+                return true;
+            Chunk* victim = nullptr;
+            for (std::unique_ptr<Chunk>& chunk : chunks)
+                if (chunk->state == CHUNK_RESIDENT && !chunk->wanted && (!victim || chunk->priority > victim->priority))
+                    victim = chunk.get();
+            if (!victim)
+                return false;
+            unload(*victim, apartment);
+            stats.evictions++;
+        }
+    }
+
+    void upload(Apartment& apartment)
+    {
+        size_t budget = options.uploadBytesPerFrame;
+        while (budget > 0)
+        {
+            // finish what was started before starting anything new, then nearest first
+            Chunk* next = nullptr;
+            for (std::unique_ptr<Chunk>& chunk : chunks)
+                if (chunk->state == CHUNK_UPLOADING)
+                    next = chunk.get();
+            if (!next)
+                for (std::unique_ptr<Chunk>& chunk : chunks)
+                    if (chunk->state == CHUNK_DECODED && chunk->wanted && (!next || chunk->priority < next->priority))
+                        next = chunk.get();
+            if (!next)
+                break;
+            Chunk& chunk = *next;
+            ChunkData& data = *chunk.data;
+
+            if (chunk.state == CHUNK_DECODED)
+            {
+                size_t bytes = data.vertexBytes() + data.indexBytes();
+                if (!makeRoom(bytes, apartment))
+                {
+                    stats.budgetWaits++;
+                    break;
+                }
+                chunk.vao.create("world chunk VAO");
+                chunk.vao.bind();
+                chunk.vertexBuffer.create(GPU_VERTEX_BUFFER, "world chunk vertices");
+                chunk.vertexBuffer.data(GL_ARRAY_BUFFER, data.vertexBytes(), nullptr, GL_STATIC_DRAW);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+                glEnableVertexAttribArray(0);
+                chunk.indexBuffer.create(GPU_INDEX_BUFFER, "world chunk indices");
+                chunk.indexBuffer.data(GL_ELEMENT_ARRAY_BUFFER, data.indexBytes(), nullptr, GL_STATIC_DRAW);
+                glBindVertexArray(0);
+                chunk.gpuBytes = bytes;
+                chunk.uploaded = 0;
+                chunk.state = CHUNK_UPLOADING;
+            }
+
+            // vertices, then indices; the element buffer is only bound with the chunk's VAO
+            size_t total = data.vertexBytes() + data.indexBytes();
+            size_t step = std::min(budget, total - chunk.uploaded);
+            size_t end = chunk.uploaded + step;
+            if (chunk.uploaded < data.vertexBytes())
+            {
+                size_t vertexEnd = std::min(end, data.vertexBytes());
+                chunk.vertexBuffer.subData(GL_ARRAY_BUFFER, chunk.uploaded, vertexEnd - chunk.uploaded,
+                                           reinterpret_cast<const uint8_t*>(data.vertices.data()) + chunk.uploaded);
+                chunk.uploaded = vertexEnd;
+            }
+            if (chunk.uploaded < end)
+            {
+                size_t offset = chunk.uploaded - data.vertexBytes();
+                chunk.vao.bind();
+                chunk.indexBuffer.subData(GL_ELEMENT_ARRAY_BUFFER, offset, end - chunk.uploaded,
+                                          reinterpret_cast<const uint8_t*>(data.indices.data()) + offset);
+                glBindVertexArray(0);
+                chunk.uploaded = end;
+            }
+            budget -= step;
+            stats.uploadedBytes += step;
+
+            if (chunk.uploaded == total)
+                makeResident(chunk, apartment);
+        }
+    }
+
+    // the props go to their rooms; the geometry lives on in the buffers only
+    void makeResident(Chunk& chunk, Apartment& apartment)
+    {
+        ChunkData& data = *chunk.data;
+        for (const WorldChunkRoom& room : data.rooms)
+        {
+            apartment.rooms[room.cell].props.assign(data.props.begin() + room.propFirst,
+                                                    data.props.begin() + room.propFirst + room.propCount);
+            BakedRoom& baked = cellBaked[room.cell];
+            baked.chunk = &chunk;
+            baked.firstIndex = room.bakedFirstIndex;
+            baked.count = room.bakedCount;
+        }
+        double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - chunk.requested).count();
+        stats.loads++;
+        stats.loadLatencyMs += latency;
+        stats.worstLoadLatencyMs = std::max(stats.worstLoadLatencyMs, latency);
+        stats.decodeMs += data.decodeMs;
+        chunk.data.reset();
+        chunk.state = CHUNK_RESIDENT;
+    }
+
+    void readLoop()
+    {
+        tracer().nameThread("world chunk read");
+        for (;;)
+        {
+            int index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !jobs.empty(); });
+                if (quit)
+                    return;
+                index = jobs.front();
+                jobs.pop_front();
+            }
+            // 'path' and the cell count are not changed while the threads run
+            std::unique_ptr<ChunkData> data = read(chunks[index]->path, cellBaked.size());
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.emplace_back(index, std::move(data));
+        }
+    }
+
+    // maps the chunk file and copies its arrays out; null if it is missing, damaged or names
+    // a cell outside the apartment's 'cellCount'
+    static std::unique_ptr<ChunkData> read(const std::string& path, size_t cellCount)
+    {
+        TRACE_ZONE("chunk read");
+        auto begin = std::chrono::steady_clock::now();
+        AssetPack pack;
+        if (!pack.open(path.c_str()))
+            return nullptr;
+        const AssetPackEntry* rooms = pack.find("rooms", ASSET_ROOMS);
+        const AssetPackEntry* props = pack.find("props", ASSET_PROPS);
+        const AssetPackEntry* vertices = pack.find("vertices", ASSET_VERTICES);
+        const AssetPackEntry* indices = pack.find("indices", ASSET_INDICES);
+        if (!rooms || !props || !vertices || !indices)
+            return nullptr;
+        std::unique_ptr<ChunkData> data(new ChunkData());
+        data->rooms.assign(pack.array<WorldChunkRoom>(*rooms), pack.array<WorldChunkRoom>(*rooms) + pack.count<WorldChunkRoom>(*rooms));
+        data->props.assign(pack.array<RoomProp>(*props), pack.array<RoomProp>(*props) + pack.count<RoomProp>(*props));
+        data->vertices.assign(pack.array<glm::vec3>(*vertices), pack.array<glm::vec3>(*vertices) + pack.count<glm::vec3>(*vertices));
+        data->indices.assign(pack.array<uint32_t>(*indices), pack.array<uint32_t>(*indices) + pack.count<uint32_t>(*indices));
+        for (const WorldChunkRoom& room : data->rooms)
+            if (room.cell >= cellCount || (size_t)room.propFirst + (size_t)room.propCount > data->props.size() ||
+                (size_t)room.bakedFirstIndex + (size_t)room.bakedCount * 36 > data->indices.size())
+                return nullptr;
+        for (uint32_t index : data->indices)
+            if (index >= data->vertices.size())
+                return nullptr;
+        data->decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        return data;
+    }
+};
+
+#endif